@@ -0,0 +1,41 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulation stand-in for libopencm3/cm3/common.h
+ *
+ * Every register access is routed through the simulated register file, so
+ * writes are seen by the virtual chains. See sim/simregs.c.
+ */
+#if !defined(LIBOPENCM3_CM3_COMMON_H)
+#define LIBOPENCM3_CM3_COMMON_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+extern volatile uint32_t *simRegs_Access(uint32_t address);
+extern void simRegs_Write(volatile uint32_t *reg, uint32_t value);
+extern uint32_t simRegs_Read(volatile uint32_t *reg);
+
+#define MMIO32(addr)	(*simRegs_Access(addr))
+
+//jtag.c keeps pointers to the registers it uses most, these let each access through them be seen
+#define JTAG_REG_WRITE(reg, value)	simRegs_Write((reg), (value))
+#define JTAG_REG_READ(reg)		simRegs_Read(reg)
+
+#endif
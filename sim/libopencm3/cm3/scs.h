@@ -0,0 +1,33 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulation stand-in for libopencm3/cm3/scs.h
+ */
+#if !defined(LIBOPENCM3_CM3_SCS_H)
+#define LIBOPENCM3_CM3_SCS_H
+
+#include <libopencm3/cm3/common.h>
+
+#define SCS_BASE		(0xE000E000)
+
+#define SCS_DEMCR		MMIO32(SCS_BASE + 0xDFC)
+
+#define SCS_DEMCR_TRCENA	(1 << 24)
+
+#endif
@@ -0,0 +1,43 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulation stand-in for libopencm3/stm32/f1/bkp.h
+ *
+ * The backup registers start cleared on each run, so there's never a scan
+ * checkpoint to resume.
+ */
+#if !defined(LIBOPENCM3_BKP_H)
+#define LIBOPENCM3_BKP_H
+
+#include <libopencm3/cm3/common.h>
+
+#define BACKUP_REGS_BASE	(0x40006C00)
+
+#define BKP_DR1			MMIO32(BACKUP_REGS_BASE + 0x04)
+#define BKP_DR2			MMIO32(BACKUP_REGS_BASE + 0x08)
+#define BKP_DR3			MMIO32(BACKUP_REGS_BASE + 0x0C)
+#define BKP_DR4			MMIO32(BACKUP_REGS_BASE + 0x10)
+#define BKP_DR5			MMIO32(BACKUP_REGS_BASE + 0x14)
+#define BKP_DR6			MMIO32(BACKUP_REGS_BASE + 0x18)
+#define BKP_DR7			MMIO32(BACKUP_REGS_BASE + 0x1C)
+#define BKP_DR8			MMIO32(BACKUP_REGS_BASE + 0x20)
+#define BKP_DR9			MMIO32(BACKUP_REGS_BASE + 0x24)
+#define BKP_DR10		MMIO32(BACKUP_REGS_BASE + 0x28)
+
+#endif
@@ -0,0 +1,76 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulation stand-in for libopencm3/stm32/gpio.h, STM32F1 layout
+ *
+ * Writes to BSRR and BRR take effect at the next register access, see
+ * simRegs_Access.
+ */
+#if !defined(LIBOPENCM3_GPIO_H)
+#define LIBOPENCM3_GPIO_H
+
+#include <libopencm3/cm3/common.h>
+
+#define GPIO_PORT_A_BASE	(0x40010800)
+#define GPIO_PORT_B_BASE	(0x40010C00)
+#define GPIO_PORT_C_BASE	(0x40011000)
+
+#define GPIOA			GPIO_PORT_A_BASE
+#define GPIOB			GPIO_PORT_B_BASE
+#define GPIOC			GPIO_PORT_C_BASE
+
+#define GPIO_CRL(port)		MMIO32((port) + 0x00)
+#define GPIO_CRH(port)		MMIO32((port) + 0x04)
+#define GPIO_IDR(port)		MMIO32((port) + 0x08)
+#define GPIO_ODR(port)		MMIO32((port) + 0x0C)
+#define GPIO_BSRR(port)		MMIO32((port) + 0x10)
+#define GPIO_BRR(port)		MMIO32((port) + 0x14)
+#define GPIO_LCKR(port)		MMIO32((port) + 0x18)
+
+#define GPIOA_IDR		GPIO_IDR(GPIOA)
+#define GPIOA_ODR		GPIO_ODR(GPIOA)
+#define GPIOA_BSRR		GPIO_BSRR(GPIOA)
+#define GPIOB_IDR		GPIO_IDR(GPIOB)
+#define GPIOB_ODR		GPIO_ODR(GPIOB)
+#define GPIOB_BSRR		GPIO_BSRR(GPIOB)
+#define GPIOC_IDR		GPIO_IDR(GPIOC)
+#define GPIOC_ODR		GPIO_ODR(GPIOC)
+#define GPIOC_BSRR		GPIO_BSRR(GPIOC)
+
+#define GPIO_MODE_INPUT			(0x00)
+#define GPIO_MODE_OUTPUT_10_MHZ		(0x01)
+#define GPIO_MODE_OUTPUT_2_MHZ		(0x02)
+#define GPIO_MODE_OUTPUT_50_MHZ		(0x03)
+
+#define GPIO_CNF_INPUT_ANALOG		(0x00)
+#define GPIO_CNF_INPUT_FLOAT		(0x01)
+#define GPIO_CNF_INPUT_PULL_UPDOWN	(0x02)
+#define GPIO_CNF_OUTPUT_PUSHPULL	(0x00)
+#define GPIO_CNF_OUTPUT_OPENDRAIN	(0x01)
+#define GPIO_CNF_OUTPUT_ALTFN_PUSHPULL	(0x02)
+#define GPIO_CNF_OUTPUT_ALTFN_OPENDRAIN	(0x03)
+
+#define AFIO_MAPR_SWJ_CFG_JTAG_OFF_SW_ON	(0x2 << 24)
+
+extern void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios);
+extern void gpio_set(uint32_t gpioport, uint16_t gpios);
+extern void gpio_clear(uint32_t gpioport, uint16_t gpios);
+extern void gpio_primary_remap(uint32_t swjdisable, uint32_t maps);
+
+#endif
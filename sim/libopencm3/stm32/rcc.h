@@ -0,0 +1,43 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Simulation stand-in for libopencm3/stm32/rcc.h
+ */
+#if !defined(LIBOPENCM3_RCC_H)
+#define LIBOPENCM3_RCC_H
+
+#include <libopencm3/cm3/common.h>
+
+enum rcc_periph_clken
+{
+	RCC_GPIOA,
+	RCC_GPIOB,
+	RCC_GPIOC,
+	RCC_AFIO,
+	RCC_PWR,
+	RCC_BKP,
+};
+
+extern uint32_t rcc_ahb_frequency;
+extern uint32_t rcc_apb1_frequency;
+extern uint32_t rcc_apb2_frequency;
+
+extern void rcc_periph_clock_enable(enum rcc_periph_clken clken);
+
+#endif
@@ -0,0 +1,607 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "simregs.h"
+#include "simchain.h"
+#include "simhost.h"
+#include "jtag.h"
+#include "jtagtap.h"
+#include "serial.h"
+#include "knock.h"
+#include "message.h"
+#include "comprocessor.h"
+#include "chain.h"
+#include "idcode.h"
+#include "sched.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * Host build of the firmware, scanning randomly wired virtual chains
+ *
+ * source/ is compiled against the register file in simregs.c, with the
+ * chains of simchain.c on the pads. Each scan wires up a new random board,
+ * runs the scan command through the command processor as the host would
+ * and checks the chains the firmware saves against the ones on the board.
+ * With -b the bench command is run on a single board instead.
+ */
+
+#define SIM_PINS_MIN		(16)	///< Default fewest pins wired up for a scan
+#define SIM_PINS_MAX		(40)	///< Default most pins wired up for a scan
+#define SIM_CHAINS_DEFAULT	(2)	///< Default most chains on a board
+#define SIM_DEVICES_DEFAULT	(4)	///< Default most devices on a chain
+#define SIM_IDCODE_PERCENT	(75)	///< Default chance of a device having an ID CODE
+#define SIM_CLOCK_DEFAULT	(JTAG_CLOCK_MAX)	///< Default TCK rate, the chains don't mind and it's quickest
+#define SIM_MODE_RANDOM		(KNOCK_MODE_MAX)	///< Pick a JTAG scan mode for each scan
+#define SIM_COMMAND_LENGTH	(64)	///< Longest command sent to the firmware
+#define SIM_BYPASS_IRLEN_MAX	(99)	///< Longest total IR the bypass scan sees, it fills the IR with 100 ones
+
+/**
+ * @brief What to simulate, from the command line
+ */
+typedef struct sim_sOptions
+{
+	unsigned int scans;		///< Scans to run
+	uint32_t seed;			///< Seed of the first scan, each scan after uses the next
+	knock_Mode mode;		///< Scan mode, or SIM_MODE_RANDOM
+	unsigned int pins_min;		///< Fewest pins wired up
+	unsigned int pins_max;		///< Most pins wired up
+	unsigned int chains_max;	///< Most chains on a board
+	unsigned int devices_max;	///< Most devices on a chain
+	unsigned int idcode_percent;	///< Chance of a device having an ID CODE
+	unsigned int clock;		///< TCK rate in kHz
+	bool echo;			///< Show what the firmware sends the host
+	bool bench;			///< Run the benchmarks instead of scanning
+} sim_Options;
+
+static const char * const sim_ModeNames[KNOCK_MODE_MAX] = {
+	[KNOCK_MODE_RESET] = "reset",
+	[KNOCK_MODE_BYPASS] = "bypass",
+	[KNOCK_MODE_BROADCAST] = "broadcast",
+	[KNOCK_MODE_AUTO] = "auto",
+	[KNOCK_MODE_SWD] = "swd",
+};
+
+static uint32_t sim_State;		///< Random number generator state
+
+static bool sim_HostTask();
+static uint32_t sim_Random();
+static unsigned int sim_Between(unsigned int low, unsigned int high);
+static uint32_t sim_RandomIDCode();
+static unsigned int sim_Wire(const sim_Options *options, unsigned int pins);
+static bool sim_Findable(const simChain_Chain *chain, knock_Mode mode);
+static bool sim_Matches(const simChain_Chain *chain, const simHost_Found *found);
+static bool sim_Check(knock_Mode mode, bool report);
+static void sim_Describe(knock_Mode mode, unsigned int pins);
+static void sim_Command(const char *command);
+static void sim_Bench(const sim_Options *options);
+static bool sim_ParseOptions(int argc, char **argv, sim_Options *options);
+
+/**
+ * @brief Hand host input to the command processor, as main_HostTask does
+ *
+ * @retval true There is more input waiting.
+ */
+static bool sim_HostTask()
+{
+	const char *data;
+	unsigned int len = 0;
+
+	if(!sched_IsBusy())
+	{
+		len = serial_Receive(&data);
+		if(len > 0)
+		{
+			serial_Consume(comproc_Process(data, len));
+		}
+	}
+	return len > 0;
+}
+
+/**
+ * @brief Get the next random number, xorshift32 so a seed gives the same board everywhere
+ */
+static uint32_t sim_Random()
+{
+	sim_State ^= sim_State << 13;
+	sim_State ^= sim_State >> 17;
+	sim_State ^= sim_State << 5;
+	return sim_State;
+}
+
+/**
+ * @brief Get a random number from low to high inclusive
+ */
+static unsigned int sim_Between(unsigned int low, unsigned int high)
+{
+	return low + (sim_Random() % (high - low + 1));
+}
+
+/**
+ * @brief Make up an ID CODE the firmware will believe
+ */
+static uint32_t sim_RandomIDCode()
+{
+	uint32_t idcode;
+
+	do
+	{
+		idcode = sim_Random() | 0x01;
+	}
+	while(!idcode_IsPlausible(idcode));
+	return idcode;
+}
+
+/**
+ * @brief Wire up a random board
+ *
+ * The chains get pads picked at random from the pins the firmware can use
+ * within the first pins, each pad used once.
+ *
+ * @param[in] options The limits on the board.
+ * @param[in] pins The number of pins the scan is told are wired up.
+ * @returns The number of chains wired up.
+ */
+static unsigned int sim_Wire(const sim_Options *options, unsigned int pins)
+{
+	int pads[JTAG_PIN_MAX];
+	unsigned int npads = 0;
+	unsigned int nchains = sim_Between(1, options->chains_max);
+	jtag_PinMask free;
+	jtag_Signal sig;
+	unsigned int i;
+
+	//the scan frees the signals before it starts, so their pins are free to wire to
+	for(sig = JTAG_SIGNAL_TCK; sig < JTAG_SIGNAL_MAX; ++sig)
+	{
+		jtag_Cfg(sig, JTAG_SIGNAL_NOT_ALLOCATED);
+	}
+	free = jtag_GetFreePins() & (JTAG_PIN(pins) - 1);
+
+	for(i = 0; i < JTAG_PIN_MAX; ++i)
+	{
+		if(((free >> i) & 0x01) == 1)
+		{
+			pads[npads++] = i;
+		}
+	}
+
+	//shuffle, then deal the pads out four at a time
+	for(i = npads; i > 1; --i)
+	{
+		unsigned int j = sim_Random() % i;
+		int pad = pads[i - 1];
+
+		pads[i - 1] = pads[j];
+		pads[j] = pad;
+	}
+
+	simChain_Init();
+	for(i = 0; (i < nchains) && (((i + 1) * 4) <= npads); ++i)
+	{
+		simChain_Chain *chain = simChain_Add(pads[i * 4], pads[(i * 4) + 1], pads[(i * 4) + 2], pads[(i * 4) + 3]);
+		unsigned int ndevices = sim_Between(1, options->devices_max);
+		unsigned int device;
+
+		for(device = 0; device < ndevices; ++device)
+		{
+			uint32_t idcode = (sim_Between(1, 100) <= options->idcode_percent) ? sim_RandomIDCode() : 0;
+
+			simChain_AddDevice(chain, idcode, sim_Between(SIMCHAIN_IRLEN_MIN, SIMCHAIN_IRLEN_MAX));
+		}
+	}
+	return simChain_Count();
+}
+
+/**
+ * @brief Check if a scan mode should find a chain
+ *
+ * The reset based scans can only see a chain with an ID CODE on it, the
+ * bypass scan one with a short enough IR. An auto scan falls back to
+ * bypass for a chain without ID CODEs.
+ */
+static bool sim_Findable(const simChain_Chain *chain, knock_Mode mode)
+{
+	bool idcode = false;
+	unsigned int irlength = 0;
+	unsigned int device;
+
+	for(device = 0; device < chain->ndevices; ++device)
+	{
+		idcode = idcode || (chain->devices[device].idcode != 0);
+		irlength += chain->devices[device].irlength;
+	}
+
+	switch(mode)
+	{
+		case KNOCK_MODE_BYPASS:
+			return irlength <= SIM_BYPASS_IRLEN_MAX;
+
+		case KNOCK_MODE_AUTO:
+			return idcode || (irlength <= SIM_BYPASS_IRLEN_MAX);
+
+		default:
+			return idcode;
+	}
+}
+
+/**
+ * @brief Check if a saved chain is wired the same as a virtual one
+ */
+static bool sim_Matches(const simChain_Chain *chain, const simHost_Found *found)
+{
+	return (found->tck == chain->tck) && (found->tms == chain->tms) && (found->tdi == chain->tdi) && (found->tdo == chain->tdo);
+}
+
+/**
+ * @brief Check the chains the firmware saved against the board
+ *
+ * Every chain the mode can find has to be saved once, with its devices' ID
+ * CODEs and IR lengths. Nothing else may be saved.
+ *
+ * @param[in] mode The mode the scan was run in.
+ * @param[in] report true to print what was wrong.
+ * @retval true The scan found the board.
+ */
+static bool sim_Check(knock_Mode mode, bool report)
+{
+	bool success = simHost_FoundCount() <= SIMHOST_FOUND_MAX;
+	unsigned int i;
+	unsigned int j;
+
+	for(i = 0; i < simChain_Count(); ++i)
+	{
+		const simChain_Chain *chain = simChain_Get(i);
+		unsigned int saved = 0;
+
+		for(j = 0; simHost_GetFound(j) != NULL; ++j)
+		{
+			const simHost_Found *found = simHost_GetFound(j);
+			unsigned int device;
+			bool same = (found->ndevices == chain->ndevices);
+
+			if(!sim_Matches(chain, found))
+			{
+				continue;
+			}
+			++saved;
+
+			for(device = 0; (device < chain->ndevices) && same; ++device)
+			{
+				same = (found->idcodes[device] == chain->devices[device].idcode) && (found->irlengths[device] == chain->devices[device].irlength);
+			}
+			if(!same)
+			{
+				if(report)
+				{
+					printf("  chain %u detected wrongly\n", i);
+				}
+				success = false;
+			}
+		}
+
+		if((saved == 0) && sim_Findable(chain, mode))
+		{
+			if(report)
+			{
+				printf("  chain %u not found\n", i);
+			}
+			success = false;
+		}
+		else if(saved > 1)
+		{
+			if(report)
+			{
+				printf("  chain %u saved %u times\n", i, saved);
+			}
+			success = false;
+		}
+	}
+
+	for(j = 0; simHost_GetFound(j) != NULL; ++j)
+	{
+		const simHost_Found *found = simHost_GetFound(j);
+		bool real = false;
+
+		for(i = 0; (i < simChain_Count()) && !real; ++i)
+		{
+			real = sim_Matches(simChain_Get(i), found);
+		}
+		if(!real)
+		{
+			if(report)
+			{
+				printf("  false chain TCK: %i TMS: %i TDI: %i TDO: %i\n", found->tck, found->tms, found->tdi, found->tdo);
+			}
+			success = false;
+		}
+	}
+	return success;
+}
+
+/**
+ * @brief Print the board and what the firmware saved
+ */
+static void sim_Describe(knock_Mode mode, unsigned int pins)
+{
+	unsigned int i;
+	unsigned int device;
+
+	printf("  scan %u %s\n", pins, sim_ModeNames[mode]);
+	for(i = 0; i < simChain_Count(); ++i)
+	{
+		const simChain_Chain *chain = simChain_Get(i);
+
+		printf("  chain %u TCK: %i TMS: %i TDI: %i TDO: %i\n", i, chain->tck, chain->tms, chain->tdi, chain->tdo);
+		for(device = 0; device < chain->ndevices; ++device)
+		{
+			printf("    device %u ID CODE: %08lX IR: %u\n", device, (unsigned long)chain->devices[device].idcode, chain->devices[device].irlength);
+		}
+	}
+	for(i = 0; simHost_GetFound(i) != NULL; ++i)
+	{
+		const simHost_Found *found = simHost_GetFound(i);
+
+		printf("  saved TCK: %i TMS: %i TDI: %i TDO: %i\n", found->tck, found->tms, found->tdi, found->tdo);
+		for(device = 0; (device < found->ndevices) && (device < SIMCHAIN_DEVICES_MAX); ++device)
+		{
+			printf("    device %u ID CODE: %08lX IR: %u\n", device, (unsigned long)found->idcodes[device], found->irlengths[device]);
+		}
+	}
+}
+
+/**
+ * @brief Send a command and run the firmware until it and any scan are done
+ */
+static void sim_Command(const char *command)
+{
+	simHost_Input(command);
+	do
+	{
+		sched_Run();
+	}
+	while(!simHost_IsIdle() || sched_IsBusy() || knock_IsRunning());
+	message_Flush();
+}
+
+/**
+ * @brief Run the benchmarks on the board for the seed
+ *
+ * The board is wired on the fewest pins allowed and the signals are
+ * configured on its first chain, so chain_Detect has something to find.
+ * The times are in simulated core clocks, so they follow the register
+ * accesses made rather than the host's speed.
+ */
+static void sim_Bench(const sim_Options *options)
+{
+	static const jtag_Signal signals[] = { JTAG_SIGNAL_TCK, JTAG_SIGNAL_TMS, JTAG_SIGNAL_TDI, JTAG_SIGNAL_TDO };
+	char command[SIM_COMMAND_LENGTH];
+	const simChain_Chain *chain;
+	unsigned int i;
+
+	sim_State = options->seed;
+	sim_Wire(options, options->pins_min);
+	chain = simChain_Get(0);
+
+	for(i = 0; i < (sizeof(signals) / sizeof(signals[0])); ++i)
+	{
+		const int pads[] = { chain->tck, chain->tms, chain->tdi, chain->tdo };
+
+		//the config command numbers pins from 1
+		snprintf(command, sizeof(command), "config %s %i\r\n", jtag_SignalNames[signals[i]], pads[i] + 1);
+		sim_Command(command);
+	}
+	printf("# chain TCK: %i TMS: %i TDI: %i TDO: %i\n", chain->tck, chain->tms, chain->tdi, chain->tdo);
+	for(i = 0; i < chain->ndevices; ++i)
+	{
+		printf("#   device %u ID CODE: %08lX IR: %u\n", i, (unsigned long)chain->devices[i].idcode, chain->devices[i].irlength);
+	}
+	sim_Command("bench\r\n");
+}
+
+/**
+ * @brief Read the command line
+ *
+ * @retval true The options are valid.
+ */
+static bool sim_ParseOptions(int argc, char **argv, sim_Options *options)
+{
+	int opt;
+	bool success = true;
+
+	options->scans = 100;
+	options->seed = 1;
+	options->mode = SIM_MODE_RANDOM;
+	options->pins_min = SIM_PINS_MIN;
+	options->pins_max = SIM_PINS_MAX;
+	options->chains_max = SIM_CHAINS_DEFAULT;
+	options->devices_max = SIM_DEVICES_DEFAULT;
+	options->idcode_percent = SIM_IDCODE_PERCENT;
+	options->clock = SIM_CLOCK_DEFAULT;
+	options->echo = false;
+	options->bench = false;
+
+	while(success && ((opt = getopt(argc, argv, "n:s:m:p:c:d:i:k:vb")) != -1))
+	{
+		switch(opt)
+		{
+			case 'n':
+				options->scans = strtoul(optarg, NULL, 0);
+				break;
+
+			case 's':
+				options->seed = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'm':
+				//the virtual devices don't speak SWD, so that mode isn't offered
+				options->mode = SIM_MODE_RANDOM;
+				if(strcmp(optarg, "random") != 0)
+				{
+					for(options->mode = KNOCK_MODE_RESET; (options->mode < KNOCK_MODE_SWD) && (strcmp(optarg, sim_ModeNames[options->mode]) != 0); ++options->mode)
+					{
+					}
+					success = options->mode < KNOCK_MODE_SWD;
+				}
+				break;
+
+			case 'p':
+				switch(sscanf(optarg, "%u-%u", &options->pins_min, &options->pins_max))
+				{
+					case 1:
+						options->pins_max = options->pins_min;
+						break;
+
+					case 2:
+						break;
+
+					default:
+						success = false;
+						break;
+				}
+				break;
+
+			case 'c':
+				options->chains_max = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'd':
+				options->devices_max = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'i':
+				options->idcode_percent = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'k':
+				options->clock = strtoul(optarg, NULL, 0);
+				break;
+
+			case 'v':
+				options->echo = true;
+				break;
+
+			case 'b':
+				options->bench = true;
+				break;
+
+			default:
+				success = false;
+				break;
+		}
+	}
+
+	success = success && (options->seed != 0) &&
+			(options->pins_min >= 4) && (options->pins_min <= options->pins_max) && (options->pins_max <= JTAG_PIN_MAX) &&
+			(options->chains_max >= 1) && (options->chains_max <= SIMCHAIN_CHAINS_MAX) &&
+			(options->devices_max >= 1) && (options->devices_max <= SIMCHAIN_DEVICES_MAX) &&
+			(options->idcode_percent <= 100) && (options->clock >= 1) && (options->clock <= JTAG_CLOCK_MAX);
+	if(!success)
+	{
+		fprintf(stderr,
+			"usage: %s [-n scans] [-s seed] [-m reset|bypass|broadcast|auto|random]\n"
+			"          [-p pins|min-max] [-c chains] [-d devices] [-i idcode%%] [-k khz] [-v] [-b]\n",
+			argv[0]);
+	}
+	return success;
+}
+
+/**
+ * Simulation entry point
+ */
+int main(int argc, char **argv)
+{
+	sim_Options options;
+	char command[SIM_COMMAND_LENGTH];
+	struct timespec start;
+	struct timespec end;
+	unsigned int scan;
+	unsigned int failed = 0;
+	unsigned long clocks = 0;
+	double seconds;
+
+	if(!sim_ParseOptions(argc, argv, &options))
+	{
+		return 2;
+	}
+
+	//bring the firmware up as main does
+	simRegs_Init();
+	simChain_Init();
+	simHost_Init(options.echo || options.bench);
+	serial_Init();
+	message_Init();
+	jtag_Init();
+	jtagTAP_Init();
+	chain_Init();
+	comproc_Init();
+	knock_Init();
+
+	sched_Init();
+	sched_Add(sim_HostTask);
+	sched_Add(knock_Step);
+	sched_Add(message_Task);
+
+	snprintf(command, sizeof(command), "config clock %u\r\n", options.clock);
+	sim_Command(command);
+
+	if(options.bench)
+	{
+		sim_Bench(&options);
+		return 0;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(scan = 0; scan < options.scans; ++scan)
+	{
+		uint32_t seed = options.seed + scan;
+		knock_Mode mode;
+		unsigned int pins;
+		unsigned int i;
+
+		sim_State = seed;
+		mode = (options.mode == SIM_MODE_RANDOM) ? (knock_Mode)sim_Between(KNOCK_MODE_RESET, KNOCK_MODE_AUTO) : options.mode;
+		pins = sim_Between(options.pins_min, options.pins_max);
+		sim_Wire(&options, pins);
+		simHost_ClearFound();
+
+		snprintf(command, sizeof(command), "scan %u %s\r\n", pins, sim_ModeNames[mode]);
+		sim_Command(command);
+
+		for(i = 0; i < simChain_Count(); ++i)
+		{
+			clocks += simChain_Get(i)->clocks;
+		}
+
+		if(!sim_Check(mode, false))
+		{
+			++failed;
+			printf("FAIL seed %lu\n", (unsigned long)seed);
+			sim_Describe(mode, pins);
+			sim_Check(mode, true);
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	seconds = (end.tv_sec - start.tv_sec) + ((end.tv_nsec - start.tv_nsec) / 1e9);
+	printf("%u scans, %u passed, %u failed, %.2fs, %.0f scans/s, %lu chain clocks\n",
+		options.scans, options.scans - failed, failed, seconds, (seconds > 0) ? (options.scans / seconds) : 0.0, clocks);
+	return (failed == 0) ? 0 : 1;
+}
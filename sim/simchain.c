@@ -0,0 +1,305 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "simchain.h"
+#include <stddef.h>
+
+#define SIMCHAIN_PAD(num)	((uint64_t)1 << (num))	///< The mask of a single pad
+#define SIMCHAIN_BYPASS(device)	((uint32_t)(((uint64_t)1 << (device)->irlength) - 1))	///< The all ones BYPASS instruction of a device
+
+/**
+ * @brief IEEE 1149.1 state transitions, indexed by the state and then TMS
+ */
+static const simChain_State simChain_Next[SIMCHAIN_STATE_MAX][2] = {
+	[SIMCHAIN_STATE_RESET] = { SIMCHAIN_STATE_RUN_IDLE, SIMCHAIN_STATE_RESET },
+	[SIMCHAIN_STATE_RUN_IDLE] = { SIMCHAIN_STATE_RUN_IDLE, SIMCHAIN_STATE_DR_SELECT },
+	[SIMCHAIN_STATE_DR_SELECT] = { SIMCHAIN_STATE_DR_CAPTURE, SIMCHAIN_STATE_IR_SELECT },
+	[SIMCHAIN_STATE_DR_CAPTURE] = { SIMCHAIN_STATE_DR_SHIFT, SIMCHAIN_STATE_DR_EXIT1 },
+	[SIMCHAIN_STATE_DR_SHIFT] = { SIMCHAIN_STATE_DR_SHIFT, SIMCHAIN_STATE_DR_EXIT1 },
+	[SIMCHAIN_STATE_DR_EXIT1] = { SIMCHAIN_STATE_DR_PAUSE, SIMCHAIN_STATE_DR_UPDATE },
+	[SIMCHAIN_STATE_DR_PAUSE] = { SIMCHAIN_STATE_DR_PAUSE, SIMCHAIN_STATE_DR_EXIT2 },
+	[SIMCHAIN_STATE_DR_EXIT2] = { SIMCHAIN_STATE_DR_SHIFT, SIMCHAIN_STATE_DR_UPDATE },
+	[SIMCHAIN_STATE_DR_UPDATE] = { SIMCHAIN_STATE_RUN_IDLE, SIMCHAIN_STATE_DR_SELECT },
+	[SIMCHAIN_STATE_IR_SELECT] = { SIMCHAIN_STATE_IR_CAPTURE, SIMCHAIN_STATE_RESET },
+	[SIMCHAIN_STATE_IR_CAPTURE] = { SIMCHAIN_STATE_IR_SHIFT, SIMCHAIN_STATE_IR_EXIT1 },
+	[SIMCHAIN_STATE_IR_SHIFT] = { SIMCHAIN_STATE_IR_SHIFT, SIMCHAIN_STATE_IR_EXIT1 },
+	[SIMCHAIN_STATE_IR_EXIT1] = { SIMCHAIN_STATE_IR_PAUSE, SIMCHAIN_STATE_IR_UPDATE },
+	[SIMCHAIN_STATE_IR_PAUSE] = { SIMCHAIN_STATE_IR_PAUSE, SIMCHAIN_STATE_IR_EXIT2 },
+	[SIMCHAIN_STATE_IR_EXIT2] = { SIMCHAIN_STATE_IR_SHIFT, SIMCHAIN_STATE_IR_UPDATE },
+	[SIMCHAIN_STATE_IR_UPDATE] = { SIMCHAIN_STATE_RUN_IDLE, SIMCHAIN_STATE_DR_SELECT },
+};
+
+static simChain_Chain simChain_Chains[SIMCHAIN_CHAINS_MAX];
+static unsigned int simChain_Used;
+
+static void simChain_Reset(simChain_Chain *chain);
+static void simChain_Rise(simChain_Chain *chain, bool tms, bool tdi);
+static void simChain_Fall(simChain_Chain *chain);
+static bool simChain_Level(uint64_t driven, uint64_t levels, int pad, bool pull);
+
+/**
+ * @brief Remove all the virtual chains
+ */
+void simChain_Init()
+{
+	simChain_Used = 0;
+}
+
+/**
+ * @brief Wire up a new virtual chain, with no devices yet
+ *
+ * @param[in] tck The pad TCK is on.
+ * @param[in] tms The pad TMS is on.
+ * @param[in] tdi The pad TDI is on.
+ * @param[in] tdo The pad TDO is on.
+ * @returns The chain, or NULL if there are already @ref SIMCHAIN_CHAINS_MAX.
+ */
+simChain_Chain *simChain_Add(int tck, int tms, int tdi, int tdo)
+{
+	simChain_Chain *chain = NULL;
+
+	if(simChain_Used < SIMCHAIN_CHAINS_MAX)
+	{
+		chain = &simChain_Chains[simChain_Used++];
+		chain->tck = tck;
+		chain->tms = tms;
+		chain->tdi = tdi;
+		chain->tdo = tdo;
+		chain->ndevices = 0;
+		chain->tck_level = false;
+		chain->clocks = 0;
+		simChain_Reset(chain);
+	}
+	return chain;
+}
+
+/**
+ * @brief Add a device to a chain, between the devices already there and TDI
+ *
+ * @param[in,out] chain The chain to add to.
+ * @param[in] idcode The device's ID CODE, 0 for a device that only has BYPASS.
+ * @param[in] irlength The length of the device's IR, @ref SIMCHAIN_IRLEN_MIN
+ * to @ref SIMCHAIN_IRLEN_MAX.
+ * @retval true The device was added.
+ */
+bool simChain_AddDevice(simChain_Chain *chain, uint32_t idcode, unsigned int irlength)
+{
+	bool success = (chain->ndevices < SIMCHAIN_DEVICES_MAX) && (irlength >= SIMCHAIN_IRLEN_MIN) && (irlength <= SIMCHAIN_IRLEN_MAX);
+
+	if(success)
+	{
+		simChain_Device *device = &chain->devices[chain->ndevices++];
+
+		device->idcode = idcode;
+		device->irlength = irlength;
+		simChain_Reset(chain);
+	}
+	return success;
+}
+
+/**
+ * @brief Get the number of virtual chains
+ */
+unsigned int simChain_Count()
+{
+	return simChain_Used;
+}
+
+/**
+ * @brief Get a virtual chain
+ *
+ * @param[in] index The chain, in the order they were added.
+ * @returns The chain, or NULL if there isn't one.
+ */
+const simChain_Chain *simChain_Get(unsigned int index)
+{
+	return (index < simChain_Used) ? &simChain_Chains[index] : NULL;
+}
+
+/**
+ * @brief Put every TAP on a chain into TEST_LOGIC_RESET
+ *
+ * The instruction becomes IDCODE, or BYPASS for devices without one.
+ */
+static void simChain_Reset(simChain_Chain *chain)
+{
+	unsigned int i;
+
+	chain->state = SIMCHAIN_STATE_RESET;
+	chain->tdo_enabled = false;
+	chain->tdo_level = false;
+	for(i = 0; i < chain->ndevices; ++i)
+	{
+		simChain_Device *device = &chain->devices[i];
+
+		device->instruction = (device->idcode != 0) ? SIMCHAIN_IR_IDCODE : SIMCHAIN_BYPASS(device);
+		device->ir = 0;
+		device->dr = 0;
+		device->drlength = 1;
+	}
+}
+
+/**
+ * @brief Clock the TAPs on a rising edge of TCK
+ *
+ * The action of the state the TAPs are in is carried out, then they move on
+ * according to TMS. Shifting moves every device's register along by one,
+ * TDI into the device furthest from TDO.
+ *
+ * @param[in,out] chain The chain being clocked.
+ * @param[in] tms The level of the chain's TMS.
+ * @param[in] tdi The level of the chain's TDI.
+ */
+static void simChain_Rise(simChain_Chain *chain, bool tms, bool tdi)
+{
+	unsigned int i;
+	uint32_t in = tdi ? 1 : 0;
+
+	switch(chain->state)
+	{
+		case SIMCHAIN_STATE_DR_CAPTURE:
+			for(i = 0; i < chain->ndevices; ++i)
+			{
+				simChain_Device *device = &chain->devices[i];
+				bool idcode = (device->idcode != 0) && (device->instruction == SIMCHAIN_IR_IDCODE);
+
+				device->dr = idcode ? device->idcode : 0;
+				device->drlength = idcode ? 32 : 1;
+			}
+			break;
+
+		case SIMCHAIN_STATE_IR_CAPTURE:
+			for(i = 0; i < chain->ndevices; ++i)
+			{
+				chain->devices[i].ir = SIMCHAIN_IR_CAPTURE;
+			}
+			break;
+
+		case SIMCHAIN_STATE_DR_SHIFT:
+			for(i = chain->ndevices; i-- > 0; )
+			{
+				simChain_Device *device = &chain->devices[i];
+				uint32_t out = device->dr & 0x01;
+
+				device->dr = (uint32_t)(((uint64_t)device->dr >> 1) | ((uint64_t)in << (device->drlength - 1)));
+				in = out;
+			}
+			break;
+
+		case SIMCHAIN_STATE_IR_SHIFT:
+			for(i = chain->ndevices; i-- > 0; )
+			{
+				simChain_Device *device = &chain->devices[i];
+				uint32_t out = device->ir & 0x01;
+
+				device->ir = (uint32_t)(((uint64_t)device->ir >> 1) | ((uint64_t)in << (device->irlength - 1)));
+				in = out;
+			}
+			break;
+
+		default:
+			break;
+	}
+
+	chain->state = simChain_Next[chain->state][tms ? 1 : 0];
+	++chain->clocks;
+
+	if(chain->state == SIMCHAIN_STATE_RESET)
+	{
+		simChain_Reset(chain);
+	}
+	else if(chain->state == SIMCHAIN_STATE_IR_UPDATE)
+	{
+		for(i = 0; i < chain->ndevices; ++i)
+		{
+			chain->devices[i].instruction = chain->devices[i].ir;
+		}
+	}
+}
+
+/**
+ * @brief Update TDO on a falling edge of TCK
+ *
+ * TDO is only driven in the shift states, with the LSB of the register the
+ * device nearest it is shifting.
+ */
+static void simChain_Fall(simChain_Chain *chain)
+{
+	chain->tdo_enabled = (chain->ndevices > 0) && ((chain->state == SIMCHAIN_STATE_DR_SHIFT) || (chain->state == SIMCHAIN_STATE_IR_SHIFT));
+	if(chain->tdo_enabled)
+	{
+		const simChain_Device *device = &chain->devices[0];
+
+		chain->tdo_level = (((chain->state == SIMCHAIN_STATE_DR_SHIFT) ? device->dr : device->ir) & 0x01) != 0;
+	}
+}
+
+/**
+ * @brief Get the level a chain sees on one of its pads
+ *
+ * @param[in] driven The pads the firmware is driving.
+ * @param[in] levels The levels of the driven pads.
+ * @param[in] pad The pad to look at.
+ * @param[in] pull The level of the pad when it isn't driven.
+ */
+static bool simChain_Level(uint64_t driven, uint64_t levels, int pad, bool pull)
+{
+	return ((driven & SIMCHAIN_PAD(pad)) != 0) ? ((levels & SIMCHAIN_PAD(pad)) != 0) : pull;
+}
+
+/**
+ * @brief Let the chains see the pads the firmware drives
+ *
+ * Called whenever the outputs change. Each chain is clocked on an edge of
+ * its TCK pad, with TMS and TDI as they are now.
+ *
+ * @param[in] driven A bitmask of the pads the firmware is driving.
+ * @param[in] levels The levels of the driven pads.
+ * @param[out] outputs The levels the chains drive or pull their pads to.
+ * @returns A bitmask of the pads the chains drive or pull.
+ */
+uint64_t simChain_Update(uint64_t driven, uint64_t levels, uint64_t *outputs)
+{
+	uint64_t chain_driven = 0;
+	unsigned int i;
+
+	*outputs = 0;
+	for(i = 0; i < simChain_Used; ++i)
+	{
+		simChain_Chain *chain = &simChain_Chains[i];
+		bool tck = simChain_Level(driven, levels, chain->tck, false);
+
+		if(tck && !chain->tck_level)
+		{
+			simChain_Rise(chain, simChain_Level(driven, levels, chain->tms, true), simChain_Level(driven, levels, chain->tdi, true));
+		}
+		else if(!tck && chain->tck_level)
+		{
+			simChain_Fall(chain);
+		}
+		chain->tck_level = tck;
+
+		chain_driven |= SIMCHAIN_PAD(chain->tms) | SIMCHAIN_PAD(chain->tdi);
+		*outputs |= SIMCHAIN_PAD(chain->tms) | SIMCHAIN_PAD(chain->tdi);
+		if(chain->tdo_enabled)
+		{
+			chain_driven |= SIMCHAIN_PAD(chain->tdo);
+			*outputs |= chain->tdo_level ? SIMCHAIN_PAD(chain->tdo) : 0;
+		}
+	}
+	return chain_driven;
+}
@@ -0,0 +1,97 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(_SIMCHAIN_H_)
+#define _SIMCHAIN_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIMCHAIN_CHAINS_MAX	(4)		///< Virtual chains that can be wired up at once
+#define SIMCHAIN_DEVICES_MAX	(16)		///< Devices on each virtual chain
+#define SIMCHAIN_IRLEN_MIN	(2)		///< Shortest IR allowed by IEEE 1149.1
+#define SIMCHAIN_IRLEN_MAX	(32)		///< Longest IR a virtual device can have
+#define SIMCHAIN_IR_CAPTURE	(0x01)		///< Loaded into the IR in CAPTURE_IR, the ...01 every device captures
+#define SIMCHAIN_IR_IDCODE	(0x01)		///< Instruction that selects the ID CODE register
+
+/**
+ * @brief The states of the virtual TAPs, kept apart from jtagTAP's so it can be checked
+ */
+typedef enum simChain_eState
+{
+	SIMCHAIN_STATE_RESET = 0,
+	SIMCHAIN_STATE_RUN_IDLE,
+	SIMCHAIN_STATE_DR_SELECT,
+	SIMCHAIN_STATE_DR_CAPTURE,
+	SIMCHAIN_STATE_DR_SHIFT,
+	SIMCHAIN_STATE_DR_EXIT1,
+	SIMCHAIN_STATE_DR_PAUSE,
+	SIMCHAIN_STATE_DR_EXIT2,
+	SIMCHAIN_STATE_DR_UPDATE,
+	SIMCHAIN_STATE_IR_SELECT,
+	SIMCHAIN_STATE_IR_CAPTURE,
+	SIMCHAIN_STATE_IR_SHIFT,
+	SIMCHAIN_STATE_IR_EXIT1,
+	SIMCHAIN_STATE_IR_PAUSE,
+	SIMCHAIN_STATE_IR_EXIT2,
+	SIMCHAIN_STATE_IR_UPDATE,
+	SIMCHAIN_STATE_MAX
+} simChain_State;
+
+/**
+ * @brief A virtual device, with an IR, BYPASS and optionally an ID CODE
+ */
+typedef struct simChain_sDevice
+{
+	uint32_t idcode;		///< ID CODE captured by the IDCODE instruction, 0 for BYPASS only
+	unsigned int irlength;		///< Bits in the IR
+	uint32_t ir;			///< IR shift stage
+	uint32_t instruction;		///< Instruction last updated
+	uint32_t dr;			///< Shift stage of the selected data register
+	unsigned int drlength;		///< Bits in the selected data register
+} simChain_Device;
+
+/**
+ * @brief A set of virtual devices sharing TCK and TMS, with TDI and TDO daisy chained
+ *
+ * TMS and TDI are pulled up when the pads aren't driven, as IEEE 1149.1
+ * requires, TCK and a disabled TDO float low.
+ */
+typedef struct simChain_sChain
+{
+	int tck;				///< Pad TCK is on
+	int tms;				///< Pad TMS is on
+	int tdi;				///< Pad TDI is on
+	int tdo;				///< Pad TDO is on
+	unsigned int ndevices;			///< Devices on the chain
+	simChain_Device devices[SIMCHAIN_DEVICES_MAX];	///< The devices, 0 is nearest TDO as for chain.c
+	simChain_State state;			///< State all the TAPs are in
+	bool tck_level;				///< TCK at the last update, for finding edges
+	bool tdo_enabled;			///< TDO is being driven, in SHIFT_DR or SHIFT_IR
+	bool tdo_level;				///< The level TDO is driven to
+	unsigned long clocks;			///< Rising edges seen
+} simChain_Chain;
+
+extern void simChain_Init();
+extern simChain_Chain *simChain_Add(int tck, int tms, int tdi, int tdo);
+extern bool simChain_AddDevice(simChain_Chain *chain, uint32_t idcode, unsigned int irlength);
+extern unsigned int simChain_Count();
+extern const simChain_Chain *simChain_Get(unsigned int index);
+extern uint64_t simChain_Update(uint64_t driven, uint64_t levels, uint64_t *outputs);
+
+#endif
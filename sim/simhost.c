@@ -0,0 +1,266 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "simhost.h"
+#include "simregs.h"
+#include "serial.h"
+#include "jtag.h"
+#include "jtagspi.h"
+#include "jtagtimer.h"
+#include "pinstore.h"
+#include "chain.h"
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Stand-ins for the modules that drive peripherals the simulation doesn't
+ * have: the host link, SPI1, TIM2 and the flash page of found pinouts.
+ */
+
+static char simHost_Buffer[SIMHOST_INPUT_LENGTH];	///< Host input not yet consumed
+static unsigned int simHost_Length;		///< Bytes in simHost_Buffer
+static bool simHost_Echo;			///< Copy what the firmware sends to stdout
+static simHost_Found simHost_Saved[SIMHOST_FOUND_MAX];
+static unsigned int simHost_SavedCount;	///< Chains saved, may be more than were kept
+static uint32_t simHost_Widths[JTAG_SIGNAL_MAX];	///< Reset pulse widths in us
+
+/**
+ * @brief Set up the host link and forget the chains found
+ *
+ * @param[in] echo true to copy the firmware's output to stdout.
+ */
+void simHost_Init(bool echo)
+{
+	simHost_Echo = echo;
+	simHost_Length = 0;
+	simHost_SavedCount = 0;
+}
+
+/**
+ * @brief Queue text for the firmware to receive, as if sent by the host
+ *
+ * @param[in] text The commands, each ended by CR or LF.
+ * @retval true The text fitted.
+ */
+bool simHost_Input(const char *text)
+{
+	unsigned int len = strlen(text);
+	bool success = (simHost_Length + len) <= SIMHOST_INPUT_LENGTH;
+
+	if(success)
+	{
+		memcpy(&simHost_Buffer[simHost_Length], text, len);
+		simHost_Length += len;
+	}
+	return success;
+}
+
+/**
+ * @brief Check if the firmware has taken all the host input
+ */
+bool simHost_IsIdle()
+{
+	return simHost_Length == 0;
+}
+
+/**
+ * @brief Forget the chains saved so far
+ */
+void simHost_ClearFound()
+{
+	simHost_SavedCount = 0;
+}
+
+/**
+ * @brief Get the number of times the firmware saved a chain
+ */
+unsigned int simHost_FoundCount()
+{
+	return simHost_SavedCount;
+}
+
+/**
+ * @brief Get a chain the firmware saved
+ *
+ * @param[in] index The chain, in the order they were saved.
+ * @returns The chain, or NULL if it wasn't kept.
+ */
+const simHost_Found *simHost_GetFound(unsigned int index)
+{
+	return ((index < simHost_SavedCount) && (index < SIMHOST_FOUND_MAX)) ? &simHost_Saved[index] : NULL;
+}
+
+//serial.h, the host link
+
+void serial_Init()
+{
+	simHost_Length = 0;
+}
+
+void serial_Send(const char *buffer, unsigned int len)
+{
+	if(simHost_Echo)
+	{
+		fwrite(buffer, 1, len, stdout);
+	}
+}
+
+unsigned int serial_Receive(const char **data)
+{
+	*data = simHost_Buffer;
+	return simHost_Length;
+}
+
+void serial_Consume(unsigned int len)
+{
+	if(len > simHost_Length)
+	{
+		len = simHost_Length;
+	}
+	memmove(simHost_Buffer, &simHost_Buffer[len], simHost_Length - len);
+	simHost_Length -= len;
+}
+
+unsigned int serial_TxPeek(const char **data)
+{
+	*data = NULL;
+	return 0;
+}
+
+void serial_TxRelease(unsigned int len)
+{
+	(void)len;
+}
+
+unsigned int serial_TxPending()
+{
+	return 0;
+}
+
+//jtagspi.h, SPI1 isn't simulated so the shifts all go through the GPIO
+
+void jtagSPI_Init()
+{
+}
+
+bool jtagSPI_SetRate(unsigned int rate)
+{
+	(void)rate;
+	return false;
+}
+
+bool jtagSPI_Usable(int tck, int tdi, int tdo)
+{
+	(void)tck;
+	(void)tdi;
+	(void)tdo;
+	return false;
+}
+
+void jtagSPI_Shift(const uint8_t *tdi, uint8_t *tdo, unsigned int nbytes, bool tdi_level)
+{
+	(void)tdi;
+	(void)tdo;
+	(void)nbytes;
+	(void)tdi_level;
+}
+
+//jtagtimer.h, pulses and delays take no time beyond moving the cycle counter on
+
+void jtagTimer_Init()
+{
+	simHost_Widths[JTAG_SIGNAL_TRST] = JTAGTIMER_TRST_DEFAULT;
+	simHost_Widths[JTAG_SIGNAL_SRST] = JTAGTIMER_SRST_DEFAULT;
+}
+
+bool jtagTimer_SetWidth(jtag_Signal sig, uint32_t us)
+{
+	bool success = ((sig == JTAG_SIGNAL_TRST) || (sig == JTAG_SIGNAL_SRST)) && (us > 0);
+
+	if(success)
+	{
+		simHost_Widths[sig] = us;
+	}
+	return success;
+}
+
+uint32_t jtagTimer_GetWidth(jtag_Signal sig)
+{
+	return ((sig == JTAG_SIGNAL_TRST) || (sig == JTAG_SIGNAL_SRST)) ? simHost_Widths[sig] : 0;
+}
+
+bool jtagTimer_Pulse(jtag_Signal sig)
+{
+	bool success = (sig == JTAG_SIGNAL_TRST) || (sig == JTAG_SIGNAL_SRST);
+
+	if(success)
+	{
+		jtag_Set(sig, false);
+		jtagTimer_Delay(simHost_Widths[sig]);
+		jtag_Set(sig, true);
+	}
+	return success;
+}
+
+bool jtagTimer_IsPulsing(jtag_Signal sig)
+{
+	(void)sig;
+	return false;
+}
+
+void jtagTimer_Delay(uint32_t us)
+{
+	simRegs_Advance(us * (SIMREGS_CORE_HZ / 1000000));
+}
+
+bool jtagTimer_IsDelaying()
+{
+	return false;
+}
+
+void jtagTimer_Wait()
+{
+}
+
+//pinstore.h, found chains are kept for the simulation to check instead of written to flash
+
+bool pinstore_Save()
+{
+	if(simHost_SavedCount < SIMHOST_FOUND_MAX)
+	{
+		simHost_Found *found = &simHost_Saved[simHost_SavedCount];
+		unsigned int device;
+
+		found->tck = jtag_GetCfg(JTAG_SIGNAL_TCK);
+		found->tms = jtag_GetCfg(JTAG_SIGNAL_TMS);
+		found->tdi = jtag_GetCfg(JTAG_SIGNAL_TDI);
+		found->tdo = jtag_GetCfg(JTAG_SIGNAL_TDO);
+		found->ndevices = chain_GetDevices();
+		for(device = 0; (device < found->ndevices) && (device < SIMCHAIN_DEVICES_MAX); ++device)
+		{
+			found->idcodes[device] = chain_GetIDCode(device);
+			found->irlengths[device] = chain_GetIRLength(device);
+		}
+	}
+	++simHost_SavedCount;
+	return true;
+}
+
+bool pinstore_Recall()
+{
+	return false;
+}
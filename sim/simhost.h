@@ -0,0 +1,50 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(_SIMHOST_H_)
+#define _SIMHOST_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "simchain.h"
+
+#define SIMHOST_INPUT_LENGTH	(256)	///< Bytes of host input that can be waiting
+#define SIMHOST_FOUND_MAX	(16)	///< Chains saved by the firmware that are kept for checking
+
+/**
+ * @brief A chain the firmware saved with pinstore_Save
+ */
+typedef struct simHost_sFound
+{
+	int tck;					///< Pin of TCK
+	int tms;					///< Pin of TMS
+	int tdi;					///< Pin of TDI
+	int tdo;					///< Pin of TDO
+	unsigned int ndevices;				///< Devices chain_Detect found
+	uint32_t idcodes[SIMCHAIN_DEVICES_MAX];		///< ID CODE of each device, 0 is nearest TDO
+	unsigned int irlengths[SIMCHAIN_DEVICES_MAX];	///< IR length of each device
+} simHost_Found;
+
+extern void simHost_Init(bool echo);
+extern bool simHost_Input(const char *text);
+extern bool simHost_IsIdle();
+extern void simHost_ClearFound();
+extern unsigned int simHost_FoundCount();
+extern const simHost_Found *simHost_GetFound(unsigned int index);
+
+#endif
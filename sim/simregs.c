@@ -0,0 +1,354 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "simregs.h"
+#include "simchain.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/pwr.h>
+#include <libopencm3/stm32/f1/bkp.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scs.h>
+
+#define SIMREGS_PORT_SIZE	(0x400)		///< Address space of each GPIO port
+#define SIMREGS_PORT_WORDS	(7)		///< CRL, CRH, IDR, ODR, BSRR, BRR and LCKR
+#define SIMREGS_BACKUP_WORDS	(11)		///< BKP_DR1 - BKP_DR10, word 0 is reserved
+#define SIMREGS_REG_CRL		(0)		///< Index of CRL in a port's registers
+#define SIMREGS_REG_CRH		(1)		///< Index of CRH in a port's registers
+#define SIMREGS_REG_IDR		(2)		///< Index of IDR in a port's registers
+#define SIMREGS_REG_ODR		(3)		///< Index of ODR in a port's registers
+#define SIMREGS_REG_BSRR	(4)		///< Index of BSRR in a port's registers
+#define SIMREGS_REG_BRR		(5)		///< Index of BRR in a port's registers
+#define SIMREGS_PORT_BITS(pads, port)	((uint32_t)((pads) >> ((port) * 16)) & 0xFFFF)	///< The register bits of the pads on a port
+
+uint32_t rcc_ahb_frequency = SIMREGS_CORE_HZ;
+uint32_t rcc_apb1_frequency = SIMREGS_CORE_HZ / 2;
+uint32_t rcc_apb2_frequency = SIMREGS_CORE_HZ;
+
+static uint32_t simRegs_Ports[SIMREGS_PORTS][SIMREGS_PORT_WORDS];	///< The GPIO registers, as last written
+static uint32_t simRegs_Driven[SIMREGS_PORTS];	///< ODR as last applied to the pads
+static int simRegs_Pending;			///< Port of the last register handed out, that may have been written since
+static uint64_t simRegs_Outputs;		///< Pads set up as outputs
+static uint64_t simRegs_Pads;			///< Level of every pad, driven or not
+static uint32_t simRegs_Backup[SIMREGS_BACKUP_WORDS];
+static uint32_t simRegs_DWTCtrl;
+static uint32_t simRegs_Cycles;			///< DWT_CYCCNT
+static uint32_t simRegs_DEMCR;
+
+static bool simRegs_Apply();
+static void simRegs_Settle();
+static void simRegs_Update();
+
+/**
+ * @brief Reset the registers to their power on state
+ *
+ * All the pads are floating inputs and the backup registers are cleared.
+ */
+void simRegs_Init()
+{
+	unsigned int port;
+	unsigned int i;
+
+	for(port = 0; port < SIMREGS_PORTS; ++port)
+	{
+		for(i = 0; i < SIMREGS_PORT_WORDS; ++i)
+		{
+			simRegs_Ports[port][i] = 0;
+		}
+		simRegs_Ports[port][SIMREGS_REG_CRL] = 0x44444444;
+		simRegs_Ports[port][SIMREGS_REG_CRH] = 0x44444444;
+		simRegs_Driven[port] = 0;
+	}
+	for(i = 0; i < SIMREGS_BACKUP_WORDS; ++i)
+	{
+		simRegs_Backup[i] = 0;
+	}
+	simRegs_Outputs = 0;
+	simRegs_Pending = -1;
+	simRegs_DWTCtrl = 0;
+	simRegs_Cycles = 0;
+	simRegs_DEMCR = 0;
+	simRegs_Update();
+}
+
+/**
+ * @brief Carry out a write made to BSRR, BRR or ODR since the last access
+ *
+ * A store through MMIO32 can't be seen as it is made, so it is picked up
+ * here instead, before the next access. Only the port of the register last
+ * handed out can have been written.
+ *
+ * @retval true An output changed.
+ */
+static bool simRegs_Apply()
+{
+	bool changed = false;
+
+	if(simRegs_Pending >= 0)
+	{
+		uint32_t *regs = simRegs_Ports[simRegs_Pending];
+
+		if((regs[SIMREGS_REG_BSRR] | regs[SIMREGS_REG_BRR]) != 0)
+		{
+			//set wins over reset, as on the chip
+			uint32_t reset = (regs[SIMREGS_REG_BSRR] >> 16) | regs[SIMREGS_REG_BRR];
+
+			regs[SIMREGS_REG_ODR] = ((regs[SIMREGS_REG_ODR] & ~reset) | regs[SIMREGS_REG_BSRR]) & 0xFFFF;
+			regs[SIMREGS_REG_BSRR] = 0;
+			regs[SIMREGS_REG_BRR] = 0;
+		}
+		if(regs[SIMREGS_REG_ODR] != simRegs_Driven[simRegs_Pending])
+		{
+			simRegs_Driven[simRegs_Pending] = regs[SIMREGS_REG_ODR];
+			changed = true;
+		}
+		simRegs_Pending = -1;
+	}
+	return changed;
+}
+
+/**
+ * @brief Carry out any write still waiting and update the pads for it
+ */
+static void simRegs_Settle()
+{
+	if(simRegs_Apply())
+	{
+		simRegs_Update();
+	}
+}
+
+/**
+ * @brief Work out the pads from the outputs and the virtual chains
+ *
+ * The chains see the edges on their pads and drive TDO, the pads are then
+ * latched into the IDRs. A pad driven by the firmware reads back its own
+ * level, one nothing drives reads low.
+ */
+static void simRegs_Update()
+{
+	uint64_t levels = 0;
+	uint64_t chain_levels;
+	uint64_t chain_driven;
+	unsigned int port;
+
+	for(port = 0; port < SIMREGS_PORTS; ++port)
+	{
+		levels |= (uint64_t)simRegs_Driven[port] << (port * 16);
+	}
+	levels &= simRegs_Outputs;
+
+	chain_driven = simChain_Update(simRegs_Outputs, levels, &chain_levels);
+	simRegs_Pads = levels | (chain_levels & chain_driven & ~simRegs_Outputs);
+
+	for(port = 0; port < SIMREGS_PORTS; ++port)
+	{
+		simRegs_Ports[port][SIMREGS_REG_IDR] = SIMREGS_PORT_BITS(simRegs_Pads, port);
+	}
+}
+
+/**
+ * @brief Find a register in the simulated register file
+ *
+ * Used by MMIO32, so the firmware's register accesses all come through
+ * here. Any writes made since the last access are applied first. Reading
+ * the cycle counter moves it on by @ref SIMREGS_CYCLES_PER_READ, so timed
+ * waits end. Unknown addresses stop the simulation, as a peripheral that
+ * isn't simulated has been used.
+ *
+ * @param[in] address The address of the register.
+ * @returns The register's storage.
+ */
+volatile uint32_t *simRegs_Access(uint32_t address)
+{
+	volatile uint32_t *reg = NULL;
+
+	simRegs_Settle();
+
+	if((address >= GPIO_PORT_A_BASE) && (address < (GPIO_PORT_A_BASE + (SIMREGS_PORTS * SIMREGS_PORT_SIZE))))
+	{
+		unsigned int port = (address - GPIO_PORT_A_BASE) / SIMREGS_PORT_SIZE;
+		unsigned int word = ((address - GPIO_PORT_A_BASE) % SIMREGS_PORT_SIZE) / 4;
+
+		if(word < SIMREGS_PORT_WORDS)
+		{
+			reg = &simRegs_Ports[port][word];
+			simRegs_Pending = port;
+		}
+	}
+	else if((address > BACKUP_REGS_BASE) && (address < (BACKUP_REGS_BASE + (SIMREGS_BACKUP_WORDS * 4))))
+	{
+		reg = &simRegs_Backup[(address - BACKUP_REGS_BASE) / 4];
+	}
+	else if(address == (DWT_BASE + 0x04))
+	{
+		simRegs_Cycles += SIMREGS_CYCLES_PER_READ;
+		reg = &simRegs_Cycles;
+	}
+	else if(address == DWT_BASE)
+	{
+		reg = &simRegs_DWTCtrl;
+	}
+	else if(address == (SCS_BASE + 0xDFC))
+	{
+		reg = &simRegs_DEMCR;
+	}
+
+	if(reg == NULL)
+	{
+		fprintf(stderr, "sim: access to unsimulated register 0x%08lX\n", (unsigned long)address);
+		exit(2);
+	}
+	return reg;
+}
+
+/**
+ * @brief Write a register through a pointer kept by the firmware
+ *
+ * Used by JTAG_REG_WRITE, the write takes effect straight away.
+ *
+ * @param[in] reg The register, from an earlier @ref simRegs_Access.
+ * @param[in] value The value to write.
+ */
+void simRegs_Write(volatile uint32_t *reg, uint32_t value)
+{
+	simRegs_Settle();
+	*reg = value;
+	simRegs_Pending = ((const uint32_t *)reg - &simRegs_Ports[0][0]) / SIMREGS_PORT_WORDS;
+	simRegs_Settle();
+}
+
+/**
+ * @brief Read a register through a pointer kept by the firmware
+ *
+ * Used by JTAG_REG_READ, a write still waiting is carried out first.
+ *
+ * @param[in] reg The register, from an earlier @ref simRegs_Access.
+ * @returns The value of the register.
+ */
+uint32_t simRegs_Read(volatile uint32_t *reg)
+{
+	simRegs_Settle();
+	return *reg;
+}
+
+/**
+ * @brief Move the cycle counter on, for time spent waiting outside the GPIO
+ *
+ * @param[in] cycles The number of core clocks to add.
+ */
+void simRegs_Advance(uint32_t cycles)
+{
+	simRegs_Cycles += cycles;
+}
+
+/**
+ * @brief Get the level of every pad
+ *
+ * @returns A bitmask of the pads that are high, numbered as for jtag_Cfg.
+ */
+uint64_t simRegs_GetPads()
+{
+	simRegs_Settle();
+	return simRegs_Pads;
+}
+
+/**
+ * @brief Get the pads the firmware is driving
+ *
+ * @returns A bitmask of the pads set up as outputs.
+ */
+uint64_t simRegs_GetOutputs()
+{
+	return simRegs_Outputs;
+}
+
+/**
+ * @brief Set the mode of a group of pins, as libopencm3 does
+ *
+ * The CRL and CRH bits are kept up to date, but only whether a pin is an
+ * output matters to the pads.
+ */
+void gpio_set_mode(uint32_t gpioport, uint8_t mode, uint8_t cnf, uint16_t gpios)
+{
+	unsigned int port = (gpioport - GPIO_PORT_A_BASE) / SIMREGS_PORT_SIZE;
+	unsigned int pin;
+
+	simRegs_Settle();
+	for(pin = 0; pin < 16; ++pin)
+	{
+		if((gpios & (1U << pin)) != 0)
+		{
+			uint32_t *cr = &simRegs_Ports[port][(pin < 8) ? SIMREGS_REG_CRL : SIMREGS_REG_CRH];
+			unsigned int shift = (pin % 8) * 4;
+			uint64_t mask = (uint64_t)1 << ((port * 16) + pin);
+
+			*cr = (*cr & ~(0x0FUL << shift)) | ((uint32_t)((cnf << 2) | mode) << shift);
+			if(mode == GPIO_MODE_INPUT)
+			{
+				simRegs_Outputs &= ~mask;
+			}
+			else
+			{
+				simRegs_Outputs |= mask;
+			}
+		}
+	}
+	simRegs_Update();
+}
+
+/**
+ * @brief Drive a group of pins high, as libopencm3 does
+ */
+void gpio_set(uint32_t gpioport, uint16_t gpios)
+{
+	GPIO_BSRR(gpioport) = gpios;
+}
+
+/**
+ * @brief Drive a group of pins low, as libopencm3 does
+ */
+void gpio_clear(uint32_t gpioport, uint16_t gpios)
+{
+	GPIO_BSRR(gpioport) = (uint32_t)gpios << 16;
+}
+
+/**
+ * @brief The simulated pads are never held by the debug port, so there's nothing to remap
+ */
+void gpio_primary_remap(uint32_t swjdisable, uint32_t maps)
+{
+	(void)swjdisable;
+	(void)maps;
+}
+
+/**
+ * @brief Peripheral clocks are always running in the simulation
+ */
+void rcc_periph_clock_enable(enum rcc_periph_clken clken)
+{
+	(void)clken;
+}
+
+/**
+ * @brief The backup registers are always writable in the simulation
+ */
+void pwr_disable_backup_domain_write_protect(void)
+{
+}
@@ -0,0 +1,37 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(_SIMREGS_H_)
+#define _SIMREGS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIMREGS_PORTS		(3)		///< GPIO ports simulated, GPIOA - GPIOC, pins 0 - 47 as for jtag_Cfg
+#define SIMREGS_CORE_HZ		(72000000)	///< Core clock the firmware is told it runs at
+#define SIMREGS_CYCLES_PER_READ	(8)		///< Core clocks the cycle counter moves on each time it is read
+
+extern void simRegs_Init();
+extern volatile uint32_t *simRegs_Access(uint32_t address);
+extern void simRegs_Write(volatile uint32_t *reg, uint32_t value);
+extern uint32_t simRegs_Read(volatile uint32_t *reg);
+extern void simRegs_Advance(uint32_t cycles);
+extern uint64_t simRegs_GetPads();
+extern uint64_t simRegs_GetOutputs();
+
+#endif
@@ -0,0 +1,435 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <libopencm3/stm32/rcc.h>
+#include "bench.h"
+#include "message.h"
+
+#if defined(BENCH)
+#include <string.h>
+#include <libopencm3/cm3/dwt.h>
+#include "jtag.h"
+#include "jtagtap.h"
+#include "chain.h"
+#include "knock.h"
+#include "serial.h"
+
+#define BENCH_CLOCKS		(16384)	///< TCK pulses timed through jtag_Clock()
+#define BENCH_SHIFT_BYTES	(256)	///< Bytes passed to each call of the shift engine
+#define BENCH_SHIFTS		(8)	///< Calls to the shift engine timed
+#define BENCH_TAP_MOVES		(1024)	///< State changes timed through jtagTAP_SetState()
+#define BENCH_DETECTS		(16)	///< Calls to chain_Detect() timed
+#define BENCH_LINK_BYTES	(16384)	///< Bytes sent to time the host link
+#define BENCH_LINK_LINE		(64)	///< Bytes in each comment line sent to time the link
+#define BENCH_LINK_TIMEOUT	(2)	///< Seconds to wait for the host to take what was sent
+#define BENCH_DIGITS		(21)	///< Longest 64 bit decimal, with its terminator
+
+//The host simulation builds with BENCH_LINK=0, its host link takes no time so there's nothing to measure
+#if !defined(BENCH_LINK)
+#define BENCH_LINK		(1)	///< Time the host link
+#endif
+
+/**
+ * @brief The benchmarks, run in order
+ */
+typedef enum bench_eStage
+{
+	BENCH_STAGE_CLOCK = 0,		///< jtag_Clock()
+	BENCH_STAGE_SHIFT,		///< jtag_Shift() in SHIFT-DR
+	BENCH_STAGE_TAP,		///< jtagTAP_SetState()
+	BENCH_STAGE_DETECT,		///< chain_Detect() on the configured signals
+	BENCH_STAGE_LINK,		///< serial_Send() until the host has it all
+	BENCH_STAGE_SWEEP,		///< Each scan in bench_Sweeps
+	BENCH_STAGE_DONE,
+} bench_Stage;
+
+/**
+ * @brief A full scan to time
+ */
+typedef struct bench_sSweep
+{
+	const char *name;	///< Name the result is reported under
+	knock_Mode mode;	///< Scan mode
+	unsigned int pins;	///< Pins scanned
+} bench_Sweep;
+
+static const bench_Sweep bench_Sweeps[] =
+{
+	{ "knock_reset_8", KNOCK_MODE_RESET, 8 },
+	{ "knock_reset_16", KNOCK_MODE_RESET, 16 },
+	{ "knock_bypass_8", KNOCK_MODE_BYPASS, 8 },
+	{ "knock_bypass_16", KNOCK_MODE_BYPASS, 16 },
+};
+
+#define BENCH_SWEEPS	(sizeof(bench_Sweeps) / sizeof(bench_Sweep))	///< Number of scans timed
+
+static const jtagTAP_TAPState bench_TAPStates[] =
+{
+	JTAGTAP_STATE_DR_SHIFT,
+	JTAGTAP_STATE_DR_PAUSE,
+	JTAGTAP_STATE_IDLE,
+};
+
+#define BENCH_TAP_STATES	(sizeof(bench_TAPStates) / sizeof(jtagTAP_TAPState))	///< States walked through
+
+static bench_Stage bench_Current;		///< Benchmark run by the next step
+static unsigned int bench_SweepIndex;		///< Scan being timed in BENCH_STAGE_SWEEP
+static bool bench_Sweeping;			///< The scan has been started
+static uint32_t bench_Last;			///< DWT_CYCCNT when the scan was last checked
+static uint64_t bench_Cycles;			///< Cycles the scan has taken so far
+static uint8_t bench_TDI[BENCH_SHIFT_BYTES];	///< Data shifted in
+static uint8_t bench_TDO[BENCH_SHIFT_BYTES];	///< Data shifted out
+static char bench_Line[BENCH_LINK_LINE];	///< Comment line sent to time the link
+static message_Levels bench_Level;		///< Message level to put back once done
+
+static const char *bench_Decimal(uint64_t value, char *buffer);
+static void bench_Report(const char *name, uint32_t count, const char *unit, uint64_t cycles);
+#if BENCH_LINK
+static bool bench_Drain();
+#endif
+static void bench_Clock();
+static void bench_Shift();
+static void bench_TAP();
+static void bench_Detect();
+static void bench_Link();
+static bool bench_Scan();
+
+/**
+ * @brief Write a 64 bit result out in decimal
+ *
+ * message_Write only goes up to 32 bits, longer results are written out
+ * here so they're shown in full.
+ *
+ * @param[in] value The result.
+ * @param[out] buffer At least BENCH_DIGITS long.
+ * @returns The start of the digits in buffer.
+ */
+static const char *bench_Decimal(uint64_t value, char *buffer)
+{
+	char *p = &buffer[BENCH_DIGITS - 1];
+
+	*p = '\x00';
+	do
+	{
+		*--p = '0' + (value % 10);
+		value /= 10;
+	} while(value > 0);
+	return p;
+}
+
+/**
+ * @brief Display the result of a benchmark
+ *
+ * @param[in] name The code path timed.
+ * @param[in] count The number of units, bits, calls or bytes, it handled.
+ * @param[in] unit What count is of.
+ * @param[in] cycles Core clocks taken.
+ *
+ * The rate is per 1000 seconds, so a run of up to 1000 seconds doesn't
+ * show as 0.
+ */
+static void bench_Report(const char *name, uint32_t count, const char *unit, uint64_t cycles)
+{
+	const uint32_t cyclesPerUs = rcc_ahb_frequency / 1000000;
+	const uint64_t ns = (cycles * 1000) / cyclesPerUs;
+	const uint64_t total = (uint64_t)count * rcc_ahb_frequency;
+	uint64_t rate = 0;
+	char digits[4][BENCH_DIGITS];
+
+	if(cycles != 0)
+	{
+		//split to keep count * rcc_ahb_frequency * 1000 from overflowing
+		rate = ((total / cycles) * 1000) + (((total % cycles) * 1000) / cycles);
+	}
+	message_Write(MESSAGE_LEVEL_REQUIRED, "bench,%s,%lu,%s,%s,%s,%s,%s\r\n", name, (unsigned long)count, unit,
+			bench_Decimal(cycles, digits[0]),
+			bench_Decimal(ns, digits[1]),
+			bench_Decimal((count != 0) ? (ns / count) : 0, digits[2]),
+			bench_Decimal(rate, digits[3]));
+}
+
+#if BENCH_LINK
+/**
+ * @brief Wait for the host to take everything sent so far
+ *
+ * @retval true The transmit ring is empty.
+ * @retval false The host didn't take it within BENCH_LINK_TIMEOUT.
+ */
+static bool bench_Drain()
+{
+	uint32_t start = DWT_CYCCNT;
+
+	while((serial_TxPending() > 0) && ((DWT_CYCCNT - start) < (BENCH_LINK_TIMEOUT * rcc_ahb_frequency)))
+	{
+	}
+	return serial_TxPending() == 0;
+}
+#endif
+
+/**
+ * @brief Time TCK pulses on their own, with the TAP held in RUN-TEST/IDLE
+ */
+static void bench_Clock()
+{
+	uint32_t start;
+	unsigned int i;
+
+	jtagTAP_SetState(JTAGTAP_STATE_RESET);
+	jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+
+	start = DWT_CYCCNT;
+	for(i = 0; i < BENCH_CLOCKS; ++i)
+	{
+		jtag_Clock();
+	}
+	bench_Report("jtag_Clock", BENCH_CLOCKS, "bit", DWT_CYCCNT - start);
+}
+
+/**
+ * @brief Time the shift engine through the selected data register
+ */
+static void bench_Shift()
+{
+	uint32_t start;
+	unsigned int i;
+
+	jtagTAP_SetState(JTAGTAP_STATE_DR_SHIFT);
+
+	start = DWT_CYCCNT;
+	for(i = 0; i < BENCH_SHIFTS; ++i)
+	{
+		jtag_Shift(bench_TDI, bench_TDO, BENCH_SHIFT_BYTES * 8, false);
+	}
+	bench_Report("jtag_Shift", BENCH_SHIFTS * BENCH_SHIFT_BYTES * 8, "bit", DWT_CYCCNT - start);
+
+	jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+}
+
+/**
+ * @brief Time walking the TAP around the DR states
+ *
+ * The IR states are kept out of the walk, so the instruction isn't changed.
+ */
+static void bench_TAP()
+{
+	uint32_t start = DWT_CYCCNT;
+	unsigned int i;
+
+	for(i = 0; i < BENCH_TAP_MOVES; ++i)
+	{
+		jtagTAP_SetState(bench_TAPStates[i % BENCH_TAP_STATES]);
+	}
+	bench_Report("jtagTAP_SetState", BENCH_TAP_MOVES, "move", DWT_CYCCNT - start);
+
+	jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+}
+
+/**
+ * @brief Time detecting the chain on the configured signals
+ */
+static void bench_Detect()
+{
+	uint32_t start = DWT_CYCCNT;
+	unsigned int found = 0;
+	unsigned int i;
+
+	for(i = 0; i < BENCH_DETECTS; ++i)
+	{
+		if(chain_Detect())
+		{
+			++found;
+		}
+	}
+	bench_Report("chain_Detect", BENCH_DETECTS, "call", DWT_CYCCNT - start);
+	message_Write(MESSAGE_LEVEL_REQUIRED, "# chain_Detect found %u device(s) %u/%u times\r\n", chain_GetDevices(), found, BENCH_DETECTS);
+}
+
+/**
+ * @brief Time sending to the host until it has taken all of it
+ *
+ * What's sent is comment lines, so it doesn't get in the way of the results.
+ */
+static void bench_Link()
+{
+#if BENCH_LINK
+	uint32_t start;
+	unsigned int sent;
+
+	//don't count what's already waiting
+	bench_Drain();
+
+	start = DWT_CYCCNT;
+	for(sent = 0; sent < BENCH_LINK_BYTES; sent += BENCH_LINK_LINE)
+	{
+		serial_Send(bench_Line, BENCH_LINK_LINE);
+	}
+	if(!bench_Drain())
+	{
+		message_Write(MESSAGE_LEVEL_REQUIRED, "# host link timed out\r\n");
+	}
+	bench_Report("serial_Send", BENCH_LINK_BYTES - serial_TxPending(), "byte", DWT_CYCCNT - start);
+#else
+	message_Write(MESSAGE_LEVEL_REQUIRED, "# serial_Send not measured, this build has no host link to time\r\n");
+#endif
+}
+
+/**
+ * @brief Time the next full scan
+ *
+ * The scan is stepped by knock_Step from the main loop like any other, so
+ * the time includes servicing the host between candidates.
+ *
+ * @retval true The scan is still running.
+ */
+static bool bench_Scan()
+{
+	const bench_Sweep *sweep = &bench_Sweeps[bench_SweepIndex];
+	uint32_t now = DWT_CYCCNT;
+
+	if(!bench_Sweeping)
+	{
+		chain_Invalidate();
+		knock_Start(sweep->mode, sweep->pins, 0);
+		bench_Cycles = 0;
+		bench_Sweeping = true;
+	}
+	else
+	{
+		bench_Cycles += now - bench_Last;
+	}
+	bench_Last = now;
+
+	if(bench_Sweeping && !knock_IsRunning())
+	{
+		bench_Report(sweep->name, 1, "scan", bench_Cycles);
+		bench_Sweeping = false;
+		++bench_SweepIndex;
+	}
+	return bench_Sweeping;
+}
+
+/**
+ * @brief Start the benchmarks
+ *
+ * They're run on the configured signals and whatever is wired to them, the
+ * scans at the end leave the signals as a scan command would. Results are
+ * displayed one line each, as
+ * bench,<name>,<count>,<unit>,<cycles>,<ns>,<ns per unit>,<units per 1000 s>,
+ * anything else sent starts with '#'. Only required messages are shown
+ * until they're done, so what's timed doesn't depend on the message level.
+ *
+ * @retval true The benchmarks were started, step them with @ref bench_Step.
+ */
+bool bench_Start()
+{
+	memset(bench_TDI, 0xA5, sizeof(bench_TDI));
+	memset(bench_Line, '.', sizeof(bench_Line));
+	bench_Line[0] = '#';
+	bench_Line[BENCH_LINK_LINE - 2] = '\r';
+	bench_Line[BENCH_LINK_LINE - 1] = '\n';
+
+	bench_Current = BENCH_STAGE_CLOCK;
+	bench_SweepIndex = 0;
+	bench_Sweeping = false;
+
+	bench_Level = message_GetLevel();
+	message_SetLevel(MESSAGE_LEVEL_REQUIRED);
+
+	chain_Invalidate();
+	message_Write(MESSAGE_LEVEL_REQUIRED, "# core_hz %lu tck_khz %u\r\n", (unsigned long)rcc_ahb_frequency, jtag_GetClockRate());
+	message_Write(MESSAGE_LEVEL_REQUIRED, "# bench,name,count,unit,cycles,ns,ns_each,per_ks\r\n");
+	return true;
+}
+
+/**
+ * @brief Run the next benchmark
+ *
+ * Each benchmark but the scans runs in a single step, a scan takes a step
+ * for every check on whether it's done.
+ *
+ * @retval true There are more to run.
+ */
+bool bench_Step()
+{
+	switch(bench_Current)
+	{
+		case BENCH_STAGE_CLOCK:
+			bench_Clock();
+			++bench_Current;
+			break;
+
+		case BENCH_STAGE_SHIFT:
+			bench_Shift();
+			++bench_Current;
+			break;
+
+		case BENCH_STAGE_TAP:
+			bench_TAP();
+			++bench_Current;
+			break;
+
+		case BENCH_STAGE_DETECT:
+			bench_Detect();
+			++bench_Current;
+			break;
+
+		case BENCH_STAGE_LINK:
+			bench_Link();
+			++bench_Current;
+			break;
+
+		case BENCH_STAGE_SWEEP:
+			if(!bench_Scan() && (bench_SweepIndex >= BENCH_SWEEPS))
+			{
+				message_Write(MESSAGE_LEVEL_REQUIRED, "# bench done\r\n");
+				message_SetLevel(bench_Level);
+				++bench_Current;
+			}
+			break;
+
+		default:
+			break;
+	}
+	return bench_Current != BENCH_STAGE_DONE;
+}
+
+#else
+
+/**
+ * @brief Start the benchmarks, they are compiled out
+ *
+ * @retval false The benchmarks weren't built in.
+ */
+bool bench_Start()
+{
+	message_Write(MESSAGE_LEVEL_GENERAL, "Benchmarks not enabled, build with BENCH=1.\r\n");
+	return false;
+}
+
+/**
+ * @brief Run the next benchmark, there are none
+ *
+ * @retval false Nothing to run.
+ */
+bool bench_Step()
+{
+	return false;
+}
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdbool.h>
+#include "bitbang.h"
+#include "comprocessor.h"
+#include "serial.h"
+#include "message.h"
+#include "jtag.h"
+#include "jtagtap.h"
+
+#define BITBANG_REPLY_LENGTH	(64)	///< TDO reads batched into each reply
+
+static unsigned int bitbang_Data(const char *buffer, unsigned int len);
+
+/**
+ * @brief Enter OpenOCD remote_bitbang mode
+ *
+ * All further data is interpreted as the remote_bitbang protocol until a
+ * quit command is received:
+ *   '0' - '7'  Set TCK, TMS and TDI, bits 2, 1 and 0 of the value.
+ *   'R'        Read TDO, replies with '0' or '1'.
+ *   'r' - 'u'  Set TRST and SRST, bits 1 and 0 of the value, 1 asserts.
+ *   'B', 'b'   Blink on or off, there is no LED so these are ignored.
+ *   'Q'        Quit back to command mode.
+ *
+ * The TAP state can't be followed, so it is marked unknown.
+ */
+void bitbang_Start()
+{
+	jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
+	comproc_SetDataHandler(bitbang_Data);
+}
+
+/**
+ * @brief Process a packet of remote_bitbang commands
+ *
+ * The whole packet is processed in one go, with the TDO reads collected and
+ * sent back in as few writes as possible rather than one per read.
+ *
+ * @param[in] buffer The incoming data.
+ * @param[in] len The number of bytes in buffer.
+ * @returns The number of bytes consumed.
+ */
+static unsigned int bitbang_Data(const char *buffer, unsigned int len)
+{
+	char reply[BITBANG_REPLY_LENGTH];
+	unsigned int replyLength = 0;
+	unsigned int used = 0;
+	bool quit = false;
+
+	while((used < len) && !quit)
+	{
+		char c = buffer[used++];
+
+		if((c >= '0') && (c <= '7'))
+		{
+			c -= '0';
+			jtag_Write((c & 0x04) != 0, (c & 0x02) != 0, (c & 0x01) != 0);
+		}
+		else if((c >= 'r') && (c <= 'u'))
+		{
+			//the reset signals are active low
+			c -= 'r';
+			jtag_Set(JTAG_SIGNAL_TRST, (c & 0x02) == 0);
+			jtag_Set(JTAG_SIGNAL_SRST, (c & 0x01) == 0);
+		}
+		else if(c == 'R')
+		{
+			reply[replyLength++] = jtag_Get(JTAG_SIGNAL_TDO) ? '1' : '0';
+			if(replyLength == BITBANG_REPLY_LENGTH)
+			{
+				serial_Send(reply, replyLength);
+				replyLength = 0;
+			}
+		}
+		else if(c == 'Q')
+		{
+			quit = true;
+		}
+		//anything else, including blink, is ignored
+	}
+
+	if(replyLength > 0)
+	{
+		serial_Send(reply, replyLength);
+	}
+
+	if(quit)
+	{
+		comproc_SetDataHandler(NULL);
+		message_Write(MESSAGE_LEVEL_REQUIRED, "> ");
+	}
+	return used;
+}
@@ -19,19 +19,48 @@
 #include "chain.h"
 #include "jtag.h"
 #include "jtagtap.h"
+#include "idcode.h"
 #include "message.h"
+#include "stats.h"
 
 #include <stdint.h>
+#include <string.h>
 #include <libopencm3/stm32/gpio.h>
 
+#define CHAIN_MARKER_FIRST	(0x35A6C9D2)	///< Marker sent to measure the chain, bits 0 and 31 clear
+#define CHAIN_MARKER_CONFIRM	(0x4C3A95E6)	///< Marker sent to confirm the length, bits 0 and 31 clear
+#define CHAIN_DETECT_PASSES	(4)		///< Markers sent for two lengths in a row to agree
+#define CHAIN_NOT_SELECTED	(-1)		///< No device is selected
+#define CHAIN_GANG_BITS		((CHAIN_GANG_DEVICES + 1) * 32)	///< Bits read from each gang target, room for the TDI ones after the last ID CODE
+
+/**
+ * @brief What is known about one device on the chain
+ */
+typedef struct chain_sDevice
+{
+	uint32_t idcode;		///< ID CODE after reset, 0 for BYPASS
+	uint32_t instruction;		///< Instruction loaded, if chain_IRValid
+	unsigned int irlength;		///< IR length from the capture pattern, 0 if not known
+} chain_Device;
+
 // Module local variables
 static unsigned int chain_IRLength;
 static unsigned int chain_Devices;
+static chain_Device chain_Model[CHAIN_MAX_DEVICES];	///< The devices, 0 is nearest TDO
+static int chain_Selected;				///< Device the ir and dr scans are for
+static bool chain_IRValid;				///< Does the model hold the instructions loaded
+static const uint8_t chain_Ones[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
 
 // Module local functions
 static bool chain_findDevices();
 static bool chain_findIRLength();
 static uint32_t chain_findIDCode();
+static int chain_findMarker(uint32_t marker, unsigned int max);
+static int chain_findLength(unsigned int max);
+static bool chain_findIRLengths();
+static void chain_shiftOnes(unsigned int nbits, bool exit);
+static int chain_parseIDCodes(const uint8_t *data, unsigned int nbits, uint32_t *idcodes, unsigned int max);
+static void chain_writeIDCode(unsigned int target, unsigned int device, uint32_t idcode);
 
 /**
  * @brief Initializes the chain module
@@ -41,6 +70,112 @@ void chain_Init()
 {
 	chain_IRLength = 0;
 	chain_Devices = 0;
+	chain_Selected = CHAIN_NOT_SELECTED;
+	chain_IRValid = false;
+}
+
+/**
+ * @brief Get the number of devices found by the last detect
+ *
+ * @returns The number of devices, 0 if the last detect failed.
+ */
+unsigned int chain_GetDevices()
+{
+	return chain_Devices;
+}
+
+/**
+ * @brief Get a device's ID CODE from the last detect
+ *
+ * @param[in] device The device number, 0 is nearest TDO.
+ * @returns The ID CODE, or 0 if the device was in BYPASS or doesn't exist.
+ */
+uint32_t chain_GetIDCode(unsigned int device)
+{
+	return (device < chain_Devices) ? chain_Model[device].idcode : 0;
+}
+
+/**
+ * @brief Get a device's IR length from the last detect
+ *
+ * @param[in] device The device number, 0 is nearest TDO.
+ * @returns The IR length, or 0 if it isn't known.
+ */
+unsigned int chain_GetIRLength(unsigned int device)
+{
+	return (device < chain_Devices) ? chain_Model[device].irlength : 0;
+}
+
+/**
+ * @brief Send a marker through the chain and find when it comes out
+ *
+ * The marker is shifted in followed by ones, 32 bits at a time with the bulk
+ * shift engine, and TDO is correlated against it as it is shifted. Stopping
+ * as soon as it is seen keeps the cost to the length of the chain rather
+ * than the maximum. Bits 0 and 31 of the marker must be clear so it can't
+ * match itself when overlapped with ones. Once found the marker has left
+ * the chain, which is full of ones.
+ *
+ * @param[in] marker The 32 bit pattern to send.
+ * @param[in] max The longest chain to look for, in bits.
+ * @returns The number of bits between TDI and TDO, or -1 if not found.
+ */
+static int chain_findMarker(uint32_t marker, unsigned int max)
+{
+	uint8_t tdi[4] = { marker & 0xFF, (marker >> 8) & 0xFF, (marker >> 16) & 0xFF, (marker >> 24) & 0xFF };
+	uint8_t tdo[4];
+	uint32_t history = 0;
+	unsigned int count;
+	int found = -1;
+
+	for(count = 0; (count <= max) && (found < 0); count += 32)
+	{
+		unsigned int bit;
+
+		jtag_Shift(tdi, tdo, 32, false);
+		tdi[0] = tdi[1] = tdi[2] = tdi[3] = 0xFF;	//the marker is only sent once
+
+		for(bit = 0; bit < 32; ++bit)
+		{
+			//TDO is sampled before each clock, the oldest sample ends up in bit 0
+			history = (history >> 1) | ((uint32_t)((tdo[bit >> 3] >> (bit & 0x07)) & 0x01) << 31);
+			if(((count + bit) >= 31) && (history == marker) && ((count + bit - 31) <= max))
+			{
+				found = count + bit - 31;
+				break;
+			}
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief Find the length of the selected register chain
+ *
+ * Markers are sent until two in a row give the same length. The first can be
+ * fooled by whatever the chain captured as it isn't flushed beforehand, the
+ * ones after it flush the chain so the following marker is exact.
+ *
+ * @param[in] max The longest chain to look for, in bits.
+ * @returns The number of bits between TDI and TDO, or -1 if not found.
+ */
+static int chain_findLength(unsigned int max)
+{
+	static const uint32_t markers[2] = { CHAIN_MARKER_FIRST, CHAIN_MARKER_CONFIRM };
+	int length = chain_findMarker(markers[0], max);
+	unsigned int pass;
+
+	for(pass = 1; (pass < CHAIN_DETECT_PASSES) && (length >= 0); ++pass)
+	{
+		int confirm = chain_findMarker(markers[pass & 0x01], max);
+
+		if(confirm == length)
+		{
+			return length;
+		}
+		length = confirm;
+	}
+	return -1;
 }
 
 /**
@@ -48,8 +183,8 @@ void chain_Init()
  *
  * To determine the number of chain IR length, the following algorithm
  * is used:
- *	Enter into bypass mode (IR = 0xFF....)
- * 	Clock a single 0 through and count the clocks until it appears
+ *	Enter IR_SHIFT
+ * 	Send a marker through followed by ones and find when it appears
  * If more than one device is on the chain this approach finds the sum of the
  * device IR lengths. The IR should also be left in the BYPASS instruction
  * (filled with ones)
@@ -57,35 +192,107 @@ void chain_Init()
 static bool chain_findIRLength()
 {
 	bool success = false;
-	unsigned int count;
+	int length;
 
-	//set TDI high and clock it through the chain in IR_SHIFT
+	//the ones following the marker leave the chain in bypass
 	jtag_Set(JTAG_SIGNAL_TDI, true);
 	jtagTAP_SetState(JTAGTAP_STATE_IR_SHIFT);
-
-	for(count = 0; count < CHAIN_MAX_IRLEN; ++count)
+	length = chain_findLength(CHAIN_MAX_IRLEN);
+	if(length > 0)
 	{
-		jtag_Clock();
+		chain_IRLength = length;
+		success = true;
 	}
+	return success;
+}
+
+/**
+ * @brief Find each device's IR length from the IR capture pattern
+ *
+ * Every IR captures ...01 on the way into IR_SHIFT, so a device starts at
+ * each 1 that is followed by a 0, the first out of TDO being nearest TDO.
+ * Only when there are exactly as many of these as devices are the lengths
+ * known, otherwise the other captured bits are hiding them. The capture is
+ * streamed 32 bits at a time and the IR is left full of ones.
+ *
+ * @pre The total IR length and number of devices are known.
+ * @retval true The IR length of every device is known.
+ */
+static bool chain_findIRLengths()
+{
+	uint8_t tdo[4];
+	unsigned int starts = 0;
+	unsigned int count;
+	unsigned int prev = 0;
+	unsigned int device;
+	bool last = false;
+	bool aligned = true;
 
-	//now set TDI low and count the number of clocks until TDO goes low
-	jtag_Set(JTAG_SIGNAL_TDI, false);
-	jtag_Clock();
 	jtag_Set(JTAG_SIGNAL_TDI, true);
+	jtagTAP_SetState(JTAGTAP_STATE_IR_SHIFT);
+	for(count = 0; count < chain_IRLength; count += 32)
+	{
+		unsigned int nbits = ((chain_IRLength - count) < 32) ? (chain_IRLength - count) : 32;
+		unsigned int bit;
+
+		jtag_Shift(chain_Ones, tdo, nbits, false);
+		for(bit = 0; bit < nbits; ++bit)
+		{
+			bool level = ((tdo[bit >> 3] >> (bit & 0x07)) & 0x01) != 0;
+
+			if(last && !level)
+			{
+				//a device starts at the previous bit
+				unsigned int start = count + bit - 1;
+				aligned = aligned && ((starts > 0) || (start == 0));
+				if((starts > 0) && (starts <= chain_Devices))
+				{
+					chain_Model[starts - 1].irlength = start - prev;
+				}
+				prev = start;
+				++starts;
+			}
+			last = level;
+		}
+	}
 
-	for(count = 1; count < CHAIN_MAX_IRLEN; ++count)
+	if(aligned && (starts == chain_Devices) && (starts > 0))
 	{
-		if(!jtag_Get(JTAG_SIGNAL_TDO))
+		chain_Model[starts - 1].irlength = chain_IRLength - prev;
+	}
+	else if(chain_Devices == 1)
+	{
+		//nothing else it could be
+		chain_Model[0].irlength = chain_IRLength;
+	}
+	else
+	{
+		for(device = 0; device < chain_Devices; ++device)
 		{
-			//went to 0
-			chain_IRLength = count;
-			success = true;
-			break;
+			chain_Model[device].irlength = 0;
 		}
-		jtag_Clock();
+		return false;
+	}
+	return true;
+}
+
+/**
+ * @brief Shift ones through the selected register
+ *
+ * @param[in] nbits The number of ones to shift.
+ * @param[in] exit true to leave the shift state on the last bit.
+ */
+static void chain_shiftOnes(unsigned int nbits, bool exit)
+{
+	while(nbits > 32)
+	{
+		jtag_Shift(chain_Ones, NULL, 32, false);
+		nbits -= 32;
+	}
+	if(nbits > 0)
+	{
+		jtag_Shift(chain_Ones, NULL, nbits, exit);
 	}
-	jtag_Clock();	//shift in another 1 so that the chain ends up in bypass
-	return success;
 }
 
 /**
@@ -94,8 +301,8 @@ static bool chain_findIRLength()
  * To determine the number of devices on the chain, the following algorithm
  * is used:
  *	Enter into bypass mode (IR = 0xFF....)
- *	Enter into shift_dr and fill with ones
- * 	Clock a 0 through and count the clocks until it appears
+ *	Enter into shift_dr
+ * 	Send a marker through and count the clocks until it appears
  *	DR can be left in whatever state
  * When the device is in BYPASS mode, the data register has a length of one,
  * so the devices on a chain is just the length of the data register. The DR
@@ -106,30 +313,23 @@ static bool chain_findIRLength()
 static bool chain_findDevices()
 {
 	bool success = false;
-	unsigned int count;
+	int count;
 
 	//get the TAP into the right state and set TDI high
 	jtagTAP_SetState(JTAGTAP_STATE_IR_SHIFT);
 	jtag_Set(JTAG_SIGNAL_TDI, true);
 
 	//load BYPASS into every device in the chain (TDI = all ones)
-	for(count = 0; count < chain_IRLength; ++count)
-	{
-		jtag_Clock();
-	}
+	jtag_Shift(NULL, NULL, chain_IRLength, false);
 
 	jtagTAP_SetState(JTAGTAP_STATE_DR_SHIFT);
 
-	for(count = 0; count < CHAIN_MAX_DEVICES; ++count)
+	//each bypass register is one bit long
+	count = chain_findLength(CHAIN_MAX_DEVICES);
+	if(count >= 0)
 	{
-		if(jtag_Get(JTAG_SIGNAL_TDO))
-		{
-			//went to 1, all bypass registers have been emptied
-			chain_Devices = count;
-			success = true;
-			break;
-		}
-		jtag_Clock();
+		chain_Devices = count;
+		success = true;
 	}
 	return success;
 }
@@ -145,27 +345,20 @@ static bool chain_findDevices()
  */
 uint32_t chain_findIDCode()
 {
-	unsigned int count;
 	uint32_t idcode;
 
 	if(jtag_Get(JTAG_SIGNAL_TDO))
 	{
-		//start of an ID Code
-		idcode = 0x00000000;
-
-		//shift in all 32 bits of the code
-		for(count = 0; count < 32; ++count)
-		{
-			idcode >>= 1;
-			idcode |= (jtag_Get(JTAG_SIGNAL_TDO) ? 0x80000000 : 0);
-			jtag_Clock();
-		}
+		//start of an ID Code, shift in all 32 bits of it
+		uint8_t code[4];
+		jtag_Shift(NULL, code, 32, false);
+		idcode = code[0] | (code[1] << 8) | (code[2] << 16) | ((uint32_t)code[3] << 24);
 	}
 	else
 	{
 		//this device is in BYPASS
 		idcode = 0;
-		jtag_Clock();	//procede to the next device (if any)
+		jtag_Shift(NULL, NULL, 1, false);	//procede to the next device (if any)
 	}
 	return idcode;
 }
@@ -178,12 +371,17 @@ uint32_t chain_findIDCode()
 bool chain_Detect()
 {
 	bool success = false;
+	STATS_BEGIN(STATS_CHAIN_DETECT);
+
+	chain_Devices = 0;
+	chain_Selected = CHAIN_NOT_SELECTED;
+	chain_IRValid = false;
 
 	//get some of the chain information
 	if(chain_findIRLength() && chain_findDevices())
 	{
-		unsigned int count;
 		unsigned int device = 0;
+		bool irlengths;
 
 		//reset the TAP and hope the devices support ID Code
 		jtagTAP_SetState(JTAGTAP_STATE_RESET);
@@ -191,19 +389,323 @@ bool chain_Detect()
 		jtag_Set(JTAG_SIGNAL_TDI, true);
 
 		message_Write(MESSAGE_LEVEL_GENERAL, "[+] %i Device(s) found, with total IR Length of %i\r\n", chain_Devices, chain_IRLength);
+		success = true;
 
 		for(device = 0; device < chain_Devices; ++device)
 		{
-			uint32_t idcode = chain_findIDCode();
-			if(idcode != 0)
+			chain_Model[device].idcode = chain_findIDCode();
+		}
+
+		//the ones shifted while finding the lengths leave every device in BYPASS
+		irlengths = chain_findIRLengths();
+		jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+		for(device = 0; device < chain_Devices; ++device)
+		{
+			chain_Model[device].instruction = (chain_Model[device].irlength < 32) ? ((1UL << chain_Model[device].irlength) - 1) : 0xFFFFFFFF;
+			if(chain_Model[device].idcode != 0)
 			{
-				message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Device %i - ID Code %08X\r\n", device +1, idcode);
+				const char *manufacturer = idcode_Manufacturer(chain_Model[device].idcode);
+				const char *part = idcode_Part(chain_Model[device].idcode);
+
+				if(part != NULL)
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Device %i - ID Code %08X (%s %s), IR Length %i\r\n", device +1, chain_Model[device].idcode, manufacturer, part, chain_Model[device].irlength);
+				}
+				else if(manufacturer != NULL)
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Device %i - ID Code %08X (%s), IR Length %i\r\n", device +1, chain_Model[device].idcode, manufacturer, chain_Model[device].irlength);
+				}
+				else
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Device %i - ID Code %08X, IR Length %i\r\n", device +1, chain_Model[device].idcode, chain_Model[device].irlength);
+				}
 			}
 			else
 			{
-				message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Device %i - BYPASS\r\n", device +1);
+				message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Device %i - BYPASS, IR Length %i\r\n", device +1, chain_Model[device].irlength);
+			}
+		}
+		chain_IRValid = irlengths;
+		if(!irlengths)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "[-] IR lengths couldn't be told apart from the capture pattern\r\n");
+		}
+	}
+	STATS_END(STATS_CHAIN_DETECT);
+	return success;
+}
+
+/**
+ * @brief Split the DR shifted out after a reset into ID CODEs
+ *
+ * Each device shifts out a 1 followed by the rest of its ID CODE, or a single
+ * 0 when it is in BYPASS. TDI is held high, so the chain ends where a run of
+ * 32 ones comes out.
+ *
+ * @param[in] data The bits shifted out, LSB of the first byte first.
+ * @param[in] nbits The number of bits in data.
+ * @param[out] idcodes The ID CODE of each device, 0 for BYPASS.
+ * @param[in] max The number of entries in idcodes.
+ * @returns The number of devices, or -1 if the end of the chain wasn't found.
+ */
+static int chain_parseIDCodes(const uint8_t *data, unsigned int nbits, uint32_t *idcodes, unsigned int max)
+{
+	unsigned int bit = 0;
+	unsigned int devices = 0;
+
+	while((bit + 32) <= nbits)
+	{
+		if(((data[bit >> 3] >> (bit & 0x07)) & 0x01) == 0)
+		{
+			//this device is in BYPASS
+			if(devices == max)
+			{
+				break;
+			}
+			idcodes[devices++] = 0;
+			++bit;
+		}
+		else
+		{
+			uint32_t idcode = 0;
+			unsigned int i;
+
+			for(i = 0; i < 32; ++i, ++bit)
+			{
+				idcode |= (uint32_t)((data[bit >> 3] >> (bit & 0x07)) & 0x01) << i;
+			}
+			if(idcode == 0xFFFFFFFF)
+			{
+				return devices;	//the ones from TDI, past the last device
+			}
+			if(devices == max)
+			{
+				break;
+			}
+			idcodes[devices++] = idcode;
+		}
+	}
+	return -1;
+}
+
+/**
+ * @brief Display a gang target's device
+ *
+ * @param[in] target The target number, 0 is the TDI and TDO signals.
+ * @param[in] device The device number, 0 is nearest TDO.
+ * @param[in] idcode The device's ID CODE, 0 for BYPASS.
+ */
+static void chain_writeIDCode(unsigned int target, unsigned int device, uint32_t idcode)
+{
+	const char *manufacturer = idcode_Manufacturer(idcode);
+	const char *part = idcode_Part(idcode);
+
+	if(idcode == 0)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Target %i Device %i - BYPASS\r\n", target + 1, device + 1);
+	}
+	else if(part != NULL)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Target %i Device %i - ID Code %08X (%s %s)\r\n", target + 1, device + 1, idcode, manufacturer, part);
+	}
+	else if(manufacturer != NULL)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Target %i Device %i - ID Code %08X (%s)\r\n", target + 1, device + 1, idcode, manufacturer);
+	}
+	else
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[+]  Target %i Device %i - ID Code %08X\r\n", target + 1, device + 1, idcode);
+	}
+}
+
+/**
+ * @brief Read the ID CODEs of every gang target at once
+ *
+ * All the targets are reset together and their DRs shifted in lockstep, see
+ * @ref jtag_ShiftGang. The ID CODEs of each target are displayed and checked
+ * against the first target that answered, as the targets are meant to be
+ * identical boards. The chain model isn't changed, @ref chain_Detect still
+ * describes the first target.
+ *
+ * @retval true Every configured target answered with the same devices.
+ */
+bool chain_DetectGang()
+{
+	uint8_t data[JTAG_GANG_MAX][CHAIN_GANG_BITS / 8];
+	uint8_t *tdo[JTAG_GANG_MAX];
+	uint32_t idcodes[JTAG_GANG_MAX][CHAIN_GANG_DEVICES];
+	int devices[JTAG_GANG_MAX];
+	int reference = -1;
+	bool success = true;
+	unsigned int target;
+
+	for(target = 0; target < JTAG_GANG_MAX; ++target)
+	{
+		int tdi_pin, tdo_pin;
+		tdo[target] = jtag_GetGangCfg(target, &tdi_pin, &tdo_pin) ? data[target] : NULL;
+	}
+	if(tdo[0] == NULL)
+	{
+		return false;	//the gang is shifted with TDI and TDO
+	}
+
+	//get the TAP into DR_SHIFT from reset, so every device gives its ID CODE
+	chain_Invalidate();
+	jtagTAP_SetState(JTAGTAP_STATE_RESET);
+	jtagTAP_SetState(JTAGTAP_STATE_DR_SHIFT);
+	jtag_Set(JTAG_SIGNAL_TDI, true);
+	jtag_ShiftGang(NULL, tdo, CHAIN_GANG_BITS, false);
+	jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+
+	for(target = 0; target < JTAG_GANG_MAX; ++target)
+	{
+		if(tdo[target] == NULL)
+		{
+			continue;
+		}
+
+		devices[target] = chain_parseIDCodes(data[target], CHAIN_GANG_BITS, idcodes[target], CHAIN_GANG_DEVICES);
+		if(devices[target] <= 0)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "[-] Target %i: no devices found\r\n", target + 1);
+			success = false;
+		}
+		else
+		{
+			int device;
+
+			message_Write(MESSAGE_LEVEL_GENERAL, "[+] Target %i: %i Device(s) found\r\n", target + 1, devices[target]);
+			for(device = 0; device < devices[target]; ++device)
+			{
+				chain_writeIDCode(target, device, idcodes[target][device]);
+			}
+
+			if(reference < 0)
+			{
+				reference = target;
+			}
+			else if((devices[target] != devices[reference]) || (memcmp(idcodes[target], idcodes[reference], devices[target] * sizeof(uint32_t)) != 0))
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "[-] Target %i doesn't match target %i\r\n", target + 1, reference + 1);
+				success = false;
 			}
 		}
 	}
 	return success;
 }
+
+/**
+ * @brief Forget the instructions loaded into the chain
+ *
+ * Needs to be called when something other than this module has shifted the
+ * IR or reset the TAP, so the next IR scan isn't skipped.
+ */
+void chain_Invalidate()
+{
+	chain_IRValid = false;
+}
+
+/**
+ * @brief Select the device that IR and DR scans are for
+ *
+ * @param[in] device The device number, 0 is nearest TDO.
+ * @retval true The device was selected.
+ */
+bool chain_Select(unsigned int device)
+{
+	bool success = (device < chain_Devices) && (chain_Model[device].irlength > 0) && (chain_Model[device].irlength <= 32);
+
+	if(success)
+	{
+		chain_Selected = device;
+	}
+	return success;
+}
+
+/**
+ * @brief Load an instruction into the selected device
+ *
+ * Every other device is given BYPASS. Nothing is shifted if the chain
+ * already holds these instructions, saving a full IR scan. The TAP is left
+ * in IDLE.
+ *
+ * @param[in] instruction The instruction, LSB first.
+ * @retval true The instruction is loaded.
+ */
+bool chain_ScanIR(uint32_t instruction)
+{
+	unsigned int device;
+	bool needed = !chain_IRValid;
+
+	if(chain_Selected == CHAIN_NOT_SELECTED)
+	{
+		return false;
+	}
+
+	for(device = 0; device < chain_Devices; ++device)
+	{
+		const chain_Device *model = &chain_Model[device];
+		uint32_t mask = (model->irlength < 32) ? ((1UL << model->irlength) - 1) : 0xFFFFFFFF;
+		uint32_t wanted = (device == (unsigned int)chain_Selected) ? (instruction & mask) : mask;
+
+		needed = needed || (model->instruction != wanted);
+	}
+
+	if(needed)
+	{
+		jtagTAP_SetState(JTAGTAP_STATE_IR_SHIFT);
+		//the first bits shifted end up in the device nearest TDO
+		for(device = 0; device < chain_Devices; ++device)
+		{
+			chain_Device *model = &chain_Model[device];
+			uint32_t mask = (model->irlength < 32) ? ((1UL << model->irlength) - 1) : 0xFFFFFFFF;
+			bool exit = (device == (chain_Devices - 1));
+
+			if(device == (unsigned int)chain_Selected)
+			{
+				const uint8_t tdi[4] = { instruction & 0xFF, (instruction >> 8) & 0xFF, (instruction >> 16) & 0xFF, (instruction >> 24) & 0xFF };
+				jtag_Shift(tdi, NULL, model->irlength, exit);
+				model->instruction = instruction & mask;
+			}
+			else
+			{
+				chain_shiftOnes(model->irlength, exit);
+				model->instruction = mask;
+			}
+		}
+		jtagTAP_ShiftExit();
+		chain_IRValid = true;
+	}
+	jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+	return true;
+}
+
+/**
+ * @brief Scan the data register of the selected device
+ *
+ * The devices nearer TDO are in BYPASS and take one bit each, so they are
+ * padded around the data. The TAP is left in IDLE.
+ *
+ * @param[in] tdi The data to shift in, LSB of the first byte first.
+ * @param[out] tdo The data shifted out, may be NULL.
+ * @param[in] nbits The length of the selected device's data register.
+ * @retval true The data register was scanned.
+ */
+bool chain_ScanDR(const uint8_t *tdi, uint8_t *tdo, unsigned int nbits)
+{
+	unsigned int after;
+
+	if((chain_Selected == CHAIN_NOT_SELECTED) || (nbits == 0))
+	{
+		return false;
+	}
+
+	after = chain_Devices - 1 - chain_Selected;
+	jtagTAP_SetState(JTAGTAP_STATE_DR_SHIFT);
+	chain_shiftOnes(chain_Selected, false);
+	jtag_Shift(tdi, tdo, nbits, (after == 0));
+	chain_shiftOnes(after, true);
+	jtagTAP_ShiftExit();
+	jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+	return true;
+}
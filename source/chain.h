@@ -19,11 +19,21 @@
 #define _CHAIN_H_
 
 #include <stdbool.h>
+#include <stdint.h>
 
-#define CHAIN_MAX_DEVICES		(20)	///< Maximum number of devices in a chain supported
+#define CHAIN_MAX_DEVICES		(128)	///< Maximum number of devices in a chain supported
 #define CHAIN_MAX_IRLEN			(CHAIN_MAX_DEVICES * 32)	///< Maximum chain IR length supported for autodetection
+#define CHAIN_GANG_DEVICES		(8)	///< Maximum number of devices read from each gang target
 
 extern void chain_Init();
 extern bool chain_Detect();
+extern bool chain_DetectGang();
+extern unsigned int chain_GetDevices();
+extern uint32_t chain_GetIDCode(unsigned int device);
+extern unsigned int chain_GetIRLength(unsigned int device);
+extern void chain_Invalidate();
+extern bool chain_Select(unsigned int device);
+extern bool chain_ScanIR(uint32_t instruction);
+extern bool chain_ScanDR(const uint8_t *tdi, uint8_t *tdo, unsigned int nbits);
 
 #endif
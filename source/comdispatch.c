@@ -0,0 +1,253 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "comdispatch.h"
+#include "message.h"
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+
+static bool comdisp_IsDelimiter(char c);
+static bool comdisp_Convert(const comdisp_Param *param, const char *token, uint32_t *value);
+
+/**
+ * @brief Check for a character that separates tokens
+ *
+ * @param[in] c The character to check.
+ * @retval true c is a space, CR or LF.
+ */
+static bool comdisp_IsDelimiter(char c)
+{
+	return (c == ' ') || (c == '\r') || (c == '\n');
+}
+
+/**
+ * @brief Split a command line into tokens in place
+ *
+ * The delimiters are overwritten with terminators in a single pass over the
+ * line, so the tokens point into buffer. Tokens beyond max are counted but
+ * not stored.
+ *
+ * @param[in,out] buffer The null terminated command line.
+ * @param[out] tokens Set to the start of each token.
+ * @param[in] max The number of entries in tokens.
+ * @returns The number of tokens on the line.
+ */
+unsigned int comdisp_Tokenize(char *buffer, char **tokens, unsigned int max)
+{
+	unsigned int count = 0;
+	bool inToken = false;
+
+	for(; *buffer != '\x00'; ++buffer)
+	{
+		if(comdisp_IsDelimiter(*buffer))
+		{
+			*buffer = '\x00';
+			inToken = false;
+		}
+		else if(!inToken)
+		{
+			if(count < max)
+			{
+				tokens[count] = buffer;
+			}
+			++count;
+			inToken = true;
+		}
+	}
+	return count;
+}
+
+/**
+ * @brief Binary search a sorted command table
+ *
+ * @param[in] table The table to search.
+ * @param[in] count The number of entries in table.
+ * @param[in] name The command word to look for.
+ * @returns The matching entry, or NULL if there isn't one.
+ */
+const comdisp_Command *comdisp_Find(const comdisp_Command *table, unsigned int count, const char *name)
+{
+	unsigned int low = 0;
+	unsigned int high = count;
+
+	while(low < high)
+	{
+		unsigned int mid = low + ((high - low) / 2);
+		int order = strcmp(table[mid].name, name);
+
+		if(order == 0)
+		{
+			return &table[mid];
+		}
+		else if(order < 0)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Convert a token to a 32 bit number
+ *
+ * The whole token has to be digits of the base, so a sign, a leading space
+ * or a value that doesn't fit in 32 bits is rejected rather than wrapped.
+ *
+ * @param[in] token The number as given.
+ * @param[in] base 10 or 16.
+ * @param[out] value The number, only set if it's valid.
+ * @retval true The token is a valid number.
+ */
+bool comdisp_Number(const char *token, int base, uint32_t *value)
+{
+	char *end;
+	unsigned long number;
+	bool success = false;
+
+	if((base == 16) ? isxdigit((unsigned char)token[0]) : isdigit((unsigned char)token[0]))
+	{
+		errno = 0;
+		number = strtoul(token, &end, base);
+		if((*end == '\x00') && (errno != ERANGE) && (number <= UINT32_MAX))
+		{
+			*value = (uint32_t)number;
+			success = true;
+		}
+	}
+	return success;
+}
+
+/**
+ * @brief Check and convert a parameter
+ *
+ * @param[in] param The parameter's description.
+ * @param[in] token The parameter as given.
+ * @param[out] value The converted value.
+ * @retval true The token is valid for the parameter.
+ */
+static bool comdisp_Convert(const comdisp_Param *param, const char *token, uint32_t *value)
+{
+	unsigned int i;
+	bool success = false;
+
+	switch(param->type)
+	{
+		case COMDISP_PARAM_DEC:
+			success = comdisp_Number(token, 10, value);
+			break;
+
+		case COMDISP_PARAM_HEX:
+			success = comdisp_Number(token, 16, value);
+			break;
+
+		case COMDISP_PARAM_KEYWORD:
+			for(i = 0; i < param->nkeywords; ++i)
+			{
+				if((param->keywords[i] != NULL) && (strcasecmp(token, param->keywords[i]) == 0))
+				{
+					*value = i;
+					success = true;
+					break;
+				}
+			}
+			break;
+
+		default:
+			*value = 0;
+			success = true;
+			break;
+	}
+	return success;
+}
+
+/**
+ * @brief Check the parameters of a command
+ *
+ * If the first parameter names one of the command's subcommands, the
+ * subcommand is used instead with the parameters after it. Every given
+ * parameter is converted according to its type and any left out take
+ * their fallback. A message naming the parameter is displayed for the
+ * first one that's missing or invalid.
+ *
+ * @param[in] command The command to check the parameters of.
+ * @param[in] tokens The tokens following the command word.
+ * @param[in] count The number of tokens.
+ * @param[out] args The command found and its parameters.
+ * @retval true The parameters are valid and args can be passed to the handler.
+ */
+bool comdisp_Parse(const comdisp_Command *command, char * const *tokens, unsigned int count, comdisp_Args *args)
+{
+	const comdisp_Command *sub = NULL;
+	unsigned int i;
+	bool success = true;
+
+	if((command->subcommands != NULL) && (count > 0))
+	{
+		sub = comdisp_Find(command->subcommands, command->nsubcommands, tokens[0]);
+	}
+	if(sub != NULL)
+	{
+		command = sub;
+		++tokens;
+		--count;
+	}
+
+	args->command = command;
+	args->count = count;
+	args->tokens = tokens;
+
+	for(i = 0; (i < COMDISP_PARAMS_MAX) && (command->params[i].type != COMDISP_PARAM_NONE) && success; ++i)
+	{
+		const comdisp_Param *param = &command->params[i];
+
+		if(i < count)
+		{
+			success = comdisp_Convert(param, tokens[i], &args->values[i]);
+			if(!success && (param->type == COMDISP_PARAM_KEYWORD))
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "invalid %s.\r\n", param->name);
+			}
+			else if(!success)
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "%s needs to be %s.\r\n", param->name, (param->type == COMDISP_PARAM_HEX) ? "hex" : "a number");
+			}
+		}
+		else if(i < command->required)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "missing parameter %s.\r\n", param->name);
+			success = false;
+		}
+		else
+		{
+			args->values[i] = param->fallback;
+		}
+	}
+
+	if(success && (count > i) && ((command->flags & COMDISP_FLAG_MORE) == 0))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "too many parameters.\r\n");
+		success = false;
+	}
+	return success;
+}
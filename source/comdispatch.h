@@ -0,0 +1,97 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if !defined(_COMDISPATCH_H_)
+#define _COMDISPATCH_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define COMDISP_PARAMS_MAX	(3)	///< Most typed parameters a command can take
+
+#define COMDISP_FLAG_SCAN	(0x01)	///< Accepted while a scan is running
+#define COMDISP_FLAG_MORE	(0x02)	///< Tokens after the typed parameters are passed on unchecked
+#define COMDISP_FLAG_HOST	(0x04)	///< Takes further lines or data from the host, so can't be batched
+
+#define COMDISP_ENTRIES(table)	(sizeof(table) / sizeof(comdisp_Command))	///< Entries in a command table
+
+#define COMDISP_DEC(name, fallback)		{ COMDISP_PARAM_DEC, (name), NULL, 0, (uint32_t)(fallback) }	///< Decimal parameter
+#define COMDISP_HEX(name, fallback)		{ COMDISP_PARAM_HEX, (name), NULL, 0, (uint32_t)(fallback) }	///< Hex parameter
+#define COMDISP_KEYWORD(name, words, fallback)	{ COMDISP_PARAM_KEYWORD, (name), (words), sizeof(words) / sizeof((words)[0]), (uint32_t)(fallback) }	///< One of a list of words
+#define COMDISP_TEXT(name)			{ COMDISP_PARAM_TEXT, (name), NULL, 0, 0 }	///< Parameter checked by the handler
+
+/**
+ * @brief How a parameter is checked and converted
+ */
+typedef enum comdisp_eParamType
+{
+	COMDISP_PARAM_NONE = 0,		///< Ends the parameter list
+	COMDISP_PARAM_DEC,		///< Decimal number
+	COMDISP_PARAM_HEX,		///< Hex number
+	COMDISP_PARAM_KEYWORD,		///< One of a list of words, the value is its index
+	COMDISP_PARAM_TEXT,		///< Passed as is, the value is 0
+} comdisp_ParamType;
+
+/**
+ * @brief A parameter of a command
+ */
+typedef struct comdisp_sParam
+{
+	comdisp_ParamType type;		///< How the token is checked
+	const char *name;		///< Name used in error messages
+	const char * const *keywords;	///< Words indexed by value for COMDISP_PARAM_KEYWORD, NULL entries are skipped
+	unsigned int nkeywords;		///< Entries in keywords
+	uint32_t fallback;		///< Value used when the parameter isn't given
+} comdisp_Param;
+
+/**
+ * @brief The checked parameters of a command, passed to its handler
+ */
+typedef struct comdisp_sArgs
+{
+	const struct comdisp_sCommand *command;	///< The command or subcommand found
+	unsigned int count;			///< Parameters given, not counting the command words
+	char * const *tokens;			///< The parameters, as split from the line
+	uint32_t values[COMDISP_PARAMS_MAX];	///< Typed parameters, or their fallbacks when not given
+} comdisp_Args;
+
+typedef void (*comdisp_Handler)(const comdisp_Args *args);
+
+/**
+ * @brief An entry in a command table
+ *
+ * Tables are binary searched, so they have to be kept sorted by name.
+ */
+typedef struct comdisp_sCommand
+{
+	const char *name;				///< Command word, tables are sorted on it
+	comdisp_Handler handler;			///< Called once the parameters have been checked
+	const struct comdisp_sCommand *subcommands;	///< Sorted table of words that can follow, or NULL
+	unsigned int nsubcommands;			///< Entries in subcommands
+	unsigned int required;				///< Parameters that have to be given
+	unsigned int flags;				///< COMDISP_FLAG_ values
+	uint32_t value;					///< Passed to the handler, for entries sharing one
+	comdisp_Param params[COMDISP_PARAMS_MAX];	///< Parameters in order, ended by COMDISP_PARAM_NONE
+} comdisp_Command;
+
+extern unsigned int comdisp_Tokenize(char *buffer, char **tokens, unsigned int max);
+extern const comdisp_Command *comdisp_Find(const comdisp_Command *table, unsigned int count, const char *name);
+extern bool comdisp_Parse(const comdisp_Command *command, char * const *tokens, unsigned int count, comdisp_Args *args);
+extern bool comdisp_Number(const char *token, int base, uint32_t *value);
+
+#endif
@@ -16,27 +16,178 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "comexecute.h"
+#include "comprocessor.h"
+#include "comdispatch.h"
 #include "message.h"
 #include "chain.h"
 #include "knock.h"
+#include "pinstore.h"
 #include "jtag.h"
 #include "jtagtap.h"
+#include "jtagtimer.h"
+#include "bitbang.h"
+#include "stats.h"
+#include "bench.h"
+#include "sched.h"
+#include "swd.h"
+#include "svf.h"
 #include <string.h>
-#include <errno.h>
+#include <stdlib.h>
+
+#define COMEXEC_TOKENS_MAX	(1 + (4 * SWD_BATCH_MAX))	///< Most tokens on a line, a full batch of swd writes
+#define COMEXEC_SHIFT_NIBBLES	(64)	///< Nibbles decoded for each call to the shift engine
+#define COMEXEC_DR_MAX_BITS	(256)	///< Longest data register the dr command can scan
+#define COMEXEC_RUNTEST_BATCH	(256)	///< Clocks run for each step of a runtest job
+#define COMEXEC_BATCH_LENGTH	(512)	///< Bytes of commands a batch can hold
+#define COMEXEC_BATCH_RUNS_MAX	(32)	///< Macros a batch can run, stops a macro running itself forever
+#define COMEXEC_MACROS_MAX	(4)	///< Number of macros that can be defined
+#define COMEXEC_MACRO_LENGTH	(256)	///< Bytes of commands a macro can hold
+#define COMEXEC_MACRO_NAME_LENGTH	(8)	///< Longest macro name
+
+/**
+ * @brief What the lines from the host are recorded for
+ */
+typedef enum comexec_eRecordMode
+{
+	COMEXEC_RECORD_NONE = 0,	///< Lines are executed as they arrive
+	COMEXEC_RECORD_BATCH,		///< Lines are run as a batch at end
+	COMEXEC_RECORD_MACRO,		///< Lines are stored as a macro at end
+} comexec_RecordMode;
+
+/**
+ * @brief A stored sequence of commands
+ */
+typedef struct comexec_sMacro
+{
+	char name[COMEXEC_MACRO_NAME_LENGTH + 1];	///< Name given to define, empty when the entry is free
+	char text[COMEXEC_MACRO_LENGTH + 1];		///< The commands, separated by ';'
+} comexec_Macro;
 
 static void comexec_SendReply(bool Success);
 
 //Command handlers
 static void comexec_MessageLevel(message_Levels Level);
 static void comexec_Chain();
-static void comexec_ScanForJTAG(unsigned int Pins, knock_Mode Mode);
+static void comexec_Select(unsigned int Device);
+static void comexec_IR(uint32_t Instruction);
+static void comexec_DR(unsigned int Bits, const char *Value);
+static void comexec_ScanForJTAG(unsigned int Pins, knock_Mode Mode, unsigned int Budget);
+static void comexec_ScanStatus();
+static void comexec_ScanAbort();
+static void comexec_ScanResume();
+static void comexec_Recall(unsigned int Pins, knock_Mode Mode, unsigned int Budget);
 static void comexec_SignalConfig(jtag_Signal Signal, int Pin);
 static void comexec_Config();
+static void comexec_Gang();
+static void comexec_GangConfig(unsigned int Target, int TDI, int TDO);
+static void comexec_GangChain();
+static void comexec_SWD();
+static void comexec_SWDBatch(swd_Transfer *Transfers, unsigned int Count);
+static void comexec_ClockConfig(unsigned int Rate, bool Adaptive);
 static void comexec_TAP(jtagTAP_TAPState State);
 static void comexec_Clock(unsigned int Counts);
+static void comexec_Pulse(jtag_Signal Signal, uint32_t Width);
+static void comexec_RunTest(unsigned int Clocks, uint32_t Time);
+static bool comexec_RunTestJob();
 static void comexec_SetSignal(jtag_Signal Signal, bool State);
 static void comexec_GetSignal(jtag_Signal Signal);
+static void comexec_Stats(bool Reset);
+static void comexec_Bench();
+static bool comexec_BenchJob();
+static void comexec_Shift();
+static unsigned int comexec_ShiftData(const char *Buffer, unsigned int Len);
+static unsigned int comexec_ShiftEnd(const char *Buffer, unsigned int Len);
+static void comexec_Play(uint32_t Bytes);
+static unsigned int comexec_PlayData(const char *Buffer, unsigned int Len);
+static bool comexec_PlayJob();
+static void comexec_PlayEnd();
 static void comexec_Help();
+static bool comexec_StartJob(sched_Task Job);
+static void comexec_Run(char *Command);
+static bool comexec_BatchAdd(const char *Text);
+static void comexec_BatchStart();
+static bool comexec_BatchJob();
+static void comexec_RecordStart(comexec_RecordMode Mode);
+static void comexec_RecordLine(char *Line);
+static void comexec_RecordEnd(comexec_RecordMode Mode);
+static bool comexec_StoreMacro();
+static comexec_Macro *comexec_FindMacro(const char *Name);
+
+//Command table entries, these convert the checked parameters for the handlers
+static void comexec_CmdChain(const comdisp_Args *Args);
+static void comexec_CmdSelect(const comdisp_Args *Args);
+static void comexec_CmdIR(const comdisp_Args *Args);
+static void comexec_CmdDR(const comdisp_Args *Args);
+static void comexec_CmdScan(const comdisp_Args *Args);
+static void comexec_CmdScanStatus(const comdisp_Args *Args);
+static void comexec_CmdScanAbort(const comdisp_Args *Args);
+static void comexec_CmdScanResume(const comdisp_Args *Args);
+static void comexec_CmdScanRecall(const comdisp_Args *Args);
+static void comexec_CmdConfig(const comdisp_Args *Args);
+static void comexec_CmdConfigClock(const comdisp_Args *Args);
+static void comexec_CmdGang(const comdisp_Args *Args);
+static void comexec_CmdGangChain(const comdisp_Args *Args);
+static void comexec_CmdSWD(const comdisp_Args *Args);
+static void comexec_CmdClock(const comdisp_Args *Args);
+static void comexec_CmdPulse(const comdisp_Args *Args);
+static void comexec_CmdRunTest(const comdisp_Args *Args);
+static void comexec_CmdTAP(const comdisp_Args *Args);
+static void comexec_CmdSignal(const comdisp_Args *Args);
+static void comexec_CmdMessage(const comdisp_Args *Args);
+static void comexec_CmdMessageLog(const comdisp_Args *Args);
+static void comexec_CmdStats(const comdisp_Args *Args);
+static void comexec_CmdBench(const comdisp_Args *Args);
+static void comexec_CmdShift(const comdisp_Args *Args);
+static void comexec_CmdPlay(const comdisp_Args *Args);
+static void comexec_CmdBitbang(const comdisp_Args *Args);
+static void comexec_CmdHelp(const comdisp_Args *Args);
+static void comexec_CmdBegin(const comdisp_Args *Args);
+static void comexec_CmdDefine(const comdisp_Args *Args);
+static void comexec_CmdEnd(const comdisp_Args *Args);
+static void comexec_CmdRun(const comdisp_Args *Args);
+
+static uint32_t comexec_PlayRemaining;	///< Bytes of the SVF stream still to come
+
+static char comexec_BatchText[COMEXEC_BATCH_LENGTH + 1];	///< Commands being recorded or run, separated by ';'
+static unsigned int comexec_BatchLength;	///< Bytes recorded into comexec_BatchText
+static char *comexec_BatchNext;			///< Next command of the running batch
+static bool comexec_Batching;			///< A batch is running, replies are held back
+static bool comexec_BatchFailed;		///< A command of the running batch failed
+static unsigned int comexec_BatchCommands;	///< Commands the running batch has started
+static unsigned int comexec_BatchRuns;		///< Macros the running batch has run
+static sched_Task comexec_BatchWait;		///< Job of a batched command, stepped by the batch
+static comexec_RecordMode comexec_Recording;	///< What lines from the host are recorded for
+static bool comexec_RecordOverflow;		///< The recorded lines didn't fit
+static char comexec_RecordName[COMEXEC_MACRO_NAME_LENGTH + 1];	///< Name of the macro being defined
+static comexec_Macro comexec_Macros[COMEXEC_MACROS_MAX];	///< The defined macros
+
+/**
+ * @brief Scan modes, as given to scan
+ */
+static const char * const comexec_ModeNames[KNOCK_MODE_MAX] = {
+	[KNOCK_MODE_RESET] = "reset",
+	[KNOCK_MODE_BYPASS] = "bypass",
+	[KNOCK_MODE_BROADCAST] = "broadcast",
+	[KNOCK_MODE_AUTO] = "auto",
+	[KNOCK_MODE_SWD] = "swd",
+};
+
+/**
+ * @brief TAP states that can be given to tap
+ */
+static const char * const comexec_TAPNames[JTAGTAP_STATE_MAX] = {
+	[JTAGTAP_STATE_RESET] = "reset",
+	[JTAGTAP_STATE_IDLE] = "run_idle",
+	[JTAGTAP_STATE_DR_SHIFT] = "shift_dr",
+	[JTAGTAP_STATE_DR_PAUSE] = "pause_dr",
+	[JTAGTAP_STATE_IR_SHIFT] = "shift_ir",
+	[JTAGTAP_STATE_IR_PAUSE] = "pause_ir",
+};
+
+/**
+ * @brief Signal states, as given to the signal commands
+ */
+static const char * const comexec_LevelNames[] = { "0", "1" };
 
 /**
  * @brief Sets the current message level
@@ -86,6 +237,117 @@ void comexec_Chain()
 	comexec_SendReply(success);
 }
 
+/**
+ * @brief Selects the device the ir and dr commands talk to
+ *
+ * The other devices on the chain are kept in BYPASS.
+ *
+ * @param[in] Device The device to select, 1 being the device nearest TDO
+ */
+void comexec_Select(unsigned int Device)
+{
+	bool success = (Device > 0) && chain_Select(Device - 1);
+	if(!success)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "No such device, or its IR length isn't known. Run chain first.\r\n");
+	}
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Scans an instruction into the selected device
+ *
+ * @param[in] Instruction The instruction to load, LSB nearest TDO.
+ */
+void comexec_IR(uint32_t Instruction)
+{
+	bool success = chain_ScanIR(Instruction);
+	if(!success)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "No device selected.\r\n");
+	}
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Scans a data register of the selected device
+ *
+ * The value is written and displayed in hex, most significant digit first.
+ * The captured value is displayed with enough digits for Bits.
+ *
+ * @param[in] Bits The length of the data register.
+ * @param[in] Value Hex value to shift in, NULL to shift in zeros.
+ */
+void comexec_DR(unsigned int Bits, const char *Value)
+{
+	static const char hexDigits[] = "0123456789ABCDEF";
+	uint8_t tdi[COMEXEC_DR_MAX_BITS / 8] = {0};
+	uint8_t tdo[COMEXEC_DR_MAX_BITS / 8] = {0};
+	char reply[(COMEXEC_DR_MAX_BITS / 4) + 1];
+	unsigned int nibbles = (Bits + 3) / 4;
+	unsigned int i;
+	bool success = false;
+
+	if((Bits == 0) || (Bits > COMEXEC_DR_MAX_BITS))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "nbits must be between %i and %i inclusive.\r\n", 1, COMEXEC_DR_MAX_BITS);
+	}
+	else
+	{
+		success = true;
+		if(Value != NULL)
+		{
+			//the last digit is the least significant nibble
+			unsigned int len = strlen(Value);
+			for(i = 0; (i < len) && success; ++i)
+			{
+				char c = Value[len - 1 - i];
+				uint8_t value;
+
+				if((c >= '0') && (c <= '9'))
+				{
+					value = c - '0';
+				}
+				else if(((c | 0x20) >= 'a') && ((c | 0x20) <= 'f'))
+				{
+					value = (c | 0x20) - 'a' + 10;
+				}
+				else
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "value needs to be hex.\r\n");
+					success = false;
+					break;
+				}
+
+				if(i < nibbles)
+				{
+					tdi[i >> 1] |= value << ((i & 0x01) * 4);
+				}
+			}
+		}
+
+		if(success)
+		{
+			success = chain_ScanDR(tdi, tdo, Bits);
+			if(success)
+			{
+				for(i = 0; i < nibbles; ++i)
+				{
+					unsigned int nibble = nibbles - 1 - i;
+					reply[i] = hexDigits[(tdo[nibble >> 1] >> ((nibble & 0x01) * 4)) & 0x0F];
+				}
+				reply[nibbles] = '\x00';
+				message_Write(MESSAGE_LEVEL_GENERAL, "%s\r\n", reply);
+			}
+			else
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "No device selected.\r\n");
+			}
+		}
+	}
+	comexec_SendReply(success);
+}
+
 /**
  * @brief Scans for a JTAG port
  *
@@ -98,31 +360,106 @@ void comexec_Chain()
  * bypass mode scans BYPASS commands into the TAPs and looks for TDO. Takes
  * (npins*(npins-1)*(npins-2) operations.
  *
- * All pins are left deconfigured when the scan finishes.
+ * broadcast mode is reset mode with TMS driven on groups of pins at once,
+ * taking about 2*log2(npins) captures per TCK candidate instead of npins-1.
+ *
+ * auto mode runs reset mode and only falls back to bypass mode, for the pins
+ * that changed, when something answered the reset without an idcode.
+ *
+ * All pins are left deconfigured when the scan finishes. The scan runs in
+ * the background, so the reply is sent as soon as it starts.
  *
  * @param[in] Pins The number of pins to use in the scan, must be 4 or more
  * @param[in] Mode The scanning mode to use
+ * @param[in] Budget The number of seconds to scan for before pausing, 0 for no limit, at most KNOCK_BUDGET_MAX
  */
-void comexec_ScanForJTAG(unsigned int Pins, knock_Mode Mode)
+void comexec_ScanForJTAG(unsigned int Pins, knock_Mode Mode, unsigned int Budget)
 {
 	bool success = false;
-	if((Pins >=4 ) && (Pins <= JTAG_PIN_MAX))
+	if((Pins < 4) || (Pins > JTAG_PIN_MAX))
 	{
-		knock_Scan(Mode, Pins);
-		success = true;	//the command itself doesn't fail, even if the scan doesn't find anything.
+		message_Write(MESSAGE_LEVEL_GENERAL, "At least 4 pins are required for a scan. Max %i.\r\n", JTAG_PIN_MAX);
+	}
+	else if(Budget > KNOCK_BUDGET_MAX)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "seconds can be at most %i.\r\n", KNOCK_BUDGET_MAX);
 	}
 	else
 	{
-		message_Write(MESSAGE_LEVEL_GENERAL, "At least 4 pins are required for a scan. Max 16.\r\n");
+		chain_Invalidate();
+		knock_Start(Mode, Pins, Budget);
+		success = true;	//the command itself doesn't fail, even if the scan doesn't find anything.
+	}
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Displays the progress of the scan
+ */
+void comexec_ScanStatus()
+{
+	knock_Status();
+	comexec_SendReply(true);
+}
+
+/**
+ * @brief Pauses the running scan
+ */
+void comexec_ScanAbort()
+{
+	bool success = knock_Abort();
+	if(!success)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "No scan running.\r\n");
+	}
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Carries on with a paused scan
+ */
+void comexec_ScanResume()
+{
+	bool success = knock_Resume();
+	if(!success)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "No paused scan.\r\n");
 	}
 	comexec_SendReply(success);
 }
 
+/**
+ * @brief Looks for one of the stored chains
+ *
+ * Tries the most recently found pinouts, leaving the first that still
+ * matches configured. If none match and npins is given, falls back to a
+ * full scan.
+ *
+ * @param[in] Pins The number of pins to scan if recall fails, 0 not to scan
+ * @param[in] Mode The scanning mode to fall back to
+ * @param[in] Budget The number of seconds to scan for before pausing, 0 for no limit
+ */
+void comexec_Recall(unsigned int Pins, knock_Mode Mode, unsigned int Budget)
+{
+	if(pinstore_Recall())
+	{
+		comexec_SendReply(true);
+	}
+	else if(Pins != 0)
+	{
+		comexec_ScanForJTAG(Pins, Mode, Budget);
+	}
+	else
+	{
+		comexec_SendReply(false);
+	}
+}
+
 /**
  * @brief Configures a signal
  *
  * Specifing a pin of 0 deconfigures the signal, otherwise the signal is
- * assigned to the pin.
+ * assigned to the pin. A negative pin displays the current assignment.
  *
  * @param[in] Signal The signal to configure.
  * @param[in] The pin number to assign to the signal.
@@ -133,7 +470,13 @@ void comexec_SignalConfig(jtag_Signal Signal, int Pin)
 	//test the signal is in range
 	if((Signal >= JTAG_SIGNAL_TCK) && (Signal < JTAG_SIGNAL_MAX))
 	{
-		if((Pin >= 0) && (Pin <= JTAG_PIN_MAX))
+		if(Pin < 0)
+		{
+			//just display the current assignment
+			message_Write(MESSAGE_LEVEL_GENERAL, "%s: %i\r\n", jtag_SignalNames[Signal], jtag_GetCfg(Signal) + 1);
+			success = true;
+		}
+		else if(Pin <= JTAG_PIN_MAX)
 		{
 			//set Pin to the correct value
 			if(Pin == 0)
@@ -145,6 +488,7 @@ void comexec_SignalConfig(jtag_Signal Signal, int Pin)
 				Pin -= 1;	//turn into 0 based pins
 			}
 			success = jtag_Cfg(Signal, Pin);
+			chain_Invalidate();
 
 			if(!success)
 			{
@@ -186,229 +530,1644 @@ void comexec_Config()
 }
 
 /**
- * @brief Set or display the current TAP state
- *
- * If State is JTAGTAP_STATE_MAX the current state is displayed, otherwise
- * the TAP is shifted to the provided state.
+ * @brief Display the gang targets
  *
- * @param[in] State the state to transfer to.
+ * Target 1 is the TDI and TDO signals.
  */
-void comexec_TAP(jtagTAP_TAPState State)
+void comexec_Gang()
 {
-	bool success = false;
+	unsigned int target;
 
-	if(State == JTAGTAP_STATE_MAX)
-	{
-		//displaying the current state
-		message_Write(MESSAGE_LEVEL_GENERAL, "TAP State: %s\r\n", jtagTAP_StateNames[jtagTAP_GetState()]);
-		success = true;
-	}
-	else
+	message_Write(MESSAGE_LEVEL_GENERAL, "Gang Configuration:\r\n  Target  TDI  TDO\r\n");
+	for(target = 0; target < JTAG_GANG_MAX; ++target)
 	{
-		//setting the state
-		jtagTAP_TAPState oldState = jtagTAP_GetState();
-		jtagTAP_SetState(State);
-		message_Write(MESSAGE_LEVEL_VERBOSE, "TAP State: %s -> %s\r\n", jtagTAP_StateNames[oldState], jtagTAP_StateNames[jtagTAP_GetState()]);
-		success = true;
-	}
+		int tdi, tdo;
 
-	comexec_SendReply(success);
+		if(jtag_GetGangCfg(target, &tdi, &tdo))
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "      %2i   %2i   %2i\r\n", target + 1, tdi + 1, tdo + 1);
+		}
+	}
+	comexec_SendReply(true);
 }
 
 /**
- * @brief Toggle the clock signal.
+ * @brief Configures a gang target
  *
- * Assumes that the clock signal has been assigned to a pin.
- * Does nothing otherwise.
+ * A TDI pin of 0 removes the target. The pins are 1 based, as for config.
  *
- * @param[in] Counts The number of clock pulses to provide
+ * @param[in] Target The target to configure, 2 to JTAG_GANG_MAX.
+ * @param[in] TDI The pin the target's TDI is on.
+ * @param[in] TDO The pin the target's TDO is on.
  */
-void comexec_Clock(unsigned int Counts)
+void comexec_GangConfig(unsigned int Target, int TDI, int TDO)
 {
-	while((Counts--) > 0)
+	bool success = false;
+
+	if((Target >= 2) && (Target <= JTAG_GANG_MAX))
 	{
-		jtag_Clock();
+		success = jtag_CfgGang(Target - 1, TDI - 1, TDO - 1);
+		chain_Invalidate();
+		if(!success)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "Configuration failed: Pin in use, or not on the TDI and TDO ports.\r\n");
+		}
 	}
-	comexec_SendReply(true);
+	else
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Target must be between %i and %i inclusive.\r\n", 2, JTAG_GANG_MAX);
+	}
+	comexec_SendReply(success);
 }
 
 /**
- * @brief Set a signal
- *
- * Trying to set an input has no effect.
- *
- * @param[in] Signal The signal to set.
- * @param[in] State The state to set to.
+ * @brief Reads the ID CODEs of every gang target
  */
-void comexec_SetSignal(jtag_Signal Signal, bool State)
+void comexec_GangChain()
 {
-	jtag_Set(Signal, State);
-	comexec_SendReply(true);
+	bool success = chain_DetectGang();
+	if(!success)
+	{
+		message_Write(MESSAGE_LEVEL_VERBOSE, "Gang targets missing or not matching. Are the signal assignments correct?\r\n");
+	}
+	comexec_SendReply(success);
 }
 
 /**
- * @brief Get a signal state
+ * @brief Connects to a SWD target and displays its DPIDR
  *
- * @param[in] Signal The signal to display.
+ * SWCLK is the TCK signal and SWDIO is the TMS signal.
  */
-void comexec_GetSignal(jtag_Signal Signal)
+void comexec_SWD()
 {
-	bool val = jtag_Get(Signal);
-	message_Write(MESSAGE_LEVEL_GENERAL, "%s: %i\r\n",  jtag_SignalNames[Signal], val);
-	comexec_SendReply(true);
-}
+	uint32_t dpidr = 0;
+	bool success = false;
 
-/**
- * @brief Send a reply message
- *
- * The reply message indicates the successful execution of the command
- * `OK` or failure `ERR`. The command handlers can provide additional
- * information in both cases.
- */
-void comexec_SendReply(bool Success)
-{
-	if(Success)
+	if(jtag_IsAllocated(JTAG_SIGNAL_TCK) && jtag_IsAllocated(JTAG_SIGNAL_TMS))
 	{
-		message_Write(MESSAGE_LEVEL_REQUIRED, "OK\r\n");
+		chain_Invalidate();
+		success = swd_Connect(&dpidr);
+		if(success)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "DPIDR: %08X\r\n", dpidr);
+		}
+		else
+		{
+			message_Write(MESSAGE_LEVEL_VERBOSE, "No SWD target found. Are TCK (SWCLK) and TMS (SWDIO) correct?\r\n");
+		}
 	}
 	else
 	{
-		message_Write(MESSAGE_LEVEL_REQUIRED, "ERROR\r\n");
+		message_Write(MESSAGE_LEVEL_GENERAL, "TCK and TMS need to be configured.\r\n");
 	}
-	//issue a new prompt
-	message_Write(MESSAGE_LEVEL_REQUIRED, "> ");
+	comexec_SendReply(success);
 }
 
 /**
- * @brief Display the list of available commands
+ * @brief Runs a batch of SWD transfers and displays the values read
+ *
+ * The target has to have been connected to with swd first.
  *
+ * @param[in,out] Transfers The transfers to run.
+ * @param[in] Count The number of transfers.
  */
-void comexec_Help()
+void comexec_SWDBatch(swd_Transfer *Transfers, unsigned int Count)
 {
+	static const char * const ack_names[] = {
+		[SWD_ACK_OK] = "OK",
+		[SWD_ACK_WAIT] = "WAIT",
+		[SWD_ACK_FAULT] = "FAULT",
+		[SWD_ACK_PARITY] = "parity error",
+	};
+	unsigned int done;
+	unsigned int i;
+
+	chain_Invalidate();
+	done = swd_Batch(Transfers, Count);
+	for(i = 0; i < done; ++i)
+	{
+		if((Transfers[i].request & SWD_REQUEST_READ) != 0)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "%s %X: %08X\r\n", ((Transfers[i].request & SWD_REQUEST_AP) != 0) ? "AP" : "DP", SWD_REQUEST_ADDR(Transfers[i].request), Transfers[i].data);
+		}
+	}
+	if(done < Count)
+	{
+		uint8_t ack = Transfers[done].ack;
+		const char *name = ((ack < (sizeof(ack_names) / sizeof(ack_names[0]))) && (ack_names[ack] != NULL)) ? ack_names[ack] : "no reply";
 
+		message_Write(MESSAGE_LEVEL_GENERAL, "Transfer %i failed: %s\r\n", done + 1, name);
+	}
+	comexec_SendReply(done == Count);
 }
 
 /**
- * @brief Execute the given command
+ * @brief Set or display the JTAG clock
  *
- * Parses the supplied command and converts any arguments into the data types
- * expected by the various handler functions.
+ * A Rate of 0 with Adaptive false displays the current setting.
  *
- * @param[in] Buffer The command to execute in string format
+ * @param[in] Rate The TCK rate in kHz
+ * @param[in] Adaptive Use RTCK to pace TCK instead of a fixed rate
  */
-void comexec_Execute(char *Buffer)
+void comexec_ClockConfig(unsigned int Rate, bool Adaptive)
 {
-	char *pSaveToken;
-	char *Token;
-	bool parseSuccess = false;
-
-	Token = strtok_r(Buffer, " ", &pSaveToken);
+	bool success = false;
 
-	if(strcmp(Token, "help") == 0)
-	{
-		comexec_Help();
-	}
-	else if(strcmp(Token, "chain") == 0)
-	{
-		comexec_Chain();
-	}
-	else if(strcmp(Token, "clock") == 0)
+	if(Adaptive)
 	{
-		unsigned int count;
-
-		//check and convert the required counts value
-		if((Token = strtok_r(NULL, " ", &pSaveToken)) != NULL)
+		success = jtag_SetClockAdaptive(true);
+		if(!success)
 		{
-			errno = 0;
-			count = strtoul(Token, NULL, 10);
-			if(errno == 0)
-			{
-				//execute the clock command
-				comexec_Clock(count);
-			}
-			else
-			{
-				message_Write(MESSAGE_LEVEL_GENERAL, "n needs to be a number.\r\n");
-				comexec_SendReply(false);
-			}
+			message_Write(MESSAGE_LEVEL_GENERAL, "RTCK must be assigned for adaptive clocking.\r\n");
 		}
-		else
+	}
+	else if(Rate != 0)
+	{
+		success = jtag_SetClockRate(Rate) && jtag_SetClockAdaptive(false);
+		if(!success)
 		{
-			message_Write(MESSAGE_LEVEL_GENERAL, "missing parameter count.\r\n");
-			comexec_SendReply(false);
+			message_Write(MESSAGE_LEVEL_GENERAL, "Rate must be between %i and %i kHz inclusive.\r\n", JTAG_CLOCK_MIN, JTAG_CLOCK_MAX);
 		}
 	}
-	else if(strcmp(Token, "message") == 0)
+	else
+	{
+		success = true;
+	}
+
+	if(success)
 	{
-		message_Levels level = MESSAGE_LEVEL_MAX;
-		parseSuccess = true;
-		//check and convert the required counts value
-		if((Token = strtok_r(NULL, " ", &pSaveToken)) != NULL)
+		if(jtag_IsClockAdaptive())
 		{
-			errno = 0;
-			level = strtoul(Token, NULL, 10);
-			if(errno != 0)
-			{
-				parseSuccess = false;
-				message_Write(MESSAGE_LEVEL_GENERAL, "level needs to be a number.\r\n");
-				comexec_SendReply(false);
-			}
+			message_Write(MESSAGE_LEVEL_GENERAL, "Clock: adaptive\r\n");
 		}
-		if(parseSuccess)
+		else
 		{
-			comexec_MessageLevel(level);
+			message_Write(MESSAGE_LEVEL_GENERAL, "Clock: %i kHz\r\n", jtag_GetClockRate());
 		}
 	}
-	else if(strcmp(Token, "scan") == 0)
-	{
-		knock_Mode scanMode = KNOCK_MODE_RESET;
-		unsigned int pins;
+	comexec_SendReply(success);
+}
 
-		//check and convert the required npins value
-		if((Token = strtok_r(NULL, " ", &pSaveToken)) != NULL)
-		{
-			errno = 0;
-			pins = strtoul(Token, NULL, 10);
-			if(errno == 0)
-			{
-				parseSuccess = true;
-				if((Token = strtok_r(NULL, " ", &pSaveToken)) != NULL)
-				{
-					//handle the mode if supplied
-					if(strcmp(Token, "reset") == 0)
-					{
-						scanMode = KNOCK_MODE_RESET;
-					}
-					else if(strcmp(Token, "bypass") == 0)
-					{
-						scanMode = KNOCK_MODE_BYPASS;
-					}
-					else
-					{
-						message_Write(MESSAGE_LEVEL_GENERAL, "invalid mode.\r\n");
-						comexec_SendReply(false);
-						parseSuccess = false;
-					}
+/**
+ * @brief Set or display the current TAP state
+ *
+ * If State is JTAGTAP_STATE_MAX the current state is displayed, otherwise
+ * the TAP is shifted to the provided state.
+ *
+ * @param[in] State the state to transfer to.
+ */
+void comexec_TAP(jtagTAP_TAPState State)
+{
+	bool success = false;
+
+	if(State == JTAGTAP_STATE_MAX)
+	{
+		//displaying the current state
+		message_Write(MESSAGE_LEVEL_GENERAL, "TAP State: %s\r\n", jtagTAP_StateNames[jtagTAP_GetState()]);
+		success = true;
+	}
+	else
+	{
+		//setting the state
+		jtagTAP_TAPState oldState = jtagTAP_GetState();
+		jtagTAP_SetState(State);
+		chain_Invalidate();
+		message_Write(MESSAGE_LEVEL_VERBOSE, "TAP State: %s -> %s\r\n", jtagTAP_StateNames[oldState], jtagTAP_StateNames[jtagTAP_GetState()]);
+		success = true;
+	}
+
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Toggle the clock signal.
+ *
+ * Assumes that the clock signal has been assigned to a pin.
+ * Does nothing otherwise.
+ *
+ * @param[in] Counts The number of clock pulses to provide
+ */
+void comexec_Clock(unsigned int Counts)
+{
+	//the TAPs may have moved under TMS
+	chain_Invalidate();
+	while((Counts--) > 0)
+	{
+		jtag_Clock();
+	}
+	comexec_SendReply(true);
+}
+
+/**
+ * @brief Pulse TRST or SRST low
+ *
+ * The pulse is timed in the background, so the reply is sent straight
+ * away. A TRST pulse leaves the TAP state unknown, the next move waits for
+ * the pulse to end and resets the TAP again.
+ *
+ * @param[in] Signal TRST or SRST.
+ * @param[in] Width The pulse width in us, 0 to use the last width set.
+ */
+void comexec_Pulse(jtag_Signal Signal, uint32_t Width)
+{
+	bool success = false;
+
+	if((Signal != JTAG_SIGNAL_TRST) && (Signal != JTAG_SIGNAL_SRST))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Only trst and srst can be pulsed.\r\n");
+	}
+	else if(!jtag_IsAllocated(Signal))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "%s isn't assigned to a pin.\r\n", jtag_SignalNames[Signal]);
+	}
+	else
+	{
+		if(Width != 0)
+		{
+			jtagTimer_SetWidth(Signal, Width);
+		}
+		success = jtagTimer_Pulse(Signal);
+		if(Signal == JTAG_SIGNAL_TRST)
+		{
+			jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
+		}
+		chain_Invalidate();
+		message_Write(MESSAGE_LEVEL_VERBOSE, "%s pulsed for %lu us\r\n", jtag_SignalNames[Signal], (unsigned long)jtagTimer_GetWidth(Signal));
+	}
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Wait in Run/Idle
+ *
+ * The wait runs as a job, so the reply is sent by @ref comexec_RunTestJob
+ * once it's over and the next command is held until then.
+ *
+ * @param[in] Clocks The minimum number of TCK cycles to run.
+ * @param[in] Time The minimum time to wait in us.
+ */
+void comexec_RunTest(unsigned int Clocks, uint32_t Time)
+{
+	jtagTAP_RunTestStart(Clocks, Time);
+	comexec_StartJob(comexec_RunTestJob);
+}
+
+/**
+ * @brief Run a batch of the runtest clocks
+ *
+ * @retval true There is more to wait for.
+ */
+bool comexec_RunTestJob()
+{
+	bool more = jtagTAP_RunTestStep(COMEXEC_RUNTEST_BATCH);
+
+	if(!more)
+	{
+		comexec_SendReply(true);
+	}
+	return more;
+}
+
+/**
+ * @brief Set a signal
+ *
+ * Trying to set an input has no effect.
+ *
+ * @param[in] Signal The signal to set.
+ * @param[in] State The state to set to.
+ */
+void comexec_SetSignal(jtag_Signal Signal, bool State)
+{
+	jtag_Set(Signal, State);
+	chain_Invalidate();
+	comexec_SendReply(true);
+}
+
+/**
+ * @brief Get a signal state
+ *
+ * @param[in] Signal The signal to display.
+ */
+void comexec_GetSignal(jtag_Signal Signal)
+{
+	bool val = jtag_Get(Signal);
+	message_Write(MESSAGE_LEVEL_GENERAL, "%s: %i\r\n",  jtag_SignalNames[Signal], val);
+	comexec_SendReply(true);
+}
+
+/**
+ * @brief Display or reset the timing statistics
+ *
+ * @param[in] Reset true to clear the counters instead of displaying them.
+ */
+void comexec_Stats(bool Reset)
+{
+	bool success = true;
+
+	if(Reset)
+	{
+		stats_Reset();
+	}
+	else
+	{
+		success = stats_Display();
+	}
+	comexec_SendReply(success);
+}
+
+/**
+ * @brief Run the benchmarks
+ *
+ * They run as a job, so the reply is sent by @ref comexec_BenchJob once the
+ * last one is done.
+ */
+void comexec_Bench()
+{
+	chain_Invalidate();
+	if(!bench_Start() || !comexec_StartJob(comexec_BenchJob))
+	{
+		comexec_SendReply(false);
+	}
+}
+
+/**
+ * @brief Run the next benchmark
+ *
+ * @retval true There are more to run.
+ */
+bool comexec_BenchJob()
+{
+	bool more = bench_Step();
+
+	if(!more)
+	{
+		comexec_SendReply(true);
+	}
+	return more;
+}
+
+/**
+ * @brief Enter data shift mode
+ *
+ * The incoming data is passed to @ref comexec_ShiftData until a non hex
+ * character is received. The TAP state is not changed.
+ */
+void comexec_Shift()
+{
+	chain_Invalidate();
+	comproc_SetDataHandler(comexec_ShiftData);
+	message_Write(MESSAGE_LEVEL_REQUIRED, ">>");
+}
+
+/**
+ * @brief Shift hex encoded data through TDI and TDO
+ *
+ * Nibbles are decoded straight from the incoming data and shifted as soon
+ * as they arrive, LSB first. The bits captured from TDO are encoded the same
+ * way and sent back for each block of nibbles, so the length of a scan isn't
+ * limited by any buffer.
+ *
+ * The first non hex character ends shift mode and is consumed, along with
+ * the LF of a CRLF pair.
+ *
+ * @param[in] Buffer The incoming data.
+ * @param[in] Len The number of bytes in Buffer.
+ * @returns The number of bytes consumed.
+ */
+unsigned int comexec_ShiftData(const char *Buffer, unsigned int Len)
+{
+	static const char hexDigits[] = "0123456789ABCDEF";
+	uint8_t tdi[COMEXEC_SHIFT_NIBBLES / 2];
+	uint8_t tdo[COMEXEC_SHIFT_NIBBLES / 2];
+	char reply[COMEXEC_SHIFT_NIBBLES];
+	unsigned int nibbles = 0;
+	unsigned int used = 0;
+	bool end = false;
+
+	while((used < Len) && (nibbles < COMEXEC_SHIFT_NIBBLES))
+	{
+		char c = Buffer[used];
+		uint8_t value;
+
+		if((c >= '0') && (c <= '9'))
+		{
+			value = c - '0';
+		}
+		else if(((c | 0x20) >= 'a') && ((c | 0x20) <= 'f'))
+		{
+			value = (c | 0x20) - 'a' + 10;
+		}
+		else
+		{
+			end = true;
+			break;
+		}
+
+		if((nibbles & 0x01) == 0)
+		{
+			tdi[nibbles >> 1] = value;
+		}
+		else
+		{
+			tdi[nibbles >> 1] |= value << 4;
+		}
+		++nibbles;
+		++used;
+	}
+
+	if(nibbles > 0)
+	{
+		unsigned int i;
+
+		jtag_Shift(tdi, tdo, nibbles * 4, false);
+		for(i = 0; i < nibbles; ++i)
+		{
+			reply[i] = hexDigits[(tdo[i >> 1] >> ((i & 0x01) * 4)) & 0x0F];
+		}
+		message_Write(MESSAGE_LEVEL_REQUIRED, "%.*s", nibbles, reply);
+	}
+
+	if(end)
+	{
+		//consume the terminator and catch the LF of CRLF, even in the next packet
+		if(Buffer[used++] == '\r')
+		{
+			comproc_SetDataHandler(comexec_ShiftEnd);
+			used += comexec_ShiftEnd(&Buffer[used], Len - used);
+		}
+		else
+		{
+			comproc_SetDataHandler(NULL);
+		}
+		message_Write(MESSAGE_LEVEL_REQUIRED, "\r\n");
+		comexec_SendReply(true);
+	}
+
+	return used;
+}
+
+/**
+ * @brief Drop the LF following a CR that ended shift mode
+ *
+ * @param[in] Buffer The incoming data.
+ * @param[in] Len The number of bytes in Buffer.
+ * @returns The number of bytes consumed.
+ */
+unsigned int comexec_ShiftEnd(const char *Buffer, unsigned int Len)
+{
+	unsigned int used = 0;
+
+	if(Len > 0)
+	{
+		if(Buffer[0] == '\n')
+		{
+			used = 1;
+		}
+		comproc_SetDataHandler(NULL);
+	}
+	return used;
+}
+
+/**
+ * @brief Plays an SVF stream from the host
+ *
+ * The next Bytes bytes received are the stream, run a statement at a time
+ * as they arrive. TDO is checked on the board, only the outcome is sent
+ * back once the whole stream has been received. A RUNTEST is run as a job,
+ * while it waits the USB link's flow control holds the host off. The USART
+ * has none, so there the host has to pace the stream itself, see
+ * @ref serial_Receive.
+ *
+ * @param[in] Bytes The length of the stream, an empty stream completes at once.
+ */
+void comexec_Play(uint32_t Bytes)
+{
+	chain_Invalidate();
+	svf_Start();
+	comexec_PlayRemaining = Bytes;
+	comproc_SetDataHandler(comexec_PlayData);
+	message_Write(MESSAGE_LEVEL_REQUIRED, ">>");
+	if(Bytes == 0)
+	{
+		//no data is coming to finish the stream, so finish it now
+		comexec_PlayEnd();
+	}
+}
+
+/**
+ * @brief Data handler for play, passes the stream to the player
+ *
+ * @param[in] Buffer The received data.
+ * @param[in] Len The number of bytes in Buffer.
+ * @returns The number of bytes used.
+ */
+unsigned int comexec_PlayData(const char *Buffer, unsigned int Len)
+{
+	unsigned int used = svf_Process(Buffer, (Len < comexec_PlayRemaining) ? Len : comexec_PlayRemaining);
+
+	comexec_PlayRemaining -= used;
+	if(svf_IsWaiting())
+	{
+		sched_StartJob(comexec_PlayJob);
+	}
+	else if(comexec_PlayRemaining == 0)
+	{
+		comexec_PlayEnd();
+	}
+	return used;
+}
+
+/**
+ * @brief Job running a RUNTEST from the stream being played
+ *
+ * @retval true The RUNTEST has more to do.
+ */
+bool comexec_PlayJob()
+{
+	bool more = svf_Step();
+
+	if(!more && (comexec_PlayRemaining == 0))
+	{
+		comexec_PlayEnd();
+	}
+	return more;
+}
+
+/**
+ * @brief Reports the outcome of the stream and returns to commands
+ */
+void comexec_PlayEnd()
+{
+	uint32_t offset;
+	uint32_t statements;
+	svf_Result result = svf_Finish(&offset, &statements);
+
+	comproc_SetDataHandler(NULL);
+	message_Write(MESSAGE_LEVEL_REQUIRED, "\r\n");
+	if(result == SVF_RESULT_OK)
+	{
+		message_Write(MESSAGE_LEVEL_VERBOSE, "%lu statement(s) played\r\n", (unsigned long)statements);
+	}
+	else
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[-] %s at byte %lu, after %lu statement(s)\r\n", svf_ResultNames[result], (unsigned long)offset, (unsigned long)statements);
+	}
+	comexec_SendReply(result == SVF_RESULT_OK);
+}
+
+/**
+ * @brief Send a reply message
+ *
+ * The reply message indicates the successful execution of the command
+ * `OK` or failure `ERR`. The command handlers can provide additional
+ * information in both cases.
+ *
+ * Within a batch only a failure is noted, the batch sends one reply for
+ * all of its commands once it's done.
+ */
+void comexec_SendReply(bool Success)
+{
+	if(comexec_Batching)
+	{
+		if(!Success)
+		{
+			comexec_BatchFailed = true;
+		}
+	}
+	else
+	{
+		if(Success)
+		{
+			message_Write(MESSAGE_LEVEL_REQUIRED, "OK\r\n");
+		}
+		else
+		{
+			message_Write(MESSAGE_LEVEL_REQUIRED, "ERROR\r\n");
+		}
+		//issue a new prompt
+		message_Write(MESSAGE_LEVEL_REQUIRED, "> ");
+	}
+}
+
+/**
+ * @brief Start a job for a command
+ *
+ * Within a batch the batch is already the running job, so it steps the
+ * command's job itself before moving on to the next command.
+ *
+ * @param[in] Job The job to start.
+ * @retval true The job was started.
+ */
+bool comexec_StartJob(sched_Task Job)
+{
+	bool success = true;
+
+	if(comexec_Batching)
+	{
+		comexec_BatchWait = Job;
+	}
+	else
+	{
+		success = sched_StartJob(Job);
+	}
+	return success;
+}
+
+/**
+ * @brief Put commands in front of those the batch still has to run
+ *
+ * The commands already run are dropped to make room, so a batch can run
+ * macros for as long as the rest fits.
+ *
+ * @param[in] Text The commands, separated by ';'.
+ * @retval true The commands were added.
+ */
+bool comexec_BatchAdd(const char *Text)
+{
+	unsigned int len = strlen(Text);
+	unsigned int rest = strlen(comexec_BatchNext);
+	bool success = (len + 1 + rest) <= COMEXEC_BATCH_LENGTH;
+
+	if(success)
+	{
+		memmove(&comexec_BatchText[len + 1], comexec_BatchNext, rest + 1);
+		memcpy(comexec_BatchText, Text, len);
+		comexec_BatchText[len] = ';';
+		comexec_BatchNext = comexec_BatchText;
+	}
+	else
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Batch too long, at most %i bytes.\r\n", COMEXEC_BATCH_LENGTH);
+	}
+	return success;
+}
+
+/**
+ * @brief Run the commands in comexec_BatchText as a batch
+ *
+ * The batch is run as a job, so the host is held off until it's done.
+ */
+void comexec_BatchStart()
+{
+	comexec_Batching = true;
+	comexec_BatchFailed = false;
+	comexec_BatchCommands = 0;
+	comexec_BatchRuns = 0;
+	comexec_BatchWait = NULL;
+	sched_StartJob(comexec_BatchJob);
+}
+
+/**
+ * @brief Run the commands of a batch
+ *
+ * Commands are run back to back until one starts a job, which is then
+ * stepped until it's done. The batch stops at the first command that
+ * fails and sends a single reply for the whole batch.
+ *
+ * @retval true There are more commands to run.
+ */
+bool comexec_BatchJob()
+{
+	bool more;
+
+	if((comexec_BatchWait != NULL) && !comexec_BatchWait())
+	{
+		comexec_BatchWait = NULL;
+	}
+
+	while((comexec_BatchWait == NULL) && !comexec_BatchFailed && (*comexec_BatchNext != '\x00'))
+	{
+		char *command = comexec_BatchNext;
+		char *end = strchr(command, ';');
+
+		if(end != NULL)
+		{
+			*end = '\x00';
+			comexec_BatchNext = end + 1;
+		}
+		else
+		{
+			comexec_BatchNext = command + strlen(command);
+		}
+		comexec_Run(command);
+	}
+
+	more = (comexec_BatchWait != NULL);
+	if(!more)
+	{
+		comexec_Batching = false;
+		if(comexec_BatchFailed)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "Batch stopped at command %u.\r\n", comexec_BatchCommands);
+		}
+		comexec_SendReply(!comexec_BatchFailed);
+	}
+	return more;
+}
+
+/**
+ * @brief Start recording lines from the host
+ *
+ * @param[in] Mode What the lines are recorded for.
+ */
+void comexec_RecordStart(comexec_RecordMode Mode)
+{
+	comexec_Recording = Mode;
+	comexec_RecordOverflow = false;
+	comexec_BatchLength = 0;
+	comexec_BatchText[0] = '\x00';
+	message_Write(MESSAGE_LEVEL_REQUIRED, ">>");
+}
+
+/**
+ * @brief Record a line from the host instead of executing it
+ *
+ * Empty lines are dropped and a line of just end stops the recording.
+ *
+ * @param[in] Line The line from the host.
+ */
+void comexec_RecordLine(char *Line)
+{
+	char *start = Line + strspn(Line, " \r\n");
+	unsigned int len = strcspn(start, "\r\n");
+
+	while((len > 0) && (start[len - 1] == ' '))
+	{
+		--len;
+	}
+
+	if((len == 3) && (strncmp(start, "end", 3) == 0))
+	{
+		comexec_RecordEnd(comexec_Recording);
+	}
+	else
+	{
+		if(len > 0)
+		{
+			if((comexec_BatchLength + len + 1) <= COMEXEC_BATCH_LENGTH)
+			{
+				memcpy(&comexec_BatchText[comexec_BatchLength], start, len);
+				comexec_BatchLength += len;
+				comexec_BatchText[comexec_BatchLength++] = ';';
+				comexec_BatchText[comexec_BatchLength] = '\x00';
+			}
+			else
+			{
+				comexec_RecordOverflow = true;
+			}
+		}
+		message_Write(MESSAGE_LEVEL_REQUIRED, ">>");
+	}
+}
+
+/**
+ * @brief Stop recording and run or store what was recorded
+ *
+ * @param[in] Mode What the lines were recorded for.
+ */
+void comexec_RecordEnd(comexec_RecordMode Mode)
+{
+	bool success = !comexec_RecordOverflow;
+
+	comexec_Recording = COMEXEC_RECORD_NONE;
+	if(!success)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Too long, at most %i bytes.\r\n", COMEXEC_BATCH_LENGTH);
+	}
+	else if(Mode == COMEXEC_RECORD_MACRO)
+	{
+		success = comexec_StoreMacro();
+	}
+
+	if(success && (Mode == COMEXEC_RECORD_BATCH) && (comexec_BatchLength > 0))
+	{
+		comexec_BatchNext = comexec_BatchText;
+		comexec_BatchStart();
+	}
+	else
+	{
+		comexec_SendReply(success);
+	}
+}
+
+/**
+ * @brief Store the recorded lines as the macro being defined
+ *
+ * Nothing recorded removes the macro.
+ *
+ * @retval true The macro was stored or removed.
+ */
+bool comexec_StoreMacro()
+{
+	comexec_Macro *macro = comexec_FindMacro(comexec_RecordName);
+	//drop the separator after the last command
+	unsigned int len = (comexec_BatchLength > 0) ? comexec_BatchLength - 1 : 0;
+	bool success = false;
+
+	if(len > COMEXEC_MACRO_LENGTH)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Too long, at most %i bytes.\r\n", COMEXEC_MACRO_LENGTH);
+	}
+	else if(len == 0)
+	{
+		if(macro != NULL)
+		{
+			macro->name[0] = '\x00';
+		}
+		success = true;
+	}
+	else
+	{
+		if(macro == NULL)
+		{
+			//an unused entry has no name
+			macro = comexec_FindMacro("");
+		}
+
+		if(macro != NULL)
+		{
+			strcpy(macro->name, comexec_RecordName);
+			memcpy(macro->text, comexec_BatchText, len);
+			macro->text[len] = '\x00';
+			success = true;
+		}
+		else
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "No room for another macro, at most %i.\r\n", COMEXEC_MACROS_MAX);
+		}
+	}
+	return success;
+}
+
+/**
+ * @brief Look up a macro by name
+ *
+ * @param[in] Name The name to look for, empty to find a free entry.
+ * @returns The macro, or NULL if there isn't one.
+ */
+comexec_Macro *comexec_FindMacro(const char *Name)
+{
+	unsigned int i;
+
+	for(i = 0; i < COMEXEC_MACROS_MAX; ++i)
+	{
+		if(strcmp(comexec_Macros[i].name, Name) == 0)
+		{
+			return &comexec_Macros[i];
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Detect the chain
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdChain(const comdisp_Args *Args)
+{
+	comexec_Chain();
+}
+
+/**
+ * @brief Select a device on the chain
+ *
+ * @param[in] Args The device.
+ */
+void comexec_CmdSelect(const comdisp_Args *Args)
+{
+	comexec_Select(Args->values[0]);
+}
+
+/**
+ * @brief Scan an instruction into the selected device
+ *
+ * @param[in] Args The hex instruction.
+ */
+void comexec_CmdIR(const comdisp_Args *Args)
+{
+	comexec_IR(Args->values[0]);
+}
+
+/**
+ * @brief Scan a data register of the selected device
+ *
+ * The value is checked by @ref comexec_DR, as it can be longer than 32 bits.
+ *
+ * @param[in] Args The length and optional hex value.
+ */
+void comexec_CmdDR(const comdisp_Args *Args)
+{
+	comexec_DR(Args->values[0], (Args->count > 1) ? Args->tokens[1] : NULL);
+}
+
+/**
+ * @brief Start a scan
+ *
+ * @param[in] Args The number of pins, mode and time budget.
+ */
+void comexec_CmdScan(const comdisp_Args *Args)
+{
+	if(knock_IsRunning())
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Scan running, use scan status or scan abort.\r\n");
+		comexec_SendReply(false);
+	}
+	else
+	{
+		comexec_ScanForJTAG(Args->values[0], Args->values[1], Args->values[2]);
+	}
+}
+
+/**
+ * @brief Display the scan progress
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdScanStatus(const comdisp_Args *Args)
+{
+	comexec_ScanStatus();
+}
+
+/**
+ * @brief Pause the running scan
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdScanAbort(const comdisp_Args *Args)
+{
+	comexec_ScanAbort();
+}
+
+/**
+ * @brief Carry on with a paused scan
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdScanResume(const comdisp_Args *Args)
+{
+	comexec_ScanResume();
+}
+
+/**
+ * @brief Try the stored pinouts
+ *
+ * @param[in] Args The number of pins, mode and time budget of the fallback scan.
+ */
+void comexec_CmdScanRecall(const comdisp_Args *Args)
+{
+	if(knock_IsRunning())
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Scan running, use scan status or scan abort.\r\n");
+		comexec_SendReply(false);
+	}
+	else
+	{
+		comexec_Recall(Args->values[0], Args->values[1], Args->values[2]);
+	}
+}
+
+/**
+ * @brief Display the configuration or configure a signal
+ *
+ * @param[in] Args The optional signal and pin.
+ */
+void comexec_CmdConfig(const comdisp_Args *Args)
+{
+	if(Args->count == 0)
+	{
+		comexec_Config();
+	}
+	else
+	{
+		comexec_SignalConfig(Args->values[0], (int)Args->values[1]);
+	}
+}
+
+/**
+ * @brief Set or display the JTAG clock
+ *
+ * @param[in] Args The optional rate in kHz, or adaptive.
+ */
+void comexec_CmdConfigClock(const comdisp_Args *Args)
+{
+	uint32_t rate = 0;
+	bool adaptive = false;
+	bool success = true;
+
+	if(Args->count > 0)
+	{
+		if(strcmp(Args->tokens[0], "adaptive") == 0)
+		{
+			adaptive = true;
+		}
+		else
+		{
+			success = comdisp_Number(Args->tokens[0], 10, &rate) && (rate != 0);
+		}
+	}
+
+	if(success)
+	{
+		comexec_ClockConfig(rate, adaptive);
+	}
+	else
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "rate needs to be a number.\r\n");
+		comexec_SendReply(false);
+	}
+}
+
+/**
+ * @brief Display the gang targets or configure one
+ *
+ * A tdi of 0 removes the target, so tdo can then be left out.
+ *
+ * @param[in] Args The optional target, tdi and tdo.
+ */
+void comexec_CmdGang(const comdisp_Args *Args)
+{
+	if(Args->count == 0)
+	{
+		comexec_Gang();
+	}
+	else if((Args->count == 1) || ((Args->values[1] != 0) && (Args->count < 3)))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "missing parameter %s.\r\n", (Args->count == 1) ? "tdi" : "tdo");
+		comexec_SendReply(false);
+	}
+	else
+	{
+		comexec_GangConfig(Args->values[0], Args->values[1], Args->values[2]);
+	}
+}
+
+/**
+ * @brief Read the ID CODEs of the gang targets
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdGangChain(const comdisp_Args *Args)
+{
+	comexec_GangChain();
+}
+
+/**
+ * @brief Connect to a SWD target or run a batch of transfers
+ *
+ * The transfers are dp|ap r addr or dp|ap w addr value, repeated.
+ *
+ * @param[in] Args The transfers, none to connect.
+ */
+void comexec_CmdSWD(const comdisp_Args *Args)
+{
+	swd_Transfer transfers[SWD_BATCH_MAX];
+	unsigned int count = 0;
+	unsigned int i = 0;
+	bool success = true;
+
+	if(Args->count == 0)
+	{
+		comexec_SWD();
+	}
+	else
+	{
+		while(success && (i < Args->count))
+		{
+			bool ap = (strcmp(Args->tokens[i], "ap") == 0);
+			bool read = false;
+			uint32_t addr = 0;
+
+			if(count >= SWD_BATCH_MAX)
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "At most %i transfers.\r\n", SWD_BATCH_MAX);
+				success = false;
+			}
+			else if(!ap && (strcmp(Args->tokens[i], "dp") != 0))
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "Transfers start with dp or ap.\r\n");
+				success = false;
+			}
+			else if((++i >= Args->count) || ((strcmp(Args->tokens[i], "r") != 0) && (strcmp(Args->tokens[i], "w") != 0)))
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "missing r or w.\r\n");
+				success = false;
+			}
+			else
+			{
+				read = (strcmp(Args->tokens[i], "r") == 0);
+				if(++i >= Args->count)
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "missing parameter addr.\r\n");
+					success = false;
+				}
+				else
+				{
+					success = comdisp_Number(Args->tokens[i], 16, &addr) && ((addr & ~0x0CU) == 0);
+					if(!success)
+					{
+						message_Write(MESSAGE_LEVEL_GENERAL, "addr needs to be 0, 4, 8 or c.\r\n");
+					}
 				}
+			}
 
-				if(parseSuccess)
+			if(success)
+			{
+				transfers[count].request = swd_Request(ap, read, addr);
+				transfers[count].data = 0;
+				if(!read)
 				{
-					//execute the scan command
-					comexec_ScanForJTAG(pins, scanMode);
+					if(++i < Args->count)
+					{
+						success = comdisp_Number(Args->tokens[i], 16, &transfers[count].data);
+					}
+					else
+					{
+						success = false;
+					}
+					if(!success)
+					{
+						message_Write(MESSAGE_LEVEL_GENERAL, "value needs to be hex.\r\n");
+					}
 				}
+				++count;
+				++i;
 			}
-			else
+		}
+
+		if(success)
+		{
+			comexec_SWDBatch(transfers, count);
+		}
+		else
+		{
+			comexec_SendReply(false);
+		}
+	}
+}
+
+/**
+ * @brief Toggle the clock
+ *
+ * @param[in] Args The number of clocks.
+ */
+void comexec_CmdClock(const comdisp_Args *Args)
+{
+	comexec_Clock(Args->values[0]);
+}
+
+/**
+ * @brief Pulse a reset
+ *
+ * @param[in] Args The signal and optional width in us.
+ */
+void comexec_CmdPulse(const comdisp_Args *Args)
+{
+	comexec_Pulse(Args->values[0], Args->values[1]);
+}
+
+/**
+ * @brief Wait in Run/Idle
+ *
+ * @param[in] Args The number of clocks and optional time in us.
+ */
+void comexec_CmdRunTest(const comdisp_Args *Args)
+{
+	comexec_RunTest(Args->values[0], Args->values[1]);
+}
+
+/**
+ * @brief Set or display the TAP state
+ *
+ * @param[in] Args The optional state to move to.
+ */
+void comexec_CmdTAP(const comdisp_Args *Args)
+{
+	comexec_TAP(Args->values[0]);
+}
+
+/**
+ * @brief Set or display a signal
+ *
+ * The signal is the table entry's value, as every signal has its own
+ * command word.
+ *
+ * @param[in] Args The optional state.
+ */
+void comexec_CmdSignal(const comdisp_Args *Args)
+{
+	jtag_Signal sig = Args->command->value;
+
+	if(Args->count == 0)
+	{
+		comexec_GetSignal(sig);
+	}
+	else
+	{
+		comexec_SetSignal(sig, Args->values[0] != 0);
+	}
+}
+
+/**
+ * @brief Set or display the message level
+ *
+ * @param[in] Args The optional level.
+ */
+void comexec_CmdMessage(const comdisp_Args *Args)
+{
+	comexec_MessageLevel(Args->values[0]);
+}
+
+/**
+ * @brief Set how logged messages are sent
+ *
+ * The format is the table entry's value.
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdMessageLog(const comdisp_Args *Args)
+{
+	message_SetLogFormat(Args->command->value);
+	comexec_SendReply(true);
+}
+
+/**
+ * @brief Display or reset the timing statistics
+ *
+ * Reset is the table entry's value.
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdStats(const comdisp_Args *Args)
+{
+	comexec_Stats(Args->command->value != 0);
+}
+
+/**
+ * @brief Run the benchmarks
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdBench(const comdisp_Args *Args)
+{
+	comexec_Bench();
+}
+
+/**
+ * @brief Enter data shift mode
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdShift(const comdisp_Args *Args)
+{
+	comexec_Shift();
+}
+
+/**
+ * @brief Play an SVF stream
+ *
+ * @param[in] Args The length of the stream.
+ */
+void comexec_CmdPlay(const comdisp_Args *Args)
+{
+	if(Args->values[0] > 0)
+	{
+		comexec_Play(Args->values[0]);
+	}
+	else
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "nbytes needs to be a number.\r\n");
+		comexec_SendReply(false);
+	}
+}
+
+/**
+ * @brief Enter remote_bitbang mode
+ *
+ * There's no prompt, the host takes over straight away.
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdBitbang(const comdisp_Args *Args)
+{
+	message_Write(MESSAGE_LEVEL_REQUIRED, "OK\r\n");
+	chain_Invalidate();
+	bitbang_Start();
+}
+
+/**
+ * @brief Display the list of available commands
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdHelp(const comdisp_Args *Args)
+{
+	comexec_Help();
+}
+
+/**
+ * @brief Record the following lines as a batch
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdBegin(const comdisp_Args *Args)
+{
+	comexec_RecordStart(COMEXEC_RECORD_BATCH);
+}
+
+/**
+ * @brief Record the following lines as a macro, or list the macros
+ *
+ * @param[in] Args The optional macro name.
+ */
+void comexec_CmdDefine(const comdisp_Args *Args)
+{
+	unsigned int i;
+
+	if(Args->count == 0)
+	{
+		for(i = 0; i < COMEXEC_MACROS_MAX; ++i)
+		{
+			if(comexec_Macros[i].name[0] != '\x00')
 			{
-				message_Write(MESSAGE_LEVEL_GENERAL, "npins needs to be a number.\r\n");
-				comexec_SendReply(false);
-				parseSuccess = false;
+				message_Write(MESSAGE_LEVEL_GENERAL, "%s: %s\r\n", comexec_Macros[i].name, comexec_Macros[i].text);
 			}
+		}
+		comexec_SendReply(true);
+	}
+	else if(strlen(Args->tokens[0]) > COMEXEC_MACRO_NAME_LENGTH)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "name must be at most %i characters.\r\n", COMEXEC_MACRO_NAME_LENGTH);
+		comexec_SendReply(false);
+	}
+	else
+	{
+		strcpy(comexec_RecordName, Args->tokens[0]);
+		comexec_RecordStart(COMEXEC_RECORD_MACRO);
+	}
+}
+
+/**
+ * @brief End without a begin or define
+ *
+ * An end while recording is picked out before the line is parsed.
+ *
+ * @param[in] Args No parameters.
+ */
+void comexec_CmdEnd(const comdisp_Args *Args)
+{
+	message_Write(MESSAGE_LEVEL_GENERAL, "No begin or define to end.\r\n");
+	comexec_SendReply(false);
+}
+
+/**
+ * @brief Run a macro
+ *
+ * Within a batch the macro's commands are run in place of the run command.
+ *
+ * @param[in] Args The macro name.
+ */
+void comexec_CmdRun(const comdisp_Args *Args)
+{
+	comexec_Macro *macro = comexec_FindMacro(Args->tokens[0]);
+	bool success = false;
+
+	if(macro == NULL)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "No such macro.\r\n");
+		comexec_SendReply(false);
+	}
+	else if(comexec_Batching)
+	{
+		if(++comexec_BatchRuns > COMEXEC_BATCH_RUNS_MAX)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "At most %i runs in a batch.\r\n", COMEXEC_BATCH_RUNS_MAX);
+		}
+		else
+		{
+			success = comexec_BatchAdd(macro->text);
+		}
+		comexec_SendReply(success);
+	}
+	else
+	{
+		comexec_BatchText[0] = '\x00';
+		comexec_BatchNext = comexec_BatchText;
+		if(comexec_BatchAdd(macro->text))
+		{
+			comexec_BatchStart();
+		}
+		else
+		{
+			comexec_SendReply(false);
+		}
+	}
+}
+
+/**
+ * @brief Words following scan. Keep sorted.
+ */
+static const comdisp_Command comexec_ScanCommands[] =
+{
+	{ .name = "abort", .handler = comexec_CmdScanAbort },
+	{ .name = "recall", .handler = comexec_CmdScanRecall, .params = { COMDISP_DEC("npins", 0), COMDISP_KEYWORD("mode", comexec_ModeNames, KNOCK_MODE_RESET), COMDISP_DEC("seconds", 0) } },
+	{ .name = "resume", .handler = comexec_CmdScanResume },
+	{ .name = "status", .handler = comexec_CmdScanStatus },
+};
+
+/**
+ * @brief Words following config. Keep sorted.
+ */
+static const comdisp_Command comexec_ConfigCommands[] =
+{
+	{ .name = "clock", .handler = comexec_CmdConfigClock, .params = { COMDISP_TEXT("rate") } },
+};
+
+/**
+ * @brief Words following gang. Keep sorted.
+ */
+static const comdisp_Command comexec_GangCommands[] =
+{
+	{ .name = "chain", .handler = comexec_CmdGangChain },
+};
+
+/**
+ * @brief Words following swd. Keep sorted.
+ */
+static const comdisp_Command comexec_SWDCommands[] =
+{
+	{ .name = "connect", .handler = comexec_CmdSWD },
+};
+
+/**
+ * @brief Words following message. Keep sorted.
+ */
+static const comdisp_Command comexec_MessageCommands[] =
+{
+	{ .name = "binary", .handler = comexec_CmdMessageLog, .value = MESSAGE_LOG_BINARY },
+	{ .name = "text", .handler = comexec_CmdMessageLog, .value = MESSAGE_LOG_TEXT },
+};
+
+/**
+ * @brief Words following stats. Keep sorted.
+ */
+static const comdisp_Command comexec_StatsCommands[] =
+{
+	{ .name = "reset", .handler = comexec_CmdStats, .value = true },
+};
+
+/**
+ * @brief The commands, looked up by their first word. Keep sorted.
+ */
+static const comdisp_Command comexec_Commands[] =
+{
+	{ .name = "begin", .handler = comexec_CmdBegin, .flags = COMDISP_FLAG_HOST },
+	{ .name = "bench", .handler = comexec_CmdBench },
+	{ .name = "bitbang", .handler = comexec_CmdBitbang, .flags = COMDISP_FLAG_HOST },
+	{ .name = "chain", .handler = comexec_CmdChain },
+	{ .name = "clock", .handler = comexec_CmdClock, .required = 1, .params = { COMDISP_DEC("n", 0) } },
+	{ .name = "config", .handler = comexec_CmdConfig, .subcommands = comexec_ConfigCommands, .nsubcommands = COMDISP_ENTRIES(comexec_ConfigCommands),
+		.params = { COMDISP_KEYWORD("signal", jtag_SignalNames, JTAG_SIGNAL_MAX), COMDISP_DEC("pin", -1) } },
+	{ .name = "define", .handler = comexec_CmdDefine, .flags = COMDISP_FLAG_HOST, .params = { COMDISP_TEXT("name") } },
+	{ .name = "dr", .handler = comexec_CmdDR, .required = 1, .params = { COMDISP_DEC("nbits", 0), COMDISP_TEXT("value") } },
+	{ .name = "end", .handler = comexec_CmdEnd, .flags = COMDISP_FLAG_HOST },
+	{ .name = "gang", .handler = comexec_CmdGang, .subcommands = comexec_GangCommands, .nsubcommands = COMDISP_ENTRIES(comexec_GangCommands),
+		.params = { COMDISP_DEC("target", 0), COMDISP_DEC("tdi", 0), COMDISP_DEC("tdo", 0) } },
+	{ .name = "help", .handler = comexec_CmdHelp },
+	{ .name = "ir", .handler = comexec_CmdIR, .required = 1, .params = { COMDISP_HEX("value", 0) } },
+	{ .name = "message", .handler = comexec_CmdMessage, .subcommands = comexec_MessageCommands, .nsubcommands = COMDISP_ENTRIES(comexec_MessageCommands), .params = { COMDISP_DEC("level", MESSAGE_LEVEL_MAX) } },
+	{ .name = "play", .handler = comexec_CmdPlay, .flags = COMDISP_FLAG_HOST, .required = 1, .params = { COMDISP_DEC("nbytes", 0) } },
+	{ .name = "pulse", .handler = comexec_CmdPulse, .required = 1, .params = { COMDISP_KEYWORD("signal", jtag_SignalNames, JTAG_SIGNAL_MAX), COMDISP_DEC("us", 0) } },
+	{ .name = "rtck", .handler = comexec_CmdSignal, .value = JTAG_SIGNAL_RTCK, .params = { COMDISP_KEYWORD("state", comexec_LevelNames, 0) } },
+	{ .name = "run", .handler = comexec_CmdRun, .required = 1, .params = { COMDISP_TEXT("name") } },
+	{ .name = "runtest", .handler = comexec_CmdRunTest, .required = 1, .params = { COMDISP_DEC("n", 0), COMDISP_DEC("us", 0) } },
+	{ .name = "scan", .handler = comexec_CmdScan, .subcommands = comexec_ScanCommands, .nsubcommands = COMDISP_ENTRIES(comexec_ScanCommands), .required = 1, .flags = COMDISP_FLAG_SCAN,
+		.params = { COMDISP_DEC("npins", 0), COMDISP_KEYWORD("mode", comexec_ModeNames, KNOCK_MODE_RESET), COMDISP_DEC("seconds", 0) } },
+	{ .name = "select", .handler = comexec_CmdSelect, .required = 1, .params = { COMDISP_DEC("device", 0) } },
+	{ .name = "shift", .handler = comexec_CmdShift, .flags = COMDISP_FLAG_HOST },
+	{ .name = "srst", .handler = comexec_CmdSignal, .value = JTAG_SIGNAL_SRST, .params = { COMDISP_KEYWORD("state", comexec_LevelNames, 0) } },
+	{ .name = "stats", .handler = comexec_CmdStats, .subcommands = comexec_StatsCommands, .nsubcommands = COMDISP_ENTRIES(comexec_StatsCommands) },
+	{ .name = "swd", .handler = comexec_CmdSWD, .subcommands = comexec_SWDCommands, .nsubcommands = COMDISP_ENTRIES(comexec_SWDCommands), .flags = COMDISP_FLAG_MORE },
+	{ .name = "tap", .handler = comexec_CmdTAP, .params = { COMDISP_KEYWORD("state", comexec_TAPNames, JTAGTAP_STATE_MAX) } },
+	{ .name = "tck", .handler = comexec_CmdSignal, .value = JTAG_SIGNAL_TCK, .params = { COMDISP_KEYWORD("state", comexec_LevelNames, 0) } },
+	{ .name = "tdi", .handler = comexec_CmdSignal, .value = JTAG_SIGNAL_TDI, .params = { COMDISP_KEYWORD("state", comexec_LevelNames, 0) } },
+	{ .name = "tdo", .handler = comexec_CmdSignal, .value = JTAG_SIGNAL_TDO, .params = { COMDISP_KEYWORD("state", comexec_LevelNames, 0) } },
+	{ .name = "tms", .handler = comexec_CmdSignal, .value = JTAG_SIGNAL_TMS, .params = { COMDISP_KEYWORD("state", comexec_LevelNames, 0) } },
+	{ .name = "trst", .handler = comexec_CmdSignal, .value = JTAG_SIGNAL_TRST, .params = { COMDISP_KEYWORD("state", comexec_LevelNames, 0) } },
+};
+
+/**
+ * @brief Display the list of available commands
+ *
+ */
+void comexec_Help()
+{
+	unsigned int i;
+
+	message_Write(MESSAGE_LEVEL_GENERAL, "Valid Commands:\r\n");
+	for(i = 0; i < COMDISP_ENTRIES(comexec_Commands); ++i)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, " %s", comexec_Commands[i].name);
+	}
+	message_Write(MESSAGE_LEVEL_GENERAL, "\r\n");
+	comexec_SendReply(true);
+}
 
+/**
+ * @brief Execute the given command
+ *
+ * A line with ';' in it is run as a batch, one command after another with
+ * a single reply. While a begin or define is recording, lines are stored
+ * instead of being executed.
+ *
+ * @param[in] Buffer The command to execute in string format
+ */
+void comexec_Execute(char *Buffer)
+{
+	if(comexec_Recording != COMEXEC_RECORD_NONE)
+	{
+		comexec_RecordLine(Buffer);
+	}
+	else if(strchr(Buffer, ';') != NULL)
+	{
+		comexec_BatchText[0] = '\x00';
+		comexec_BatchNext = comexec_BatchText;
+		if(comexec_BatchAdd(Buffer))
+		{
+			comexec_BatchStart();
 		}
 		else
 		{
-			message_Write(MESSAGE_LEVEL_GENERAL, "missing parameter npins.\r\n");
 			comexec_SendReply(false);
 		}
 	}
+	else
+	{
+		comexec_Run(Buffer);
+	}
+}
+
+/**
+ * @brief Run a single command
+ *
+ * The line is split in place and the first word looked up in
+ * @ref comexec_Commands. The parameters are checked against the table
+ * entry before its handler is called, so the handlers get them already
+ * converted.
+ *
+ * @param[in] Command The command and its parameters.
+ */
+void comexec_Run(char *Command)
+{
+	static char *tokens[COMEXEC_TOKENS_MAX];
+	static comdisp_Args args;
+	const comdisp_Command *command = NULL;
+	unsigned int count = comdisp_Tokenize(Command, tokens, COMEXEC_TOKENS_MAX);
+
+	if(count > 0)
+	{
+		command = comdisp_Find(comexec_Commands, COMDISP_ENTRIES(comexec_Commands), tokens[0]);
+		if(comexec_Batching)
+		{
+			++comexec_BatchCommands;
+		}
+	}
+
+	if(count == 0)
+	{
+		if(!comexec_Batching)
+		{
+			//empty line, just issue a new prompt
+			message_Write(MESSAGE_LEVEL_REQUIRED, "> ");
+		}
+	}
+	else if(command == NULL)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "Invalid command\r\n");
+		comexec_SendReply(false);
+	}
+	else if(knock_IsRunning() && ((command->flags & COMDISP_FLAG_SCAN) == 0))
+	{
+		//the scan owns the signals until it finishes or is stopped
+		message_Write(MESSAGE_LEVEL_GENERAL, "Scan running, use scan status or scan abort.\r\n");
+		comexec_SendReply(false);
+	}
+	else if(comexec_Batching && ((command->flags & COMDISP_FLAG_HOST) != 0))
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "%s can't be batched.\r\n", command->name);
+		comexec_SendReply(false);
+	}
+	else if(count > COMEXEC_TOKENS_MAX)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "too many parameters.\r\n");
+		comexec_SendReply(false);
+	}
+	else if(comdisp_Parse(command, &tokens[1], count - 1, &args))
+	{
+		args.command->handler(&args);
+	}
+	else
+	{
+		comexec_SendReply(false);
+	}
 }
@@ -16,13 +16,16 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <stddef.h>
 #include "comprocessor.h"
 #include "comexecute.h"
+#include "sched.h"
 
 #define COMPROC_BUFFER_LENGTH	(80)			///< Maximum command length supported
 
 static unsigned int comproc_BufferLength;		///< Length of the command in the buffer
 static char comproc_Buffer[COMPROC_BUFFER_LENGTH+1];	///< Command buffer
+static comproc_DataHandler comproc_Handler;		///< Receives raw data instead of the command buffer
 
 /**
  * @brief Initialize the command processor
@@ -32,6 +35,22 @@ void comproc_Init()
 {
 	//Initialize the buffer length
 	comproc_BufferLength = 0;
+	comproc_Handler = NULL;
+}
+
+/**
+ * @brief Install or remove a raw data handler
+ *
+ * Used by commands that are followed by a data stream. The handler may be
+ * installed from within a command, any remaining bytes in the current packet
+ * are passed straight to it.
+ *
+ * @param[in] handler The handler to pass incoming data to, or NULL to return
+ * to command processing.
+ */
+void comproc_SetDataHandler(comproc_DataHandler handler)
+{
+	comproc_Handler = handler;
 }
 
 /**
@@ -53,14 +72,34 @@ void comproc_Init()
  * in the buffer will be silently discarded when a terminator is finally seen
  * and normal processing will resume.
  *
+ * When a data handler is installed the bytes are handed to it untouched.
+ *
+ * If a command or the data handler starts a job, processing stops straight
+ * after it so the following data waits for the job to finish.
+ *
+ * @returns The number of bytes consumed, the rest should be passed in again.
  */
-void comproc_Process(const char * buffer, unsigned int len)
+unsigned int comproc_Process(const char * buffer, unsigned int len)
 {
 	const char *src = buffer;
 	char *dest = &comproc_Buffer[comproc_BufferLength];
 
 	while(len > 0)
 	{
+		if(comproc_Handler != NULL)
+		{
+			//hand the data straight over, no copy into the command buffer
+			unsigned int used = comproc_Handler(src, len);
+			src += used;
+			len -= used;
+			if(sched_IsBusy())
+			{
+				//the handler started a job, leave the rest until it's done
+				break;
+			}
+			continue;
+		}
+
 		if(comproc_BufferLength < COMPROC_BUFFER_LENGTH)
 		{
 			//process backspace and delete first
@@ -98,6 +137,13 @@ void comproc_Process(const char * buffer, unsigned int len)
 					//reset the index and pointer
 					comproc_BufferLength = 0;
 					dest = comproc_Buffer;
+
+					if(sched_IsBusy())
+					{
+						//leave the rest until the job is done
+						++src;
+						break;
+					}
 				}
 
 			}
@@ -118,4 +164,5 @@ void comproc_Process(const char * buffer, unsigned int len)
 		++src;
 		--len;
 	}
+	return src - buffer;
 }
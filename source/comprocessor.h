@@ -19,7 +19,17 @@
 #if !defined(_COMPROCESSOR_H_)
 #define _COMPROCESSOR_H_
 
+/**
+ * @brief Handler for raw data following a command
+ *
+ * While installed, all incoming bytes are passed to the handler instead of
+ * the command buffer. The handler returns the number of bytes it consumed,
+ * which must be at least one unless it has removed itself.
+ */
+typedef unsigned int (*comproc_DataHandler)(const char *buffer, unsigned int len);
+
 extern void comproc_Init();
-extern void comproc_Process(const char * buffer, unsigned int len);
+extern void comproc_SetDataHandler(comproc_DataHandler handler);
+extern unsigned int comproc_Process(const char * buffer, unsigned int len);
 
 #endif
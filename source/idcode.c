@@ -0,0 +1,205 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "idcode.h"
+#include <stddef.h>
+
+/**
+ * @brief A name looked up by part of an ID CODE
+ */
+typedef struct idcode_sEntry
+{
+	uint32_t key;		///< Value matched, the tables are sorted on it
+	const char *name;	///< Name to display
+} idcode_Entry;
+
+#define IDCODE_PART_KEY(manufacturer, part)	(((uint32_t)(manufacturer) << 16) | (part))	///< Key of a part table entry
+#define IDCODE_ENTRIES(table)			(sizeof(table) / sizeof(idcode_Entry))		///< Entries in a table
+
+static const idcode_Entry *idcode_Find(const idcode_Entry *table, unsigned int count, uint32_t key);
+
+/**
+ * @brief JEP106 manufacturers, by bank and code
+ *
+ * The key is bits 11:1 of the ID CODE, the continuation count then the
+ * code without its parity bit. Keep sorted.
+ */
+static const idcode_Entry idcode_Manufacturers[] =
+{
+	{ 0x001, "AMD" },
+	{ 0x004, "Fujitsu" },
+	{ 0x007, "Hitachi" },
+	{ 0x009, "Intel" },
+	{ 0x00E, "Freescale" },
+	{ 0x010, "NEC" },
+	{ 0x015, "NXP" },
+	{ 0x017, "TI" },
+	{ 0x018, "Toshiba" },
+	{ 0x01F, "Atmel" },
+	{ 0x020, "ST" },
+	{ 0x021, "Lattice" },
+	{ 0x029, "Microchip" },
+	{ 0x02C, "Micron" },
+	{ 0x034, "Cypress" },
+	{ 0x041, "Infineon" },
+	{ 0x042, "Macronix" },
+	{ 0x049, "Xilinx" },
+	{ 0x04E, "Samsung" },
+	{ 0x065, "Analog Devices" },
+	{ 0x06E, "Altera" },
+	{ 0x070, "Qualcomm" },
+	{ 0x0BF, "Broadcom" },
+	{ 0x23B, "ARM" },
+	{ 0x489, "SiFive" },
+};
+
+/**
+ * @brief Common parts, by manufacturer and part number
+ *
+ * The version field is ignored, so parts that only differ by it share an
+ * entry. Keep sorted.
+ */
+static const idcode_Entry idcode_Parts[] =
+{
+	{ IDCODE_PART_KEY(0x01F, 0x9403), "ATmega16" },
+	{ IDCODE_PART_KEY(0x01F, 0x9502), "ATmega32" },
+	{ IDCODE_PART_KEY(0x01F, 0x9602), "ATmega64" },
+	{ IDCODE_PART_KEY(0x01F, 0x9702), "ATmega128" },
+	{ IDCODE_PART_KEY(0x01F, 0x9704), "ATmega1281" },
+	{ IDCODE_PART_KEY(0x01F, 0x9781), "AT90CAN128" },
+	{ IDCODE_PART_KEY(0x01F, 0x9801), "ATmega2560" },
+	{ IDCODE_PART_KEY(0x020, 0x6410), "STM32F10x medium density" },
+	{ IDCODE_PART_KEY(0x020, 0x6411), "STM32F2xx" },
+	{ IDCODE_PART_KEY(0x020, 0x6412), "STM32F10x low density" },
+	{ IDCODE_PART_KEY(0x020, 0x6413), "STM32F405/407" },
+	{ IDCODE_PART_KEY(0x020, 0x6414), "STM32F10x high density" },
+	{ IDCODE_PART_KEY(0x020, 0x6416), "STM32L1xx" },
+	{ IDCODE_PART_KEY(0x020, 0x6418), "STM32F105/107" },
+	{ IDCODE_PART_KEY(0x020, 0x6419), "STM32F42x/43x" },
+	{ IDCODE_PART_KEY(0x020, 0x6420), "STM32F100 value line" },
+	{ IDCODE_PART_KEY(0x020, 0x6421), "STM32F446" },
+	{ IDCODE_PART_KEY(0x020, 0x6422), "STM32F30x" },
+	{ IDCODE_PART_KEY(0x020, 0x6423), "STM32F401xB/C" },
+	{ IDCODE_PART_KEY(0x020, 0x6431), "STM32F411" },
+	{ IDCODE_PART_KEY(0x020, 0x6449), "STM32F74x" },
+	{ IDCODE_PART_KEY(0x020, 0x6450), "STM32H7xx" },
+	{ IDCODE_PART_KEY(0x021, 0x1111), "LFE5U-12F/25F" },
+	{ IDCODE_PART_KEY(0x021, 0x1112), "LFE5U-45F" },
+	{ IDCODE_PART_KEY(0x021, 0x1113), "LFE5U-85F" },
+	{ IDCODE_PART_KEY(0x049, 0x1C10), "XC3S100E" },
+	{ IDCODE_PART_KEY(0x049, 0x1C1A), "XC3S250E" },
+	{ IDCODE_PART_KEY(0x049, 0x1C22), "XC3S500E" },
+	{ IDCODE_PART_KEY(0x049, 0x1C2E), "XC3S1200E" },
+	{ IDCODE_PART_KEY(0x049, 0x1C3A), "XC3S1600E" },
+	{ IDCODE_PART_KEY(0x049, 0x362C), "XC7A50T" },
+	{ IDCODE_PART_KEY(0x049, 0x362D), "XC7A35T" },
+	{ IDCODE_PART_KEY(0x049, 0x3631), "XC7A100T" },
+	{ IDCODE_PART_KEY(0x049, 0x3651), "XC7K325T" },
+	{ IDCODE_PART_KEY(0x049, 0x3722), "XC7Z010" },
+	{ IDCODE_PART_KEY(0x049, 0x3727), "XC7Z020" },
+	{ IDCODE_PART_KEY(0x049, 0x4001), "XC6SLX9" },
+	{ IDCODE_PART_KEY(0x049, 0x5045), "XCF04S" },
+	{ IDCODE_PART_KEY(0x049, 0x9604), "XC9572XL" },
+	{ IDCODE_PART_KEY(0x049, 0x9608), "XC95144XL" },
+	{ IDCODE_PART_KEY(0x06E, 0x20A1), "EPM240" },
+	{ IDCODE_PART_KEY(0x06E, 0x20A2), "EPM570" },
+	{ IDCODE_PART_KEY(0x06E, 0x20B1), "EP2C5" },
+	{ IDCODE_PART_KEY(0x06E, 0x20B2), "EP2C8" },
+	{ IDCODE_PART_KEY(0x06E, 0x20F1), "EP4CE6/10" },
+	{ IDCODE_PART_KEY(0x06E, 0x20F2), "EP4CE15" },
+	{ IDCODE_PART_KEY(0x06E, 0x20F3), "EP4CE22" },
+	{ IDCODE_PART_KEY(0x23B, 0xBA00), "JTAG-DP" },
+	{ IDCODE_PART_KEY(0x23B, 0xBA01), "SW-DP" },
+	{ IDCODE_PART_KEY(0x23B, 0xBB11), "SW-DP (Cortex-M0)" },
+	{ IDCODE_PART_KEY(0x23B, 0xBC11), "SW-DP (Cortex-M0+)" },
+	{ IDCODE_PART_KEY(0x489, 0x0E31), "FE310-G000" },
+};
+
+/**
+ * @brief Binary search a sorted table
+ *
+ * @param[in] table The table to search.
+ * @param[in] count The number of entries in table.
+ * @param[in] key The key to look for.
+ * @returns The matching entry, or NULL if there isn't one.
+ */
+static const idcode_Entry *idcode_Find(const idcode_Entry *table, unsigned int count, uint32_t key)
+{
+	unsigned int low = 0;
+	unsigned int high = count;
+
+	while(low < high)
+	{
+		unsigned int mid = low + ((high - low) / 2);
+
+		if(table[mid].key == key)
+		{
+			return &table[mid];
+		}
+		else if(table[mid].key < key)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			high = mid;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief Check if a value could be a real ID CODE
+ *
+ * The LSB is always set and the manufacturer can't be 0 or the JEP106
+ * continuation code 0x7F. All ones is what a floating or pulled up TDO reads.
+ *
+ * @param[in] idcode The value to check.
+ * @retval true The value is a plausible ID CODE.
+ */
+bool idcode_IsPlausible(uint32_t idcode)
+{
+	uint32_t manufacturer = (idcode >> 1) & 0x7F;
+
+	return ((idcode & 0x01) != 0) && (idcode != 0xFFFFFFFF) && (manufacturer != 0x00) && (manufacturer != 0x7F);
+}
+
+/**
+ * @brief Look up the manufacturer of an ID CODE
+ *
+ * @param[in] idcode The ID CODE to decode.
+ * @returns The manufacturer's name, or NULL if it isn't in the table.
+ */
+const char *idcode_Manufacturer(uint32_t idcode)
+{
+	const idcode_Entry *entry = idcode_Find(idcode_Manufacturers, IDCODE_ENTRIES(idcode_Manufacturers), IDCODE_MANUFACTURER(idcode));
+
+	return (entry != NULL) ? entry->name : NULL;
+}
+
+/**
+ * @brief Look up the part of an ID CODE
+ *
+ * @param[in] idcode The ID CODE to decode.
+ * @returns The part's name, or NULL if it isn't in the table.
+ */
+const char *idcode_Part(uint32_t idcode)
+{
+	const idcode_Entry *entry = idcode_Find(idcode_Parts, IDCODE_ENTRIES(idcode_Parts), IDCODE_PART_KEY(IDCODE_MANUFACTURER(idcode), IDCODE_PART(idcode)));
+
+	return (entry != NULL) ? entry->name : NULL;
+}
@@ -0,0 +1,31 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_IDCODE_H_)
+#define _IDCODE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define IDCODE_MANUFACTURER(idcode)	(((idcode) >> 1) & 0x07FF)	///< JEP106 bank and code, bits 11:1
+#define IDCODE_PART(idcode)		(((idcode) >> 12) & 0xFFFF)	///< Part number, bits 27:12
+
+extern bool idcode_IsPlausible(uint32_t idcode);
+extern const char *idcode_Manufacturer(uint32_t idcode);
+extern const char *idcode_Part(uint32_t idcode);
+
+#endif
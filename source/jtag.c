@@ -19,10 +19,73 @@
 #include <stdint.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/rcc.h>
+#include <libopencm3/cm3/dwt.h>
+#include <libopencm3/cm3/scs.h>
 #include "jtag.h"
+#include "jtagspi.h"
+#include "jtagtimer.h"
+#include "serial.h"
+#include "stats.h"
 
+#define JTAG_CLOCK_OVERHEAD	(6)		///< Core clocks spent toggling TCK each half period
+#define JTAG_RTCK_TIMEOUT	(72000)		///< Core clocks to wait for RTCK before giving up (~1ms)
+#define JTAG_SPI_MIN_BITS	(32)		///< Shorter shifts aren't worth setting up SPI and DMA for
+
+#define JTAG_PORT(pin)			((pin) / JTAG_PORT_PINS)		///< Index in jtag_Ports of the port a pin is on
+#define JTAG_PORT_MASK(pin)		(1UL << ((pin) % JTAG_PORT_PINS))	///< Mask of a pin in its port's registers
+#define JTAG_PORT_PINS_MASK(port)	((jtag_PinMask)0xFFFF << ((port) * JTAG_PORT_PINS))	///< The pins on a port
+#define JTAG_PORT_BITS(pins, port)	((uint32_t)((pins) >> ((port) * JTAG_PORT_PINS)) & 0xFFFF)	///< The register bits of the pins on a port
+
+//The cached port registers are accessed through these, so the host simulation can see each access
+#if !defined(JTAG_REG_WRITE)
+#define JTAG_REG_WRITE(reg, value)	(*(reg) = (value))	///< Store to a cached port register
+#endif
+#if !defined(JTAG_REG_READ)
+#define JTAG_REG_READ(reg)		(*(reg))		///< Load from a cached port register
+#endif
+
+//PA13 and PA14 are left on the SWD port for debugging, jtag_Init takes PA15, PB3 and PB4 back from the JTAG port
+#define JTAG_DEBUG_PINS		((1ULL << 13) | (1ULL << 14))	///< SWDIO and SWCLK, they can't be used as the debug port keeps them
+
+//PC0 - PC12 aren't bonded out on the 48 pin packages, build with JTAG_UNBONDED_PINS=0 for a larger one
+#if !defined(JTAG_UNBONDED_PINS)
+#define JTAG_UNBONDED_PINS	(0x1FFFULL << 32)	///< Pins that can't be used as they aren't on the package
+#endif
+
+static const uint32_t jtag_Ports[JTAG_PORTS] = { GPIOA, GPIOB, GPIOC };	///< The ports the pins are numbered across
 static int jtag_Signals[JTAG_SIGNAL_MAX];
-static unsigned int jtag_PinUsage;		///< Bit mask of the pins used for signals.
+static jtag_PinMask jtag_PinUsage;		///< Bit mask of the pins used for signals.
+static unsigned int jtag_ClockRate;		///< The requested TCK rate in kHz
+static uint32_t jtag_ClockHalfPeriod;		///< Core clocks to wait each half of a TCK period
+static bool jtag_ClockAdaptive;			///< Wait for RTCK to follow TCK instead of timing
+
+//Port registers and masks of the shifting signals, kept in step with jtag_Signals by jtag_Cfg
+static volatile uint32_t *jtag_BSRRTCK;		///< BSRR of the port TCK is on
+static uint32_t jtag_MaskTCK;			///< TCK pin mask
+static volatile uint32_t *jtag_BSRRShift;	///< BSRR of the port TMS and TDI share, NULL if they are split across ports
+static uint32_t jtag_MaskTMS;			///< TMS pin mask in jtag_BSRRShift
+static uint32_t jtag_MaskTDI;			///< TDI pin mask in jtag_BSRRShift
+static jtag_PinMask jtag_PinsTMS;		///< TMS pins, for when TMS and TDI are split across ports
+static jtag_PinMask jtag_PinsTDI;		///< TDI pins, for when TMS and TDI are split across ports
+static volatile uint32_t *jtag_IDRTDO;		///< IDR of the port TDO is on
+static uint32_t jtag_MaskTDO;			///< TDO pin mask
+static bool jtag_UseSPI;			///< The pinout and rate allow shifting by SPI1
+static jtag_PinMask jtag_Broadcast[JTAG_SIGNAL_MAX];	///< Extra pins driven along with a signal
+
+//Gang targets, shifted in lockstep with the TDI and TDO signals, which are target 0
+static int jtag_GangTDI[JTAG_GANG_MAX];		///< TDI pin of each target
+static int jtag_GangTDO[JTAG_GANG_MAX];		///< TDO pin of each target
+static jtag_PinMask jtag_GangPinsTDI;		///< TDI pins of the targets after the first, driven with TDI
+static uint32_t jtag_MaskGangTDO[JTAG_GANG_MAX];	///< TDO pin mask of each target in jtag_IDRTDO
+
+static void jtag_SetMode(jtag_PinMask pins, uint8_t mode, uint8_t cnf);
+static jtag_PinMask jtag_SignalPins(jtag_Signal sig);
+static void jtag_UpdateMasks();
+static void jtag_WriteTMSTDI(bool tms, bool tdi, bool drive_tdi);
+static bool jtag_GangOnPorts(int tdi, int tdo);
+static void jtag_ReleaseGang(unsigned int target);
+static void jtag_ShiftBits(const uint8_t *tdi, uint8_t *tdo, unsigned int first, unsigned int nbits, bool exit);
+static void jtag_ClockWait(uint32_t start, bool level);
 
 const char * const jtag_SignalNames[JTAG_SIGNAL_MAX] = {
 	[JTAG_SIGNAL_TCK] = "TCK",
@@ -44,21 +107,38 @@ void jtag_Init()
 	for(i = 0; i < JTAG_SIGNAL_MAX; ++i)
 	{
 		jtag_Signals[i] = JTAG_SIGNAL_NOT_ALLOCATED;
+		jtag_Broadcast[i] = 0;
 	}
+	for(i = 0; i < JTAG_GANG_MAX; ++i)
+	{
+		jtag_GangTDI[i] = JTAG_SIGNAL_NOT_ALLOCATED;
+		jtag_GangTDO[i] = JTAG_SIGNAL_NOT_ALLOCATED;
+	}
+
+	jtag_PinUsage = SERIAL_RESERVED_PINS | JTAG_DEBUG_PINS | JTAG_UNBONDED_PINS;	//No pins currently allocated, apart from the host link and debug port.
+	jtagSPI_Init();
+	jtagTimer_Init();
+	jtag_UpdateMasks();
 
-	jtag_PinUsage = 0;	//No pins currently allocated.
+	//TCK is timed from the cycle counter, so make sure it is running
+	SCS_DEMCR |= SCS_DEMCR_TRCENA;
+	DWT_CYCCNT = 0;
+	DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+	jtag_ClockAdaptive = false;
+	jtag_SetClockRate(JTAG_CLOCK_DEFAULT);
 
-	//set up the io ports to be all inputs, push-pull, no pullups and slow when set as outputs.
-	//outputs default to 0
-	//GPIOA_MODER = 0x00000000;
-	//GPIOA_OTYPER = 0x00000000;
-	//GPIOA_OSPEEDR = 0x00000000;
-	GPIOA_CRL = 0x00000000;
-	GPIOA_CRH = 0x00000000;
-	//GPIOA_PUPDR = 0x00000000;
-	GPIOA_BSRR = 0xFFFF0000;
-	
 	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_GPIOB);
+	rcc_periph_clock_enable(RCC_GPIOC);
+
+	//after reset the SWJ debug port holds PA13 - PA15, PB3 and PB4 whatever the GPIO registers say, keep only SWD
+	rcc_periph_clock_enable(RCC_AFIO);
+	gpio_primary_remap(AFIO_MAPR_SWJ_CFG_JTAG_OFF_SW_ON, 0);
+
+	//set up the free pins to be floating inputs, push-pull and slow when set as outputs.
+	//outputs default to 0, the host link pins are left alone
+	jtag_SetMode(jtag_GetFreePins(), GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT);
+	jtag_WritePins(0, jtag_GetFreePins());
 
 	//assign the default signal allocation
 	jtag_Cfg(JTAG_SIGNAL_TCK, 0);
@@ -70,8 +150,9 @@ void jtag_Init()
 /**
  * @brief Sets a JTAG signal to a STM32 pin number
  *
- * The supported pin numbers are from 0 - 15 and correspond to PD0 - PD15
- * Respectively.
+ * The supported pin numbers are from 0 - 47, 0 - 15 are PA0 - PA15, 16 - 31
+ * are PB0 - PB15 and 32 - 47 are PC0 - PC15. Pins taken by the host link or
+ * the SWD port, or not on the package, can't be used.
  *
  * @param[in] sig The JTAG signal to configure.
  * @param[in] num The pin number the signal is connected to, or
@@ -83,27 +164,26 @@ bool jtag_Cfg(jtag_Signal sig, int num)
 	bool success = false;
 	if((sig >= JTAG_SIGNAL_TCK) && (sig < JTAG_SIGNAL_MAX))
 	{
-		unsigned int mask_and, mask_or;
 		if(num < JTAG_PIN_MAX)
 		{
 			if(num != JTAG_SIGNAL_NOT_ALLOCATED)
 			{
 				//is the pin being requested currently free?
-				if((jtag_PinUsage & (1 << num)) == 0)
+				if((jtag_PinUsage & JTAG_PIN(num)) == 0)
 				{
 					//Deconfigure the old pin if allocated
 					if(jtag_Signals[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
 					{
 						unsigned int old_sig = jtag_Signals[sig];
-						gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT,  (1 << old_sig));
-						jtag_PinUsage &= ~(1<<old_sig);	//mark as un-allocated
+						jtag_SetMode(JTAG_PIN(old_sig), GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT);
+						jtag_PinUsage &= ~JTAG_PIN(old_sig);	//mark as un-allocated
 					}
 
-					//Configure the IO port mode
-					int mode = ((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK)) ? GPIO_MODE_OUTPUT_10_MHZ : GPIO_MODE_INPUT;
-					int cnf = ((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK)) ? GPIO_CNF_OUTPUT_PUSHPULL : GPIO_CNF_INPUT_FLOAT;
-					gpio_set_mode(GPIOA, mode, cnf,  (1 << jtag_Signals[sig]));
-					jtag_PinUsage |= (1<<num);
+					//Configure the IO port mode, TDO and RTCK are the only inputs
+					int mode = ((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK)) ? GPIO_MODE_INPUT : GPIO_MODE_OUTPUT_10_MHZ;
+					int cnf = ((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK)) ? GPIO_CNF_INPUT_FLOAT : GPIO_CNF_OUTPUT_PUSHPULL;
+					jtag_SetMode(JTAG_PIN(num), mode, cnf);
+					jtag_PinUsage |= JTAG_PIN(num);
 					jtag_Signals[sig] = num;	//set the allocation
 					success = true;
 				}
@@ -114,18 +194,345 @@ bool jtag_Cfg(jtag_Signal sig, int num)
 				unsigned int old_sig = jtag_Signals[sig];
 				if(old_sig != JTAG_SIGNAL_NOT_ALLOCATED)
 				{
-					gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT,  (1 << old_sig));
-					jtag_PinUsage &= ~(1<<jtag_Signals[sig]);	//mark as un-allocated
+					jtag_SetMode(JTAG_PIN(old_sig), GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT);
+					jtag_PinUsage &= ~JTAG_PIN(old_sig);	//mark as un-allocated
 				}
 				jtag_Signals[sig] = num;	//set the allocation
 				success = true;
+
+				if(sig == JTAG_SIGNAL_RTCK)
+				{
+					jtag_ClockAdaptive = false;	//nothing to wait on anymore
+				}
 			}
 
 		}
 	}
+
+	//the gang targets have to stay on the ports of TDI and TDO
+	if(success && ((sig == JTAG_SIGNAL_TDI) || (sig == JTAG_SIGNAL_TDO)))
+	{
+		unsigned int target;
+
+		for(target = 1; target < JTAG_GANG_MAX; ++target)
+		{
+			if((jtag_GangTDI[target] != JTAG_SIGNAL_NOT_ALLOCATED) && !jtag_GangOnPorts(jtag_GangTDI[target], jtag_GangTDO[target]))
+			{
+				jtag_ReleaseGang(target);
+			}
+		}
+	}
+
+	if(success)
+	{
+		jtag_UpdateMasks();
+	}
 	return success;
 }
 
+/**
+ * @brief Add or remove a target that is shifted in lockstep with the first
+ *
+ * Gang targets share TCK, TMS and the resets and are all shifted the same
+ * TDI data. Their TDI pins have to be on the same port as the TDI signal and
+ * their TDO pins on the same port as TDO, so one BSRR write drives every TDI
+ * and one IDR read samples every TDO. Moving TDI or TDO to another port
+ * releases the targets left behind.
+ *
+ * @param[in] target The target to configure, 1 to JTAG_GANG_MAX - 1. Target
+ * 0 is the TDI and TDO signals.
+ * @param[in] tdi The pin the target's TDI is on, or JTAG_SIGNAL_NOT_ALLOCATED
+ * to remove the target.
+ * @param[in] tdo The pin the target's TDO is on, ignored when removing.
+ * @returns true if configuration suceeded, false if a pin was in use or on
+ * the wrong port.
+ */
+bool jtag_CfgGang(unsigned int target, int tdi, int tdo)
+{
+	bool success = false;
+
+	if((target > 0) && (target < JTAG_GANG_MAX))
+	{
+		if(tdi == JTAG_SIGNAL_NOT_ALLOCATED)
+		{
+			jtag_ReleaseGang(target);
+			success = true;
+		}
+		else if((tdi >= 0) && (tdi < JTAG_PIN_MAX) && (tdo >= 0) && (tdo < JTAG_PIN_MAX) && (tdi != tdo) && jtag_GangOnPorts(tdi, tdo))
+		{
+			jtag_PinMask pins = JTAG_PIN(tdi) | JTAG_PIN(tdo);
+			jtag_PinMask old = 0;
+
+			if(jtag_GangTDI[target] != JTAG_SIGNAL_NOT_ALLOCATED)
+			{
+				old = JTAG_PIN(jtag_GangTDI[target]) | JTAG_PIN(jtag_GangTDO[target]);
+			}
+
+			//is the pair free, apart from the pins the target already has?
+			if(((jtag_PinUsage & ~old) & pins) == 0)
+			{
+				jtag_ReleaseGang(target);
+				jtag_SetMode(JTAG_PIN(tdi), GPIO_MODE_OUTPUT_10_MHZ, GPIO_CNF_OUTPUT_PUSHPULL);
+				jtag_SetMode(JTAG_PIN(tdo), GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT);
+				jtag_PinUsage |= pins;
+				jtag_GangTDI[target] = tdi;
+				jtag_GangTDO[target] = tdo;
+				success = true;
+			}
+		}
+	}
+
+	if(success)
+	{
+		jtag_UpdateMasks();
+	}
+	return success;
+}
+
+/**
+ * @brief Return the configuration of a gang target
+ *
+ * @param[in] target The target, 0 returns the TDI and TDO signals.
+ * @param[out] tdi The pin the target's TDI is on.
+ * @param[out] tdo The pin the target's TDO is on.
+ * @retval true The target is configured.
+ */
+bool jtag_GetGangCfg(unsigned int target, int *tdi, int *tdo)
+{
+	bool retval = false;
+
+	if(target == 0)
+	{
+		*tdi = jtag_Signals[JTAG_SIGNAL_TDI];
+		*tdo = jtag_Signals[JTAG_SIGNAL_TDO];
+		retval = (*tdi != JTAG_SIGNAL_NOT_ALLOCATED) && (*tdo != JTAG_SIGNAL_NOT_ALLOCATED);
+	}
+	else if(target < JTAG_GANG_MAX)
+	{
+		*tdi = jtag_GangTDI[target];
+		*tdo = jtag_GangTDO[target];
+		retval = (*tdi != JTAG_SIGNAL_NOT_ALLOCATED);
+	}
+	return retval;
+}
+
+/**
+ * @brief Check a gang target's pins share ports with TDI and TDO
+ *
+ * @param[in] tdi The pin for the target's TDI.
+ * @param[in] tdo The pin for the target's TDO.
+ * @retval true TDI and TDO are allocated and on the same ports as the pins.
+ */
+static bool jtag_GangOnPorts(int tdi, int tdo)
+{
+	return (jtag_Signals[JTAG_SIGNAL_TDI] != JTAG_SIGNAL_NOT_ALLOCATED) && (jtag_Signals[JTAG_SIGNAL_TDO] != JTAG_SIGNAL_NOT_ALLOCATED) &&
+		(JTAG_PORT(tdi) == JTAG_PORT(jtag_Signals[JTAG_SIGNAL_TDI])) && (JTAG_PORT(tdo) == JTAG_PORT(jtag_Signals[JTAG_SIGNAL_TDO]));
+}
+
+/**
+ * @brief Free a gang target's pins
+ *
+ * The masks aren't updated, that is left to the caller.
+ *
+ * @param[in] target The target to release, 1 to JTAG_GANG_MAX - 1.
+ */
+static void jtag_ReleaseGang(unsigned int target)
+{
+	if(jtag_GangTDI[target] != JTAG_SIGNAL_NOT_ALLOCATED)
+	{
+		jtag_PinMask pins = JTAG_PIN(jtag_GangTDI[target]) | JTAG_PIN(jtag_GangTDO[target]);
+
+		jtag_SetMode(pins, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT);
+		jtag_PinUsage &= ~pins;
+		jtag_GangTDI[target] = JTAG_SIGNAL_NOT_ALLOCATED;
+		jtag_GangTDO[target] = JTAG_SIGNAL_NOT_ALLOCATED;
+	}
+}
+
+/**
+ * @brief Drive a signal on a group of pins
+ *
+ * The pins in mask are driven with the signal as well as its assigned pin,
+ * if any. Used when scanning to try many pins as a signal at once. Only TMS
+ * and TDI can be broadcast.
+ *
+ * @param[in] sig The signal to broadcast, JTAG_SIGNAL_TMS or JTAG_SIGNAL_TDI.
+ * @param[in] mask The pins to drive, 0 stops the broadcast.
+ * @returns true if configuration suceeded, false if a pin was in use.
+ */
+bool jtag_CfgBroadcast(jtag_Signal sig, jtag_PinMask mask)
+{
+	bool success = false;
+
+	if((sig == JTAG_SIGNAL_TMS) || (sig == JTAG_SIGNAL_TDI))
+	{
+		//the pins can only be used by this broadcast
+		if(((jtag_PinUsage & ~jtag_Broadcast[sig]) & mask) == 0)
+		{
+			if(jtag_Broadcast[sig] != 0)
+			{
+				jtag_SetMode(jtag_Broadcast[sig], GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT);
+				jtag_PinUsage &= ~jtag_Broadcast[sig];
+			}
+			if(mask != 0)
+			{
+				jtag_SetMode(mask, GPIO_MODE_OUTPUT_10_MHZ, GPIO_CNF_OUTPUT_PUSHPULL);
+				jtag_PinUsage |= mask;
+			}
+			jtag_Broadcast[sig] = mask;
+			jtag_UpdateMasks();
+			success = true;
+		}
+	}
+	return success;
+}
+
+/**
+ * @brief Get the pins that aren't in use
+ *
+ * @returns A bit mask of the pins that can be assigned to a signal.
+ */
+jtag_PinMask jtag_GetFreePins()
+{
+	return ~jtag_PinUsage & (JTAG_PIN(JTAG_PIN_MAX) - 1);
+}
+
+/**
+ * @brief Sample every pin
+ *
+ * Each port's input register is read once, back to back, so scanning many
+ * pins costs no more than scanning a few.
+ *
+ * @returns The state of all the pins.
+ */
+jtag_PinMask jtag_Sample()
+{
+	const uint32_t a = GPIOA_IDR;
+	const uint32_t b = GPIOB_IDR;
+	const uint32_t c = GPIOC_IDR;
+
+	return (a & 0xFFFF) | ((jtag_PinMask)(b & 0xFFFF) << 16) | ((jtag_PinMask)(c & 0xFFFF) << 32);
+}
+
+/**
+ * @brief Set and reset a group of pins
+ *
+ * One BSRR write is made for each port with pins to change. Pins in both
+ * masks are set.
+ *
+ * @param[in] set A bit mask of the pins to drive high.
+ * @param[in] reset A bit mask of the pins to drive low.
+ */
+void jtag_WritePins(jtag_PinMask set, jtag_PinMask reset)
+{
+	unsigned int port;
+
+	for(port = 0; port < JTAG_PORTS; ++port)
+	{
+		uint32_t bsrr = JTAG_PORT_BITS(set, port) | (JTAG_PORT_BITS(reset, port) << 16);
+
+		if(bsrr != 0)
+		{
+			GPIO_BSRR(jtag_Ports[port]) = bsrr;
+		}
+	}
+}
+
+/**
+ * @brief Set the mode of a group of pins, across ports
+ *
+ * @param[in] pins A bit mask of the pins to set up.
+ * @param[in] mode The GPIO mode, as for gpio_set_mode.
+ * @param[in] cnf The GPIO configuration, as for gpio_set_mode.
+ */
+static void jtag_SetMode(jtag_PinMask pins, uint8_t mode, uint8_t cnf)
+{
+	unsigned int port;
+
+	for(port = 0; port < JTAG_PORTS; ++port)
+	{
+		if(JTAG_PORT_BITS(pins, port) != 0)
+		{
+			gpio_set_mode(jtag_Ports[port], mode, cnf, JTAG_PORT_BITS(pins, port));
+		}
+	}
+}
+
+/**
+ * @brief Get the pins a signal is driven on
+ *
+ * TDI is driven on the gang targets' TDI pins as well.
+ *
+ * @param[in] sig The signal.
+ * @returns A bit mask of the signal's pin and any it is broadcast on.
+ */
+static jtag_PinMask jtag_SignalPins(jtag_Signal sig)
+{
+	jtag_PinMask pins = jtag_Broadcast[sig];
+
+	if(sig == JTAG_SIGNAL_TDI)
+	{
+		pins |= jtag_GangPinsTDI;
+	}
+
+	if(jtag_Signals[sig] != JTAG_SIGNAL_NOT_ALLOCATED)
+	{
+		pins |= JTAG_PIN(jtag_Signals[sig]);
+	}
+	return pins;
+}
+
+/**
+ * @brief Cache the port registers and masks for the shifting signals
+ *
+ * Unallocated signals get a mask of 0, so writing them to BSRR has no effect
+ * and the hot paths don't need to check the allocation. When TMS and TDI,
+ * along with their broadcasts, are all on one port they are updated with a
+ * single BSRR write.
+ */
+static void jtag_UpdateMasks()
+{
+	const int tck = jtag_Signals[JTAG_SIGNAL_TCK];
+	const int tdo = jtag_Signals[JTAG_SIGNAL_TDO];
+	unsigned int port;
+	unsigned int target;
+
+	jtag_BSRRTCK = &GPIO_BSRR(jtag_Ports[(tck != JTAG_SIGNAL_NOT_ALLOCATED) ? JTAG_PORT(tck) : 0]);
+	jtag_MaskTCK = (tck != JTAG_SIGNAL_NOT_ALLOCATED) ? JTAG_PORT_MASK(tck) : 0;
+	jtag_IDRTDO = &GPIO_IDR(jtag_Ports[(tdo != JTAG_SIGNAL_NOT_ALLOCATED) ? JTAG_PORT(tdo) : 0]);
+	jtag_MaskTDO = (tdo != JTAG_SIGNAL_NOT_ALLOCATED) ? JTAG_PORT_MASK(tdo) : 0;
+
+	//the gang targets are on the TDI and TDO ports
+	jtag_GangPinsTDI = 0;
+	jtag_MaskGangTDO[0] = jtag_MaskTDO;
+	for(target = 1; target < JTAG_GANG_MAX; ++target)
+	{
+		jtag_MaskGangTDO[target] = 0;
+		if(jtag_GangTDI[target] != JTAG_SIGNAL_NOT_ALLOCATED)
+		{
+			jtag_GangPinsTDI |= JTAG_PIN(jtag_GangTDI[target]);
+			jtag_MaskGangTDO[target] = JTAG_PORT_MASK(jtag_GangTDO[target]);
+		}
+	}
+
+	jtag_PinsTMS = jtag_SignalPins(JTAG_SIGNAL_TMS);
+	jtag_PinsTDI = jtag_SignalPins(JTAG_SIGNAL_TDI);
+	jtag_BSRRShift = NULL;
+	for(port = 0; port < JTAG_PORTS; ++port)
+	{
+		if(((jtag_PinsTMS | jtag_PinsTDI) & ~JTAG_PORT_PINS_MASK(port)) == 0)
+		{
+			jtag_BSRRShift = &GPIO_BSRR(jtag_Ports[port]);
+			jtag_MaskTMS = JTAG_PORT_BITS(jtag_PinsTMS, port);
+			jtag_MaskTDI = JTAG_PORT_BITS(jtag_PinsTDI, port);
+			break;
+		}
+	}
+
+	//SPI1 can only drive one TDI pin and sample one TDO
+	jtag_UseSPI = !jtag_ClockAdaptive && (jtag_Broadcast[JTAG_SIGNAL_TDI] == 0) && (jtag_GangPinsTDI == 0) && jtagSPI_Usable(jtag_Signals[JTAG_SIGNAL_TCK], jtag_Signals[JTAG_SIGNAL_TDI], jtag_Signals[JTAG_SIGNAL_TDO]);
+}
+
 /**
  * @brief Return the configuration of a signal
  */
@@ -142,27 +549,50 @@ int jtag_GetCfg(jtag_Signal sig)
 /**
  * @brief Set one of the JTAG signals to the provided value
  *
+ * Any pins the signal is broadcast on are set as well.
+ *
  * @param[in] sig The signal to set
  * @param[in] val true for High, false for Low.
  */
 void jtag_Set(jtag_Signal sig, bool val)
 {
-	unsigned int pinNum;
-
 	if((sig >= JTAG_SIGNAL_TCK) && (sig < JTAG_SIGNAL_MAX) && !((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK)))
 	{
-		pinNum = jtag_Signals[sig];
+		jtag_PinMask pins = jtag_SignalPins(sig);
 
-		if(pinNum != JTAG_SIGNAL_NOT_ALLOCATED)
+		//set/reset the appropriate pins
+		if(val)
 		{
-			//set/reset the appropriate pin
-			pinNum = 1 << pinNum;
-			if(!val)
-			{
-				//resetting, shift it further
-				pinNum = pinNum << 16;
-			}
-			GPIOA_BSRR = pinNum;
+			jtag_WritePins(pins, 0);
+		}
+		else
+		{
+			jtag_WritePins(0, pins);
+		}
+	}
+}
+
+/**
+ * @brief Release an output signal, or drive it again
+ *
+ * Lets a bidirectional line such as SWDIO be turned round. Any pins the
+ * signal is broadcast on are switched as well. The output data register is
+ * kept, so the signal comes back at the level it was last set to.
+ *
+ * @param[in] sig The signal, TDO and RTCK are always inputs.
+ * @param[in] input true to float the signal, false to drive it.
+ */
+void jtag_SetInput(jtag_Signal sig, bool input)
+{
+	if((sig >= JTAG_SIGNAL_TCK) && (sig < JTAG_SIGNAL_MAX) && !((sig == JTAG_SIGNAL_TDO) || (sig == JTAG_SIGNAL_RTCK)))
+	{
+		if(input)
+		{
+			jtag_SetMode(jtag_SignalPins(sig), GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT);
+		}
+		else
+		{
+			jtag_SetMode(jtag_SignalPins(sig), GPIO_MODE_OUTPUT_10_MHZ, GPIO_CNF_OUTPUT_PUSHPULL);
 		}
 	}
 }
@@ -176,38 +606,322 @@ void jtag_Set(jtag_Signal sig, bool val)
  */
 bool jtag_Get(jtag_Signal sig)
 {
-	unsigned int pinNum = jtag_Signals[sig];
+	int pinNum = jtag_Signals[sig];
 	bool pinState = false;
 
 	if(pinNum != JTAG_SIGNAL_NOT_ALLOCATED)
 	{
 		//read the pin state from the input register
-		pinState = ((GPIOA_IDR & (1 << pinNum)) != 0);
+		pinState = ((GPIO_IDR(jtag_Ports[JTAG_PORT(pinNum)]) & JTAG_PORT_MASK(pinNum)) != 0);
 	}
 
 	return pinState;
 }
 
+/**
+ * @brief Set TCK, TMS and TDI together
+ *
+ * When all three are on one port they are updated with a single BSRR write,
+ * so they change at the same time. Otherwise TMS and TDI are updated before
+ * TCK. Used when the host is timing the clock.
+ *
+ * @param[in] tck The level for TCK
+ * @param[in] tms The level for TMS
+ * @param[in] tdi The level for TDI
+ */
+void jtag_Write(bool tck, bool tms, bool tdi)
+{
+	const uint32_t clock = tck ? jtag_MaskTCK : (jtag_MaskTCK << 16);
+
+	if(jtag_BSRRShift == jtag_BSRRTCK)
+	{
+		JTAG_REG_WRITE(jtag_BSRRTCK, clock |
+				(tms ? jtag_MaskTMS : (jtag_MaskTMS << 16)) |
+				(tdi ? jtag_MaskTDI : (jtag_MaskTDI << 16)));
+	}
+	else
+	{
+		jtag_WriteTMSTDI(tms, tdi, true);
+		JTAG_REG_WRITE(jtag_BSRRTCK, clock);
+	}
+}
+
+/**
+ * @brief Drive TMS, and TDI if asked, ready for the next clock
+ *
+ * A single BSRR write when they share a port, otherwise one for each port
+ * they are on.
+ *
+ * @param[in] tms The level for TMS
+ * @param[in] tdi The level for TDI
+ * @param[in] drive_tdi false to leave TDI unchanged
+ */
+static void jtag_WriteTMSTDI(bool tms, bool tdi, bool drive_tdi)
+{
+	if(jtag_BSRRShift != NULL)
+	{
+		uint32_t bsrr = tms ? jtag_MaskTMS : (jtag_MaskTMS << 16);
+
+		if(drive_tdi)
+		{
+			bsrr |= tdi ? jtag_MaskTDI : (jtag_MaskTDI << 16);
+		}
+		JTAG_REG_WRITE(jtag_BSRRShift, bsrr);
+	}
+	else
+	{
+		jtag_PinMask set = tms ? jtag_PinsTMS : 0;
+		jtag_PinMask reset = tms ? 0 : jtag_PinsTMS;
+
+		if(drive_tdi)
+		{
+			set |= tdi ? jtag_PinsTDI : 0;
+			reset |= tdi ? 0 : jtag_PinsTDI;
+		}
+		jtag_WritePins(set, reset);
+	}
+}
+
 /**
  * @brief Toggles the JTAG clock
  *
+ * Each half of the period is timed from the DWT cycle counter so the rate
+ * doesn't depend on the compiler or the surrounding code. When adaptive
+ * clocking is enabled each edge waits for RTCK to follow TCK instead.
  */
 void jtag_Clock()
 {
-	unsigned int cnt;
-	jtag_Set(JTAG_SIGNAL_TCK, true);
+	STATS_BEGIN(STATS_JTAG_CLOCK);
+	uint32_t start = DWT_CYCCNT;
+	JTAG_REG_WRITE(jtag_BSRRTCK, jtag_MaskTCK);
+	jtag_ClockWait(start, true);
+
+	start = DWT_CYCCNT;
+	JTAG_REG_WRITE(jtag_BSRRTCK, jtag_MaskTCK << 16);
+	jtag_ClockWait(start, false);
+	STATS_END(STATS_JTAG_CLOCK);
+}
+
+/**
+ * @brief Shift a buffer of bits through TDI and TDO
+ *
+ * Bits are packed little endian, the LSB of the first byte is shifted first.
+ * TMS is held low, apart from the last bit when exit is set, which moves the
+ * TAP from SHIFT into EXIT1.
+ *
+ * When TCK, TDI and TDO are on the SPI1 pins the whole bytes are shifted by
+ * SPI1 and DMA, leaving only the trailing bits and the exit bit to the GPIO.
+ *
+ * @param[in] tdi The data to shift in, or NULL to leave TDI unchanged.
+ * @param[out] tdo Buffer for the data shifted out, or NULL to discard it.
+ * @param[in] nbits The number of bits to shift.
+ * @param[in] exit true to raise TMS on the last bit.
+ */
+void jtag_Shift(const uint8_t *tdi, uint8_t *tdo, unsigned int nbits, bool exit)
+{
+	unsigned int first = 0;
+
+	if(jtag_UseSPI && (nbits >= JTAG_SPI_MIN_BITS))
+	{
+		//the exit bit needs TMS, so it always goes through the GPIO
+		unsigned int nbytes = (exit ? (nbits - 1) : nbits) >> 3;
+
+		//SPI1 is only used with TDI on GPIOA
+		jtag_WriteTMSTDI(false, false, false);
+		jtagSPI_Shift(tdi, tdo, nbytes, (GPIOA_ODR & JTAG_PORT_MASK(jtag_Signals[JTAG_SIGNAL_TDI])) != 0);
+		first = nbytes << 3;
+	}
+	jtag_ShiftBits(tdi, tdo, first, nbits, exit);
+}
+
+/**
+ * @brief Shift bits through TDI and TDO on the GPIO
+ *
+ * For each bit TDI and TMS are updated, with a single BSRR write when they
+ * share a port, TDO is sampled and then TCK is pulsed.
+ *
+ * @param[in] tdi The data to shift in, or NULL to leave TDI unchanged.
+ * @param[out] tdo Buffer for the data shifted out, or NULL to discard it.
+ * @param[in] first The index of the first bit in the buffers to shift.
+ * @param[in] nbits The index after the last bit to shift.
+ * @param[in] exit true to raise TMS on the last bit.
+ */
+static void jtag_ShiftBits(const uint8_t *tdi, uint8_t *tdo, unsigned int first, unsigned int nbits, bool exit)
+{
+	unsigned int bit;
+
+	for(bit = first; bit < nbits; ++bit)
+	{
+		const unsigned int index = bit >> 3;
+		const uint8_t mask = 1 << (bit & 0x07);
+
+		jtag_WriteTMSTDI(exit && (bit == (nbits - 1)), (tdi != NULL) && ((tdi[index] & mask) != 0), tdi != NULL);
+
+		if(tdo != NULL)
+		{
+			if((JTAG_REG_READ(jtag_IDRTDO) & jtag_MaskTDO) != 0)
+			{
+				tdo[index] |= mask;
+			}
+			else
+			{
+				tdo[index] &= ~mask;
+			}
+		}
+		jtag_Clock();
+	}
+}
+
+/**
+ * @brief Shift the same bits through every gang target
+ *
+ * As @ref jtag_Shift, but TDO is kept for each target. All the TDIs change
+ * with the one BSRR write and all the TDOs are sampled with one IDR read, so
+ * the targets take no longer than one. Always shifts on the GPIO.
+ *
+ * @param[in] tdi The data to shift in, or NULL to leave TDI unchanged.
+ * @param[out] tdo A buffer for the data shifted out of each target, NULL
+ * discards it. Targets that aren't configured read as 0.
+ * @param[in] nbits The number of bits to shift.
+ * @param[in] exit true to raise TMS on the last bit.
+ */
+void jtag_ShiftGang(const uint8_t *tdi, uint8_t * const tdo[JTAG_GANG_MAX], unsigned int nbits, bool exit)
+{
+	unsigned int bit;
+
+	for(bit = 0; bit < nbits; ++bit)
+	{
+		const unsigned int index = bit >> 3;
+		const uint8_t mask = 1 << (bit & 0x07);
+		uint32_t sample;
+		unsigned int target;
+
+		jtag_WriteTMSTDI(exit && (bit == (nbits - 1)), (tdi != NULL) && ((tdi[index] & mask) != 0), tdi != NULL);
+
+		sample = JTAG_REG_READ(jtag_IDRTDO);
+		for(target = 0; target < JTAG_GANG_MAX; ++target)
+		{
+			if(tdo[target] != NULL)
+			{
+				if((sample & jtag_MaskGangTDO[target]) != 0)
+				{
+					tdo[target][index] |= mask;
+				}
+				else
+				{
+					tdo[target][index] &= ~mask;
+				}
+			}
+		}
+		jtag_Clock();
+	}
+}
+
+/**
+ * @brief Clock out a sequence of TMS values
+ *
+ * Used to walk the TAP between states. TMS is left at the last value.
+ *
+ * @param[in] tms The TMS values, the first one clocked is the LSB
+ * @param[in] count The number of clocks to provide, max 16
+ */
+void jtag_ClockTMS(uint16_t tms, unsigned int count)
+{
+	while(count-- > 0)
+	{
+		jtag_WriteTMSTDI((tms & 0x01) != 0, false, false);
+		jtag_Clock();
+		tms >>= 1;
+	}
+}
+
+/**
+ * @brief Wait out half of a TCK period
+ *
+ * @param[in] start The cycle count when the TCK edge was started.
+ * @param[in] level The level TCK was set to, used for adaptive clocking.
+ */
+static void jtag_ClockWait(uint32_t start, bool level)
+{
+	if(jtag_ClockAdaptive)
+	{
+		//wait for the target to acknowledge the edge, but don't hang on a dead target
+		while((jtag_Get(JTAG_SIGNAL_RTCK) != level) && ((DWT_CYCCNT - start) < JTAG_RTCK_TIMEOUT))
+		{
+		}
+	}
+	else
+	{
+		while((DWT_CYCCNT - start) < jtag_ClockHalfPeriod)
+		{
+		}
+	}
+}
 
-	for(cnt = 8000; cnt > 0; --cnt)
+/**
+ * @brief Sets the TCK rate
+ *
+ * The half period is calculated from the core clock frequency. Rates that
+ * are faster than the GPIO can be toggled run as fast as the GPIO allows.
+ *
+ * @param[in] rate The TCK rate in kHz, from @ref JTAG_CLOCK_MIN to @ref JTAG_CLOCK_MAX
+ * @returns true if the rate was set, false if it was out of range.
+ */
+bool jtag_SetClockRate(unsigned int rate)
+{
+	bool success = false;
+	if((rate >= JTAG_CLOCK_MIN) && (rate <= JTAG_CLOCK_MAX))
 	{
-		__asm("nop");
+		uint32_t half = rcc_ahb_frequency / (rate * 2000);
+
+		jtag_ClockHalfPeriod = (half > JTAG_CLOCK_OVERHEAD) ? (half - JTAG_CLOCK_OVERHEAD) : 0;
+		jtag_ClockRate = rate;
+		jtagSPI_SetRate(rate);
+		jtag_UpdateMasks();
+		success = true;
 	}
+	return success;
+}
 
-	jtag_Set(JTAG_SIGNAL_TCK, false);
+/**
+ * @brief Get the TCK rate
+ *
+ * @returns The TCK rate in kHz
+ */
+unsigned int jtag_GetClockRate()
+{
+	return jtag_ClockRate;
+}
 
-	for(cnt = 8000; cnt > 0; --cnt)
+/**
+ * @brief Enable or disable adaptive clocking
+ *
+ * Adaptive clocking is only valid when the RTCK signal has been allocated.
+ *
+ * @param[in] adaptive true to wait on RTCK, false to use the TCK rate
+ * @returns true if the clocking mode was set
+ */
+bool jtag_SetClockAdaptive(bool adaptive)
+{
+	bool success = false;
+	if(!adaptive || jtag_IsAllocated(JTAG_SIGNAL_RTCK))
 	{
-		__asm("nop");
+		jtag_ClockAdaptive = adaptive;
+		jtag_UpdateMasks();
+		success = true;
 	}
+	return success;
+}
+
+/**
+ * @brief Get the adaptive clocking state
+ *
+ * @retval true TCK waits for RTCK
+ * @retval false TCK runs at the set rate
+ */
+bool jtag_IsClockAdaptive()
+{
+	return jtag_ClockAdaptive;
 }
 
 /**
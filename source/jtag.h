@@ -19,8 +19,26 @@
 #define _JTAG_H_
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
 #define JTAG_SIGNAL_NOT_ALLOCATED	(-1)	///< Flag for deallocating a signal
-#define JTAG_PIN_MAX			(16)	///< Maximum number of signals supported
+#define JTAG_PORTS			(3)	///< GPIO ports the pins are numbered across, GPIOA - GPIOC
+#define JTAG_PORT_PINS			(16)	///< Pins on each GPIO port
+#define JTAG_PIN_MAX			(JTAG_PORTS * JTAG_PORT_PINS)	///< Maximum number of signals supported
+#define JTAG_CLOCK_DEFAULT		(100)	///< Default TCK rate in kHz
+#define JTAG_CLOCK_MIN			(1)	///< Slowest TCK rate in kHz that can be requested
+#define JTAG_CLOCK_MAX			(8000)	///< Fastest TCK rate in kHz that can be requested
+#define JTAG_GANG_MAX			(4)	///< Targets that can be shifted in lockstep, including the first
+
+#define JTAG_PIN(num)			((jtag_PinMask)1 << (num))	///< The mask of a single pin
+
+/**
+ * @brief A bit mask of pins, bit n is pin n
+ *
+ * Pins 0 - 15 are PA0 - PA15, 16 - 31 are PB0 - PB15 and 32 - 47 are
+ * PC0 - PC15.
+ */
+typedef uint64_t jtag_PinMask;
 
 typedef enum jtag_eSignal
 {
@@ -40,9 +58,24 @@ extern void jtag_Init();
 
 extern bool jtag_Cfg(jtag_Signal sig, int num);
 extern int jtag_GetCfg(jtag_Signal sig);
+extern bool jtag_CfgBroadcast(jtag_Signal sig, jtag_PinMask mask);
+extern jtag_PinMask jtag_GetFreePins();
+extern jtag_PinMask jtag_Sample();
+extern void jtag_WritePins(jtag_PinMask set, jtag_PinMask reset);
 extern void jtag_Set(jtag_Signal sig, bool val);
 extern bool jtag_Get(jtag_Signal sig);
+extern void jtag_SetInput(jtag_Signal sig, bool input);
 extern bool jtag_IsAllocated(jtag_Signal sig);
+extern void jtag_Write(bool tck, bool tms, bool tdi);
 extern void jtag_Clock();
+extern void jtag_ClockTMS(uint16_t tms, unsigned int count);
+extern void jtag_Shift(const uint8_t *tdi, uint8_t *tdo, unsigned int nbits, bool exit);
+extern bool jtag_CfgGang(unsigned int target, int tdi, int tdo);
+extern bool jtag_GetGangCfg(unsigned int target, int *tdi, int *tdo);
+extern void jtag_ShiftGang(const uint8_t *tdi, uint8_t * const tdo[JTAG_GANG_MAX], unsigned int nbits, bool exit);
+extern bool jtag_SetClockRate(unsigned int rate);
+extern unsigned int jtag_GetClockRate();
+extern bool jtag_SetClockAdaptive(bool adaptive);
+extern bool jtag_IsClockAdaptive();
 
 #endif
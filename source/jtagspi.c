@@ -0,0 +1,211 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/spi.h>
+#include <libopencm3/stm32/dma.h>
+#include "jtagspi.h"
+#include "serial.h"
+
+#define JTAGSPI_DMA_RX		DMA_CHANNEL2	///< DMA1 channel for SPI1_RX
+#define JTAGSPI_DMA_TX		DMA_CHANNEL3	///< DMA1 channel for SPI1_TX
+#define JTAGSPI_PINS_OUT	((1 << JTAGSPI_PIN_TCK) | (1 << JTAGSPI_PIN_TDI))	///< SPI driven pins
+
+static bool jtagSPI_RateValid;		///< Can SPI1 generate the requested TCK rate
+static uint32_t jtagSPI_BaudRate;	///< The SPI1 baud rate prescaler for the TCK rate
+
+#if !defined(SERIAL_TRANSPORT_USART)
+static void jtagSPI_SetupDMA(uint8_t channel, void *buffer, unsigned int nbytes, bool increment, bool from_memory);
+#endif
+
+/**
+ * @brief Initialise SPI1 and its DMA channels for shifting
+ *
+ * SPI1 is set up as a master in mode 0, LSB first. That matches JTAG, as
+ * MOSI (TDI) is sampled on the rising edge and MISO (TDO) is sampled on the
+ * rising edge after the target changed it on the falling edge. The pins are
+ * only handed over to SPI1 for the duration of a transfer.
+ */
+void jtagSPI_Init()
+{
+	rcc_periph_clock_enable(RCC_SPI1);
+	rcc_periph_clock_enable(RCC_DMA1);
+
+	jtagSPI_RateValid = false;
+	jtagSPI_BaudRate = SPI_CR1_BAUDRATE_FPCLK_DIV_256;
+}
+
+/**
+ * @brief Pick the SPI1 prescaler for a TCK rate
+ *
+ * SPI1 runs from APB2 and can only divide by powers of two from 2 to 256.
+ * The fastest rate that doesn't exceed the requested one is used.
+ *
+ * @param[in] rate The TCK rate in kHz
+ * @returns true if SPI1 can run at or below the requested rate
+ */
+bool jtagSPI_SetRate(unsigned int rate)
+{
+	uint32_t divider;
+	uint32_t baud = SPI_CR1_BAUDRATE_FPCLK_DIV_2;
+
+	for(divider = 2; divider <= 256; divider <<= 1)
+	{
+		if((rcc_apb2_frequency / divider) <= (rate * 1000))
+		{
+			break;
+		}
+		baud += SPI_CR1_BAUDRATE_FPCLK_DIV_4 - SPI_CR1_BAUDRATE_FPCLK_DIV_2;
+	}
+
+	jtagSPI_RateValid = (divider <= 256);
+	if(jtagSPI_RateValid)
+	{
+		jtagSPI_BaudRate = baud;
+	}
+	return jtagSPI_RateValid;
+}
+
+/**
+ * @brief Check if a pinout can be shifted by SPI1
+ *
+ * @param[in] tck The pin TCK is on
+ * @param[in] tdi The pin TDI is on
+ * @param[in] tdo The pin TDO is on
+ * @retval true The signals are on the SPI1 pins and the rate is valid
+ */
+bool jtagSPI_Usable(int tck, int tdi, int tdo)
+{
+	return jtagSPI_RateValid && (tck == JTAGSPI_PIN_TCK) && (tdi == JTAGSPI_PIN_TDI) && (tdo == JTAGSPI_PIN_TDO);
+}
+
+#if !defined(SERIAL_TRANSPORT_USART)
+/**
+ * @brief Set up one DMA channel attached to SPI1_DR
+ *
+ * @param[in] channel The DMA1 channel to set up
+ * @param[in] buffer The memory side of the transfer
+ * @param[in] nbytes The number of bytes to transfer
+ * @param[in] increment true to step through the buffer, false to reuse one byte
+ * @param[in] from_memory true for a transmit channel, false for receive
+ */
+static void jtagSPI_SetupDMA(uint8_t channel, void *buffer, unsigned int nbytes, bool increment, bool from_memory)
+{
+	dma_channel_reset(DMA1, channel);
+	dma_set_peripheral_address(DMA1, channel, (uint32_t)&SPI1_DR);
+	dma_set_memory_address(DMA1, channel, (uint32_t)buffer);
+	dma_set_number_of_data(DMA1, channel, nbytes);
+	dma_set_peripheral_size(DMA1, channel, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, channel, DMA_CCR_MSIZE_8BIT);
+	dma_set_priority(DMA1, channel, DMA_CCR_PL_VERY_HIGH);
+	if(increment)
+	{
+		dma_enable_memory_increment_mode(DMA1, channel);
+	}
+	if(from_memory)
+	{
+		dma_set_read_from_memory(DMA1, channel);
+	}
+	else
+	{
+		dma_set_read_from_peripheral(DMA1, channel);
+	}
+	dma_enable_channel(DMA1, channel);
+}
+#endif
+
+/**
+ * @brief Shift whole bytes through SPI1 using DMA
+ *
+ * TMS must already be low and TCK low. The pins are returned to GPIO
+ * outputs once the transfer completes.
+ *
+ * With the USART host link DMA1 channel 3 is busy receiving from USART3, so
+ * SPI1 is polled a byte at a time instead.
+ *
+ * @param[in] tdi The data to shift in, or NULL to hold TDI at tdi_level.
+ * @param[out] tdo Buffer for the data shifted out, or NULL to discard it.
+ * @param[in] nbytes The number of bytes to shift.
+ * @param[in] tdi_level The level to hold TDI at when tdi is NULL.
+ */
+void jtagSPI_Shift(const uint8_t *tdi, uint8_t *tdo, unsigned int nbytes, bool tdi_level)
+{
+	uint8_t tdi_fill = tdi_level ? 0xFF : 0x00;
+#if defined(SERIAL_TRANSPORT_USART)
+	unsigned int index;
+#else
+	uint8_t tdo_discard;
+#endif
+
+	if(nbytes == 0)
+	{
+		return;
+	}
+
+	spi_reset(SPI1);
+	spi_init_master(SPI1, jtagSPI_BaudRate, SPI_CR1_CPOL_CLK_TO_0_WHEN_IDLE, SPI_CR1_CPHA_CLK_TRANSITION_1, SPI_CR1_DFF_8BIT, SPI_CR1_LSBFIRST);
+	spi_enable_software_slave_management(SPI1);
+	spi_set_nss_high(SPI1);
+
+#if defined(SERIAL_TRANSPORT_USART)
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, JTAGSPI_PINS_OUT);
+	spi_enable(SPI1);
+
+	for(index = 0; index < nbytes; ++index)
+	{
+		uint8_t in = spi_xfer(SPI1, (tdi != NULL) ? tdi[index] : tdi_fill);
+		if(tdo != NULL)
+		{
+			tdo[index] = in;
+		}
+	}
+	while((SPI_SR(SPI1) & SPI_SR_BSY) != 0)
+	{
+	}
+	spi_disable(SPI1);
+#else
+	//receive is set up first so no byte can be missed
+	jtagSPI_SetupDMA(JTAGSPI_DMA_RX, (tdo != NULL) ? tdo : &tdo_discard, nbytes, tdo != NULL, false);
+	jtagSPI_SetupDMA(JTAGSPI_DMA_TX, (tdi != NULL) ? (void *)tdi : &tdi_fill, nbytes, tdi != NULL, true);
+
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_50_MHZ, GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, JTAGSPI_PINS_OUT);
+	spi_enable(SPI1);
+	spi_enable_rx_dma(SPI1);
+	spi_enable_tx_dma(SPI1);
+
+	//the last byte is in once the receive channel completes
+	while(!dma_get_interrupt_flag(DMA1, JTAGSPI_DMA_RX, DMA_TCIF))
+	{
+	}
+	while((SPI_SR(SPI1) & SPI_SR_BSY) != 0)
+	{
+	}
+
+	spi_disable_tx_dma(SPI1);
+	spi_disable_rx_dma(SPI1);
+	dma_disable_channel(DMA1, JTAGSPI_DMA_TX);
+	dma_disable_channel(DMA1, JTAGSPI_DMA_RX);
+	spi_disable(SPI1);
+#endif
+
+	//hand the pins back, TCK idles low in mode 0 so there is no glitch
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_10_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, JTAGSPI_PINS_OUT);
+}
@@ -0,0 +1,33 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_JTAGSPI_H_)
+#define _JTAGSPI_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define JTAGSPI_PIN_TCK		(5)	///< SPI1 SCK is on PA5
+#define JTAGSPI_PIN_TDO		(6)	///< SPI1 MISO is on PA6
+#define JTAGSPI_PIN_TDI		(7)	///< SPI1 MOSI is on PA7
+
+extern void jtagSPI_Init();
+extern bool jtagSPI_SetRate(unsigned int rate);
+extern bool jtagSPI_Usable(int tck, int tdi, int tdo);
+extern void jtagSPI_Shift(const uint8_t *tdi, uint8_t *tdo, unsigned int nbytes, bool tdi_level);
+
+#endif
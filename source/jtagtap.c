@@ -17,8 +17,13 @@
  */
 #include "jtag.h"
 #include "jtagtap.h"
+#include "jtagtimer.h"
+#include "stats.h"
+#include <stdint.h>
 
 static jtagTAP_TAPState TAPState;	//<< Holds the current state of the TAP
+static unsigned int jtagTAP_RunTestClocks;	///< Clocks left to run in Run/Idle
+static bool jtagTAP_RunTestTimed;		///< Is the Run/Idle wait still timing
 
 const char * const jtagTAP_StateNames[JTAGTAP_STATE_MAX] = {
 	[JTAGTAP_STATE_UNKNOWN] = "Unknown",
@@ -40,7 +45,332 @@ const char * const jtagTAP_StateNames[JTAGTAP_STATE_MAX] = {
 	[JTAGTAP_STATE_IR_UPDATE] = "Update IR"
 };
 
-const unsigned int delay_count = 20000;
+/**
+ * @brief A TMS sequence that moves the TAP between two states
+ */
+typedef struct jtagTAP_sPath {
+	uint16_t tms;		///< TMS values to clock out, first value in the LSB
+	uint8_t length;		///< Number of clocks in the sequence
+} jtagTAP_Path;
+
+/**
+ * @brief Shortest TMS sequences between every pair of TAP states
+ *
+ * Indexed by [from][to]. Leaving the UNKNOWN state always starts with five
+ * clocks with TMS high to guarantee the TAP is in RESET. Nothing moves into
+ * the UNKNOWN state, so that column is left empty.
+ */
+static const jtagTAP_Path jtagTAP_Paths[JTAGTAP_STATE_MAX][JTAGTAP_STATE_MAX] = {
+	[JTAGTAP_STATE_UNKNOWN] = {
+		[JTAGTAP_STATE_RESET] = { 0x01F,  5 },
+		[JTAGTAP_STATE_IDLE] = { 0x01F,  6 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x05F,  7 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x05F,  8 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x05F,  9 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x15F,  9 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x15F, 10 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x55F, 11 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x35F, 10 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x0DF,  8 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x0DF,  9 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x0DF, 10 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x2DF, 10 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x2DF, 11 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0xADF, 12 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x6DF, 11 },
+	},
+	[JTAGTAP_STATE_RESET] = {
+		[JTAGTAP_STATE_RESET] = { 0x000,  0 },
+		[JTAGTAP_STATE_IDLE] = { 0x000,  1 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x002,  2 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x002,  3 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x002,  4 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x00A,  4 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x00A,  5 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x02A,  6 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x01A,  5 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x006,  3 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x006,  4 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x006,  5 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x016,  5 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x016,  6 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x056,  7 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x036,  6 },
+	},
+	[JTAGTAP_STATE_IDLE] = {
+		[JTAGTAP_STATE_RESET] = { 0x007,  3 },
+		[JTAGTAP_STATE_IDLE] = { 0x000,  0 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x001,  1 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x001,  3 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x005,  3 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x005,  4 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x015,  5 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x00D,  4 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x003,  2 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x003,  3 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x003,  4 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x00B,  4 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x00B,  5 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x02B,  6 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x01B,  5 },
+	},
+	[JTAGTAP_STATE_DR_SCAN] = {
+		[JTAGTAP_STATE_RESET] = { 0x003,  2 },
+		[JTAGTAP_STATE_IDLE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x000,  0 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x000,  1 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x000,  2 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x002,  2 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x002,  3 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x00A,  4 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x006,  3 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x001,  1 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x001,  2 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x001,  3 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x005,  3 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x005,  4 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x015,  5 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x00D,  4 },
+	},
+	[JTAGTAP_STATE_DR_CAPTURE] = {
+		[JTAGTAP_STATE_RESET] = { 0x01F,  5 },
+		[JTAGTAP_STATE_IDLE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x000,  0 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x000,  1 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x001,  1 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x005,  3 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x003,  2 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x00F,  5 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x00F,  6 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x02F,  6 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x02F,  7 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x0AF,  8 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x06F,  7 },
+	},
+	[JTAGTAP_STATE_DR_SHIFT] = {
+		[JTAGTAP_STATE_RESET] = { 0x01F,  5 },
+		[JTAGTAP_STATE_IDLE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x000,  0 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x001,  1 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x005,  3 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x003,  2 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x00F,  5 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x00F,  6 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x02F,  6 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x02F,  7 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x0AF,  8 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x06F,  7 },
+	},
+	[JTAGTAP_STATE_DR_EXIT1] = {
+		[JTAGTAP_STATE_RESET] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IDLE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x003,  2 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x002,  3 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x000,  0 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x000,  1 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x002,  2 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x001,  1 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x007,  5 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x017,  5 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x017,  6 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x057,  7 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x037,  6 },
+	},
+	[JTAGTAP_STATE_DR_PAUSE] = {
+		[JTAGTAP_STATE_RESET] = { 0x01F,  5 },
+		[JTAGTAP_STATE_IDLE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x005,  3 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x000,  0 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x001,  1 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x003,  2 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x00F,  5 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x00F,  6 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x02F,  6 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x02F,  7 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x0AF,  8 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x06F,  7 },
+	},
+	[JTAGTAP_STATE_DR_EXIT2] = {
+		[JTAGTAP_STATE_RESET] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IDLE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x003,  2 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x000,  1 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x002,  2 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x002,  3 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x000,  0 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x001,  1 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x007,  5 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x017,  5 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x017,  6 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x057,  7 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x037,  6 },
+	},
+	[JTAGTAP_STATE_DR_UPDATE] = {
+		[JTAGTAP_STATE_RESET] = { 0x007,  3 },
+		[JTAGTAP_STATE_IDLE] = { 0x000,  1 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x001,  1 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x001,  3 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x005,  3 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x005,  4 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x015,  5 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x000,  0 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x003,  2 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x003,  3 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x003,  4 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x00B,  4 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x00B,  5 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x02B,  6 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x01B,  5 },
+	},
+	[JTAGTAP_STATE_IR_SCAN] = {
+		[JTAGTAP_STATE_RESET] = { 0x001,  1 },
+		[JTAGTAP_STATE_IDLE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x005,  3 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x005,  4 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x005,  5 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x015,  5 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x015,  6 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x055,  7 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x035,  6 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x000,  0 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x000,  1 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x000,  2 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x002,  2 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x002,  3 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x00A,  4 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x006,  3 },
+	},
+	[JTAGTAP_STATE_IR_CAPTURE] = {
+		[JTAGTAP_STATE_RESET] = { 0x01F,  5 },
+		[JTAGTAP_STATE_IDLE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x007,  5 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x017,  5 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x017,  6 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x057,  7 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x037,  6 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x000,  0 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x000,  1 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x001,  1 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x001,  2 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x005,  3 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x003,  2 },
+	},
+	[JTAGTAP_STATE_IR_SHIFT] = {
+		[JTAGTAP_STATE_RESET] = { 0x01F,  5 },
+		[JTAGTAP_STATE_IDLE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x007,  5 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x017,  5 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x017,  6 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x057,  7 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x037,  6 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x00F,  5 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x000,  0 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x001,  1 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x001,  2 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x005,  3 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x003,  2 },
+	},
+	[JTAGTAP_STATE_IR_EXIT1] = {
+		[JTAGTAP_STATE_RESET] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IDLE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x003,  2 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x003,  4 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x00B,  4 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x00B,  5 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x02B,  6 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x01B,  5 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x002,  3 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x000,  0 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x000,  1 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x002,  2 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x001,  1 },
+	},
+	[JTAGTAP_STATE_IR_PAUSE] = {
+		[JTAGTAP_STATE_RESET] = { 0x01F,  5 },
+		[JTAGTAP_STATE_IDLE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x007,  5 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x017,  5 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x017,  6 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x057,  7 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x037,  6 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x00F,  5 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x001,  2 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x005,  3 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x000,  0 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x001,  1 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x003,  2 },
+	},
+	[JTAGTAP_STATE_IR_EXIT2] = {
+		[JTAGTAP_STATE_RESET] = { 0x00F,  4 },
+		[JTAGTAP_STATE_IDLE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x003,  2 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x003,  3 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x003,  4 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x00B,  4 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x00B,  5 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x02B,  6 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x01B,  5 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x007,  3 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x007,  4 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x000,  1 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x002,  2 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x002,  3 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x000,  0 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x001,  1 },
+	},
+	[JTAGTAP_STATE_IR_UPDATE] = {
+		[JTAGTAP_STATE_RESET] = { 0x007,  3 },
+		[JTAGTAP_STATE_IDLE] = { 0x000,  1 },
+		[JTAGTAP_STATE_DR_SCAN] = { 0x001,  1 },
+		[JTAGTAP_STATE_DR_CAPTURE] = { 0x001,  2 },
+		[JTAGTAP_STATE_DR_SHIFT] = { 0x001,  3 },
+		[JTAGTAP_STATE_DR_EXIT1] = { 0x005,  3 },
+		[JTAGTAP_STATE_DR_PAUSE] = { 0x005,  4 },
+		[JTAGTAP_STATE_DR_EXIT2] = { 0x015,  5 },
+		[JTAGTAP_STATE_DR_UPDATE] = { 0x00D,  4 },
+		[JTAGTAP_STATE_IR_SCAN] = { 0x003,  2 },
+		[JTAGTAP_STATE_IR_CAPTURE] = { 0x003,  3 },
+		[JTAGTAP_STATE_IR_SHIFT] = { 0x003,  4 },
+		[JTAGTAP_STATE_IR_EXIT1] = { 0x00B,  4 },
+		[JTAGTAP_STATE_IR_PAUSE] = { 0x00B,  5 },
+		[JTAGTAP_STATE_IR_EXIT2] = { 0x02B,  6 },
+		[JTAGTAP_STATE_IR_UPDATE] = { 0x000,  0 },
+	},
+};
+
+
+static void jtagTAP_TRSTReset();
 
 /**
  * @brief Initalize the TAP module
@@ -51,250 +381,131 @@ void jtagTAP_Init()
 	TAPState = JTAGTAP_STATE_UNKNOWN;
 }
 
+/**
+ * @brief Reset the TAP using the TRST signal
+ *
+ * TMS is held high so the TAP stays in RESET once TRST is released. The
+ * pulse is timed by @ref jtagTimer_Pulse, the TAP can't be clocked until
+ * it's over so this waits for it.
+ */
+static void jtagTAP_TRSTReset()
+{
+	jtag_Set(JTAG_SIGNAL_TMS, true);
+	jtagTimer_Pulse(JTAG_SIGNAL_TRST);
+	while(jtagTimer_IsPulsing(JTAG_SIGNAL_TRST))
+	{
+	}
+	TAPState = JTAGTAP_STATE_RESET;
+}
+
 /**
  * @brief Advance the TAP to the requested state
  *
+ * The shortest path is looked up in @ref jtagTAP_Paths and clocked out in a
+ * single TMS burst. If TRST is assigned it's used to get into RESET.
+ *
  * @param[in] target The state to get the TAP into
  */
 void jtagTAP_SetState(jtagTAP_TAPState target)
 {
-	if(target != JTAGTAP_STATE_UNKNOWN)
+	STATS_BEGIN(STATS_TAP_SETSTATE);
+
+	if(target == JTAGTAP_STATE_UNKNOWN)
 	{
-		if((target == JTAGTAP_STATE_RESET) && (jtag_IsAllocated(JTAG_SIGNAL_TRST)))
+		TAPState = JTAGTAP_STATE_UNKNOWN;
+	}
+	else if(target < JTAGTAP_STATE_MAX)
+	{
+		if(((target == JTAGTAP_STATE_RESET) || (TAPState == JTAGTAP_STATE_UNKNOWN)) && jtag_IsAllocated(JTAG_SIGNAL_TRST))
 		{
-			unsigned int count = 0;
-
 			//take the easy way to reset
-			jtag_Set(JTAG_SIGNAL_TMS, true);
-			jtag_Set(JTAG_SIGNAL_TRST, false);	//Assumes an active low signal
-
-			//delay a bit
-			while(++count < delay_count)
-			{
-				__asm("nop");
-			}
-			jtag_Set(JTAG_SIGNAL_TRST, true);	//Assumes an active low signal
-			TAPState = JTAGTAP_STATE_RESET;
+			jtagTAP_TRSTReset();
 		}
 
-		while(TAPState != target)
+		if(TAPState != target)
 		{
-			//only process if there is a state change requested.
-			switch(TAPState)
-			{
-				//Handle the unknown case by performing a reset
-				case JTAGTAP_STATE_UNKNOWN:
-					if(jtag_IsAllocated(JTAG_SIGNAL_TRST))
-					{
-						unsigned int count = 0;
-
-						//take the easy way to reset
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						jtag_Set(JTAG_SIGNAL_TRST, false);	//Assumes an active low signal
-
-						//delay a bit
-						while(++count < delay_count)
-						{
-							__asm("nop");
-						}
-						jtag_Set(JTAG_SIGNAL_TRST, true);	//Assumes an active low signal
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						jtag_Clock();
-						jtag_Clock();
-						jtag_Clock();
-						jtag_Clock();
-						jtag_Clock();
-					}
-					TAPState = JTAGTAP_STATE_RESET;
-					break;
-
-				case JTAGTAP_STATE_RESET:
-					jtag_Set(JTAG_SIGNAL_TMS, false);
-					jtag_Clock();
-					TAPState = JTAGTAP_STATE_IDLE;
-					break;
-
-				case JTAGTAP_STATE_IDLE:
-					jtag_Set(JTAG_SIGNAL_TMS, true);
-					jtag_Clock();
-					TAPState = JTAGTAP_STATE_DR_SCAN;
-					break;
-
-				case JTAGTAP_STATE_DR_SCAN:
-					if((target >= JTAGTAP_STATE_DR_CAPTURE) && (target <= JTAGTAP_STATE_DR_UPDATE))
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_DR_CAPTURE;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_IR_SCAN;
-					}
-					jtag_Clock();
-					break;
-
-				case JTAGTAP_STATE_DR_CAPTURE:
-					if(target == JTAGTAP_STATE_DR_SHIFT)
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_DR_SHIFT;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_DR_EXIT1;
-					}
-					jtag_Clock();
-					break;
-
-				case JTAGTAP_STATE_DR_SHIFT:
-					jtag_Set(JTAG_SIGNAL_TMS, true);
-					jtag_Clock();
-					TAPState = JTAGTAP_STATE_DR_EXIT1;
-					break;
-
-				case JTAGTAP_STATE_DR_EXIT1:
-					if((target == JTAGTAP_STATE_DR_PAUSE) || (target == JTAGTAP_STATE_DR_EXIT2) || (target == JTAGTAP_STATE_DR_SHIFT))
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_DR_PAUSE;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_DR_UPDATE;
-					}
-					jtag_Clock();
-					break;
-
-				case JTAGTAP_STATE_DR_PAUSE:
-					jtag_Set(JTAG_SIGNAL_TMS, true);
-					jtag_Clock();
-					TAPState = JTAGTAP_STATE_DR_EXIT2;
-					break;
-
-				case JTAGTAP_STATE_DR_EXIT2:
-					if((target == JTAGTAP_STATE_DR_PAUSE) || (target == JTAGTAP_STATE_DR_EXIT1) || (target == JTAGTAP_STATE_DR_SHIFT))
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_DR_SHIFT;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_DR_UPDATE;
-					}
-					jtag_Clock();
-					break;
-
-				case JTAGTAP_STATE_DR_UPDATE:
-					if(target == JTAGTAP_STATE_IDLE)
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_IDLE;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_DR_SCAN;
-					}
-					jtag_Clock();
-					break;
-
-				case JTAGTAP_STATE_IR_SCAN:
-					if((target >= JTAGTAP_STATE_IR_CAPTURE) && (target <= JTAGTAP_STATE_IR_UPDATE))
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_IR_CAPTURE;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_RESET;
-					}
-					jtag_Clock();
-					break;
-
-				case JTAGTAP_STATE_IR_CAPTURE:
-					if(target == JTAGTAP_STATE_IR_SHIFT)
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_IR_SHIFT;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_IR_EXIT1;
-					}
-					jtag_Clock();
-					break;
-
-				case JTAGTAP_STATE_IR_SHIFT:
-					jtag_Set(JTAG_SIGNAL_TMS, true);
-					jtag_Clock();
-					TAPState = JTAGTAP_STATE_IR_EXIT1;
-					break;
-
-				case JTAGTAP_STATE_IR_EXIT1:
-					if((target == JTAGTAP_STATE_IR_PAUSE) || (target == JTAGTAP_STATE_IR_EXIT2) || (target == JTAGTAP_STATE_IR_SHIFT))
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_IR_PAUSE;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_IR_UPDATE;
-					}
-					jtag_Clock();
-					break;
-
-				case JTAGTAP_STATE_IR_PAUSE:
-					jtag_Set(JTAG_SIGNAL_TMS, true);
-					jtag_Clock();
-					TAPState = JTAGTAP_STATE_IR_EXIT2;
-					break;
+			const jtagTAP_Path *path = &jtagTAP_Paths[TAPState][target];
+			jtag_ClockTMS(path->tms, path->length);
+			TAPState = target;
+		}
+	}
+	STATS_END(STATS_TAP_SETSTATE);
+}
 
-				case JTAGTAP_STATE_IR_EXIT2:
-					if((target == JTAGTAP_STATE_IR_PAUSE) || (target == JTAGTAP_STATE_IR_EXIT1) || (target == JTAGTAP_STATE_IR_SHIFT))
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_IR_SHIFT;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_IR_UPDATE;
-					}
-					jtag_Clock();
-					break;
+/**
+ * @brief Start waiting in Run/Idle for a number of clocks and a length of time
+ *
+ * The TAP is moved to Run/Idle and the time is started on TIM2, the clocks
+ * are run by @ref jtagTAP_RunTestStep. The wait lasts for whichever is
+ * longer, as SVF's RUNTEST expects.
+ *
+ * @param[in] clocks The minimum number of TCK cycles to run.
+ * @param[in] us The minimum time to wait in us.
+ */
+void jtagTAP_RunTestStart(unsigned int clocks, uint32_t us)
+{
+	jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+	jtagTAP_RunTestClocks = clocks;
+	jtagTAP_RunTestTimed = us > 0;
+	if(jtagTAP_RunTestTimed)
+	{
+		jtagTimer_Delay(us);
+	}
+}
 
-				case JTAGTAP_STATE_IR_UPDATE:
-					if(target == JTAGTAP_STATE_IDLE)
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, false);
-						TAPState = JTAGTAP_STATE_IDLE;
-					}
-					else
-					{
-						jtag_Set(JTAG_SIGNAL_TMS, true);
-						TAPState = JTAGTAP_STATE_DR_SCAN;
-					}
-					jtag_Clock();
-					break;
+/**
+ * @brief Run the next batch of a Run/Idle wait
+ *
+ * @param[in] batch The most clocks to run.
+ * @retval true There is more to wait for.
+ */
+bool jtagTAP_RunTestStep(unsigned int batch)
+{
+	unsigned int clocks = (jtagTAP_RunTestClocks < batch) ? jtagTAP_RunTestClocks : batch;
 
-			}
+	jtag_ClockTMS(0x0000, clocks);
+	jtagTAP_RunTestClocks -= clocks;
+	if((jtagTAP_RunTestClocks == 0) && jtagTAP_RunTestTimed)
+	{
+		jtagTAP_RunTestTimed = jtagTimer_IsDelaying();
+	}
+	return (jtagTAP_RunTestClocks > 0) || jtagTAP_RunTestTimed;
+}
 
-		}
+/**
+ * @brief Wait in Run/Idle for a number of clocks and a length of time
+ *
+ * See @ref jtagTAP_RunTestStart, this doesn't return until the wait is over.
+ *
+ * @param[in] clocks The minimum number of TCK cycles to run.
+ * @param[in] us The minimum time to wait in us.
+ */
+void jtagTAP_RunTest(unsigned int clocks, uint32_t us)
+{
+	jtagTAP_RunTestStart(clocks, us);
+	while(jtagTAP_RunTestStep(clocks))
+	{
 	}
-	else
+}
+
+/**
+ * @brief Get the TMS sequence between two states
+ *
+ * @param[in] from The state the TAP starts in
+ * @param[in] to The state the TAP should end up in
+ * @param[out] tms The TMS values to clock out, first value in the LSB
+ * @returns The number of clocks in the sequence
+ */
+unsigned int jtagTAP_GetPath(jtagTAP_TAPState from, jtagTAP_TAPState to, uint16_t *tms)
+{
+	unsigned int length = 0;
+	*tms = 0;
+	if((from < JTAGTAP_STATE_MAX) && (to > JTAGTAP_STATE_UNKNOWN) && (to < JTAGTAP_STATE_MAX))
 	{
-		TAPState = JTAGTAP_STATE_UNKNOWN;
+		*tms = jtagTAP_Paths[from][to].tms;
+		length = jtagTAP_Paths[from][to].length;
 	}
+	return length;
 }
 
 /**
@@ -305,3 +516,21 @@ jtagTAP_TAPState jtagTAP_GetState()
 {
 	return TAPState;
 }
+
+/**
+ * @brief Note that a shift left the shift state
+ *
+ * jtag_Shift raises TMS on the last bit when exit is set, which moves the
+ * TAP from DR_SHIFT or IR_SHIFT to the matching EXIT1 state.
+ */
+void jtagTAP_ShiftExit()
+{
+	if(TAPState == JTAGTAP_STATE_DR_SHIFT)
+	{
+		TAPState = JTAGTAP_STATE_DR_EXIT1;
+	}
+	else if(TAPState == JTAGTAP_STATE_IR_SHIFT)
+	{
+		TAPState = JTAGTAP_STATE_IR_EXIT1;
+	}
+}
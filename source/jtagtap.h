@@ -18,6 +18,9 @@
 #if !defined(_JTAGTAP_H_)
 #define _JTAGTAP_H_
 
+#include <stdint.h>
+#include <stdbool.h>
+
 typedef enum jtagTAP_eTAPState {
 	JTAGTAP_STATE_UNKNOWN = 0,
 	JTAGTAP_STATE_RESET,
@@ -44,5 +47,10 @@ extern const char * const jtagTAP_StateNames[JTAGTAP_STATE_MAX];
 void jtagTAP_Init();
 void jtagTAP_SetState(jtagTAP_TAPState target);
 jtagTAP_TAPState jtagTAP_GetState();
+void jtagTAP_ShiftExit();
+void jtagTAP_RunTestStart(unsigned int clocks, uint32_t us);
+bool jtagTAP_RunTestStep(unsigned int batch);
+void jtagTAP_RunTest(unsigned int clocks, uint32_t us);
+unsigned int jtagTAP_GetPath(jtagTAP_TAPState from, jtagTAP_TAPState to, uint16_t *tms);
 
 #endif
@@ -0,0 +1,287 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/timer.h>
+#include <libopencm3/cm3/nvic.h>
+#include "jtagtimer.h"
+
+#define JTAGTIMER_TICK_HZ	(1000000)	///< TIM2 counts in us
+#define JTAGTIMER_CHUNK		(0x8000)	///< Longest wait scheduled on a compare channel at once
+
+/**
+ * @brief The users of the TIM2 compare channels, CC1 to CC3
+ */
+typedef enum jtagTimer_eChannel
+{
+	JTAGTIMER_CHANNEL_TRST = 0,	///< TRST pulse
+	JTAGTIMER_CHANNEL_SRST,		///< SRST pulse
+	JTAGTIMER_CHANNEL_DELAY,	///< Wall clock wait, nothing to release
+	JTAGTIMER_CHANNEL_MAX,
+} jtagTimer_Channel;
+
+/**
+ * @brief A timeout running on one of the compare channels
+ */
+typedef struct jtagTimer_sTimeout
+{
+	jtag_Signal signal;		///< Signal released at the end, JTAG_SIGNAL_MAX for none
+	uint32_t width;			///< Pulse width in us
+	volatile uint32_t remaining;	///< us left to schedule after the current chunk
+	volatile bool busy;		///< Is the timeout still running
+} jtagTimer_Timeout;
+
+static volatile uint32_t * const jtagTimer_Compare[JTAGTIMER_CHANNEL_MAX] = { &TIM2_CCR1, &TIM2_CCR2, &TIM2_CCR3 };
+static jtagTimer_Timeout jtagTimer_Timeouts[JTAGTIMER_CHANNEL_MAX];
+
+static int jtagTimer_ChannelOf(jtag_Signal sig);
+static void jtagTimer_Schedule(jtagTimer_Channel channel);
+static void jtagTimer_Start(jtagTimer_Channel channel, uint32_t us);
+
+/**
+ * @brief Start TIM2 free running at 1MHz
+ *
+ * The prescaler is worked out from the clock tree as it is now, APB1 timers
+ * run at twice the bus clock when the bus is divided down. Each compare
+ * channel times one pulse or delay, so they can overlap.
+ */
+void jtagTimer_Init()
+{
+	uint32_t timerClock = (rcc_apb1_frequency == rcc_ahb_frequency) ? rcc_apb1_frequency : (rcc_apb1_frequency * 2);
+
+	jtagTimer_Timeouts[JTAGTIMER_CHANNEL_TRST].signal = JTAG_SIGNAL_TRST;
+	jtagTimer_Timeouts[JTAGTIMER_CHANNEL_TRST].width = JTAGTIMER_TRST_DEFAULT;
+	jtagTimer_Timeouts[JTAGTIMER_CHANNEL_SRST].signal = JTAG_SIGNAL_SRST;
+	jtagTimer_Timeouts[JTAGTIMER_CHANNEL_SRST].width = JTAGTIMER_SRST_DEFAULT;
+	jtagTimer_Timeouts[JTAGTIMER_CHANNEL_DELAY].signal = JTAG_SIGNAL_MAX;
+	jtagTimer_Timeouts[JTAGTIMER_CHANNEL_DELAY].width = 0;
+
+	rcc_periph_clock_enable(RCC_TIM2);
+	TIM2_CR1 = 0;
+	TIM2_DIER = 0;
+	TIM2_PSC = (timerClock / JTAGTIMER_TICK_HZ) - 1;
+	TIM2_ARR = 0xFFFF;
+	TIM2_EGR = TIM_EGR_UG;	//load the prescaler
+	TIM2_SR = 0;
+	TIM2_CR1 = TIM_CR1_CEN;
+	nvic_enable_irq(NVIC_TIM2_IRQ);
+}
+
+/**
+ * @brief Find the compare channel that pulses a signal
+ *
+ * @param[in] sig The signal to look up.
+ * @returns The channel, or -1 if the signal can't be pulsed.
+ */
+static int jtagTimer_ChannelOf(jtag_Signal sig)
+{
+	int channel = -1;
+
+	if(sig == JTAG_SIGNAL_TRST)
+	{
+		channel = JTAGTIMER_CHANNEL_TRST;
+	}
+	else if(sig == JTAG_SIGNAL_SRST)
+	{
+		channel = JTAGTIMER_CHANNEL_SRST;
+	}
+	return channel;
+}
+
+/**
+ * @brief Set the compare channel up for the next chunk of a timeout
+ *
+ * The compare is set one tick further out than needed, so the time is a
+ * minimum even if the counter ticks while it's being set.
+ *
+ * @param[in] channel The channel to schedule.
+ */
+static void jtagTimer_Schedule(jtagTimer_Channel channel)
+{
+	jtagTimer_Timeout *timeout = &jtagTimer_Timeouts[channel];
+	uint32_t chunk = (timeout->remaining > JTAGTIMER_CHUNK) ? JTAGTIMER_CHUNK : timeout->remaining;
+
+	timeout->remaining -= chunk;
+	*jtagTimer_Compare[channel] = (TIM2_CNT + chunk + 1) & 0xFFFF;
+	TIM2_SR = ~(TIM_SR_CC1IF << channel);
+}
+
+/**
+ * @brief Start a timeout on a compare channel
+ *
+ * A timeout already running on the channel is waited for first. The
+ * interrupt is masked while the channel is set up, as the interrupt
+ * handler changes the same registers.
+ *
+ * @param[in] channel The channel to use.
+ * @param[in] us The length of the timeout.
+ */
+static void jtagTimer_Start(jtagTimer_Channel channel, uint32_t us)
+{
+	jtagTimer_Timeout *timeout = &jtagTimer_Timeouts[channel];
+
+	while(timeout->busy)
+	{
+	}
+
+	nvic_disable_irq(NVIC_TIM2_IRQ);
+	timeout->remaining = us;
+	timeout->busy = true;
+	jtagTimer_Schedule(channel);
+	TIM2_DIER |= (TIM_DIER_CC1IE << channel);
+	nvic_enable_irq(NVIC_TIM2_IRQ);
+}
+
+/**
+ * @brief Set the width of a reset pulse
+ *
+ * @param[in] sig TRST or SRST.
+ * @param[in] us The pulse width in us, must be more than 0.
+ * @retval true The width was set.
+ */
+bool jtagTimer_SetWidth(jtag_Signal sig, uint32_t us)
+{
+	int channel = jtagTimer_ChannelOf(sig);
+	bool success = (channel >= 0) && (us > 0);
+
+	if(success)
+	{
+		jtagTimer_Timeouts[channel].width = us;
+	}
+	return success;
+}
+
+/**
+ * @brief Get the width of a reset pulse
+ *
+ * @param[in] sig TRST or SRST.
+ * @returns The pulse width in us, 0 if the signal can't be pulsed.
+ */
+uint32_t jtagTimer_GetWidth(jtag_Signal sig)
+{
+	int channel = jtagTimer_ChannelOf(sig);
+
+	return (channel >= 0) ? jtagTimer_Timeouts[channel].width : 0;
+}
+
+/**
+ * @brief Start a reset pulse
+ *
+ * The signal is driven low straight away and released from the timer
+ * interrupt once the width has passed, so this doesn't wait for the pulse
+ * to finish.
+ *
+ * @param[in] sig TRST or SRST.
+ * @retval true The pulse was started.
+ */
+bool jtagTimer_Pulse(jtag_Signal sig)
+{
+	int channel = jtagTimer_ChannelOf(sig);
+	bool success = channel >= 0;
+
+	if(success)
+	{
+		//wait out a pulse that's still going, before driving low again
+		while(jtagTimer_Timeouts[channel].busy)
+		{
+		}
+		jtag_Set(sig, false);	//Assumes an active low signal
+		jtagTimer_Start(channel, jtagTimer_Timeouts[channel].width);
+	}
+	return success;
+}
+
+/**
+ * @brief Is a reset pulse still running
+ *
+ * @param[in] sig TRST or SRST.
+ * @retval true The signal is still held low.
+ */
+bool jtagTimer_IsPulsing(jtag_Signal sig)
+{
+	int channel = jtagTimer_ChannelOf(sig);
+
+	return (channel >= 0) && jtagTimer_Timeouts[channel].busy;
+}
+
+/**
+ * @brief Start a wall clock delay
+ *
+ * Use @ref jtagTimer_Wait or @ref jtagTimer_IsDelaying to wait for it to
+ * finish, so work can be done while the delay runs.
+ *
+ * @param[in] us The length of the delay.
+ */
+void jtagTimer_Delay(uint32_t us)
+{
+	jtagTimer_Start(JTAGTIMER_CHANNEL_DELAY, us);
+}
+
+/**
+ * @brief Is the delay started by @ref jtagTimer_Delay still running
+ *
+ * @retval true The delay hasn't finished.
+ */
+bool jtagTimer_IsDelaying()
+{
+	return jtagTimer_Timeouts[JTAGTIMER_CHANNEL_DELAY].busy;
+}
+
+/**
+ * @brief Wait for the delay started by @ref jtagTimer_Delay
+ */
+void jtagTimer_Wait()
+{
+	while(jtagTimer_IsDelaying())
+	{
+	}
+}
+
+/**
+ * @brief TIM2 interrupt, ends or reschedules the timeouts that have matched
+ */
+void tim2_isr()
+{
+	unsigned int channel;
+
+	for(channel = 0; channel < JTAGTIMER_CHANNEL_MAX; ++channel)
+	{
+		uint32_t flag = TIM_SR_CC1IF << channel;
+
+		if(((TIM2_SR & flag) != 0) && ((TIM2_DIER & (TIM_DIER_CC1IE << channel)) != 0))
+		{
+			jtagTimer_Timeout *timeout = &jtagTimer_Timeouts[channel];
+
+			TIM2_SR = ~flag;
+			if(timeout->remaining > 0)
+			{
+				jtagTimer_Schedule(channel);
+			}
+			else
+			{
+				TIM2_DIER &= ~(TIM_DIER_CC1IE << channel);
+				if(timeout->signal != JTAG_SIGNAL_MAX)
+				{
+					jtag_Set(timeout->signal, true);
+				}
+				timeout->busy = false;
+			}
+		}
+	}
+}
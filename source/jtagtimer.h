@@ -0,0 +1,37 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_JTAGTIMER_H_)
+#define _JTAGTIMER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "jtag.h"
+
+#define JTAGTIMER_TRST_DEFAULT	(1000)		///< Default TRST pulse width in us
+#define JTAGTIMER_SRST_DEFAULT	(100000)	///< Default SRST pulse width in us
+
+extern void jtagTimer_Init();
+extern bool jtagTimer_SetWidth(jtag_Signal sig, uint32_t us);
+extern uint32_t jtagTimer_GetWidth(jtag_Signal sig);
+extern bool jtagTimer_Pulse(jtag_Signal sig);
+extern bool jtagTimer_IsPulsing(jtag_Signal sig);
+extern void jtagTimer_Delay(uint32_t us);
+extern bool jtagTimer_IsDelaying();
+extern void jtagTimer_Wait();
+
+#endif
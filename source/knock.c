@@ -20,53 +20,247 @@
 #include "knock.h"
 #include "message.h"
 #include "chain.h"
+#include "pinstore.h"
+#include "idcode.h"
+#include "stats.h"
+#include "swd.h"
 #include <stdint.h>
+#include <stdbool.h>
 
-#include <libopencm3/stm32/gpio.h>	//for IO port access
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/pwr.h>
+#include <libopencm3/stm32/f1/bkp.h>	//for the scan checkpoint
+#include <libopencm3/cm3/dwt.h>
 
-#define KNOCK_RESULTS		(1024)		///< Number of results to store per run (max)
+#define KNOCK_RESULTS		(1024)		///< Maximum number of clocks to capture per run
 #define KNOCK_UNCHANGED		(48)		///< Number of results to store for unchanging inputs, has to be longer than an ID CODE
+#define KNOCK_WINDOW		(32)		///< Samples kept by the ID CODE detector, one ID CODE
+#define KNOCK_COUNT_BITS	(5)		///< Bits in the detector's per pin count, log2(KNOCK_WINDOW)
+#define KNOCK_TDI_NONE		(-1)		///< None of the TDI candidates are TDI
+#define KNOCK_TDI_UNKNOWN	(-2)		///< The parallel TDI search was inconclusive
+#define KNOCK_CURSOR_RESET	(JTAG_PIN_MAX)	///< TDI cursor before the first TDI of a pair
+#define KNOCK_CHECKPOINT_MAGIC	(0x4B53)	///< Marks a valid checkpoint in the backup registers
+#define KNOCK_SWD_BITS		(3 + 32 + 1)	///< ACK, DPIDR and parity sampled from each SWDIO candidate
 
-static void knock_ScanReset(unsigned int tck, unsigned int tms);
-static void knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, uint16_t pins, uint16_t tdi_state, unsigned int nresuts);
-static void knock_ScanBypass(unsigned int tck, unsigned int tms);
+/**
+ * @brief Scan progress
+ */
+typedef enum knock_eStatus
+{
+	KNOCK_STATUS_IDLE,		///< No scan, or the last one finished
+	KNOCK_STATUS_RUNNING,		///< Stepped from the main loop
+	KNOCK_STATUS_PAUSED,		///< Stopped part way, can be resumed
+} knock_ScanStatus;
+
+/**
+ * @brief The cursor and results of a scan, kept between steps
+ */
+typedef struct knock_sScanner
+{
+	knock_Mode mode;		///< The scanning mode
+	knock_ScanStatus status;	///< Is the scan being stepped
+	unsigned int tck;		///< Cursor, the TCK pin being tried
+	unsigned int tms;		///< Cursor, the TMS pin being tried
+	unsigned int tdi;		///< Cursor, the TDI pin for a bypass scan or KNOCK_CURSOR_RESET
+	jtag_PinMask active;		///< Pins an auto scan is trying as TDO with bypass
+	unsigned int candidates;	///< TCK/TMS pairs, or TCKs in broadcast and SWD mode, finished
+	unsigned int chains;		///< The number of chains found
+	uint64_t cycles;		///< Core clocks spent scanning
+	uint64_t limit;			///< Value of cycles to pause at
+	unsigned int budget;		///< Seconds to scan for before pausing, 0 for no limit
+} knock_Scanner;
+
+/**
+ * @brief Streaming ID CODE detector for all the pins at once
+ *
+ * The per pin state is bit sliced, bit n of each member is pin n.
+ */
+typedef struct knock_sDetector
+{
+	jtag_PinMask window[KNOCK_WINDOW];	///< The most recent samples
+	jtag_PinMask armed;			///< Pins waiting for the LSB of an ID CODE
+	jtag_PinMask collecting;		///< Pins part way through an ID CODE
+	jtag_PinMask count[KNOCK_COUNT_BITS];	///< Bits collected, modulo 32
+	jtag_PinMask found;			///< Pins that shifted out a valid ID CODE
+	jtag_PinMask known;			///< Pins that shifted out an ID CODE from a listed manufacturer
+	unsigned int clocks;			///< Samples taken
+} knock_Detector;
+
+static jtag_PinMask knock_Pins();
+static bool knock_PerTCK();
+static void knock_DetectorInit(knock_Detector *detector, jtag_PinMask watch);
+static void knock_DetectorSample(knock_Detector *detector, jtag_PinMask sample);
+static jtag_PinMask knock_CaptureReset(jtag_PinMask watch, jtag_PinMask *last, jtag_PinMask *active, unsigned int *clocks, jtag_PinMask *known);
+static jtag_PinMask knock_ScanReset(unsigned int tck, unsigned int tms);
+static jtag_PinMask knock_CaptureBroadcast(jtag_PinMask tms_pins, jtag_PinMask tdo_pins);
+static void knock_ScanBroadcast(unsigned int tck);
+static void knock_ScanSWD(unsigned int swclk);
+static unsigned int knock_ToggleTDI(jtag_PinMask group, jtag_PinMask tdi_state, unsigned int nresults);
+static int knock_FindTDIParallel(jtag_PinMask candidates, jtag_PinMask tdi_state, unsigned int nresults);
+static void knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, jtag_PinMask pins, jtag_PinMask tdi_state, unsigned int nresuts);
+static void knock_ScanBypass(unsigned int tck, unsigned int tms, unsigned int tdi, jtag_PinMask tdo_pins);
+static bool knock_NextPair();
+static bool knock_NextTDI();
+static bool knock_StepCandidate();
+static void knock_SaveCheckpoint();
+static bool knock_LoadCheckpoint();
+static void knock_ClearCheckpoint();
 
 //configuration information
 static unsigned int knock_PinCount;
+static jtag_PinMask knock_KnownPins;		///< Pins already found to be part of a chain
+static knock_Scanner knock_State;		///< The scan being stepped
 static const unsigned int knock_IRShiftCount = 100;
 
 /**
- * @brief Attempts to determine if a device is attached via JTAG
+ * @brief Get the pins wired up for the scan
  *
- * For the provided pin combination, this function will reset the tap and scan
- * out the data register, either getting an ID CODE, a BYPASS or garbage. It
- * will attempt to analyse the results to see if it's a valid result.
+ * @returns A bitmask of the first knock_PinCount pins.
+ */
+static jtag_PinMask knock_Pins()
+{
+	return JTAG_PIN(knock_PinCount) - 1;
+}
+
+/**
+ * @brief Check if the scan tries a TCK at a time rather than TCK/TMS pairs
  *
- * @param[in] tck The pin the TCK signal is on, for scanning
- * @param[in] tms The pin the TMS signal is on, for scanning
+ * @retval true The scan mode drives TMS, or SWDIO, on all the pins at once.
+ */
+static bool knock_PerTCK()
+{
+	return (knock_State.mode == KNOCK_MODE_BROADCAST) || (knock_State.mode == KNOCK_MODE_SWD);
+}
+
+/**
+ * @brief Start looking for ID CODEs on a set of pins
+ *
+ * @param[out] detector The detector to initialise.
+ * @param[in] watch A bitmask of the pins to look for ID CODEs on.
+ */
+static void knock_DetectorInit(knock_Detector *detector, jtag_PinMask watch)
+{
+	unsigned int i;
+
+	detector->armed = watch;
+	detector->collecting = 0;
+	detector->found = 0;
+	detector->known = 0;
+	detector->clocks = 0;
+	for(i = 0; i < KNOCK_COUNT_BITS; ++i)
+	{
+		detector->count[i] = 0;
+	}
+}
+
+/**
+ * @brief Add a sample of all the pins to the detector
+ *
+ * Each pin waits for a 1, the LSB of an ID CODE, then counts off 32 bits.
+ * The counts for all the pins are kept bit sliced, so every pin is updated
+ * with a handful of mask operations. Only when a pin completes a code is
+ * it pulled out of the window of recent samples and checked.
+ *
+ * @param[in,out] detector The detector to update.
+ * @param[in] sample The state of the pins, before the clock.
+ */
+static void knock_DetectorSample(knock_Detector *detector, jtag_PinMask sample)
+{
+	jtag_PinMask carry;
+	jtag_PinMask done;
+	unsigned int i;
+
+	detector->window[detector->clocks % KNOCK_WINDOW] = sample;
+
+	//armed pins that are high start an ID CODE with this bit
+	carry = detector->armed & sample;
+	detector->armed &= ~carry;
+	detector->collecting |= carry;
+
+	//count the bit for all the collecting pins, a carry out is 32 bits
+	carry = detector->collecting;
+	for(i = 0; i < KNOCK_COUNT_BITS; ++i)
+	{
+		jtag_PinMask next = detector->count[i] & carry;
+		detector->count[i] ^= carry;
+		carry = next;
+	}
+	done = carry;
+
+	if(done != 0)
+	{
+		unsigned int bit;
+
+		for(bit = 0; bit < JTAG_PIN_MAX; ++bit)
+		{
+			if(((done >> bit) & 0x01) == 1)
+			{
+				//oldest sample in the window is the LSB
+				uint32_t idcode = 0;
+				unsigned int index;
+
+				for(index = 1; index <= KNOCK_WINDOW; ++index)
+				{
+					idcode >>= 1;
+					idcode |= (uint32_t)((detector->window[(detector->clocks + index) % KNOCK_WINDOW] >> bit) & 0x01) << 31;
+				}
+				if(idcode_IsPlausible(idcode))
+				{
+					detector->found |= JTAG_PIN(bit);
+					if(idcode_Manufacturer(idcode) != NULL)
+					{
+						detector->known |= JTAG_PIN(bit);
+					}
+				}
+			}
+		}
+
+		//look for the next device's ID CODE
+		detector->collecting &= ~done;
+		detector->armed |= done;
+	}
+	++detector->clocks;
+}
+
+/**
+ * @brief Reset the TAP and look for ID CODEs while shifting the DR
+ *
+ * The TAP is reset and moved to DR_SHIFT, then all pins are sampled before
+ * each clock, with one read of each port, and passed through the ID CODE
+ * detector. Capturing stops early
+ * once nothing has changed for @ref KNOCK_UNCHANGED clocks.
+ *
+ * @param[in] watch A bitmask of the pins to look for ID CODEs on.
+ * @param[out] last The state of the pins at the last sample.
+ * @param[out] active A bitmask of the pins that changed while capturing.
+ * @param[out] clocks The number of samples taken before stopping.
+ * @param[out] known A bitmask of the pins whose ID CODE has a listed manufacturer.
+ * @returns A bitmask of the watched pins that shifted out an ID CODE.
  */
-static void knock_ScanReset(unsigned int tck, unsigned int tms)
+static jtag_PinMask knock_CaptureReset(jtag_PinMask watch, jtag_PinMask *last, jtag_PinMask *active, unsigned int *clocks, jtag_PinMask *known)
 {
+	knock_Detector detector;
 	unsigned int count;
 	int unchanged_count = -1;	//the first time through always results in a unchanged count
-	uint16_t data, data_changed = 0x0000;
-	uint16_t prev_data;
-	uint16_t data_interesting = 0x0000;
-	uint16_t scan_results[KNOCK_RESULTS];
+	jtag_PinMask data, data_changed = 0;
+	jtag_PinMask prev_data;
+	jtag_PinMask changed = 0;
 
+	STATS_BEGIN(STATS_KNOCK_RESET);
+	knock_DetectorInit(&detector, watch);
 	jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
 	jtagTAP_SetState(JTAGTAP_STATE_DR_SHIFT);
 
-	prev_data = GPIOA_IDR;
+	prev_data = jtag_Sample();
+	data = prev_data;
 	for(count = 0; count < KNOCK_RESULTS; ++count)
 	{
-		data = GPIOA_IDR;
+		data = jtag_Sample();
 		data_changed = data ^ prev_data;
-		data_interesting |= data_changed;
-
 		prev_data = data;
+		changed |= data_changed;
 
-		scan_results[count] = data;
+		knock_DetectorSample(&detector, data);
 
 		jtag_Clock();
 
@@ -82,51 +276,360 @@ static void knock_ScanReset(unsigned int tck, unsigned int tms)
 			unchanged_count = 0;	//something changed, reset the count.
 		}
 	}
+	STATS_END(STATS_KNOCK_RESET);
+
+	*last = data;
+	*active = changed;
+	*clocks = count;
+	*known = detector.known;
+	return detector.found;
+}
+
+/**
+ * @brief Attempts to determine if a device is attached via JTAG
+ *
+ * For the provided pin combination, this function will reset the tap and scan
+ * out the data register, either getting an ID CODE, a BYPASS or garbage. It
+ * will attempt to analyse the results to see if it's a valid result.
+ *
+ * @param[in] tck The pin the TCK signal is on, for scanning
+ * @param[in] tms The pin the TMS signal is on, for scanning
+ * @returns A bitmask of the pins that changed while the DR was shifted but
+ * didn't shift out an ID CODE, which could be the TDO of a device without
+ * one.
+ */
+static jtag_PinMask knock_ScanReset(unsigned int tck, unsigned int tms)
+{
+	jtag_PinMask last;
+	jtag_PinMask active;
+	unsigned int count;
+	jtag_PinMask known;
+	jtag_PinMask watch = knock_Pins() & ~(JTAG_PIN(tck) | JTAG_PIN(tms));
+	jtag_PinMask data_interesting = knock_CaptureReset(watch, &last, &active, &count, &known);
+
+	//an ID CODE from a manufacturer that isn't listed is more likely noise, it has to repeat
+	if((data_interesting & ~known) != 0)
+	{
+		jtag_PinMask again_last;
+		jtag_PinMask again_active;
+		unsigned int again_count;
+		jtag_PinMask again_known;
+		jtag_PinMask repeated = knock_CaptureReset(data_interesting & ~known, &again_last, &again_active, &again_count, &again_known);
+
+		data_interesting = known | repeated;
+	}
 
 	if(data_interesting != 0)
 	{
-		//a line changed state at least once, lets inspect
-		unsigned int bit = 0;
-		for(bit = 0; bit < knock_PinCount; ++bit)
+		knock_ScanResetFindTDI(tck, tms, data_interesting, last, count);
+	}
+	return active & watch & ~data_interesting & ~knock_KnownPins;
+}
+
+/**
+ * @brief Look for ID CODEs with TMS broadcast on a group of pins
+ *
+ * @param[in] tms_pins A bitmask of the pins to drive as TMS.
+ * @param[in] tdo_pins A bitmask of the pins to look for an ID CODE on.
+ * @returns A bitmask of the tdo_pins that look like TDO.
+ */
+static jtag_PinMask knock_CaptureBroadcast(jtag_PinMask tms_pins, jtag_PinMask tdo_pins)
+{
+	jtag_PinMask found;
+	jtag_PinMask last;
+	jtag_PinMask active;
+	unsigned int count;
+	jtag_PinMask known;
+
+	jtag_CfgBroadcast(JTAG_SIGNAL_TMS, tms_pins);
+	found = knock_CaptureReset(tdo_pins, &last, &active, &count, &known);
+	jtag_CfgBroadcast(JTAG_SIGNAL_TMS, 0);
+
+	return found;
+}
+
+/**
+ * @brief Scan for JTAG ports with TMS broadcast on many pins at once
+ *
+ * TMS only has to be high to reset the TAP and low to shift the DR, so every
+ * pin in a group can be driven as TMS while the rest are sampled for TDO.
+ * Splitting the pins by each bit of their number, both ways round, puts the
+ * real TMS and TDO on opposite sides at least once. A hit is then narrowed to
+ * a single TMS pin with a binary search and confirmed with
+ * @ref knock_ScanReset.
+ *
+ * @param[in] tck The pin TCK is on
+ */
+static void knock_ScanBroadcast(unsigned int tck)
+{
+	jtag_PinMask candidates = jtag_GetFreePins() & knock_Pins();
+	jtag_PinMask found = 0;	//TMS pins already confirmed for this TCK
+	unsigned int bit;
+
+	for(bit = 0; (1U << bit) < knock_PinCount; ++bit)
+	{
+		unsigned int polarity;
+
+		for(polarity = 0; polarity < 2; ++polarity)
 		{
-			if(((data_interesting >> bit) & 0x01) == 1)
+			jtag_PinMask tms_pins = 0;
+			jtag_PinMask tdo_pins;
+			jtag_PinMask hits;
+			unsigned int pin;
+
+			for(pin = 0; pin < knock_PinCount; ++pin)
 			{
-				//this line changed
-				unsigned int index;
+				if(((pin >> bit) & 0x01) == polarity)
+				{
+					tms_pins |= JTAG_PIN(pin);
+				}
+			}
+			tms_pins &= candidates;
+			tdo_pins = candidates & ~tms_pins;
+			if((tms_pins == 0) || (tdo_pins == 0))
+			{
+				continue;
+			}
 
-				data_interesting &= ~(1 << bit);	//mask off this bit, until it proves itself
+			message_Log(MESSAGE_LEVEL_DEBUG, KNOCK_TCK_TMS_PINS, tck, (uint32_t)(tms_pins >> 32), (uint32_t)(tms_pins & 0xFFFFFFFF));
+			hits = knock_CaptureBroadcast(tms_pins, tdo_pins);
 
-				for(index = 0; index < count; ++index)
+			for(pin = 0; (pin < knock_PinCount) && (hits != 0); ++pin)
+			{
+				if(((hits >> pin) & 0x01) == 1)
 				{
-					if((((scan_results[index] >> bit) & 0x01) == 1) && (count - index >= 32))
+					jtag_PinMask search = tms_pins;
+
+					hits &= ~JTAG_PIN(pin);
+
+					//halve the TMS group until one pin is left
+					while((search & (search - 1)) != 0)
 					{
-						//this could be a potential ID CODE, get it
-						uint32_t idcode = 0x80000000;
-						unsigned int code_end = index + 32;
-						while(++index < code_end)
+						jtag_PinMask half = 0;
+						jtag_PinMask rest = search;
+						unsigned int ones = 0;
+
+						//take every other set bit
+						while(rest != 0)
 						{
-							idcode >>= 1;
-							idcode |= ((scan_results[index] >> bit) & 0x01) << 31;
+							jtag_PinMask lowest = rest & -rest;
+							if((ones++ & 0x01) == 0)
+							{
+								half |= lowest;
+							}
+							rest &= ~lowest;
 						}
-						if((idcode != 0xFFFFFFFF))
+
+						search = (knock_CaptureBroadcast(half, JTAG_PIN(pin)) != 0) ? half : (search & ~half);
+					}
+
+					if((found & search) == 0)
+					{
+						unsigned int tms = 0;
+
+						found |= search;
+						while(((search >> tms) & 0x01) == 0)
 						{
-							data_interesting |= (1 << bit);		//this is interesting, keep it
+							++tms;
 						}
-						--index; //fixup
+						jtag_Cfg(JTAG_SIGNAL_TMS, tms);
+						knock_ScanReset(tck, tms);
+						jtag_Cfg(JTAG_SIGNAL_TMS, JTAG_SIGNAL_NOT_ALLOCATED);
 					}
 				}
+			}
+		}
+	}
+}
+
+/**
+ * @brief Scan for SWD ports with SWDIO driven on all the candidates at once
+ *
+ * The switch from JTAG and a line reset are sent on every free pin, then
+ * the DPIDR read request. After the turnaround each SWDIO candidate is
+ * sampled on every clock, the same as TDO is for a JTAG scan, so a single
+ * read finds the targets on all the pins. A pin that answers with an OK
+ * acknowledge and a plausible DPIDR with good parity is confirmed on its own.
+ *
+ * @param[in] swclk The pin SWCLK, TCK, is on.
+ */
+static void knock_ScanSWD(unsigned int swclk)
+{
+	jtag_PinMask candidates = jtag_GetFreePins() & knock_Pins() & ~knock_KnownPins;
+	jtag_PinMask samples[KNOCK_SWD_BITS];
+	jtag_PinMask hits;
+	unsigned int count;
+	unsigned int pin;
+
+	if((candidates == 0) || !jtag_CfgBroadcast(JTAG_SIGNAL_TMS, candidates))
+	{
+		return;
+	}
+
+	swd_Reset();
+	swd_SendRequest(swd_Request(false, true, SWD_DP_DPIDR));
+	for(count = 0; count < KNOCK_SWD_BITS; ++count)
+	{
+		samples[count] = jtag_Sample();
+		jtag_Clock();
+	}
+	jtag_Clock();	//turnaround
+	jtag_SetInput(JTAG_SIGNAL_TMS, false);
+	jtag_CfgBroadcast(JTAG_SIGNAL_TMS, 0);
+
+	//ACK OK is 1, 0, 0
+	hits = candidates & samples[0] & ~samples[1] & ~samples[2];
+	for(pin = 0; (pin < knock_PinCount) && (hits != 0); ++pin)
+	{
+		if(((hits >> pin) & 0x01) == 1)
+		{
+			uint32_t dpidr = 0;
+			bool parity = ((samples[KNOCK_SWD_BITS - 1] >> pin) & 0x01) != 0;
+
+			hits &= ~JTAG_PIN(pin);
+			for(count = 0; count < 32; ++count)
+			{
+				dpidr |= (uint32_t)((samples[3 + count] >> pin) & 0x01) << count;
+			}
+			if((parity != swd_Parity(dpidr)) || !idcode_IsPlausible(dpidr))
+			{
+				continue;
+			}
+
+			//make sure it wasn't another pin driving this one
+			if(jtag_Cfg(JTAG_SIGNAL_TMS, pin))
+			{
+				if(swd_Connect(&dpidr))
+				{
+					message_Write(MESSAGE_LEVEL_GENERAL, "[!] Potential SWD: SWCLK: %i SWDIO: %i DPIDR: %08X\r\n", swclk, pin, dpidr);
+					knock_KnownPins |= JTAG_PIN(swclk) | JTAG_PIN(pin);
+					++knock_State.chains;
+				}
+				jtag_Cfg(JTAG_SIGNAL_TMS, JTAG_SIGNAL_NOT_ALLOCATED);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Toggle a group of TDI candidates and count the changes on TDO
+ *
+ * Each pin in the group is driven to the opposite of the level it was
+ * floating at and the DR is clocked through. A real TDI shows up as a single
+ * change on TDO once it has passed through the chain. The pins are then
+ * put back and clocked through again, undoing the change, before being
+ * returned to inputs.
+ *
+ * @param[in] group A bitmask of the pins to toggle.
+ * @param[in] tdi_state The state the pins were floating at.
+ * @param[in] nresults The number of clocks to shift each way.
+ * @returns The number of times TDO changed.
+ */
+static unsigned int knock_ToggleTDI(jtag_PinMask group, jtag_PinMask tdi_state, unsigned int nresults)
+{
+	unsigned int clocks, changes = 0;
+	bool prev_tdo_val;
+	uint8_t tdo_vals[KNOCK_RESULTS / 8];
+
+	//set the levels first so the pins only change once when they become outputs
+	jtag_WritePins(group & ~tdi_state, group & tdi_state);
+	jtag_CfgBroadcast(JTAG_SIGNAL_TDI, group);
+
+	prev_tdo_val = jtag_Get(JTAG_SIGNAL_TDO);
+	jtag_Shift(NULL, tdo_vals, nresults, false);
+
+	for(clocks = 0; clocks < nresults; ++clocks)
+	{
+		bool tdo_val = ((tdo_vals[clocks >> 3] >> (clocks & 0x07)) & 0x01) != 0;
+
+		if(tdo_val != prev_tdo_val)
+		{
+			++changes;
+		}
+		prev_tdo_val = tdo_val;
+	}
+
+	//reset the pin state and clock again, undoing what we just did
+	jtag_WritePins(group & tdi_state, group & ~tdi_state);
+	jtag_Shift(NULL, NULL, nresults, false);
+	jtag_CfgBroadcast(JTAG_SIGNAL_TDI, 0);
 
+	return changes;
+}
+
+/**
+ * @brief Find TDI by toggling many candidates at once
+ *
+ * Each candidate is numbered from 1 and pass n toggles every candidate with
+ * bit n of its number set. Only the real TDI changes TDO, so the passes that
+ * saw a change spell out its number, in about log2(n) passes rather than n.
+ * The pin found is confirmed on its own.
+ *
+ * @param[in] candidates A bitmask of the pins that could be TDI.
+ * @param[in] tdi_state The state the pins were floating at.
+ * @param[in] nresults The number of clocks to shift for each pass.
+ * @returns The TDI pin, @ref KNOCK_TDI_NONE if no candidate is TDI or
+ * @ref KNOCK_TDI_UNKNOWN if the passes didn't agree.
+ */
+static int knock_FindTDIParallel(jtag_PinMask candidates, jtag_PinMask tdi_state, unsigned int nresults)
+{
+	uint8_t order[JTAG_PIN_MAX];
+	unsigned int npins = 0;
+	unsigned int code = 0;
+	unsigned int pin, bit;
+	int tdi = KNOCK_TDI_UNKNOWN;
+
+	for(pin = 0; pin < JTAG_PIN_MAX; ++pin)
+	{
+		if(((candidates >> pin) & 0x01) == 1)
+		{
+			order[npins++] = pin;
+		}
+	}
+
+	for(bit = 0; (1U << bit) <= npins; ++bit)
+	{
+		jtag_PinMask group = 0;
+		unsigned int changes;
+
+		for(pin = 0; pin < npins; ++pin)
+		{
+			if((((pin + 1) >> bit) & 0x01) == 1)
+			{
+				group |= JTAG_PIN(order[pin]);
 			}
 		}
-		knock_ScanResetFindTDI(tck, tms, data_interesting, scan_results[count-1], count);
+
+		changes = knock_ToggleTDI(group, tdi_state, nresults);
+		if(changes == 1)
+		{
+			code |= (1 << bit);
+		}
+		else if(changes != 0)
+		{
+			//something other than TDI is affecting TDO
+			return KNOCK_TDI_UNKNOWN;
+		}
+	}
+
+	if(code == 0)
+	{
+		tdi = KNOCK_TDI_NONE;
 	}
+	else if((code <= npins) && (knock_ToggleTDI(JTAG_PIN(order[code - 1]), tdi_state, nresults) == 1))
+	{
+		tdi = order[code - 1];
+	}
+	return tdi;
 }
 
 /**
  * @brief Try to find TDI given a list of potential TDOs
  *
  * Based on the scan results and a list of interesting pins, which could be
- * TDO, try and find TDI.
+ * TDO, try and find TDI. The candidates are searched in parallel, falling
+ * back to one at a time if the parallel passes are inconclusive. Pins
+ * already found in an earlier chain aren't tried.
  *
  * The TAP is currently in JTAGTAP_STATE_DR_SHIFT and the shift registers are
  * full of whatever TDI is set to.
@@ -135,171 +638,391 @@ static void knock_ScanReset(unsigned int tck, unsigned int tms)
  * @param[in] tms The pin that TMS is on.
  * @param[in] pins A bitmask of potential TDOs.
  * @param[in] tdi_state The current state of all pins.
- * @param[in] nresults The number of results in the scan_results array.
+ * @param[in] nresults The number of clocks the reset capture took.
  */
-static void knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, uint16_t pins, uint16_t tdi_state, unsigned int nresults)
+static void knock_ScanResetFindTDI(unsigned int tck, unsigned int tms, jtag_PinMask pins, jtag_PinMask tdi_state, unsigned int nresults)
 {
 	unsigned int tdo;
+	STATS_BEGIN(STATS_KNOCK_TDI);
 
+	pins &= ~knock_KnownPins;
 	for(tdo = 0; tdo < knock_PinCount; ++tdo)
 	{
 		if(((pins >> tdo) & 0x01) == 1)
 		{
-			unsigned int tdi;
+			jtag_PinMask candidates;
+			int tdi;
+
+			jtag_Cfg(JTAG_SIGNAL_TDO, tdo);
+			candidates = jtag_GetFreePins() & knock_Pins() & ~knock_KnownPins;
 
-			//look for pins that match the value above
-			for(tdi = 0; tdi < knock_PinCount; ++tdi)
+			tdi = knock_FindTDIParallel(candidates, tdi_state, nresults);
+			if(tdi == KNOCK_TDI_UNKNOWN)
 			{
-				if((tdi != tck) && (tdi != tms) && (tdi != tdo))
+				//try them one by one instead
+				for(tdi = 0; tdi < (int)knock_PinCount; ++tdi)
 				{
-					//we aren't already using this pin
-					unsigned int clocks, changes = 0;
-					unsigned int prev_tdo_val = (GPIOA_IDR & (1 << tdo));
-
-					jtag_Cfg(JTAG_SIGNAL_TDI, tdi);
-					jtag_Set(JTAG_SIGNAL_TDI, ((tdi_state >> tdi) & 1) == 0);	//toggle the TDI pin
-
-					for(clocks = 0; clocks < nresults; ++clocks)
+					if((((candidates >> tdi) & 0x01) == 1) && (knock_ToggleTDI(JTAG_PIN(tdi), tdi_state, nresults) == 1))
 					{
-						unsigned int tdo_val = (GPIOA_IDR & (1 << tdo));
-						jtag_Clock();
-
-						if((tdo_val ^ prev_tdo_val) != 0)
-						{
-							++changes;
-						}
-						prev_tdo_val = tdo_val;
-					}
-
-					//reset the pin state and clock again, undoing what we just did
-					jtag_Set(JTAG_SIGNAL_TDI, ((tdi_state >> tdi) & 1) == 1);	//toggle the TDI pin
-					for(clocks = 0; clocks < nresults; ++clocks)
-					{
-						jtag_Clock();
+						break;
 					}
+				}
+				if(tdi == (int)knock_PinCount)
+				{
+					tdi = KNOCK_TDI_NONE;
+				}
+			}
 
-					if(changes == 1)
-					{
-						message_Write(MESSAGE_LEVEL_GENERAL, "[!] Potential Chain: TCK: %i TMS: %i TDO: %i TDI: %i\r\n", tck, tms, tdo, tdi);
-						jtag_Cfg(JTAG_SIGNAL_TDO, tdo);
-						chain_Detect();
-					}
+			if(tdi != KNOCK_TDI_NONE)
+			{
+				message_Write(MESSAGE_LEVEL_GENERAL, "[!] Potential Chain: TCK: %i TMS: %i TDO: %i TDI: %i\r\n", tck, tms, tdo, tdi);
+				knock_KnownPins |= JTAG_PIN(tck) | JTAG_PIN(tms) | JTAG_PIN(tdo) | JTAG_PIN(tdi);
+				++knock_State.chains;
 
-					jtag_Cfg(JTAG_SIGNAL_TDI, JTAG_SIGNAL_NOT_ALLOCATED);
-					jtag_Cfg(JTAG_SIGNAL_TDO, JTAG_SIGNAL_NOT_ALLOCATED);
+				jtag_Cfg(JTAG_SIGNAL_TDI, tdi);
+				if(chain_Detect())
+				{
+					pinstore_Save();
 				}
+				jtag_Cfg(JTAG_SIGNAL_TDI, JTAG_SIGNAL_NOT_ALLOCATED);
 			}
+
+			jtag_Cfg(JTAG_SIGNAL_TDO, JTAG_SIGNAL_NOT_ALLOCATED);
 		}
 	}
+	STATS_END(STATS_KNOCK_TDI);
 }
 
 /**
  * @brief Scan for JTAG ports by looking for a IR register
  *
- * Guesses at TDI and sets the TAP into BYPASS mode. Sends some clocks and
+ * Sets the TAP into BYPASS mode with the given TDI. Sends some clocks and
  * looks to see if one of the inputs starts low and then goes high.
  *
  * @param[in] tck The pin TCK is on
  * @param[in] tms The pin TMS is on
+ * @param[in] tdi The pin to try as TDI
+ * @param[in] tdo_pins A bitmask of the pins that could be TDO.
  */
-static void knock_ScanBypass(unsigned int tck, unsigned int tms)
+static void knock_ScanBypass(unsigned int tck, unsigned int tms, unsigned int tdi, jtag_PinMask tdo_pins)
 {
-	unsigned int tdi, tdo;
+	unsigned int tdo;
 	unsigned int count;
+	jtag_PinMask tdo_candidates;
+	int tdo_change_clocks[JTAG_PIN_MAX];
+	STATS_BEGIN(STATS_KNOCK_BYPASS);
 
-	for(tdi = 0; tdi < knock_PinCount; ++tdi)
+	//skip pins the host link has or that aren't on the package
+	if(!jtag_Cfg(JTAG_SIGNAL_TDI, tdi))
 	{
-		if((tdi != tck) && (tdi !=tms))
-		{
-			uint16_t tdo_candidates;
-			int tdo_change_clocks[16];
+		STATS_END(STATS_KNOCK_BYPASS);
+		return;
+	}
+	jtag_Set(JTAG_SIGNAL_TDI, true);	//set the pin to a known state
 
-			//we can use this pin
-			jtag_Cfg(JTAG_SIGNAL_TDI, tdi);
-			jtag_Set(JTAG_SIGNAL_TDI, true);	//set the pin to a known state
+	//put the JTAG TAP into a known state
+	jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
+	jtagTAP_SetState(JTAGTAP_STATE_IR_SHIFT);
 
-			//put the JTAG TAP into a known state
-			jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
-			jtagTAP_SetState(JTAGTAP_STATE_IR_SHIFT);
+	jtag_Shift(NULL, NULL, knock_IRShiftCount, false);
+	tdo_candidates = jtag_Sample() & tdo_pins;	//any pin which is set here and changes to
+						//0 once and stays there is probably TDO
+
+	jtag_Set(JTAG_SIGNAL_TDI, false);
+	for(count = 0; count < JTAG_PIN_MAX; ++count)
+	{
+		tdo_change_clocks[count] = 0;
+	}
 
-			for(count = 0; count < knock_IRShiftCount; ++count)
+	for(count = 1; count < knock_IRShiftCount; ++count)
+	{
+		jtag_PinMask tdo_sample ;
+		jtag_Clock();
+
+		tdo_sample = jtag_Sample();
+
+		for(tdo = 0; tdo < knock_PinCount; ++tdo)
+		{
+			//check if this is a candidate pin and not in use
+			if((tdo != tck) && (tdo != tms) && (tdo != tdi) && ((tdo_candidates & JTAG_PIN(tdo)) != 0))
 			{
-				jtag_Clock();
+				if((tdo_sample & JTAG_PIN(tdo)) == 0)
+				{
+					//the pin went low, this is good
+					if(tdo_change_clocks[tdo] == 0)
+					{
+						tdo_change_clocks[tdo] = count;
+					}
+				}
+				else if(tdo_change_clocks[tdo] > 0)
+				{
+					//it had gone low, but went high. damn.
+					tdo_change_clocks[tdo] = -1;
+				}
 			}
-			tdo_candidates = GPIOA_IDR;	//any pin which is set here and changes to
-							//0 once and stays there is probably TDO
+		}
+	}
 
-			jtag_Set(JTAG_SIGNAL_TDI, false);
-			for(count = 0; count < 16; ++count)
+	for(tdo = 0; tdo < knock_PinCount; ++tdo)
+	{
+		if(tdo_change_clocks[tdo] >= 2)
+		{
+			message_Write(MESSAGE_LEVEL_GENERAL, "[!] Potential Chain: TCK: %i TMS: %i TDO: %i TDI: %i\r\n", tck, tms, tdo, tdi);
+			++knock_State.chains;
+			jtag_Cfg(JTAG_SIGNAL_TDO, tdo);
+			if(chain_Detect())
 			{
-				tdo_change_clocks[count] = 0;
+				pinstore_Save();
 			}
+			jtag_Cfg(JTAG_SIGNAL_TDO, JTAG_SIGNAL_NOT_ALLOCATED);
+		}
+	}
 
-			for(count = 1; count < knock_IRShiftCount; ++count)
+	//we may have found a chain, put it back into bypass
+	//LX4F120HQ5R locks up with an IR full of 0
+	jtag_Set(JTAG_SIGNAL_TDI, true);	//set the pin to a known state
+	jtag_Shift(NULL, NULL, knock_IRShiftCount, false);
+	jtag_Cfg(JTAG_SIGNAL_TDI, JTAG_SIGNAL_NOT_ALLOCATED);
+	STATS_END(STATS_KNOCK_BYPASS);
+}
+
+/**
+ * @brief Move the cursor on to the next TCK and TMS pair
+ *
+ * @retval true There is another pair to try.
+ */
+static bool knock_NextPair()
+{
+	++knock_State.candidates;
+	knock_State.tdi = KNOCK_CURSOR_RESET;
+	if(knock_PerTCK())
+	{
+		++knock_State.tck;
+	}
+	else
+	{
+		do
+		{
+			if(++knock_State.tms >= knock_PinCount)
 			{
-				uint16_t tdo_sample ;
-				jtag_Clock();
+				knock_State.tms = 0;
+				++knock_State.tck;
+			}
+		} while(knock_State.tms == knock_State.tck);
+	}
+	return knock_State.tck < knock_PinCount;
+}
 
-				tdo_sample = GPIOA_IDR;
+/**
+ * @brief Move the cursor on to the next TDI for a bypass scan
+ *
+ * @retval true There is another TDI to try with this TCK and TMS.
+ */
+static bool knock_NextTDI()
+{
+	knock_State.tdi = (knock_State.tdi == KNOCK_CURSOR_RESET) ? 0 : (knock_State.tdi + 1);
+	while((knock_State.tdi == knock_State.tck) || (knock_State.tdi == knock_State.tms))
+	{
+		++knock_State.tdi;
+	}
+	return knock_State.tdi < knock_PinCount;
+}
 
-				for(tdo = 0; tdo < knock_PinCount; ++tdo)
-				{
-					//check if this is a candidate pin and not in use
-					if((tdo != tck) && (tdo != tms) && (tdo != tdi) && ((tdo_candidates & (1 << tdo)) != 0))
-					{
-						if((tdo_sample & (1 << tdo)) == 0)
-						{
-							//the pin went low, this is good
-							if(tdo_change_clocks[tdo] == 0)
-							{
-								tdo_change_clocks[tdo] = count;
-							}
-						}
-						else if(tdo_change_clocks[tdo] > 0)
-						{
-							//it had gone low, but went high. damn.
-							tdo_change_clocks[tdo] = -1;
-						}
-					}
-				}
+/**
+ * @brief Run the candidate under the cursor and move it on
+ *
+ * @retval true There is more of the scan left.
+ */
+static bool knock_StepCandidate()
+{
+	bool more;
+
+	if(knock_PerTCK())
+	{
+		message_Log(MESSAGE_LEVEL_VERBOSE, KNOCK_TCK, knock_State.tck);
+		if(jtag_Cfg(JTAG_SIGNAL_TCK, knock_State.tck))
+		{
+			if(knock_State.mode == KNOCK_MODE_SWD)
+			{
+				knock_ScanSWD(knock_State.tck);
 			}
+			else
+			{
+				knock_ScanBroadcast(knock_State.tck);
+			}
+			jtag_Cfg(JTAG_SIGNAL_TCK, JTAG_SIGNAL_NOT_ALLOCATED);
+		}
+		return knock_NextPair();
+	}
+
+	message_Log(MESSAGE_LEVEL_DEBUG, KNOCK_TCK_TMS, knock_State.tck, knock_State.tms);
+	//assign the JTAG signals for this candidate, skipping pins the host link
+	//has or that aren't on the package
+	if(!jtag_Cfg(JTAG_SIGNAL_TCK, knock_State.tck) || !jtag_Cfg(JTAG_SIGNAL_TMS, knock_State.tms))
+	{
+		jtag_Cfg(JTAG_SIGNAL_TCK, JTAG_SIGNAL_NOT_ALLOCATED);
+		return knock_NextPair();
+	}
+	switch(knock_State.mode)
+	{
+		case KNOCK_MODE_RESET:
+			knock_ScanReset(knock_State.tck, knock_State.tms);
+			more = false;
+			break;
 
-			for(tdo = 0; tdo < knock_PinCount; ++tdo)
+		case KNOCK_MODE_BYPASS:
+			if(knock_State.tdi == KNOCK_CURSOR_RESET)
 			{
-				if(tdo_change_clocks[tdo] >= 2)
-				{
-					message_Write(MESSAGE_LEVEL_GENERAL, "[!] Potential Chain: TCK: %i TMS: %i TDO: %i TDI: %i\r\n", tck, tms, tdo, tdi);
-					jtag_Cfg(JTAG_SIGNAL_TDO, tdo);
-					chain_Detect();
-					jtag_Cfg(JTAG_SIGNAL_TDO, JTAG_SIGNAL_NOT_ALLOCATED);
-				}
+				knock_NextTDI();
 			}
+			knock_ScanBypass(knock_State.tck, knock_State.tms, knock_State.tdi, knock_Pins());
+			more = knock_NextTDI();
+			break;
 
-			//we may have found a chain, put it back into bypass
-			//LX4F120HQ5R locks up with an IR full of 0
-			jtag_Set(JTAG_SIGNAL_TDI, true);	//set the pin to a known state
-			for(count = 0; count < knock_IRShiftCount; ++count)
+		case KNOCK_MODE_AUTO:
+			//only pay for a bypass scan where something answered without an ID CODE
+			if(knock_State.tdi == KNOCK_CURSOR_RESET)
 			{
-				jtag_Clock();
+				knock_State.active = knock_ScanReset(knock_State.tck, knock_State.tms);
+				more = (knock_State.active != 0) && knock_NextTDI();
 			}
-		}
+			else
+			{
+				knock_ScanBypass(knock_State.tck, knock_State.tms, knock_State.tdi, knock_State.active);
+				more = knock_NextTDI();
+			}
+			break;
+
+		default:
+			more = false;
+			break;
+	}
+	//unassign the signals
+	jtag_Cfg(JTAG_SIGNAL_TCK, JTAG_SIGNAL_NOT_ALLOCATED);
+	jtag_Cfg(JTAG_SIGNAL_TMS, JTAG_SIGNAL_NOT_ALLOCATED);
+
+	return more || knock_NextPair();
+}
+
+/**
+ * @brief Save the scan progress in the backup registers
+ *
+ * The backup registers survive a reset, and a power cycle if VBAT is kept
+ * up, so an interrupted scan can be resumed. There are only ten 16 bit
+ * registers, so the pins an auto scan is trying with bypass aren't kept,
+ * see @ref knock_LoadCheckpoint.
+ */
+static void knock_SaveCheckpoint()
+{
+	BKP_DR2 = knock_State.mode | (knock_PinCount << 4);
+	BKP_DR3 = knock_State.tck | (knock_State.tms << 8);
+	BKP_DR4 = knock_State.tdi | (knock_State.chains << 8);
+	BKP_DR5 = knock_KnownPins & 0xFFFF;
+	BKP_DR6 = (knock_KnownPins >> 16) & 0xFFFF;
+	BKP_DR7 = (knock_KnownPins >> 32) & 0xFFFF;
+	BKP_DR8 = knock_State.candidates;
+	BKP_DR9 = knock_State.cycles / rcc_ahb_frequency;
+	BKP_DR10 = knock_State.budget;
+	BKP_DR1 = KNOCK_CHECKPOINT_MAGIC;
+}
+
+/**
+ * @brief Restore the scan progress from the backup registers
+ *
+ * An auto scan part way through the bypass scans of a TCK/TMS pair starts
+ * that pair again, to find the pins to try. The checkpoint is checked
+ * before any of it is used, a stale or corrupt one leaves the scan state
+ * as it was.
+ *
+ * @retval true An interrupted scan was restored, paused.
+ */
+static bool knock_LoadCheckpoint()
+{
+	knock_Scanner state;
+	unsigned int npins;
+
+	if((BKP_DR1 & 0xFFFF) != KNOCK_CHECKPOINT_MAGIC)
+	{
+		return false;
+	}
+
+	state.mode = BKP_DR2 & 0x0F;
+	npins = (BKP_DR2 >> 4) & 0xFF;
+	state.tck = BKP_DR3 & 0xFF;
+	state.tms = (BKP_DR3 >> 8) & 0xFF;
+	state.tdi = BKP_DR4 & 0xFF;
+	state.chains = (BKP_DR4 >> 8) & 0xFF;
+	state.budget = BKP_DR10;
+	if((state.mode >= KNOCK_MODE_MAX) || (npins > JTAG_PIN_MAX) || (state.tck >= npins) || (state.tms >= npins)
+		|| ((state.tdi != KNOCK_CURSOR_RESET) && (state.tdi >= npins)) || (state.budget > KNOCK_BUDGET_MAX))
+	{
+		return false;
+	}
+
+	state.active = 0;
+	state.candidates = BKP_DR8 & 0xFFFF;
+	state.cycles = (uint64_t)(BKP_DR9 & 0xFFFF) * rcc_ahb_frequency;
+	state.limit = 0;
+	state.status = KNOCK_STATUS_PAUSED;
+	if(state.mode == KNOCK_MODE_AUTO)
+	{
+		state.tdi = KNOCK_CURSOR_RESET;
 	}
+
+	knock_State = state;
+	knock_PinCount = npins;
+	knock_KnownPins = (BKP_DR5 & 0xFFFF) | ((jtag_PinMask)(BKP_DR6 & 0xFFFF) << 16) | ((jtag_PinMask)(BKP_DR7 & 0xFFFF) << 32);
+	return true;
 }
 
 /**
- * @brief Try and find a JTAG chain
+ * @brief Clear the scan progress from the backup registers
+ */
+static void knock_ClearCheckpoint()
+{
+	BKP_DR1 = 0;
+}
+
+/**
+ * @brief Initialise the knock module
+ *
+ * Enables access to the backup registers and picks up a scan that was
+ * interrupted by a reset. It is left paused for @ref knock_Resume.
+ */
+void knock_Init()
+{
+	rcc_periph_clock_enable(RCC_PWR);
+	rcc_periph_clock_enable(RCC_BKP);
+	pwr_disable_backup_domain_write_protect();
+
+	if(knock_LoadCheckpoint())
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[*] Interrupted scan at TCK: %i TMS: %i, use scan resume\r\n", knock_State.tck, knock_State.tms);
+	}
+	else
+	{
+		knock_State.status = KNOCK_STATUS_IDLE;
+		knock_ClearCheckpoint();
+	}
+}
+
+/**
+ * @brief Start looking for a JTAG chain
  *
  * Unassignes all signals before scanning. A known pin shouldn't be used
- * in the scan.
+ * in the scan. Each chain found is stored, see @ref pinstore_Save. The scan
+ * is run a candidate at a time by @ref knock_Step.
  *
  * @param[in] mode The scanning mode to use, see #knock_Mode
  * @param[in] pins The number of pins that are wired up, must be >= 4
+ * @param[in] budget The number of seconds to scan for before pausing, 0 for
+ * no limit
  */
-void knock_Scan(knock_Mode mode, unsigned int pins)
+void knock_Start(knock_Mode mode, unsigned int pins, unsigned int budget)
 {
-	unsigned int tck, tms;
 	jtag_Signal sig;
 	knock_PinCount = pins;
+	knock_KnownPins = 0;
 
 	//unassign all signals
 	for(sig = JTAG_SIGNAL_TCK; sig < JTAG_SIGNAL_MAX; ++sig)
@@ -307,34 +1030,131 @@ void knock_Scan(knock_Mode mode, unsigned int pins)
 		jtag_Cfg(sig, JTAG_SIGNAL_NOT_ALLOCATED);
 	}
 
+	knock_State.mode = mode;
+	knock_State.tck = 0;
+	knock_State.tms = ((mode == KNOCK_MODE_BROADCAST) || (mode == KNOCK_MODE_SWD)) ? 0 : 1;
+	knock_State.tdi = KNOCK_CURSOR_RESET;
+	knock_State.active = 0;
+	knock_State.candidates = 0;
+	knock_State.chains = 0;
+	knock_State.cycles = 0;
+	knock_State.budget = budget;
+	knock_State.status = KNOCK_STATUS_PAUSED;
+
 	message_Write(MESSAGE_LEVEL_GENERAL, "Scanning for JTAG port...\r\n");
-	for(tck = 0; tck < knock_PinCount; ++tck)
+	knock_Resume();
+}
+
+/**
+ * @brief Run the next candidate of the scan
+ *
+ * Called from the main loop, so the host is serviced between candidates.
+ * The progress is checkpointed after each one and the scan is paused once
+ * its time budget is used up.
+ *
+ * @retval true The scan has more to do.
+ */
+bool knock_Step()
+{
+	uint32_t start = DWT_CYCCNT;
+	bool more;
+
+	if(knock_State.status != KNOCK_STATUS_RUNNING)
 	{
-		message_Write(MESSAGE_LEVEL_VERBOSE, "Trying TCK: %i\r", tck);
-		for(tms = 0; tms < knock_PinCount; ++tms)
-		{
-			if(tck != tms)
-			{
-				message_Write(MESSAGE_LEVEL_DEBUG, "Trying TCK: %i TMS: %i\r", tck, tms);
-				//assign the JTAG signals for this iteration
-				jtag_Cfg(JTAG_SIGNAL_TCK, tck);
-				jtag_Cfg(JTAG_SIGNAL_TMS, tms);
-				switch(mode)
-				{
-					case KNOCK_MODE_RESET:
-						knock_ScanReset(tck, tms);
-						break;
+		return false;
+	}
 
-					case KNOCK_MODE_BYPASS:
-						knock_ScanBypass(tck, tms);
-						break;
-				}
-				//unassign the signals
-				jtag_Cfg(JTAG_SIGNAL_TCK, JTAG_SIGNAL_NOT_ALLOCATED);
-				jtag_Cfg(JTAG_SIGNAL_TMS, JTAG_SIGNAL_NOT_ALLOCATED);
-			}
+	more = knock_StepCandidate();
+	knock_State.cycles += DWT_CYCCNT - start;
+
+	if(!more)
+	{
+		knock_State.status = KNOCK_STATUS_IDLE;
+		knock_ClearCheckpoint();
+		message_Write(MESSAGE_LEVEL_GENERAL, "...Done. %i chain(s) found.\r\n", knock_State.chains);
+	}
+	else
+	{
+		knock_SaveCheckpoint();
+		if((knock_State.budget != 0) && (knock_State.cycles >= knock_State.limit))
+		{
+			knock_State.status = KNOCK_STATUS_PAUSED;
+			message_Write(MESSAGE_LEVEL_GENERAL, "[*] Scan budget used at TCK: %i TMS: %i, use scan resume\r\n", knock_State.tck, knock_State.tms);
 		}
 	}
-	message_Write(MESSAGE_LEVEL_GENERAL, "...Done.\r\n");
+	return knock_State.status == KNOCK_STATUS_RUNNING;
+}
+
+/**
+ * @brief Pause the running scan
+ *
+ * The cursor is kept, so the scan can carry on with @ref knock_Resume.
+ *
+ * @retval true A scan was paused.
+ */
+bool knock_Abort()
+{
+	bool success = (knock_State.status == KNOCK_STATUS_RUNNING);
+
+	if(success)
+	{
+		knock_State.status = KNOCK_STATUS_PAUSED;
+		message_Write(MESSAGE_LEVEL_GENERAL, "[*] Scan stopped at TCK: %i TMS: %i\r\n", knock_State.tck, knock_State.tms);
+	}
+	return success;
 }
 
+/**
+ * @brief Carry on with a paused scan
+ *
+ * The time budget, if any, starts again from now.
+ *
+ * @retval true The scan is running.
+ */
+bool knock_Resume()
+{
+	bool success = (knock_State.status == KNOCK_STATUS_PAUSED);
+
+	if(success)
+	{
+		knock_State.limit = knock_State.cycles + ((uint64_t)knock_State.budget * rcc_ahb_frequency);
+		knock_State.status = KNOCK_STATUS_RUNNING;
+	}
+	return success;
+}
+
+/**
+ * @brief Check if a scan is being run
+ *
+ * @retval true The scan is running, the JTAG signals belong to it.
+ */
+bool knock_IsRunning()
+{
+	return knock_State.status == KNOCK_STATUS_RUNNING;
+}
+
+/**
+ * @brief Display the progress of the scan
+ *
+ * The rate is in TCK/TMS candidates, or TCK candidates for broadcast and SWD
+ * mode,
+ * per second of scanning.
+ */
+void knock_Status()
+{
+	static const char * const status_names[] = {
+		[KNOCK_STATUS_IDLE] = "idle",
+		[KNOCK_STATUS_RUNNING] = "running",
+		[KNOCK_STATUS_PAUSED] = "paused",
+	};
+	unsigned int total = knock_PerTCK() ? knock_PinCount : (knock_PinCount * (knock_PinCount - 1));
+	uint32_t ms = knock_State.cycles / (rcc_ahb_frequency / 1000);
+	uint32_t rate = (ms != 0) ? ((knock_State.candidates * 1000UL) / ms) : 0;
+
+	message_Write(MESSAGE_LEVEL_REQUIRED, "Scan %s, %i chain(s) found\r\n", status_names[knock_State.status], knock_State.chains);
+	if(knock_State.status != KNOCK_STATUS_IDLE)
+	{
+		message_Write(MESSAGE_LEVEL_REQUIRED, "  At TCK: %i TMS: %i, %i/%i candidates\r\n", knock_State.tck, knock_State.tms, knock_State.candidates, total);
+		message_Write(MESSAGE_LEVEL_REQUIRED, "  %lu.%03lus, %lu candidates/s\r\n", (unsigned long)(ms / 1000), (unsigned long)(ms % 1000), (unsigned long)rate);
+	}
+}
@@ -18,10 +18,24 @@
 #if !defined(_KNOCK_H_)
 #define _KNOCK_H_
 
+#include <stdbool.h>
+
+#define KNOCK_BUDGET_MAX	(0xFFFF)	///< Longest time budget in seconds, the checkpoint keeps 16 bits
+
 typedef enum knock_eMode {
 	KNOCK_MODE_RESET,		///< Use TAP Reset to try and find a chain
 	KNOCK_MODE_BYPASS,		///< Use BYPASS instruction to try and find a chain
+	KNOCK_MODE_BROADCAST,		///< Use TAP Reset with TMS driven on many pins at once
+	KNOCK_MODE_AUTO,		///< Use TAP Reset, then BYPASS where there's activity but no ID CODE
+	KNOCK_MODE_SWD,			///< Read the SWD DPIDR with SWDIO driven on many pins at once
+	KNOCK_MODE_MAX
 } knock_Mode;
 
-extern void knock_Scan(knock_Mode mode, unsigned int Pins);
+extern void knock_Init();
+extern void knock_Start(knock_Mode mode, unsigned int pins, unsigned int budget);
+extern bool knock_Step();
+extern bool knock_Abort();
+extern bool knock_Resume();
+extern bool knock_IsRunning();
+extern void knock_Status();
 #endif
@@ -25,6 +25,37 @@
 #include "knock.h"
 #include "message.h"
 #include "comprocessor.h"
+#include "chain.h"
+#include "pinstore.h"
+#include "sched.h"
+
+static bool main_HostTask();
+
+/**
+ * @brief Hand data received from the host to the command processor
+ *
+ * While a job is running the data is left in the receive buffer, which
+ * holds a USB host off until the job is done. The USART has no flow
+ * control, see @ref serial_Receive. Whatever the command processor
+ * doesn't use is left for the next pass.
+ *
+ * @retval true There is more data waiting.
+ */
+static bool main_HostTask()
+{
+	const char *data;
+	unsigned int len = 0;
+
+	if(!sched_IsBusy())
+	{
+		len = serial_Receive(&data);
+		if(len > 0)
+		{
+			serial_Consume(comproc_Process(data, len));
+		}
+	}
+	return len > 0;
+}
 
 /**
  * Development board entry point
@@ -37,12 +68,26 @@ void main()
 	rcc_clock_setup_in_hse_8mhz_out_72mhz();
 	serial_Init();
 	message_Init();
+	jtag_Init();
+	jtagTAP_Init();
+	chain_Init();
 	comproc_Init();
+	knock_Init();
+
+	//reattach to the last board seen, if it's still there
+	pinstore_Recall();
+
+	//the host and a running scan take turns, transmit is drained by interrupts
+	//and what the scan logs is formatted between its steps
+	sched_Init();
+	sched_Add(main_HostTask);
+	sched_Add(knock_Step);
+	sched_Add(message_Task);
 
 	//processing
 	while(true)
 	{
-
+		sched_Run();
 	}
 
 	//whoops, we dropped out of the main loop
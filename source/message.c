@@ -19,10 +19,34 @@
 #include "serial.h"
 #include <strings.h>
 #include <stdarg.h>
+#include <stdio.h>
 
 #define MESSAGE_WRITE_BUFFER	256	///< The maximum length of a message
+#define MESSAGE_LOG_LENGTH	(256)	///< Words in the log ring, a power of 2
+#define MESSAGE_LOG_MASK	(MESSAGE_LOG_LENGTH - 1)	///< Index mask for the log ring
+#define MESSAGE_LOG_BUFFER	(80)	///< The maximum length of an expanded logged message
+#define MESSAGE_LOG_BATCH	(8)	///< Logged messages sent for each run of the task
+#define MESSAGE_FRAME_LENGTH	(4 + (4 * MESSAGE_LOG_ARGS_MAX))	///< Longest binary frame
 
 static message_Levels message_Level;	///< The current message level
+static message_LogFormats message_LogFormat;	///< How logged messages are sent
+
+/**
+ * @brief Formats of the logged messages, by ID
+ */
+static const char * const message_Formats[MESSAGE_ID_MAX] = {
+#define MESSAGE_ID(name, format)	[MESSAGE_ID_##name] = format,
+#include "messageids.h"
+#undef MESSAGE_ID
+};
+
+static uint32_t message_LogRing[MESSAGE_LOG_LENGTH];	///< Logged messages, a header word then the arguments
+static unsigned int message_LogHead;		///< Words recorded
+static unsigned int message_LogTail;		///< Words sent
+static uint32_t message_LogDropped;		///< Messages that didn't fit since the last report
+
+static bool message_SendNext();
+static void message_Send(message_IDs id, unsigned int count, const uint32_t *args);
 
 /**
  * @brief Initialize the message module
@@ -32,6 +56,10 @@ static message_Levels message_Level;	///< The current message level
 void message_Init()
 {
 	message_Level = MESSAGE_LEVEL_GENERAL;
+	message_LogFormat = MESSAGE_LOG_TEXT;
+	message_LogHead = 0;
+	message_LogTail = 0;
+	message_LogDropped = 0;
 }
 
 /**
@@ -62,6 +90,9 @@ message_Levels message_GetLevel()
  * The message should only be displayed to the user if the message level
  * is less than or equal to the current message level.
  *
+ * Logged messages still waiting are sent first, so the output stays in
+ * order.
+ *
  * @param level The message level
  * @param fmt A format string for the level
  * @return The number of bytes written or -1 if an error occured,
@@ -74,6 +105,7 @@ int message_Write(message_Levels level, const char *fmt, ...)
 	va_list args;
 	if(level <= message_Level)
 	{
+		message_Flush();
 		va_start(args, fmt);
 		n = vsnprintf(buffer, MESSAGE_WRITE_BUFFER, fmt, args);
 		if((n > 0) && (n < MESSAGE_WRITE_BUFFER))
@@ -90,4 +122,185 @@ int message_Write(message_Levels level, const char *fmt, ...)
 	{
 		n = -2;
 	}
+	return n;
+}
+
+/**
+ * @brief Record a message to be sent later
+ *
+ * Use @ref message_Log rather than calling this directly. Nothing is
+ * formatted here, the ID and arguments are copied into the log ring for
+ * @ref message_Task. When the ring is full the message is dropped and
+ * counted, the count is reported once the ring has drained.
+ *
+ * @param[in] level The message level.
+ * @param[in] id The message, one of messageids.h.
+ * @param[in] count The number of arguments.
+ * @param[in] args The arguments.
+ */
+void message_Record(message_Levels level, message_IDs id, unsigned int count, const uint32_t *args)
+{
+	unsigned int i;
+
+	if(level <= message_Level)
+	{
+		if(count > MESSAGE_LOG_ARGS_MAX)
+		{
+			count = MESSAGE_LOG_ARGS_MAX;
+		}
+
+		if((MESSAGE_LOG_LENGTH - (message_LogHead - message_LogTail)) > count)
+		{
+			message_LogRing[message_LogHead++ & MESSAGE_LOG_MASK] = (uint32_t)id | ((uint32_t)count << 16);
+			for(i = 0; i < count; ++i)
+			{
+				message_LogRing[message_LogHead++ & MESSAGE_LOG_MASK] = args[i];
+			}
+		}
+		else
+		{
+			++message_LogDropped;
+		}
+	}
+}
+
+/**
+ * @brief Send some of the logged messages
+ *
+ * Run by the scheduler, so logging from a scan costs the scan only the
+ * copy into the ring.
+ *
+ * @retval true There are more logged messages to send.
+ */
+bool message_Task()
+{
+	unsigned int i;
+
+	for(i = 0; (i < MESSAGE_LOG_BATCH) && message_SendNext(); ++i)
+	{
+	}
+	return (message_LogHead != message_LogTail) || (message_LogDropped > 0);
+}
+
+/**
+ * @brief Send all of the logged messages
+ */
+void message_Flush()
+{
+	while(message_SendNext())
+	{
+	}
+}
+
+/**
+ * @brief Set how logged messages are sent
+ *
+ * The messages already logged are sent in the old format first.
+ *
+ * @param[in] format The format to use.
+ */
+void message_SetLogFormat(message_LogFormats format)
+{
+	if(format < MESSAGE_LOG_MAX)
+	{
+		message_Flush();
+		message_LogFormat = format;
+	}
+}
+
+/**
+ * @brief Get how logged messages are sent
+ */
+message_LogFormats message_GetLogFormat()
+{
+	return message_LogFormat;
+}
+
+/**
+ * @brief Send the oldest logged message
+ *
+ * Once the ring is empty, the number of messages dropped is sent, if any.
+ *
+ * @retval true A message was sent.
+ */
+static bool message_SendNext()
+{
+	uint32_t args[MESSAGE_LOG_ARGS_MAX];
+	bool sent = true;
+
+	if(message_LogHead != message_LogTail)
+	{
+		uint32_t header = message_LogRing[message_LogTail++ & MESSAGE_LOG_MASK];
+		unsigned int count = header >> 16;
+		unsigned int i;
+
+		for(i = 0; i < count; ++i)
+		{
+			args[i] = message_LogRing[message_LogTail++ & MESSAGE_LOG_MASK];
+		}
+		message_Send(header & 0xFFFF, count, args);
+	}
+	else if(message_LogDropped > 0)
+	{
+		args[0] = message_LogDropped;
+		message_LogDropped = 0;
+		message_Send(MESSAGE_ID_DROPPED, 1, args);
+	}
+	else
+	{
+		sent = false;
+	}
+	return sent;
+}
+
+/**
+ * @brief Send a logged message to the host
+ *
+ * In text mode the message is formatted, with any missing arguments as 0.
+ * In binary mode a frame is sent instead: @ref MESSAGE_FRAME_START, the ID
+ * as 2 bytes, the number of arguments and then each argument as 4 bytes,
+ * all little endian.
+ *
+ * @param[in] id The message.
+ * @param[in] count The number of arguments.
+ * @param[in] args The arguments.
+ */
+static void message_Send(message_IDs id, unsigned int count, const uint32_t *args)
+{
+	unsigned int i;
+
+	if(message_LogFormat == MESSAGE_LOG_BINARY)
+	{
+		char frame[MESSAGE_FRAME_LENGTH];
+		unsigned int len = 0;
+
+		frame[len++] = MESSAGE_FRAME_START;
+		frame[len++] = id & 0xFF;
+		frame[len++] = (id >> 8) & 0xFF;
+		frame[len++] = count;
+		for(i = 0; i < count; ++i)
+		{
+			frame[len++] = args[i] & 0xFF;
+			frame[len++] = (args[i] >> 8) & 0xFF;
+			frame[len++] = (args[i] >> 16) & 0xFF;
+			frame[len++] = (args[i] >> 24) & 0xFF;
+		}
+		serial_Send(frame, len);
+	}
+	else if(id < MESSAGE_ID_MAX)
+	{
+		uint32_t values[MESSAGE_LOG_ARGS_MAX] = { 0 };
+		char buffer[MESSAGE_LOG_BUFFER];
+		int n;
+
+		for(i = 0; i < count; ++i)
+		{
+			values[i] = args[i];
+		}
+		n = snprintf(buffer, MESSAGE_LOG_BUFFER, message_Formats[id], values[0], values[1], values[2], values[3]);
+		if((n > 0) && (n < MESSAGE_LOG_BUFFER))
+		{
+			serial_Send(buffer, n);
+		}
+	}
 }
@@ -18,6 +18,12 @@
 #if !defined(_MESSAGE_H_)
 #define _MESSAGE_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
+#define MESSAGE_LOG_ARGS_MAX	(4)	///< Most arguments a logged message can have
+#define MESSAGE_FRAME_START	(0x1E)	///< First byte of a binary log frame, never part of a text message
+
 /**
  * @brief Available message levels
  *
@@ -32,10 +38,49 @@ typedef enum message_eLevels
 	MESSAGE_LEVEL_MAX		///< Maximum level number
 }message_Levels;
 
+/**
+ * @brief IDs of the messages that can be logged, from messageids.h
+ */
+typedef enum message_eIDs
+{
+#define MESSAGE_ID(name, format)	MESSAGE_ID_##name,
+#include "messageids.h"
+#undef MESSAGE_ID
+	MESSAGE_ID_MAX
+}message_IDs;
+
+/**
+ * @brief How logged messages are sent to the host
+ */
+typedef enum message_eLogFormats
+{
+	MESSAGE_LOG_TEXT = 0,		///< Expanded with their formats, as message_Write would
+	MESSAGE_LOG_BINARY,		///< Sent as frames of the ID and raw arguments, for the host to expand
+	MESSAGE_LOG_MAX			///< Maximum format number
+}message_LogFormats;
+
+#define MESSAGE_NARGS(...)	MESSAGE_NARGS_(0, ##__VA_ARGS__, 4, 3, 2, 1, 0)	///< Number of arguments given, up to 4
+#define MESSAGE_NARGS_(_0, _1, _2, _3, _4, n, ...)	n
+
+/**
+ * @brief Log a message without formatting it
+ *
+ * Only the ID, from messageids.h without the MESSAGE_ID_ prefix, and up to
+ * @ref MESSAGE_LOG_ARGS_MAX arguments are recorded. The message is
+ * formatted or sent in binary later by @ref message_Task, so this is cheap
+ * enough for inner loops.
+ */
+#define message_Log(level, id, ...)	message_Record((level), MESSAGE_ID_##id, MESSAGE_NARGS(__VA_ARGS__), &((const uint32_t[]){ 0, ##__VA_ARGS__ })[1])
+
 //Message functions
 
 extern void message_Init();
 extern void message_SetLevel(message_Levels level);
 extern message_Levels message_GetLevel();
 extern int message_Write(message_Levels level, const char *fmt, ...);
+extern void message_Record(message_Levels level, message_IDs id, unsigned int count, const uint32_t *args);
+extern bool message_Task();
+extern void message_Flush();
+extern void message_SetLogFormat(message_LogFormats format);
+extern message_LogFormats message_GetLogFormat();
 #endif
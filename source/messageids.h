@@ -0,0 +1,36 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Messages that can be logged with message_Log
+ *
+ * Each entry is MESSAGE_ID(name, format). The list is included wherever it
+ * is needed with MESSAGE_ID defined to pick out the part wanted, so the IDs
+ * and their formats can't get out of step. The position is the ID sent in
+ * binary frames, add new messages to the end. The arguments are logged as
+ * 32 bit values, so the formats can only use integer conversions such as
+ * %i, %u and %X, not %s or 64 bit values.
+ *
+ * make messageids lists the IDs and formats for decoding binary frames on
+ * the host.
+ */
+MESSAGE_ID(DROPPED, "[-] %u message(s) dropped\r\n")
+MESSAGE_ID(KNOCK_TCK, "Trying TCK: %i\r")
+MESSAGE_ID(KNOCK_TCK_TMS, "Trying TCK: %i TMS: %i\r")
+MESSAGE_ID(KNOCK_TCK_TMS_PINS, "Trying TCK: %i TMS: %04X%08X\r")
+MESSAGE_ID(RX_OVERRUN, "[-] %u received byte(s) discarded, the host sent too far ahead\r\n")
@@ -0,0 +1,335 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <libopencm3/stm32/flash.h>
+#include "pinstore.h"
+#include "jtag.h"
+#include "jtagtap.h"
+#include "chain.h"
+#include "message.h"
+
+#define PINSTORE_SIGNALS	(JTAG_SIGNAL_TDO + 1)	///< TCK, TMS, TDI and TDO are stored
+#define PINSTORE_BLANK		(0xFFFFFFFF)		///< Value of an erased flash word
+#define PINSTORE_CHECK_SEED	(0x4B4E4B4A)		///< Starting value for the record check
+
+/**
+ * @brief A discovered pinout and the ID CODEs that were on it
+ *
+ * Records are appended to the flash page in the order they are found, a
+ * record that is still erased marks the end of the list.
+ */
+typedef struct pinstore_sRecord
+{
+	uint8_t pins[PINSTORE_SIGNALS];		///< Pin for each signal, indexed by jtag_Signal
+	uint32_t devices;			///< Number of devices in the chain
+	uint32_t idcodes[PINSTORE_IDCODES];	///< ID CODEs of the first devices, 0 for BYPASS
+	uint32_t check;				///< Check value over the rest of the record
+} pinstore_Record;
+
+#define PINSTORE_WORDS		(sizeof(pinstore_Record) / sizeof(uint32_t))	///< Flash words in a record
+#define PINSTORE_SLOTS		(PINSTORE_PAGE_SIZE / sizeof(pinstore_Record))	///< Records that fit in the page
+#define pinstore_Slots		((const pinstore_Record *)PINSTORE_ADDRESS)	///< The records in flash
+
+static uint32_t pinstore_Check(const pinstore_Record *record);
+static bool pinstore_IsValid(const pinstore_Record *record);
+static bool pinstore_Matches(const pinstore_Record *a, const pinstore_Record *b);
+static unsigned int pinstore_Used();
+static int pinstore_Previous(int slot);
+static bool pinstore_Program(unsigned int slot, const pinstore_Record *record);
+static bool pinstore_Verify(const pinstore_Record *record);
+
+/**
+ * @brief Calculate the check value of a record
+ *
+ * @param[in] record The record to check.
+ * @returns The check value over everything but the check itself.
+ */
+static uint32_t pinstore_Check(const pinstore_Record *record)
+{
+	const uint32_t *words = (const uint32_t *)record;
+	uint32_t check = PINSTORE_CHECK_SEED;
+	unsigned int i;
+
+	for(i = 0; i < (PINSTORE_WORDS - 1); ++i)
+	{
+		check = ((check << 5) | (check >> 27)) ^ words[i];
+	}
+	return check;
+}
+
+/**
+ * @brief Check if a record was written completely
+ *
+ * @param[in] record The record to check.
+ * @retval true The record holds a pinout.
+ */
+static bool pinstore_IsValid(const pinstore_Record *record)
+{
+	return (*(const uint32_t *)record->pins != PINSTORE_BLANK) && (record->check == pinstore_Check(record));
+}
+
+/**
+ * @brief Check if two records hold the same pinout and chain
+ *
+ * @param[in] a The first record.
+ * @param[in] b The second record.
+ * @retval true The records match.
+ */
+static bool pinstore_Matches(const pinstore_Record *a, const pinstore_Record *b)
+{
+	const uint32_t *a_words = (const uint32_t *)a;
+	const uint32_t *b_words = (const uint32_t *)b;
+	unsigned int i;
+
+	for(i = 0; i < (PINSTORE_WORDS - 1); ++i)
+	{
+		if(a_words[i] != b_words[i])
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * @brief Find the number of slots that have been written
+ *
+ * A slot that isn't blank is in use even if the record in it is invalid, as
+ * flash can't be written twice without erasing the whole page.
+ *
+ * @returns The index of the first blank slot, PINSTORE_SLOTS if full.
+ */
+static unsigned int pinstore_Used()
+{
+	unsigned int slot;
+
+	for(slot = 0; slot < PINSTORE_SLOTS; ++slot)
+	{
+		const uint32_t *words = (const uint32_t *)&pinstore_Slots[slot];
+		unsigned int i;
+
+		for(i = 0; (i < PINSTORE_WORDS) && (words[i] == PINSTORE_BLANK); ++i)
+		{
+		}
+		if(i == PINSTORE_WORDS)
+		{
+			break;
+		}
+	}
+	return slot;
+}
+
+/**
+ * @brief Find the newest valid record before a slot
+ *
+ * @param[in] slot The slot to search back from.
+ * @returns The slot of the record, or -1 if there isn't one.
+ */
+static int pinstore_Previous(int slot)
+{
+	while(--slot >= 0)
+	{
+		if(pinstore_IsValid(&pinstore_Slots[slot]))
+		{
+			break;
+		}
+	}
+	return slot;
+}
+
+/**
+ * @brief Write a record into a blank slot
+ *
+ * @pre The flash is unlocked.
+ * @param[in] slot The slot to write.
+ * @param[in] record The record to write, not in flash.
+ * @retval true The record reads back correctly.
+ */
+static bool pinstore_Program(unsigned int slot, const pinstore_Record *record)
+{
+	const uint32_t *words = (const uint32_t *)record;
+	uint32_t address = (uint32_t)PINSTORE_ADDRESS + (slot * sizeof(pinstore_Record));
+	unsigned int i;
+
+	for(i = 0; i < PINSTORE_WORDS; ++i)
+	{
+		flash_program_word(address + (i * sizeof(uint32_t)), words[i]);
+	}
+	return pinstore_Matches(&pinstore_Slots[slot], record) && (pinstore_Slots[slot].check == record->check);
+}
+
+/**
+ * @brief Store the current pinout and chain
+ *
+ * Takes the pins from the current signal configuration and the ID CODEs
+ * from the last @ref chain_Detect. Nothing is written if the same record
+ * is already one of the most recent. When the page is full it is erased
+ * and the most recent records are written back first.
+ *
+ * @retval true The pinout is stored.
+ */
+bool pinstore_Save()
+{
+	pinstore_Record record;
+	pinstore_Record keep[PINSTORE_RECORDS - 1];
+	unsigned int nkeep = 0;
+	unsigned int used = pinstore_Used();
+	unsigned int count;
+	jtag_Signal sig;
+	int slot;
+	bool success = true;
+
+	for(sig = JTAG_SIGNAL_TCK; sig < PINSTORE_SIGNALS; ++sig)
+	{
+		int pin = jtag_GetCfg(sig);
+		if(pin == JTAG_SIGNAL_NOT_ALLOCATED)
+		{
+			return false;
+		}
+		record.pins[sig] = pin;
+	}
+	record.devices = chain_GetDevices();
+	if(record.devices == 0)
+	{
+		return false;
+	}
+	for(count = 0; count < PINSTORE_IDCODES; ++count)
+	{
+		record.idcodes[count] = chain_GetIDCode(count);
+	}
+	record.check = pinstore_Check(&record);
+
+	//don't wear the flash storing the same board again
+	for(slot = pinstore_Previous(used), count = 0; (slot >= 0) && (count < PINSTORE_RECORDS); slot = pinstore_Previous(slot), ++count)
+	{
+		if(pinstore_Matches(&pinstore_Slots[slot], &record))
+		{
+			return true;
+		}
+	}
+
+	flash_unlock();
+	if(used == PINSTORE_SLOTS)
+	{
+		//keep the most recent, oldest first
+		for(slot = pinstore_Previous(used); (slot >= 0) && (nkeep < (PINSTORE_RECORDS - 1)); slot = pinstore_Previous(slot))
+		{
+			++nkeep;
+			keep[PINSTORE_RECORDS - 1 - nkeep] = pinstore_Slots[slot];
+		}
+
+		flash_erase_page(PINSTORE_ADDRESS);
+		for(used = 0; (used < nkeep) && success; ++used)
+		{
+			success = pinstore_Program(used, &keep[PINSTORE_RECORDS - 1 - nkeep + used]);
+		}
+	}
+	success = success && pinstore_Program(used, &record);
+	flash_lock();
+
+	if(!success)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[-] Failed to store the pinout.\r\n");
+	}
+	return success;
+}
+
+/**
+ * @brief Check if a stored chain is still attached
+ *
+ * The pins are configured from the record and the chain detected once. The
+ * pins are left configured if the chain matches.
+ *
+ * @param[in] record The record to check.
+ * @retval true The same chain was found on the same pins.
+ */
+static bool pinstore_Verify(const pinstore_Record *record)
+{
+	jtag_Signal sig;
+	bool success = true;
+
+	for(sig = JTAG_SIGNAL_TCK; sig < PINSTORE_SIGNALS; ++sig)
+	{
+		jtag_Cfg(sig, JTAG_SIGNAL_NOT_ALLOCATED);
+	}
+	for(sig = JTAG_SIGNAL_TCK; (sig < PINSTORE_SIGNALS) && success; ++sig)
+	{
+		success = jtag_Cfg(sig, record->pins[sig]);
+	}
+
+	if(success)
+	{
+		unsigned int device;
+
+		message_Write(MESSAGE_LEVEL_VERBOSE, "Trying stored pinout TCK: %i TMS: %i TDO: %i TDI: %i\r\n",
+				record->pins[JTAG_SIGNAL_TCK], record->pins[JTAG_SIGNAL_TMS], record->pins[JTAG_SIGNAL_TDO], record->pins[JTAG_SIGNAL_TDI]);
+		jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
+		success = chain_Detect() && (chain_GetDevices() == record->devices);
+		for(device = 0; (device < PINSTORE_IDCODES) && success; ++device)
+		{
+			success = (chain_GetIDCode(device) == record->idcodes[device]);
+		}
+	}
+
+	if(success)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[!] Recalled Chain: TCK: %i TMS: %i TDO: %i TDI: %i\r\n",
+				record->pins[JTAG_SIGNAL_TCK], record->pins[JTAG_SIGNAL_TMS], record->pins[JTAG_SIGNAL_TDO], record->pins[JTAG_SIGNAL_TDI]);
+	}
+	else
+	{
+		for(sig = JTAG_SIGNAL_TCK; sig < PINSTORE_SIGNALS; ++sig)
+		{
+			jtag_Cfg(sig, JTAG_SIGNAL_NOT_ALLOCATED);
+		}
+	}
+	return success;
+}
+
+/**
+ * @brief Look for one of the stored chains
+ *
+ * The most recent records are tried newest first, stopping at the first
+ * that still matches. Its pins are left configured.
+ *
+ * @retval true A stored chain was found.
+ */
+bool pinstore_Recall()
+{
+	unsigned int count;
+	int slot;
+
+	for(slot = pinstore_Previous(pinstore_Used()), count = 0; (slot >= 0) && (count < PINSTORE_RECORDS); slot = pinstore_Previous(slot), ++count)
+	{
+		if(pinstore_Verify(&pinstore_Slots[slot]))
+		{
+			return true;
+		}
+	}
+
+	if(count == 0)
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "No stored pinouts.\r\n");
+	}
+	else
+	{
+		message_Write(MESSAGE_LEVEL_GENERAL, "[-] None of the %i stored pinouts responded.\r\n", count);
+	}
+	return false;
+}
@@ -0,0 +1,34 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_PINSTORE_H_)
+#define _PINSTORE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if !defined(PINSTORE_ADDRESS)
+#define PINSTORE_ADDRESS	(0x0800FC00)	///< Flash page holding the records, the last 1KB of a 64KB part
+#endif
+#define PINSTORE_PAGE_SIZE	(1024)		///< Size of the flash page in bytes
+#define PINSTORE_RECORDS	(8)		///< Number of the most recent records kept and recalled
+#define PINSTORE_IDCODES	(5)		///< Number of ID CODEs stored per record
+
+extern bool pinstore_Save();
+extern bool pinstore_Recall();
+
+#endif
@@ -0,0 +1,104 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stddef.h>
+#include "sched.h"
+
+static sched_Task sched_Tasks[SCHED_TASKS_MAX];	///< Tasks run on every pass
+static unsigned int sched_TaskCount;		///< Number of tasks added
+static sched_Task sched_Job;			///< Long JTAG job being stepped, NULL for none
+
+/**
+ * @brief Initialise the scheduler with no tasks and no job
+ */
+void sched_Init()
+{
+	sched_TaskCount = 0;
+	sched_Job = NULL;
+}
+
+/**
+ * @brief Add a task to be run on every pass
+ *
+ * Tasks are run in the order they are added, each pass runs every task once
+ * followed by a step of the job.
+ *
+ * @param[in] task The task to add.
+ * @retval true The task was added.
+ */
+bool sched_Add(sched_Task task)
+{
+	bool success = sched_TaskCount < SCHED_TASKS_MAX;
+
+	if(success)
+	{
+		sched_Tasks[sched_TaskCount++] = task;
+	}
+	return success;
+}
+
+/**
+ * @brief Start a long JTAG job
+ *
+ * The job owns the JTAG signals until it returns false. Only one job runs
+ * at a time, the host task holds further commands back while it's busy.
+ *
+ * @param[in] job The job to step.
+ * @retval true The job was started.
+ * @retval false Another job is still running.
+ */
+bool sched_StartJob(sched_Task job)
+{
+	bool success = sched_Job == NULL;
+
+	if(success)
+	{
+		sched_Job = job;
+	}
+	return success;
+}
+
+/**
+ * @brief Check if a job is running
+ *
+ * @retval true A job is being stepped.
+ */
+bool sched_IsBusy()
+{
+	return sched_Job != NULL;
+}
+
+/**
+ * @brief Run one pass of the tasks and the job
+ *
+ * The job is stepped once per pass, after the tasks. It's dropped once it
+ * returns that there is nothing more to do.
+ */
+void sched_Run()
+{
+	unsigned int i;
+
+	for(i = 0; i < sched_TaskCount; ++i)
+	{
+		sched_Tasks[i]();
+	}
+
+	if((sched_Job != NULL) && !sched_Job())
+	{
+		sched_Job = NULL;
+	}
+}
@@ -0,0 +1,41 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_SCHED_H_)
+#define _SCHED_H_
+
+#include <stdbool.h>
+
+#define SCHED_TASKS_MAX		(4)	///< Number of tasks that can be added
+
+/**
+ * @brief A slice of work, run to completion
+ *
+ * Tasks and jobs must return quickly, doing a bounded amount of work each
+ * time they are called.
+ *
+ * @retval true There is more to do.
+ */
+typedef bool (*sched_Task)(void);
+
+extern void sched_Init();
+extern bool sched_Add(sched_Task task);
+extern bool sched_StartJob(sched_Task job);
+extern bool sched_IsBusy();
+extern void sched_Run();
+
+#endif
@@ -15,40 +15,398 @@
  *   You should have received a copy of the GNU General Public License
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
+
+#include <string.h>
 #include <libopencm3/stm32/gpio.h>
 #include <libopencm3/stm32/usart.h>
 #include <libopencm3/stm32/rcc.h>
+#include <libopencm3/stm32/dma.h>
+#include <libopencm3/cm3/nvic.h>
 #include "serial.h"
+#include "usbcdc.h"
+#include "stats.h"
+#include "message.h"
+
+#define SERIAL_TX_LENGTH	(1024)	///< Transmit ring size, must be a power of 2
+#define SERIAL_TX_MASK		(SERIAL_TX_LENGTH - 1)
+
+static char serial_TxBuffer[SERIAL_TX_LENGTH];	///< Data waiting to be sent to the host
+static volatile unsigned int serial_TxHead;	///< Bytes queued, only written by serial_Send
+static volatile unsigned int serial_TxTail;	///< Bytes sent, only written by the transport
+static unsigned int serial_TxDropped;		///< Bytes dropped since the last marker
+
+static void serial_StartTx();
+static bool serial_IsConnected();
+static void serial_Queue(const char *buffer, unsigned int len);
+#if (SERIAL_TX_OVERFLOW == SERIAL_OVERFLOW_COUNT)
+static void serial_QueueDropped();
+#endif
+
+/**
+ * @brief Queue data to be sent to the host
+ *
+ * The data is copied into the transmit ring and sent from interrupts, so the
+ * caller only waits if the ring is full. What happens then depends on
+ * @ref SERIAL_TX_OVERFLOW:
+ *   - SERIAL_OVERFLOW_BLOCK waits for space, unless no host is connected.
+ *   - SERIAL_OVERFLOW_DROP discards the data that won't fit.
+ *   - SERIAL_OVERFLOW_COUNT discards it and later sends a marker with the
+ *     number of bytes lost.
+ *
+ * @param[in] buffer The data to send
+ * @param[in] len The number of bytes in buffer
+ */
+void serial_Send(const char *buffer, const unsigned int len)
+{
+	STATS_BEGIN(STATS_SERIAL_SEND);
+#if (SERIAL_TX_OVERFLOW == SERIAL_OVERFLOW_COUNT)
+	if(serial_TxDropped > 0)
+	{
+		serial_QueueDropped();
+	}
+#endif
+	serial_Queue(buffer, len);
+	serial_StartTx();
+	STATS_END(STATS_SERIAL_SEND);
+}
 
+/**
+ * @brief Get the next block of data to transmit
+ *
+ * Used by the transport to drain the transmit ring.
+ *
+ * @param[out] data Set to the start of the data
+ * @returns The number of contiguous bytes at data
+ */
+unsigned int serial_TxPeek(const char **data)
+{
+	unsigned int tail = serial_TxTail;
+	unsigned int len = serial_TxHead - tail;
+
+	if(len > (SERIAL_TX_LENGTH - (tail & SERIAL_TX_MASK)))
+	{
+		len = SERIAL_TX_LENGTH - (tail & SERIAL_TX_MASK);
+	}
+	*data = &serial_TxBuffer[tail & SERIAL_TX_MASK];
+	return len;
+}
+
+/**
+ * @brief Release data the transport has sent
+ *
+ * @param[in] len The number of bytes sent
+ */
+void serial_TxRelease(unsigned int len)
+{
+	serial_TxTail += len;
+}
+
+/**
+ * @brief Get the amount of data waiting to be sent
+ *
+ * @returns The number of bytes queued that the transport hasn't sent yet
+ */
+unsigned int serial_TxPending()
+{
+	return serial_TxHead - serial_TxTail;
+}
+
+/**
+ * @brief Copy data into the transmit ring
+ *
+ * @param[in] buffer The data to copy
+ * @param[in] len The number of bytes in buffer
+ */
+static void serial_Queue(const char *buffer, unsigned int len)
+{
+	while(len > 0)
+	{
+		unsigned int head = serial_TxHead;
+		unsigned int space = SERIAL_TX_LENGTH - (head - serial_TxTail);
+		unsigned int count;
+
+		if(space == 0)
+		{
+#if (SERIAL_TX_OVERFLOW == SERIAL_OVERFLOW_BLOCK)
+			if(serial_IsConnected())
+			{
+				serial_StartTx();
+				continue;
+			}
+#endif
+			//nowhere to put it
+			serial_TxDropped += len;
+			break;
+		}
+
+		//copy up to the end of the ring at most
+		count = (len < space) ? len : space;
+		if(count > (SERIAL_TX_LENGTH - (head & SERIAL_TX_MASK)))
+		{
+			count = SERIAL_TX_LENGTH - (head & SERIAL_TX_MASK);
+		}
+		memcpy(&serial_TxBuffer[head & SERIAL_TX_MASK], buffer, count);
+		serial_TxHead = head + count;
+
+		buffer += count;
+		len -= count;
+	}
+}
+
+#if (SERIAL_TX_OVERFLOW == SERIAL_OVERFLOW_COUNT)
+/**
+ * @brief Queue a marker with the number of bytes dropped
+ *
+ * The marker is only queued once it fits in full, until then the count
+ * keeps growing.
+ */
+static void serial_QueueDropped()
+{
+	char marker[32] = "\r\n[dropped ";
+	char digits[10];
+	unsigned int len = strlen(marker);
+	unsigned int count = 0;
+	unsigned int dropped = serial_TxDropped;
+
+	do
+	{
+		digits[count++] = '0' + (dropped % 10);
+		dropped /= 10;
+	} while(dropped > 0);
+	while(count > 0)
+	{
+		marker[len++] = digits[--count];
+	}
+	marker[len++] = ']';
+	marker[len++] = '\r';
+	marker[len++] = '\n';
+
+	if((SERIAL_TX_LENGTH - (serial_TxHead - serial_TxTail)) >= len)
+	{
+		serial_TxDropped = 0;
+		serial_Queue(marker, len);
+	}
+}
+#endif
+
+#if defined(SERIAL_TRANSPORT_USB)
+
+/**
+ * @brief Initialise the host link
+ */
 void serial_Init()
 {
+	serial_TxHead = 0;
+	serial_TxTail = 0;
+	serial_TxDropped = 0;
+	usbcdc_Init();
+}
+
+/**
+ * @brief Get data received from the host
+ *
+ * The data stays in the receive buffer until @ref serial_Consume is called.
+ *
+ * @param[out] data Set to the start of the received data
+ * @returns The number of bytes available at data
+ */
+unsigned int serial_Receive(const char **data)
+{
+	return usbcdc_Receive(data);
+}
+
+/**
+ * @brief Release received data once it has been processed
+ *
+ * @param[in] len The number of bytes processed
+ */
+void serial_Consume(unsigned int len)
+{
+	usbcdc_Consume(len);
+}
+
+/**
+ * @brief Start draining the transmit ring
+ */
+static void serial_StartTx()
+{
+	usbcdc_StartTx();
+}
+
+/**
+ * @brief Check if there is a host to drain the transmit ring
+ */
+static bool serial_IsConnected()
+{
+	return usbcdc_IsConfigured();
+}
+
+#else
+
+#define SERIAL_RX_LENGTH	(512)		///< Receive ring size, must be a power of 2
+#define SERIAL_RX_MASK		(SERIAL_RX_LENGTH - 1)
+#define SERIAL_RX_DMA		DMA_CHANNEL3	///< DMA1 channel for USART3_RX
+
+static char serial_RxBuffer[SERIAL_RX_LENGTH];	///< Filled by DMA, wraps continuously
+static volatile unsigned int serial_RxMark;	///< Bytes received up to the last half ring boundary, only written by the DMA interrupt
+static unsigned int serial_RxTail;		///< Bytes processed
+
+void serial_Init()
+{
+	serial_TxHead = 0;
+	serial_TxTail = 0;
+	serial_TxDropped = 0;
+	serial_RxMark = 0;
+	serial_RxTail = 0;
+
 	rcc_periph_clock_enable(RCC_GPIOB);
 	rcc_periph_clock_enable(RCC_USART3);
+	rcc_periph_clock_enable(RCC_DMA1);
 	
 	/* Setup GPIO pin GPIO_USART3_TX/GPIO10 on GPIO port B for transmit. */
 	gpio_set_mode(GPIOB, GPIO_MODE_OUTPUT_50_MHZ,
 		      GPIO_CNF_OUTPUT_ALTFN_PUSHPULL, GPIO_USART3_TX);
+	/* And GPIO_USART3_RX/GPIO11 for receive. */
+	gpio_set_mode(GPIOB, GPIO_MODE_INPUT,
+		      GPIO_CNF_INPUT_FLOAT, GPIO_USART3_RX);
 
 	/* Setup UART parameters. */
 	usart_set_baudrate(USART3, 115200);
 	usart_set_databits(USART3, 8);
 	usart_set_stopbits(USART3, USART_STOPBITS_1);
-	usart_set_mode(USART3, USART_MODE_TX);
+	usart_set_mode(USART3, USART_MODE_TX_RX);
 	usart_set_parity(USART3, USART_PARITY_NONE);
 	usart_set_flow_control(USART3, USART_FLOWCONTROL_NONE);
 
+	/* Received bytes are written to the ring by DMA, no interrupt per byte. */
+	dma_channel_reset(DMA1, SERIAL_RX_DMA);
+	dma_set_peripheral_address(DMA1, SERIAL_RX_DMA, (uint32_t)&USART3_DR);
+	dma_set_memory_address(DMA1, SERIAL_RX_DMA, (uint32_t)serial_RxBuffer);
+	dma_set_number_of_data(DMA1, SERIAL_RX_DMA, SERIAL_RX_LENGTH);
+	dma_set_peripheral_size(DMA1, SERIAL_RX_DMA, DMA_CCR_PSIZE_8BIT);
+	dma_set_memory_size(DMA1, SERIAL_RX_DMA, DMA_CCR_MSIZE_8BIT);
+	dma_set_read_from_peripheral(DMA1, SERIAL_RX_DMA);
+	dma_enable_memory_increment_mode(DMA1, SERIAL_RX_DMA);
+	dma_enable_circular_mode(DMA1, SERIAL_RX_DMA);
+	/* Each half of the ring filled is counted, to tell when unread data is overwritten. */
+	dma_enable_half_transfer_interrupt(DMA1, SERIAL_RX_DMA);
+	dma_enable_transfer_complete_interrupt(DMA1, SERIAL_RX_DMA);
+	nvic_enable_irq(NVIC_DMA1_CHANNEL3_IRQ);
+	dma_enable_channel(DMA1, SERIAL_RX_DMA);
+	usart_enable_rx_dma(USART3);
+
 	/* Finally enable the USART. */
 	usart_enable(USART3);
+	nvic_enable_irq(NVIC_USART3_IRQ);
+}
+
+/**
+ * @brief Get data received from the host
+ *
+ * The data is returned in place in the DMA ring, up to the point the DMA
+ * has written or the end of the ring, whichever comes first. There's no
+ * flow control, so if the host gets more than @ref SERIAL_RX_LENGTH bytes
+ * ahead of the processing the DMA overwrites data that hasn't been read.
+ * When that has happened everything unread is discarded, as it can't be
+ * told apart from the new data, and a message logs how much was lost.
+ *
+ * @param[out] data Set to the start of the received data
+ * @returns The number of bytes available at data
+ */
+unsigned int serial_Receive(const char **data)
+{
+	unsigned int mark;
+	unsigned int head;
+	unsigned int written;
+	unsigned int len;
+
+	//try again if the interrupt moved the mark while the counter was read
+	do
+	{
+		mark = serial_RxMark;
+		head = SERIAL_RX_LENGTH - DMA_CNDTR(DMA1, SERIAL_RX_DMA);
+	} while(mark != serial_RxMark);
+
+	//the DMA is less than a ring past the mark, the interrupt may not have caught up yet
+	written = mark + ((head - mark) & SERIAL_RX_MASK);
+	if((written - serial_RxTail) > SERIAL_RX_LENGTH)
+	{
+		message_Log(MESSAGE_LEVEL_REQUIRED, RX_OVERRUN, written - serial_RxTail);
+		serial_RxTail = written;
+	}
 
+	len = written - serial_RxTail;
+	if(len > (SERIAL_RX_LENGTH - (serial_RxTail & SERIAL_RX_MASK)))
+	{
+		len = SERIAL_RX_LENGTH - (serial_RxTail & SERIAL_RX_MASK);
+	}
+	*data = &serial_RxBuffer[serial_RxTail & SERIAL_RX_MASK];
+	return len;
 }
 
-void serial_Send(const char *buffer, const unsigned int len)
+/**
+ * @brief Release received data once it has been processed
+ *
+ * @param[in] len The number of bytes processed
+ */
+void serial_Consume(unsigned int len)
+{
+	serial_RxTail += len;
+}
+
+/**
+ * @brief DMA1 channel 3 interrupt, counts the halves of the receive ring filled
+ */
+void dma1_channel3_isr()
+{
+	if(dma_get_interrupt_flag(DMA1, SERIAL_RX_DMA, DMA_HTIF))
+	{
+		dma_clear_interrupt_flags(DMA1, SERIAL_RX_DMA, DMA_HTIF);
+		serial_RxMark += SERIAL_RX_LENGTH / 2;
+	}
+	if(dma_get_interrupt_flag(DMA1, SERIAL_RX_DMA, DMA_TCIF))
+	{
+		dma_clear_interrupt_flags(DMA1, SERIAL_RX_DMA, DMA_TCIF);
+		serial_RxMark += SERIAL_RX_LENGTH / 2;
+	}
+}
+
+/**
+ * @brief USART3 interrupt, sends the transmit ring a byte at a time
+ */
+void usart3_isr()
 {
-	unsigned int count;
-	const char *p = buffer;
-	for(count = 0; count < len; ++count)
+	if(((USART_CR1(USART3) & USART_CR1_TXEIE) != 0) && ((USART_SR(USART3) & USART_SR_TXE) != 0))
 	{
-		usart_send_blocking(USART3, *p++);
+		const char *data;
+
+		if(serial_TxPeek(&data) > 0)
+		{
+			USART_DR(USART3) = *data;
+			serial_TxRelease(1);
+		}
+		else
+		{
+			//nothing left, stop the interrupt until more is queued
+			usart_disable_tx_interrupt(USART3);
+		}
 	}
 }
 
+/**
+ * @brief Start draining the transmit ring
+ */
+static void serial_StartTx()
+{
+	usart_enable_tx_interrupt(USART3);
+}
+
+/**
+ * @brief Check if there is a host to drain the transmit ring
+ */
+static bool serial_IsConnected()
+{
+	return true;
+}
+
+#endif
@@ -18,7 +18,37 @@
 #if !defined(_SERIAL_H_)
 #define _SERIAL_H_
 
+#include <stdbool.h>
+
+//Select the host link, USB unless the build asks for the USART
+#if !defined(SERIAL_TRANSPORT_USB) && !defined(SERIAL_TRANSPORT_USART)
+#define SERIAL_TRANSPORT_USB
+#endif
+
+//Pins taken by the host link, numbered as for the JTAG signals, they can't be used for JTAG signals
+#if defined(SERIAL_TRANSPORT_USB)
+#define SERIAL_RESERVED_PINS	((1ULL << 11) | (1ULL << 12))	///< USB DM and DP, PA11 and PA12
+#else
+#define SERIAL_RESERVED_PINS	((1ULL << 26) | (1ULL << 27))	///< USART3 TX and RX, PB10 and PB11
+#endif
+
+//What serial_Send does when the transmit ring is full
+#define SERIAL_OVERFLOW_BLOCK	(0)	///< Wait for the host to make space
+#define SERIAL_OVERFLOW_DROP	(1)	///< Discard the data silently
+#define SERIAL_OVERFLOW_COUNT	(2)	///< Discard the data and report how much was lost
+
+#if !defined(SERIAL_TX_OVERFLOW)
+#define SERIAL_TX_OVERFLOW	SERIAL_OVERFLOW_BLOCK
+#endif
+
 void serial_Init();
 void serial_Send(const char *buffer, unsigned int len);
+unsigned int serial_Receive(const char **data);
+void serial_Consume(unsigned int len);
+unsigned int serial_TxPending();
+
+//used by the transport to drain the transmit ring
+unsigned int serial_TxPeek(const char **data);
+void serial_TxRelease(unsigned int len);
 
 #endif
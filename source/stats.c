@@ -0,0 +1,124 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <libopencm3/stm32/rcc.h>
+#include "stats.h"
+#include "message.h"
+
+#if defined(STATS)
+
+/**
+ * @brief Cycle counts for one code path
+ */
+typedef struct stats_sRecord
+{
+	uint32_t count;		///< Number of times the path ran
+	uint64_t total;		///< Total cycles spent in the path
+	uint32_t max;		///< Longest single run in cycles
+} stats_Record;
+
+static stats_Record stats_Records[STATS_MAX];
+
+static const char * const stats_Names[STATS_MAX] = {
+	[STATS_JTAG_CLOCK] = "jtag_Clock",
+	[STATS_TAP_SETSTATE] = "jtagTAP_SetState",
+	[STATS_CHAIN_DETECT] = "chain_Detect",
+	[STATS_KNOCK_RESET] = "knock_ScanReset",
+	[STATS_KNOCK_TDI] = "knock_ScanResetFindTDI",
+	[STATS_KNOCK_BYPASS] = "knock_ScanBypass",
+	[STATS_SERIAL_SEND] = "serial_Send",
+};
+
+/**
+ * @brief Add a timed run to a counter
+ *
+ * @param[in] counter The counter to update
+ * @param[in] cycles The number of core clocks the run took
+ */
+void stats_Add(stats_Counter counter, uint32_t cycles)
+{
+	stats_Record *record = &stats_Records[counter];
+
+	++record->count;
+	record->total += cycles;
+	if(cycles > record->max)
+	{
+		record->max = cycles;
+	}
+}
+
+/**
+ * @brief Clear all the counters
+ */
+void stats_Reset()
+{
+	unsigned int i;
+
+	for(i = 0; i < STATS_MAX; ++i)
+	{
+		stats_Records[i].count = 0;
+		stats_Records[i].total = 0;
+		stats_Records[i].max = 0;
+	}
+}
+
+/**
+ * @brief Display all the counters
+ *
+ * One line per counter, the total is in microseconds and the max in core
+ * clocks.
+ *
+ * @retval true The counters were displayed
+ */
+bool stats_Display()
+{
+	unsigned int i;
+	uint32_t cyclesPerUs = rcc_ahb_frequency / 1000000;
+
+	message_Write(MESSAGE_LEVEL_REQUIRED, "  Counter                  Count    Total(us)  Max(clk)\r\n");
+	for(i = 0; i < STATS_MAX; ++i)
+	{
+		const stats_Record *record = &stats_Records[i];
+		message_Write(MESSAGE_LEVEL_REQUIRED, "  %-22s %9lu %12lu %9lu\r\n", stats_Names[i],
+				(unsigned long)record->count, (unsigned long)(record->total / cyclesPerUs), (unsigned long)record->max);
+	}
+	return true;
+}
+
+#else
+
+/**
+ * @brief Clear all the counters, nothing to do when they are compiled out
+ */
+void stats_Reset()
+{
+}
+
+/**
+ * @brief Display all the counters
+ *
+ * @retval false The counters were compiled out
+ */
+bool stats_Display()
+{
+	message_Write(MESSAGE_LEVEL_GENERAL, "Statistics not enabled, build with STATS=1.\r\n");
+	return false;
+}
+
+#endif
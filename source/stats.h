@@ -0,0 +1,60 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_STATS_H_)
+#define _STATS_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @brief The instrumented code paths
+ */
+typedef enum stats_eCounter
+{
+	STATS_JTAG_CLOCK = 0,		///< jtag_Clock()
+	STATS_TAP_SETSTATE,		///< jtagTAP_SetState()
+	STATS_CHAIN_DETECT,		///< chain_Detect()
+	STATS_KNOCK_RESET,		///< Capturing TDO candidates after a TAP reset
+	STATS_KNOCK_TDI,		///< Searching for TDI after a reset capture
+	STATS_KNOCK_BYPASS,		///< Bypass scan of one TCK/TMS/TDI candidate
+	STATS_SERIAL_SEND,		///< serial_Send(), including waits for ring space
+	STATS_MAX
+} stats_Counter;
+
+#if defined(STATS)
+#include <libopencm3/cm3/dwt.h>
+
+/**
+ * Start timing a counter, must be paired with @ref STATS_END in the same scope
+ */
+#define STATS_BEGIN(counter)	const uint32_t stats_Start_##counter = DWT_CYCCNT
+/**
+ * Stop timing a counter and add the cycles to it
+ */
+#define STATS_END(counter)	stats_Add(counter, DWT_CYCCNT - stats_Start_##counter)
+
+extern void stats_Add(stats_Counter counter, uint32_t cycles);
+#else
+#define STATS_BEGIN(counter)
+#define STATS_END(counter)
+#endif
+
+extern void stats_Reset();
+extern bool stats_Display();
+
+#endif
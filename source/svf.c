@@ -0,0 +1,1015 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include "svf.h"
+#include "jtag.h"
+#include "jtagtap.h"
+
+#define SVF_MAX_BYTES		(SVF_MAX_BITS / 8)
+#define SVF_MAX_IR_BYTES	(SVF_MAX_IR_BITS / 8)
+#define SVF_PAD_BYTES		(SVF_PAD_BITS / 8)
+#define SVF_WORDS_MAX		(12)		///< Words in a statement, not counting the hex strings
+#define SVF_WORD_LENGTH		(16)		///< Longest word, a keyword or a number
+#define SVF_RUNTEST_BATCH	(256)		///< Clocks run for each step of a RUNTEST
+
+//hex strings given in a scan statement
+#define SVF_FIELD_TDI		(0x01)
+#define SVF_FIELD_TDO		(0x02)
+#define SVF_FIELD_MASK		(0x04)
+#define SVF_FIELD_SMASK		(0x08)
+
+/**
+ * @brief The header and trailer patterns
+ */
+typedef enum svf_ePadType
+{
+	SVF_PAD_HIR = 0,	///< Shifted before the SIR data
+	SVF_PAD_TIR,		///< Shifted after the SIR data
+	SVF_PAD_HDR,		///< Shifted before the SDR data
+	SVF_PAD_TDR,		///< Shifted after the SDR data
+	SVF_PAD_MAX
+} svf_PadType;
+
+/**
+ * @brief A header or trailer pattern, for the devices either side of the target
+ */
+typedef struct svf_sPad
+{
+	unsigned int bits;		///< Length of the pattern, 0 for none
+	uint8_t tdi[SVF_PAD_BYTES];	///< The pattern, LSB shifted first
+} svf_Pad;
+
+/**
+ * @brief What an SIR or SDR keeps for the next of the same kind
+ *
+ * SVF keeps TDI and MASK apart for the instruction and data registers, so
+ * an SDR can leave them out after an SIR came between it and the last SDR.
+ */
+typedef struct svf_sRegister
+{
+	unsigned int bits;	///< Length of the last scan, 0 for none
+	unsigned int max;	///< Longest scan the buffers hold
+	uint8_t *tdi;		///< TDI of the scan, kept for the next of the same length
+	uint8_t *mask;		///< TDO bits to check, kept for the next of the same length
+} svf_Register;
+
+const char * const svf_ResultNames[SVF_RESULT_MAX] = {
+	[SVF_RESULT_OK] = "OK",
+	[SVF_RESULT_MISMATCH] = "TDO mismatch",
+	[SVF_RESULT_SYNTAX] = "Syntax error",
+	[SVF_RESULT_UNSUPPORTED] = "Unsupported statement",
+	[SVF_RESULT_TOO_LONG] = "Scan too long",
+	[SVF_RESULT_INCOMPLETE] = "Incomplete statement",
+};
+
+static const char * const svf_PadNames[SVF_PAD_MAX] = {
+	[SVF_PAD_HIR] = "hir",
+	[SVF_PAD_TIR] = "tir",
+	[SVF_PAD_HDR] = "hdr",
+	[SVF_PAD_TDR] = "tdr",
+};
+
+static const char * const svf_StateNames[JTAGTAP_STATE_MAX] = {
+	[JTAGTAP_STATE_RESET] = "reset",
+	[JTAGTAP_STATE_IDLE] = "idle",
+	[JTAGTAP_STATE_DR_SCAN] = "drselect",
+	[JTAGTAP_STATE_DR_CAPTURE] = "drcapture",
+	[JTAGTAP_STATE_DR_SHIFT] = "drshift",
+	[JTAGTAP_STATE_DR_EXIT1] = "drexit1",
+	[JTAGTAP_STATE_DR_PAUSE] = "drpause",
+	[JTAGTAP_STATE_DR_EXIT2] = "drexit2",
+	[JTAGTAP_STATE_DR_UPDATE] = "drupdate",
+	[JTAGTAP_STATE_IR_SCAN] = "irselect",
+	[JTAGTAP_STATE_IR_CAPTURE] = "ircapture",
+	[JTAGTAP_STATE_IR_SHIFT] = "irshift",
+	[JTAGTAP_STATE_IR_EXIT1] = "irexit1",
+	[JTAGTAP_STATE_IR_PAUSE] = "irpause",
+	[JTAGTAP_STATE_IR_EXIT2] = "irexit2",
+	[JTAGTAP_STATE_IR_UPDATE] = "irupdate",
+};
+
+static void svf_Fail(svf_Result result);
+static void svf_Char(char c);
+static void svf_EndWord();
+static void svf_StartHex();
+static void svf_EndHex();
+static void svf_EndStatement();
+static svf_Result svf_Execute();
+static svf_Result svf_Scan(svf_Register *reg);
+static svf_Register *svf_RegisterOf(const char *word);
+static svf_Result svf_SetPad(svf_PadType pad);
+static svf_Result svf_RunTest();
+static svf_Result svf_Frequency();
+static svf_Result svf_TRST();
+static svf_PadType svf_PadOf(const char *word);
+static bool svf_ParseState(const char *word, jtagTAP_TAPState *state);
+static bool svf_IsStable(jtagTAP_TAPState state);
+static bool svf_ParseNumber(const char *word, int scale, uint32_t *value);
+static unsigned int svf_FieldCount();
+static uint8_t svf_GetNibble(const uint8_t *data, unsigned int index);
+static void svf_SetNibble(uint8_t *data, unsigned int index, uint8_t value);
+
+static svf_Result svf_Status;			///< First failure in the stream
+static uint32_t svf_Offset;			///< Bytes of the stream processed
+static uint32_t svf_StatementOffset;		///< Offset of the first byte of the current statement
+static uint32_t svf_Statements;			///< Statements run
+static bool svf_InStatement;			///< Has the current statement started
+static bool svf_InComment;			///< Skipping to the end of the line
+static bool svf_Slash;				///< The last character was the first of a //
+static char svf_Words[SVF_WORDS_MAX][SVF_WORD_LENGTH + 1];	///< The words of the current statement
+static unsigned int svf_WordCount;		///< Words complete in the current statement
+static unsigned int svf_WordLength;		///< Characters in the word being read
+static uint8_t svf_Fields;			///< Hex strings given in the current statement
+static bool svf_InHex;				///< Reading a hex string
+static uint8_t *svf_Hex;			///< Where the hex string goes, NULL to discard it
+static unsigned int svf_HexDigits;		///< Digits of the hex string read
+static unsigned int svf_HexMax;			///< Digits that fit in the scan
+static uint8_t svf_TDO[SVF_MAX_BYTES];		///< Expected TDO of the scan
+static uint8_t svf_Capture[SVF_MAX_BYTES];	///< TDO shifted out by the scan
+static uint8_t svf_TDIIR[SVF_MAX_IR_BYTES];	///< TDI of the last SIR
+static uint8_t svf_MaskIR[SVF_MAX_IR_BYTES];	///< MASK of the last SIR
+static uint8_t svf_TDIDR[SVF_MAX_BYTES];	///< TDI of the last SDR
+static uint8_t svf_MaskDR[SVF_MAX_BYTES];	///< MASK of the last SDR
+static svf_Register svf_IR;			///< Kept from the last SIR, set up by svf_Start
+static svf_Register svf_DR;			///< Kept from the last SDR, set up by svf_Start
+static svf_Pad svf_Pads[SVF_PAD_MAX];		///< Header and trailer patterns
+static jtagTAP_TAPState svf_EndIR;		///< State an SIR ends in
+static jtagTAP_TAPState svf_EndDR;		///< State an SDR ends in
+static jtagTAP_TAPState svf_EndRunTest;		///< State the running RUNTEST ends in
+static bool svf_Waiting;			///< A RUNTEST has to be stepped before the next statement
+
+/**
+ * @brief Start playing a new SVF stream
+ *
+ * The header and trailer patterns are cleared and scans end in Run/Idle,
+ * as at the start of any SVF file.
+ */
+void svf_Start()
+{
+	svf_PadType pad;
+
+	svf_Status = SVF_RESULT_OK;
+	svf_Offset = 0;
+	svf_StatementOffset = 0;
+	svf_Statements = 0;
+	svf_InComment = false;
+	svf_Slash = false;
+	svf_EndStatement();
+	for(pad = SVF_PAD_HIR; pad < SVF_PAD_MAX; ++pad)
+	{
+		svf_Pads[pad].bits = 0;
+	}
+	//set here rather than initialised, so nothing depends on the .data image
+	svf_IR.bits = 0;
+	svf_IR.max = SVF_MAX_IR_BITS;
+	svf_IR.tdi = svf_TDIIR;
+	svf_IR.mask = svf_MaskIR;
+	svf_DR.bits = 0;
+	svf_DR.max = SVF_MAX_BITS;
+	svf_DR.tdi = svf_TDIDR;
+	svf_DR.mask = svf_MaskDR;
+	svf_EndIR = JTAGTAP_STATE_IDLE;
+	svf_EndDR = JTAGTAP_STATE_IDLE;
+	svf_Waiting = false;
+}
+
+/**
+ * @brief Play part of an SVF stream
+ *
+ * The stream can be split anywhere, partial statements are kept until the
+ * rest arrives. Each statement is run as soon as its ';' is seen. Once a
+ * statement has failed the rest of the stream is skipped.
+ *
+ * Processing stops straight after a RUNTEST that has to wait, see
+ * @ref svf_IsWaiting, so the host is held off until it's done.
+ *
+ * @param[in] buffer The next part of the stream.
+ * @param[in] len The number of bytes in buffer.
+ * @returns The number of bytes used, the rest should be passed in again.
+ */
+unsigned int svf_Process(const char *buffer, unsigned int len)
+{
+	unsigned int used = 0;
+
+	while((used < len) && !svf_Waiting)
+	{
+		svf_Char(buffer[used++]);
+		++svf_Offset;
+	}
+	return used;
+}
+
+/**
+ * @brief Check if a RUNTEST is waiting to be stepped
+ *
+ * @retval true @ref svf_Step has to be called until it's done before any
+ * more of the stream is processed.
+ */
+bool svf_IsWaiting()
+{
+	return svf_Waiting;
+}
+
+/**
+ * @brief Run the next part of a RUNTEST
+ *
+ * Bounded, so it can be run as a job.
+ *
+ * @retval true There is more of the RUNTEST to do.
+ */
+bool svf_Step()
+{
+	bool more = svf_Waiting && jtagTAP_RunTestStep(SVF_RUNTEST_BATCH);
+
+	if(svf_Waiting && !more)
+	{
+		jtagTAP_SetState(svf_EndRunTest);
+		svf_Waiting = false;
+	}
+	return more;
+}
+
+/**
+ * @brief Finish playing the stream
+ *
+ * @param[out] offset The offset of the failing statement in the stream.
+ * @param[out] statements The number of statements run.
+ * @returns The outcome, a stream that stops part way through a statement
+ * is incomplete.
+ */
+svf_Result svf_Finish(uint32_t *offset, uint32_t *statements)
+{
+	if((svf_Status == SVF_RESULT_OK) && (svf_InStatement || svf_InHex))
+	{
+		svf_Status = SVF_RESULT_INCOMPLETE;
+	}
+	*offset = svf_StatementOffset;
+	*statements = svf_Statements;
+	return svf_Status;
+}
+
+/**
+ * @brief Record a failure, only the first is kept
+ */
+static void svf_Fail(svf_Result result)
+{
+	if(svf_Status == SVF_RESULT_OK)
+	{
+		svf_Status = result;
+	}
+}
+
+/**
+ * @brief Feed a character of the stream through the parser
+ *
+ * Comments run from ! or // to the end of the line. Words are split by
+ * white space, hex strings are in brackets and may contain white space.
+ *
+ * @param[in] c The next character.
+ */
+static void svf_Char(char c)
+{
+	const bool space = (c == ' ') || (c == '\t') || (c == '\r') || (c == '\n');
+
+	if(svf_Status != SVF_RESULT_OK)
+	{
+		//skip the rest of the stream
+	}
+	else if(svf_InComment)
+	{
+		svf_InComment = (c != '\n') && (c != '\r');
+	}
+	else if(svf_Slash)
+	{
+		svf_Slash = false;
+		if(c == '/')
+		{
+			svf_InComment = true;
+		}
+		else
+		{
+			svf_Fail(SVF_RESULT_SYNTAX);
+		}
+	}
+	else if(svf_InHex)
+	{
+		const char lower = c | 0x20;
+
+		if(((c >= '0') && (c <= '9')) || ((lower >= 'a') && (lower <= 'f')))
+		{
+			if(svf_HexDigits >= svf_HexMax)
+			{
+				svf_Fail(SVF_RESULT_SYNTAX);	//longer than the scan
+			}
+			else
+			{
+				if(svf_Hex != NULL)
+				{
+					svf_SetNibble(svf_Hex, svf_HexDigits, (c <= '9') ? (c - '0') : (lower - 'a' + 10));
+				}
+				++svf_HexDigits;
+			}
+		}
+		else if(c == ')')
+		{
+			svf_EndHex();
+		}
+		else if(!space)
+		{
+			svf_Fail(SVF_RESULT_SYNTAX);
+		}
+	}
+	else if(c == '!')
+	{
+		svf_EndWord();
+		svf_InComment = true;
+	}
+	else if(c == '/')
+	{
+		svf_EndWord();
+		svf_Slash = true;
+	}
+	else if(space)
+	{
+		svf_EndWord();
+	}
+	else
+	{
+		if(!svf_InStatement)
+		{
+			svf_InStatement = true;
+			svf_StatementOffset = svf_Offset;
+		}
+
+		if(c == '(')
+		{
+			svf_EndWord();
+			svf_StartHex();
+		}
+		else if(c == ';')
+		{
+			svf_EndWord();
+			svf_Fail(svf_Execute());
+			if(svf_Status == SVF_RESULT_OK)
+			{
+				++svf_Statements;
+			}
+			svf_EndStatement();
+		}
+		else if((svf_WordCount < SVF_WORDS_MAX) && (svf_WordLength < SVF_WORD_LENGTH))
+		{
+			svf_Words[svf_WordCount][svf_WordLength++] = c;
+		}
+		else
+		{
+			svf_Fail(SVF_RESULT_SYNTAX);
+		}
+	}
+}
+
+/**
+ * @brief Finish the word being read, if any
+ */
+static void svf_EndWord()
+{
+	if(svf_WordLength > 0)
+	{
+		svf_Words[svf_WordCount++][svf_WordLength] = '\x00';
+		svf_WordLength = 0;
+	}
+}
+
+/**
+ * @brief Get ready for the next statement
+ */
+static void svf_EndStatement()
+{
+	svf_InStatement = false;
+	svf_WordCount = 0;
+	svf_WordLength = 0;
+	svf_Fields = 0;
+	svf_InHex = false;
+}
+
+/**
+ * @brief Start reading a hex string
+ *
+ * The word before the bracket says which of the scan's values it is and
+ * the length of the scan says how many digits it can have. Values the
+ * player doesn't use, SMASK and the expected TDO of the headers and
+ * trailers, are checked for length and discarded.
+ */
+static void svf_StartHex()
+{
+	const svf_PadType pad = svf_PadOf(svf_Words[0]);
+	svf_Register * const reg = (svf_WordCount > 0) ? svf_RegisterOf(svf_Words[0]) : NULL;
+	const bool scan = (reg != NULL);
+	const char *name = (svf_WordCount > 0) ? svf_Words[svf_WordCount - 1] : "";
+	uint32_t bits = 0;
+	uint8_t field = 0;
+
+	if(strcasecmp(name, "tdi") == 0)
+	{
+		field = SVF_FIELD_TDI;
+	}
+	else if(strcasecmp(name, "tdo") == 0)
+	{
+		field = SVF_FIELD_TDO;
+	}
+	else if(strcasecmp(name, "mask") == 0)
+	{
+		field = SVF_FIELD_MASK;
+	}
+	else if(strcasecmp(name, "smask") == 0)
+	{
+		field = SVF_FIELD_SMASK;
+	}
+
+	if((svf_WordCount > 0) && !scan && (pad == SVF_PAD_MAX))
+	{
+		svf_Fail(SVF_RESULT_UNSUPPORTED);	//PIO
+	}
+	else if((svf_WordCount < 3) || !svf_ParseNumber(svf_Words[1], 0, &bits) || (field == 0) || ((svf_Fields & field) != 0))
+	{
+		svf_Fail(SVF_RESULT_SYNTAX);
+	}
+	else if(bits > (scan ? reg->max : SVF_PAD_BITS))
+	{
+		svf_Fail(SVF_RESULT_TOO_LONG);
+	}
+	else
+	{
+		svf_Fields |= field;
+		svf_Hex = NULL;
+		if(!scan)
+		{
+			if(field == SVF_FIELD_TDI)
+			{
+				svf_Hex = svf_Pads[pad].tdi;
+			}
+		}
+		else if(field == SVF_FIELD_TDI)
+		{
+			svf_Hex = reg->tdi;
+		}
+		else if(field == SVF_FIELD_TDO)
+		{
+			svf_Hex = svf_TDO;
+		}
+		else if(field == SVF_FIELD_MASK)
+		{
+			svf_Hex = reg->mask;
+		}
+		svf_HexDigits = 0;
+		svf_HexMax = (bits + 3) / 4;
+		svf_InHex = true;
+	}
+}
+
+/**
+ * @brief Finish reading a hex string
+ *
+ * The digits were stored in the order read, most significant first. They
+ * are reversed, so the LSB of the first byte is shifted first, and any
+ * leading digits left out are zeroed.
+ */
+static void svf_EndHex()
+{
+	svf_InHex = false;
+	if(svf_Hex != NULL)
+	{
+		unsigned int digit;
+
+		for(digit = 0; digit < (svf_HexDigits / 2); ++digit)
+		{
+			const unsigned int other = svf_HexDigits - 1 - digit;
+			const uint8_t value = svf_GetNibble(svf_Hex, digit);
+
+			svf_SetNibble(svf_Hex, digit, svf_GetNibble(svf_Hex, other));
+			svf_SetNibble(svf_Hex, other, value);
+		}
+		for(digit = svf_HexDigits; digit < svf_HexMax; ++digit)
+		{
+			svf_SetNibble(svf_Hex, digit, 0);
+		}
+	}
+}
+
+/**
+ * @brief Run the statement that has been read
+ *
+ * @returns SVF_RESULT_OK if the statement ran.
+ */
+static svf_Result svf_Execute()
+{
+	const char *command = svf_Words[0];
+	svf_Result result = SVF_RESULT_OK;
+	jtagTAP_TAPState state;
+	unsigned int word;
+
+	if(svf_WordCount == 0)
+	{
+		//an empty statement
+	}
+	else if(svf_RegisterOf(command) != NULL)
+	{
+		result = svf_Scan(svf_RegisterOf(command));
+	}
+	else if(svf_PadOf(command) != SVF_PAD_MAX)
+	{
+		result = svf_SetPad(svf_PadOf(command));
+	}
+	else if((strcasecmp(command, "endir") == 0) || (strcasecmp(command, "enddr") == 0))
+	{
+		if((svf_WordCount == 2) && svf_ParseState(svf_Words[1], &state) && svf_IsStable(state))
+		{
+			if(command[3] == 'i')
+			{
+				svf_EndIR = state;
+			}
+			else
+			{
+				svf_EndDR = state;
+			}
+		}
+		else
+		{
+			result = SVF_RESULT_SYNTAX;
+		}
+	}
+	else if(strcasecmp(command, "state") == 0)
+	{
+		//a path of states, to a stable state
+		for(word = 1; (word < svf_WordCount) && (result == SVF_RESULT_OK); ++word)
+		{
+			if(svf_ParseState(svf_Words[word], &state))
+			{
+				jtagTAP_SetState(state);
+			}
+			else
+			{
+				result = SVF_RESULT_SYNTAX;
+			}
+		}
+	}
+	else if(strcasecmp(command, "runtest") == 0)
+	{
+		result = svf_RunTest();
+	}
+	else if(strcasecmp(command, "frequency") == 0)
+	{
+		result = svf_Frequency();
+	}
+	else if(strcasecmp(command, "trst") == 0)
+	{
+		result = svf_TRST();
+	}
+	else
+	{
+		//PIO and PIOMAP, or something the player doesn't know
+		result = SVF_RESULT_UNSUPPORTED;
+	}
+	return result;
+}
+
+/**
+ * @brief Run an SIR or SDR statement
+ *
+ * The header and trailer patterns are shifted either side of the data,
+ * then the TAP is moved to the end state. When a TDO value was given the
+ * captured data is checked against it, through the mask. TDI and MASK can
+ * be left out when the scan is the same length as the last of its kind,
+ * the last values are used again. A MASK left out otherwise checks every
+ * bit.
+ *
+ * @param[in,out] reg @ref svf_IR for SIR, @ref svf_DR for SDR.
+ */
+static svf_Result svf_Scan(svf_Register *reg)
+{
+	const bool ir = (reg == &svf_IR);
+	const svf_Pad *header = &svf_Pads[ir ? SVF_PAD_HIR : SVF_PAD_HDR];
+	const svf_Pad *trailer = &svf_Pads[ir ? SVF_PAD_TIR : SVF_PAD_TDR];
+	uint32_t bits;
+	unsigned int i;
+
+	if((svf_WordCount != (2 + svf_FieldCount())) || !svf_ParseNumber(svf_Words[1], 0, &bits) || (bits == 0))
+	{
+		return SVF_RESULT_SYNTAX;
+	}
+	if(bits > reg->max)
+	{
+		return SVF_RESULT_TOO_LONG;
+	}
+	if(((svf_Fields & SVF_FIELD_TDI) == 0) && (reg->bits != bits))
+	{
+		return SVF_RESULT_SYNTAX;
+	}
+	if(((svf_Fields & SVF_FIELD_MASK) == 0) && (reg->bits != bits))
+	{
+		memset(reg->mask, 0xFF, (reg->max / 8));
+	}
+	reg->bits = bits;
+
+	jtagTAP_SetState(ir ? JTAGTAP_STATE_IR_SHIFT : JTAGTAP_STATE_DR_SHIFT);
+	if(header->bits > 0)
+	{
+		jtag_Shift(header->tdi, NULL, header->bits, false);
+	}
+	jtag_Shift(reg->tdi, svf_Capture, bits, (trailer->bits == 0));
+	if(trailer->bits > 0)
+	{
+		jtag_Shift(trailer->tdi, NULL, trailer->bits, true);
+	}
+	jtagTAP_ShiftExit();
+	jtagTAP_SetState(ir ? svf_EndIR : svf_EndDR);
+
+	if((svf_Fields & SVF_FIELD_TDO) != 0)
+	{
+		for(i = 0; i < ((bits + 7) / 8); ++i)
+		{
+			const uint8_t valid = (((i + 1) * 8) <= bits) ? 0xFF : ((1 << (bits & 0x07)) - 1);
+
+			if(((svf_Capture[i] ^ svf_TDO[i]) & reg->mask[i] & valid) != 0)
+			{
+				return SVF_RESULT_MISMATCH;
+			}
+		}
+	}
+	return SVF_RESULT_OK;
+}
+
+/**
+ * @brief Find what a scan statement keeps for the next
+ *
+ * @param[in] word The statement's command.
+ * @returns @ref svf_IR for SIR, @ref svf_DR for SDR, NULL for anything else.
+ */
+static svf_Register *svf_RegisterOf(const char *word)
+{
+	svf_Register *reg = NULL;
+
+	if(strcasecmp(word, "sir") == 0)
+	{
+		reg = &svf_IR;
+	}
+	else if(strcasecmp(word, "sdr") == 0)
+	{
+		reg = &svf_DR;
+	}
+	return reg;
+}
+
+/**
+ * @brief Run an HIR, TIR, HDR or TDR statement
+ *
+ * TDI can only be left out when the length hasn't changed, or is 0.
+ *
+ * @param[in] pad The pattern to set.
+ */
+static svf_Result svf_SetPad(svf_PadType pad)
+{
+	uint32_t bits;
+
+	if((svf_WordCount != (2 + svf_FieldCount())) || !svf_ParseNumber(svf_Words[1], 0, &bits))
+	{
+		return SVF_RESULT_SYNTAX;
+	}
+	if(bits > SVF_PAD_BITS)
+	{
+		return SVF_RESULT_TOO_LONG;
+	}
+	if(((svf_Fields & SVF_FIELD_TDI) == 0) && (bits != 0) && (bits != svf_Pads[pad].bits))
+	{
+		return SVF_RESULT_SYNTAX;
+	}
+	svf_Pads[pad].bits = bits;
+	return SVF_RESULT_OK;
+}
+
+/**
+ * @brief Run a RUNTEST statement
+ *
+ * RUNTEST [IDLE] [count TCK] [time SEC [MAXIMUM time SEC]] [ENDSTATE state]
+ *
+ * The clocks and the time run together, the wait lasts for whichever is
+ * longer. Only Run/Idle can be waited in. Short waits are run straight
+ * away, longer ones are left to @ref svf_Step.
+ */
+static svf_Result svf_RunTest()
+{
+	jtagTAP_TAPState run = JTAGTAP_STATE_IDLE;
+	jtagTAP_TAPState end;
+	uint32_t clocks = 0;
+	uint32_t us = 0;
+	unsigned int word = 1;
+
+	if((word < svf_WordCount) && svf_ParseState(svf_Words[word], &run))
+	{
+		++word;
+	}
+	end = run;
+
+	while(word < svf_WordCount)
+	{
+		const char *next = ((word + 1) < svf_WordCount) ? svf_Words[word + 1] : "";
+		uint32_t value;
+
+		if((strcasecmp(next, "tck") == 0) && svf_ParseNumber(svf_Words[word], 0, &value))
+		{
+			clocks = value;
+			word += 2;
+		}
+		else if((strcasecmp(next, "sec") == 0) && svf_ParseNumber(svf_Words[word], 6, &value))
+		{
+			us = value;
+			word += 2;
+		}
+		else if((strcasecmp(svf_Words[word], "maximum") == 0) && ((word + 2) < svf_WordCount) && (strcasecmp(svf_Words[word + 2], "sec") == 0))
+		{
+			word += 3;	//the player never overruns by much
+		}
+		else if((strcasecmp(svf_Words[word], "endstate") == 0) && svf_ParseState(next, &end) && svf_IsStable(end))
+		{
+			word += 2;
+		}
+		else if(strcasecmp(next, "sck") == 0)
+		{
+			return SVF_RESULT_UNSUPPORTED;
+		}
+		else
+		{
+			return SVF_RESULT_SYNTAX;
+		}
+	}
+
+	if(run != JTAGTAP_STATE_IDLE)
+	{
+		return SVF_RESULT_UNSUPPORTED;
+	}
+
+	jtagTAP_RunTestStart(clocks, us);
+	svf_EndRunTest = end;
+	svf_Waiting = true;
+	svf_Step();
+	return SVF_RESULT_OK;
+}
+
+/**
+ * @brief Run a FREQUENCY statement
+ *
+ * FREQUENCY [rate HZ]
+ *
+ * The rate is a maximum, so it's rounded down to a whole kHz. Without a
+ * rate, or faster than the GPIO can go, TCK runs as fast as it can. A rate
+ * slower than @ref JTAG_CLOCK_MIN can't be kept to, so isn't supported.
+ */
+static svf_Result svf_Frequency()
+{
+	uint32_t rate = JTAG_CLOCK_MAX;
+	uint32_t hz;
+
+	if(svf_WordCount == 3)
+	{
+		if((strcasecmp(svf_Words[2], "hz") != 0) || !svf_ParseNumber(svf_Words[1], 0, &hz))
+		{
+			return SVF_RESULT_SYNTAX;
+		}
+		rate = hz / 1000;
+		if(rate < JTAG_CLOCK_MIN)
+		{
+			return SVF_RESULT_UNSUPPORTED;
+		}
+		else if(rate > JTAG_CLOCK_MAX)
+		{
+			rate = JTAG_CLOCK_MAX;
+		}
+	}
+	else if(svf_WordCount != 1)
+	{
+		return SVF_RESULT_SYNTAX;
+	}
+	jtag_SetClockRate(rate);
+	return SVF_RESULT_OK;
+}
+
+/**
+ * @brief Run a TRST statement
+ *
+ * TRST ON|OFF|Z|ABSENT
+ *
+ * TRST is active low. Nothing is driven if it isn't assigned to a pin.
+ */
+static svf_Result svf_TRST()
+{
+	svf_Result result = SVF_RESULT_OK;
+
+	if(svf_WordCount != 2)
+	{
+		result = SVF_RESULT_SYNTAX;
+	}
+	else if(strcasecmp(svf_Words[1], "on") == 0)
+	{
+		jtag_SetInput(JTAG_SIGNAL_TRST, false);
+		jtag_Set(JTAG_SIGNAL_TRST, false);
+		jtagTAP_SetState(JTAGTAP_STATE_UNKNOWN);
+	}
+	else if(strcasecmp(svf_Words[1], "off") == 0)
+	{
+		jtag_Set(JTAG_SIGNAL_TRST, true);
+		jtag_SetInput(JTAG_SIGNAL_TRST, false);
+	}
+	else if(strcasecmp(svf_Words[1], "z") == 0)
+	{
+		jtag_SetInput(JTAG_SIGNAL_TRST, true);
+	}
+	else if(strcasecmp(svf_Words[1], "absent") != 0)
+	{
+		result = SVF_RESULT_SYNTAX;
+	}
+	return result;
+}
+
+/**
+ * @brief Find the header or trailer a command sets
+ *
+ * @returns The pattern, SVF_PAD_MAX if the command isn't one of them.
+ */
+static svf_PadType svf_PadOf(const char *word)
+{
+	svf_PadType pad;
+
+	for(pad = SVF_PAD_HIR; pad < SVF_PAD_MAX; ++pad)
+	{
+		if(strcasecmp(word, svf_PadNames[pad]) == 0)
+		{
+			break;
+		}
+	}
+	return pad;
+}
+
+/**
+ * @brief Convert an SVF state name
+ *
+ * @param[in] word The state name.
+ * @param[out] state The TAP state.
+ * @retval true The name is a state.
+ */
+static bool svf_ParseState(const char *word, jtagTAP_TAPState *state)
+{
+	jtagTAP_TAPState s;
+
+	for(s = JTAGTAP_STATE_RESET; s < JTAGTAP_STATE_MAX; ++s)
+	{
+		if(strcasecmp(word, svf_StateNames[s]) == 0)
+		{
+			*state = s;
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+ * @brief Check if the TAP can be left in a state
+ */
+static bool svf_IsStable(jtagTAP_TAPState state)
+{
+	return (state == JTAGTAP_STATE_RESET) || (state == JTAGTAP_STATE_IDLE) ||
+		(state == JTAGTAP_STATE_DR_PAUSE) || (state == JTAGTAP_STATE_IR_PAUSE);
+}
+
+/**
+ * @brief Convert an SVF number
+ *
+ * Numbers are integers or reals, such as 1.00E-002. The value is scaled by
+ * 10^scale, so times in seconds can be read in us, and rounded up so no
+ * wait is cut short.
+ *
+ * @param[in] word The number.
+ * @param[in] scale The power of 10 to multiply the number by.
+ * @param[out] value The scaled number.
+ * @retval true The word is a number that fits in 32 bits once scaled.
+ */
+static bool svf_ParseNumber(const char *word, int scale, uint32_t *value)
+{
+	uint64_t mantissa = 0;
+	int exponent = scale;
+	bool digits = false;
+	bool point = false;
+
+	for(; *word != '\x00'; ++word)
+	{
+		if((*word >= '0') && (*word <= '9'))
+		{
+			//keep the significant digits, the rest only move the point
+			if(mantissa < 100000000000ULL)
+			{
+				mantissa = (mantissa * 10) + (*word - '0');
+				exponent -= point ? 1 : 0;
+			}
+			else
+			{
+				exponent += point ? 0 : 1;
+			}
+			digits = true;
+		}
+		else if((*word == '.') && !point)
+		{
+			point = true;
+		}
+		else
+		{
+			break;
+		}
+	}
+
+	if(!digits)
+	{
+		return false;
+	}
+	if((*word == 'e') || (*word == 'E'))
+	{
+		char *end;
+
+		exponent += strtol(word + 1, &end, 10);
+		if((end == (word + 1)) || (*end != '\x00'))
+		{
+			return false;
+		}
+	}
+	else if(*word != '\x00')
+	{
+		return false;
+	}
+
+	if(mantissa == 0)
+	{
+		exponent = 0;
+	}
+	while((exponent > 0) && (mantissa <= 0xFFFFFFFF))
+	{
+		mantissa *= 10;
+		--exponent;
+	}
+	while((exponent < 0) && (mantissa > 1))
+	{
+		mantissa = (mantissa + 9) / 10;
+		++exponent;
+	}
+	*value = mantissa;
+	return mantissa <= 0xFFFFFFFF;
+}
+
+/**
+ * @brief Count the hex strings given in the statement
+ */
+static unsigned int svf_FieldCount()
+{
+	unsigned int count = 0;
+	uint8_t fields;
+
+	for(fields = svf_Fields; fields != 0; fields >>= 1)
+	{
+		count += fields & 0x01;
+	}
+	return count;
+}
+
+/**
+ * @brief Get a nibble from a little endian buffer
+ */
+static uint8_t svf_GetNibble(const uint8_t *data, unsigned int index)
+{
+	return (data[index >> 1] >> ((index & 0x01) * 4)) & 0x0F;
+}
+
+/**
+ * @brief Set a nibble in a little endian buffer
+ */
+static void svf_SetNibble(uint8_t *data, unsigned int index, uint8_t value)
+{
+	const unsigned int shift = (index & 0x01) * 4;
+
+	data[index >> 1] = (data[index >> 1] & ~(0x0F << shift)) | (value << shift);
+}
@@ -0,0 +1,50 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_SVF_H_)
+#define _SVF_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SVF_MAX_BITS		(4096)	///< Longest SDR that can be played
+#define SVF_MAX_IR_BITS		(256)	///< Longest SIR that can be played
+#define SVF_PAD_BITS		(256)	///< Longest HIR, TIR, HDR or TDR that can be played
+
+/**
+ * @brief Outcome of playing an SVF stream
+ */
+typedef enum svf_eResult
+{
+	SVF_RESULT_OK,			///< Every statement ran and every TDO matched
+	SVF_RESULT_MISMATCH,		///< TDO didn't match the expected value
+	SVF_RESULT_SYNTAX,		///< A statement couldn't be parsed
+	SVF_RESULT_UNSUPPORTED,		///< A statement isn't supported by the player
+	SVF_RESULT_TOO_LONG,		///< A scan is longer than the player can hold
+	SVF_RESULT_INCOMPLETE,		///< The stream ended part way through a statement
+	SVF_RESULT_MAX
+} svf_Result;
+
+extern const char * const svf_ResultNames[SVF_RESULT_MAX];
+
+extern void svf_Start();
+extern unsigned int svf_Process(const char *buffer, unsigned int len);
+extern bool svf_IsWaiting();
+extern bool svf_Step();
+extern svf_Result svf_Finish(uint32_t *offset, uint32_t *statements);
+
+#endif
@@ -0,0 +1,312 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include "swd.h"
+#include "jtag.h"
+#include "idcode.h"
+
+#define SWD_REQUEST_START	(0x01)		///< Start bit of a request
+#define SWD_REQUEST_PARK	(0x80)		///< Park bit of a request, the stop bit is 0
+#define SWD_REQUEST_PARITY	(5)		///< Bit of the request holding the parity
+#define SWD_LINE_RESET_CLOCKS	(56)		///< SWDIO high for at least 50 clocks resets the line
+#define SWD_JTAG_TO_SWD		(0xE79E)	///< Switches a SWJ-DP from JTAG to SWD
+#define SWD_IDLE_CLOCKS		(8)		///< Idle clocks after each transfer, lets the target finish it
+#define SWD_WAIT_RETRIES	(100)		///< Times a WAIT is retried before giving up
+
+static void swd_WriteBits(uint32_t bits, unsigned int count);
+static uint32_t swd_ReadBits(unsigned int count);
+static void swd_LineReset();
+static uint8_t swd_Transact(uint8_t request, uint32_t *data);
+
+/**
+ * @brief Build a request header
+ *
+ * @param[in] ap true for an AP register, false for a DP register.
+ * @param[in] read true to read the register, false to write it.
+ * @param[in] addr The register address, only bits 2 and 3 are used.
+ * @returns The 8 bit request, shifted LSB first.
+ */
+uint8_t swd_Request(bool ap, bool read, unsigned int addr)
+{
+	uint8_t request = SWD_REQUEST_START | SWD_REQUEST_PARK | ((addr & 0x0C) << 1);
+
+	if(ap)
+	{
+		request |= SWD_REQUEST_AP;
+	}
+	if(read)
+	{
+		request |= SWD_REQUEST_READ;
+	}
+	//parity of APnDP, RnW, A2 and A3
+	if(swd_Parity((request >> 1) & 0x0F))
+	{
+		request |= (1 << SWD_REQUEST_PARITY);
+	}
+	return request;
+}
+
+/**
+ * @brief Get the parity bit of a value
+ *
+ * @retval true An odd number of bits are set.
+ */
+bool swd_Parity(uint32_t value)
+{
+	value ^= value >> 16;
+	value ^= value >> 8;
+	value ^= value >> 4;
+	value ^= value >> 2;
+	value ^= value >> 1;
+	return (value & 0x01) != 0;
+}
+
+/**
+ * @brief Clock bits out on SWDIO
+ *
+ * SWCLK is TCK and SWDIO is TMS, so the bits are clocked out 16 at a time
+ * with @ref jtag_ClockTMS and are driven on any pins TMS is broadcast on.
+ *
+ * @param[in] bits The bits to send, LSB first.
+ * @param[in] count The number of bits, up to 32.
+ */
+static void swd_WriteBits(uint32_t bits, unsigned int count)
+{
+	while(count > 0)
+	{
+		unsigned int chunk = (count > 16) ? 16 : count;
+
+		jtag_ClockTMS(bits & 0xFFFF, chunk);
+		bits >>= 16;
+		count -= chunk;
+	}
+}
+
+/**
+ * @brief Clock bits in on SWDIO
+ *
+ * Each bit is sampled before the rising edge of SWCLK, the target changes
+ * SWDIO after it.
+ *
+ * @param[in] count The number of bits, up to 32.
+ * @returns The bits read, the first in the LSB.
+ */
+static uint32_t swd_ReadBits(unsigned int count)
+{
+	uint32_t bits = 0;
+	unsigned int bit;
+
+	for(bit = 0; bit < count; ++bit)
+	{
+		if(jtag_Get(JTAG_SIGNAL_TMS))
+		{
+			bits |= (1UL << bit);
+		}
+		jtag_Clock();
+	}
+	return bits;
+}
+
+/**
+ * @brief Hold SWDIO high long enough to reset the line
+ */
+static void swd_LineReset()
+{
+	swd_WriteBits(0xFFFFFFFF, 32);
+	swd_WriteBits(0xFFFFFFFF, SWD_LINE_RESET_CLOCKS - 32);
+}
+
+/**
+ * @brief Switch the target to SWD and reset the line
+ *
+ * A SWJ-DP starts out in JTAG, the switch sequence is ignored by a target
+ * that is already in SWD. The line is left idle, ready for a request. The
+ * DPIDR has to be read next to leave the reset state.
+ */
+void swd_Reset()
+{
+	swd_LineReset();
+	swd_WriteBits(SWD_JTAG_TO_SWD, 16);
+	swd_LineReset();
+	swd_WriteBits(0, 2);
+}
+
+/**
+ * @brief Send a request header and turn the line round
+ *
+ * SWDIO is left as an input, ready for the acknowledge to be read.
+ *
+ * @param[in] request The request, see @ref swd_Request.
+ */
+void swd_SendRequest(uint8_t request)
+{
+	swd_WriteBits(request, 8);
+	jtag_SetInput(JTAG_SIGNAL_TMS, true);
+	jtag_Clock();	//turnaround
+}
+
+/**
+ * @brief Run one transfer, retrying while the target answers WAIT
+ *
+ * @param[in] request The request, see @ref swd_Request.
+ * @param[in,out] data The value to write, or the value read.
+ * @returns The acknowledge, SWD_ACK_PARITY if read data was corrupt.
+ */
+static uint8_t swd_Transact(uint8_t request, uint32_t *data)
+{
+	uint8_t ack = SWD_ACK_WAIT;
+	unsigned int retry;
+
+	for(retry = 0; (ack == SWD_ACK_WAIT) && (retry < SWD_WAIT_RETRIES); ++retry)
+	{
+		swd_SendRequest(request);
+		ack = swd_ReadBits(3);
+
+		if((ack == SWD_ACK_OK) && ((request & SWD_REQUEST_READ) != 0))
+		{
+			uint32_t value = swd_ReadBits(32);
+			bool parity = (swd_ReadBits(1) != 0);
+
+			jtag_Clock();	//turnaround
+			jtag_SetInput(JTAG_SIGNAL_TMS, false);
+			if(parity != swd_Parity(value))
+			{
+				ack = SWD_ACK_PARITY;
+			}
+			else
+			{
+				*data = value;
+			}
+		}
+		else
+		{
+			//a write's data follows the turnaround, nothing follows a WAIT or FAULT
+			jtag_Clock();	//turnaround
+			jtag_SetInput(JTAG_SIGNAL_TMS, false);
+			if(ack == SWD_ACK_OK)
+			{
+				swd_WriteBits(*data, 32);
+				swd_WriteBits(swd_Parity(*data) ? 1 : 0, 1);
+			}
+		}
+		swd_WriteBits(0, SWD_IDLE_CLOCKS);
+	}
+	return ack;
+}
+
+/**
+ * @brief Look for a SWD target on SWCLK (TCK) and SWDIO (TMS)
+ *
+ * The target is switched to SWD and its DPIDR read, which also takes the
+ * line out of the reset state so other transfers can follow.
+ *
+ * @param[out] dpidr The DPIDR read.
+ * @retval true A target answered with a plausible DPIDR.
+ */
+bool swd_Connect(uint32_t *dpidr)
+{
+	uint32_t value = 0;
+	bool found = false;
+
+	swd_Reset();
+	if(swd_Transact(swd_Request(false, true, SWD_DP_DPIDR), &value) == SWD_ACK_OK)
+	{
+		//the DPIDR has the same layout as an ID CODE
+		found = idcode_IsPlausible(value);
+		*dpidr = value;
+	}
+	return found;
+}
+
+/**
+ * @brief Run a list of transfers
+ *
+ * AP reads are posted, the data read by one comes back with the next AP
+ * read or a read of RDBUFF. The list is reordered on the wire so each AP
+ * read gets its own data: a run of AP reads is sent back to back and is
+ * followed by a read of RDBUFF before anything else is sent.
+ *
+ * Transfers are stopped at the first that isn't acknowledged with OK.
+ *
+ * @param[in,out] transfers The transfers to run, the read data and
+ * acknowledges are filled in.
+ * @param[in] count The number of transfers.
+ * @returns The number of transfers, from the start of the list, that
+ * completed.
+ */
+unsigned int swd_Batch(swd_Transfer *transfers, unsigned int count)
+{
+	swd_Transfer *posted = NULL;	//AP read waiting for its data
+	unsigned int done = 0;
+	unsigned int i;
+
+	for(i = 0; i < count; ++i)
+	{
+		swd_Transfer *transfer = &transfers[i];
+		const bool apread = ((transfer->request & (SWD_REQUEST_AP | SWD_REQUEST_READ)) == (SWD_REQUEST_AP | SWD_REQUEST_READ));
+		uint32_t data = transfer->data;
+
+		if((posted != NULL) && !apread)
+		{
+			posted->ack = swd_Transact(swd_Request(false, true, SWD_DP_RDBUFF), &posted->data);
+			if(posted->ack != SWD_ACK_OK)
+			{
+				return done;
+			}
+			++done;
+			posted = NULL;
+		}
+
+		transfer->ack = swd_Transact(transfer->request, &data);
+		if(transfer->ack != SWD_ACK_OK)
+		{
+			if(posted != NULL)
+			{
+				posted->ack = transfer->ack;
+			}
+			return done;
+		}
+
+		if(apread)
+		{
+			//this read returned the data for the last one
+			if(posted != NULL)
+			{
+				posted->data = data;
+				++done;
+			}
+			posted = transfer;
+		}
+		else
+		{
+			transfer->data = data;
+			++done;
+		}
+	}
+
+	if(posted != NULL)
+	{
+		posted->ack = swd_Transact(swd_Request(false, true, SWD_DP_RDBUFF), &posted->data);
+		if(posted->ack == SWD_ACK_OK)
+		{
+			++done;
+		}
+	}
+	return done;
+}
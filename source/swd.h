@@ -0,0 +1,61 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_SWD_H_)
+#define _SWD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+//Acknowledges, as shifted out by the target
+#define SWD_ACK_OK		(0x01)	///< Transfer accepted
+#define SWD_ACK_WAIT		(0x02)	///< Target busy, try again
+#define SWD_ACK_FAULT		(0x04)	///< Sticky error set in the DP
+#define SWD_ACK_PARITY		(0x08)	///< Not from the target, the read data failed its parity check
+
+//DP register addresses
+#define SWD_DP_DPIDR		(0x00)	///< Debug Port ID, read only
+#define SWD_DP_ABORT		(0x00)	///< Abort and clear sticky errors, write only
+#define SWD_DP_CTRLSTAT		(0x04)	///< Control and status
+#define SWD_DP_SELECT		(0x08)	///< AP and AP register bank select
+#define SWD_DP_RDBUFF		(0x0C)	///< Result of the last AP read
+
+//Request header bits
+#define SWD_REQUEST_AP		(0x02)	///< Access the AP rather than the DP
+#define SWD_REQUEST_READ	(0x04)	///< Read rather than write
+#define SWD_REQUEST_ADDR(request)	(((request) >> 1) & 0x0C)	///< The register address of a request
+
+#define SWD_BATCH_MAX		(16)	///< Transfers the host can send in one swd command
+
+/**
+ * @brief One AP or DP access for @ref swd_Batch
+ */
+typedef struct swd_sTransfer
+{
+	uint8_t request;	///< The request header, see @ref swd_Request
+	uint8_t ack;		///< The acknowledge for the transfer
+	uint32_t data;		///< The value to write, or the value read
+} swd_Transfer;
+
+extern uint8_t swd_Request(bool ap, bool read, unsigned int addr);
+extern bool swd_Parity(uint32_t value);
+extern void swd_Reset();
+extern void swd_SendRequest(uint8_t request);
+extern bool swd_Connect(uint32_t *dpidr);
+extern unsigned int swd_Batch(swd_Transfer *transfers, unsigned int count);
+
+#endif
@@ -0,0 +1,420 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <libopencm3/stm32/gpio.h>
+#include <libopencm3/stm32/rcc.h>
+#include <libopencm3/cm3/nvic.h>
+#include <libopencm3/usb/usbd.h>
+#include <libopencm3/usb/cdc.h>
+#include "usbcdc.h"
+#include "serial.h"
+
+#define USBCDC_EP_OUT		(0x01)	///< Bulk endpoint for data from the host
+#define USBCDC_EP_IN		(0x82)	///< Bulk endpoint for data to the host
+#define USBCDC_EP_NOTIFY	(0x83)	///< Interrupt endpoint for CDC notifications
+#define USBCDC_RX_PACKETS	(4)	///< Received packets queued for the command processor
+#define USBCDC_DISCONNECT_DELAY	(800000)	///< Loops to hold D+ low so the host sees a disconnect
+
+/**
+ * @brief A received packet waiting to be processed
+ */
+typedef struct usbcdc_sPacket
+{
+	uint8_t length;				///< Bytes in the packet
+	uint8_t offset;				///< Bytes already consumed
+	char data[USBCDC_PACKET_SIZE];		///< Packet contents
+} usbcdc_Packet;
+
+static usbd_device *usbcdc_Device;
+static uint8_t usbcdc_ControlBuffer[128];	///< Buffer for control requests
+static volatile bool usbcdc_Configured;		///< The host has set the configuration
+static usbcdc_Packet usbcdc_RxPackets[USBCDC_RX_PACKETS];
+static volatile unsigned int usbcdc_RxHead;	///< Packets received, written by the ISR
+static volatile unsigned int usbcdc_RxTail;	///< Packets processed
+static volatile bool usbcdc_RxNAK;		///< The OUT endpoint is held off until a packet is free
+static volatile bool usbcdc_TxBusy;		///< An IN packet is waiting for the host
+
+static const struct usb_device_descriptor usbcdc_DeviceDescriptor = {
+	.bLength = USB_DT_DEVICE_SIZE,
+	.bDescriptorType = USB_DT_DEVICE,
+	.bcdUSB = 0x0200,
+	.bDeviceClass = USB_CLASS_CDC,
+	.bDeviceSubClass = 0,
+	.bDeviceProtocol = 0,
+	.bMaxPacketSize0 = 64,
+	.idVendor = 0x0483,
+	.idProduct = 0x5740,
+	.bcdDevice = 0x0200,
+	.iManufacturer = 1,
+	.iProduct = 2,
+	.iSerialNumber = 3,
+	.bNumConfigurations = 1,
+};
+
+static const struct usb_endpoint_descriptor usbcdc_NotifyEndpoint[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = USBCDC_EP_NOTIFY,
+	.bmAttributes = USB_ENDPOINT_ATTR_INTERRUPT,
+	.wMaxPacketSize = 16,
+	.bInterval = 255,
+}};
+
+static const struct usb_endpoint_descriptor usbcdc_DataEndpoints[] = {{
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = USBCDC_EP_OUT,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = USBCDC_PACKET_SIZE,
+	.bInterval = 1,
+}, {
+	.bLength = USB_DT_ENDPOINT_SIZE,
+	.bDescriptorType = USB_DT_ENDPOINT,
+	.bEndpointAddress = USBCDC_EP_IN,
+	.bmAttributes = USB_ENDPOINT_ATTR_BULK,
+	.wMaxPacketSize = USBCDC_PACKET_SIZE,
+	.bInterval = 1,
+}};
+
+static const struct {
+	struct usb_cdc_header_descriptor header;
+	struct usb_cdc_call_management_descriptor call_mgmt;
+	struct usb_cdc_acm_descriptor acm;
+	struct usb_cdc_union_descriptor cdc_union;
+} __attribute__((packed)) usbcdc_FunctionalDescriptors = {
+	.header = {
+		.bFunctionLength = sizeof(struct usb_cdc_header_descriptor),
+		.bDescriptorType = CS_INTERFACE,
+		.bDescriptorSubtype = USB_CDC_TYPE_HEADER,
+		.bcdCDC = 0x0110,
+	},
+	.call_mgmt = {
+		.bFunctionLength = sizeof(struct usb_cdc_call_management_descriptor),
+		.bDescriptorType = CS_INTERFACE,
+		.bDescriptorSubtype = USB_CDC_TYPE_CALL_MANAGEMENT,
+		.bmCapabilities = 0,
+		.bDataInterface = 1,
+	},
+	.acm = {
+		.bFunctionLength = sizeof(struct usb_cdc_acm_descriptor),
+		.bDescriptorType = CS_INTERFACE,
+		.bDescriptorSubtype = USB_CDC_TYPE_ACM,
+		.bmCapabilities = 0,
+	},
+	.cdc_union = {
+		.bFunctionLength = sizeof(struct usb_cdc_union_descriptor),
+		.bDescriptorType = CS_INTERFACE,
+		.bDescriptorSubtype = USB_CDC_TYPE_UNION,
+		.bControlInterface = 0,
+		.bSubordinateInterface0 = 1,
+	},
+};
+
+static const struct usb_interface_descriptor usbcdc_CommInterface[] = {{
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = 0,
+	.bAlternateSetting = 0,
+	.bNumEndpoints = 1,
+	.bInterfaceClass = USB_CLASS_CDC,
+	.bInterfaceSubClass = USB_CDC_SUBCLASS_ACM,
+	.bInterfaceProtocol = USB_CDC_PROTOCOL_AT,
+	.iInterface = 0,
+	.endpoint = usbcdc_NotifyEndpoint,
+	.extra = &usbcdc_FunctionalDescriptors,
+	.extralen = sizeof(usbcdc_FunctionalDescriptors),
+}};
+
+static const struct usb_interface_descriptor usbcdc_DataInterface[] = {{
+	.bLength = USB_DT_INTERFACE_SIZE,
+	.bDescriptorType = USB_DT_INTERFACE,
+	.bInterfaceNumber = 1,
+	.bAlternateSetting = 0,
+	.bNumEndpoints = 2,
+	.bInterfaceClass = USB_CLASS_DATA,
+	.bInterfaceSubClass = 0,
+	.bInterfaceProtocol = 0,
+	.iInterface = 0,
+	.endpoint = usbcdc_DataEndpoints,
+}};
+
+static const struct usb_interface usbcdc_Interfaces[] = {{
+	.num_altsetting = 1,
+	.altsetting = usbcdc_CommInterface,
+}, {
+	.num_altsetting = 1,
+	.altsetting = usbcdc_DataInterface,
+}};
+
+static const struct usb_config_descriptor usbcdc_ConfigDescriptor = {
+	.bLength = USB_DT_CONFIGURATION_SIZE,
+	.bDescriptorType = USB_DT_CONFIGURATION,
+	.wTotalLength = 0,
+	.bNumInterfaces = 2,
+	.bConfigurationValue = 1,
+	.iConfiguration = 0,
+	.bmAttributes = 0x80,
+	.bMaxPower = 0x32,
+	.interface = usbcdc_Interfaces,
+};
+
+static const char * const usbcdc_Strings[] = {
+	"JtagKnocker",
+	"JtagKnocker CDC-ACM",
+	"0001",
+};
+
+static enum usbd_request_return_codes usbcdc_ControlRequest(usbd_device *dev, struct usb_setup_data *req, uint8_t **buf, uint16_t *len, usbd_control_complete_callback *complete);
+static void usbcdc_DataRx(usbd_device *dev, uint8_t ep);
+static void usbcdc_DataTx(usbd_device *dev, uint8_t ep);
+static void usbcdc_WritePacket();
+static void usbcdc_SetConfig(usbd_device *dev, uint16_t wValue);
+static void usbcdc_Reset();
+
+/**
+ * @brief Initialise the USB peripheral as a CDC-ACM device
+ *
+ * D+ is held low for a moment first, so the host sees a disconnect after a
+ * reset and enumerates the device again. All USB processing is done from
+ * the USB interrupt.
+ */
+void usbcdc_Init()
+{
+	volatile unsigned int delay;
+
+	usbcdc_Configured = false;
+	usbcdc_RxHead = 0;
+	usbcdc_RxTail = 0;
+	usbcdc_RxNAK = false;
+	usbcdc_TxBusy = false;
+
+	rcc_periph_clock_enable(RCC_GPIOA);
+	rcc_periph_clock_enable(RCC_USB);
+
+	gpio_set_mode(GPIOA, GPIO_MODE_OUTPUT_2_MHZ, GPIO_CNF_OUTPUT_PUSHPULL, GPIO12);
+	gpio_clear(GPIOA, GPIO12);
+	for(delay = 0; delay < USBCDC_DISCONNECT_DELAY; ++delay)
+	{
+	}
+	gpio_set_mode(GPIOA, GPIO_MODE_INPUT, GPIO_CNF_INPUT_FLOAT, GPIO12);
+
+	usbcdc_Device = usbd_init(&st_usbfs_v1_usb_driver, &usbcdc_DeviceDescriptor, &usbcdc_ConfigDescriptor,
+			usbcdc_Strings, 3, usbcdc_ControlBuffer, sizeof(usbcdc_ControlBuffer));
+	usbd_register_set_config_callback(usbcdc_Device, usbcdc_SetConfig);
+	usbd_register_reset_callback(usbcdc_Device, usbcdc_Reset);
+
+	nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+}
+
+/**
+ * @brief USB low priority interrupt, runs the USB stack
+ */
+void usb_lp_can_rx0_isr()
+{
+	usbd_poll(usbcdc_Device);
+}
+
+/**
+ * @brief Check if the host has configured the device
+ *
+ * @retval true The host has enumerated the device and data can be sent
+ */
+bool usbcdc_IsConfigured()
+{
+	return usbcdc_Configured;
+}
+
+/**
+ * @brief Start sending the serial transmit ring
+ *
+ * If no IN packet is in flight the first one is written, the rest follow
+ * from the IN complete callback. Nothing is sent until the host has
+ * configured the device.
+ */
+void usbcdc_StartTx()
+{
+	nvic_disable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+	if(usbcdc_Configured && !usbcdc_TxBusy)
+	{
+		usbcdc_WritePacket();
+	}
+	nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+}
+
+/**
+ * @brief Write the next packet from the serial transmit ring
+ *
+ * Must be called with the USB interrupt disabled, or from it.
+ */
+static void usbcdc_WritePacket()
+{
+	const char *data;
+	unsigned int len = serial_TxPeek(&data);
+
+	usbcdc_TxBusy = false;
+	if(len > 0)
+	{
+		if(len > USBCDC_PACKET_SIZE)
+		{
+			len = USBCDC_PACKET_SIZE;
+		}
+		if(usbd_ep_write_packet(usbcdc_Device, USBCDC_EP_IN, data, len) != 0)
+		{
+			serial_TxRelease(len);
+			usbcdc_TxBusy = true;
+		}
+	}
+}
+
+/**
+ * @brief Get the oldest unprocessed received data
+ *
+ * @param[out] data Set to the start of the data
+ * @returns The number of bytes available at data, 0 if nothing was received
+ */
+unsigned int usbcdc_Receive(const char **data)
+{
+	unsigned int len = 0;
+
+	if(usbcdc_RxHead != usbcdc_RxTail)
+	{
+		usbcdc_Packet *packet = &usbcdc_RxPackets[usbcdc_RxTail % USBCDC_RX_PACKETS];
+		*data = &packet->data[packet->offset];
+		len = packet->length - packet->offset;
+	}
+	return len;
+}
+
+/**
+ * @brief Mark received data as processed
+ *
+ * Once a packet has been fully consumed it is returned to the queue. If the
+ * queue was full the OUT endpoint is released so the host can carry on.
+ *
+ * @param[in] len The number of bytes processed
+ */
+void usbcdc_Consume(unsigned int len)
+{
+	if(usbcdc_RxHead != usbcdc_RxTail)
+	{
+		usbcdc_Packet *packet = &usbcdc_RxPackets[usbcdc_RxTail % USBCDC_RX_PACKETS];
+
+		packet->offset += len;
+		if(packet->offset >= packet->length)
+		{
+			++usbcdc_RxTail;
+
+			nvic_disable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+			if(usbcdc_RxNAK)
+			{
+				usbcdc_RxNAK = false;
+				usbd_ep_nak_set(usbcdc_Device, USBCDC_EP_OUT, 0);
+			}
+			nvic_enable_irq(NVIC_USB_LP_CAN_RX0_IRQ);
+		}
+	}
+}
+
+/**
+ * @brief Handle the CDC class requests
+ *
+ * The line coding and control line state are accepted but have no effect.
+ */
+static enum usbd_request_return_codes usbcdc_ControlRequest(usbd_device *dev, struct usb_setup_data *req, uint8_t **buf, uint16_t *len, usbd_control_complete_callback *complete)
+{
+	enum usbd_request_return_codes result = USBD_REQ_NOTSUPP;
+
+	switch(req->bRequest)
+	{
+		case USB_CDC_REQ_SET_CONTROL_LINE_STATE:
+			result = USBD_REQ_HANDLED;
+			break;
+		case USB_CDC_REQ_SET_LINE_CODING:
+			if(*len >= sizeof(struct usb_cdc_line_coding))
+			{
+				result = USBD_REQ_HANDLED;
+			}
+			break;
+		default:
+			break;
+	}
+	return result;
+}
+
+/**
+ * @brief Receive a packet from the host
+ *
+ * The packet is queued for the main loop. When the queue fills the endpoint
+ * NAKs further packets until one is consumed.
+ */
+static void usbcdc_DataRx(usbd_device *dev, uint8_t ep)
+{
+	usbcdc_Packet *packet = &usbcdc_RxPackets[usbcdc_RxHead % USBCDC_RX_PACKETS];
+
+	packet->length = usbd_ep_read_packet(dev, ep, packet->data, USBCDC_PACKET_SIZE);
+	packet->offset = 0;
+	if(packet->length > 0)
+	{
+		++usbcdc_RxHead;
+		if((usbcdc_RxHead - usbcdc_RxTail) == USBCDC_RX_PACKETS)
+		{
+			usbcdc_RxNAK = true;
+			usbd_ep_nak_set(dev, ep, 1);
+		}
+	}
+}
+
+/**
+ * @brief The host has taken an IN packet, send the next one
+ */
+static void usbcdc_DataTx(usbd_device *dev, uint8_t ep)
+{
+	usbcdc_WritePacket();
+}
+
+/**
+ * @brief Set up the endpoints once the host selects the configuration
+ */
+static void usbcdc_SetConfig(usbd_device *dev, uint16_t wValue)
+{
+	usbd_ep_setup(dev, USBCDC_EP_OUT, USB_ENDPOINT_ATTR_BULK, USBCDC_PACKET_SIZE, usbcdc_DataRx);
+	usbd_ep_setup(dev, USBCDC_EP_IN, USB_ENDPOINT_ATTR_BULK, USBCDC_PACKET_SIZE, usbcdc_DataTx);
+	usbd_ep_setup(dev, USBCDC_EP_NOTIFY, USB_ENDPOINT_ATTR_INTERRUPT, 16, NULL);
+
+	usbd_register_control_callback(dev, USB_REQ_TYPE_CLASS | USB_REQ_TYPE_INTERFACE,
+			USB_REQ_TYPE_TYPE | USB_REQ_TYPE_RECIPIENT, usbcdc_ControlRequest);
+
+	//a reconfigure resets the endpoint, so it is no longer held off
+	usbcdc_RxNAK = ((usbcdc_RxHead - usbcdc_RxTail) == USBCDC_RX_PACKETS);
+	usbd_ep_nak_set(dev, USBCDC_EP_OUT, usbcdc_RxNAK ? 1 : 0);
+	usbcdc_Configured = true;
+
+	//send anything queued before the host connected
+	usbcdc_WritePacket();
+}
+
+/**
+ * @brief The host has reset the bus
+ */
+static void usbcdc_Reset()
+{
+	usbcdc_Configured = false;
+	usbcdc_TxBusy = false;
+}
@@ -0,0 +1,31 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_USBCDC_H_)
+#define _USBCDC_H_
+
+#include <stdbool.h>
+
+#define USBCDC_PACKET_SIZE	(64)	///< Full speed bulk packet size
+
+extern void usbcdc_Init();
+extern bool usbcdc_IsConfigured();
+extern void usbcdc_StartTx();
+extern unsigned int usbcdc_Receive(const char **data);
+extern void usbcdc_Consume(unsigned int len);
+
+#endif
@@ -23,7 +23,11 @@
 #define jtag_Set		chain_Mock_jtag_Set
 #define jtag_Get		chain_Mock_jtag_Get
 #define jtag_Clock		chain_Mock_jtag_Clock
+#define jtag_Shift		chain_Mock_jtag_Shift
 #define jtagTAP_SetState	chain_Mock_jtagTAP_SetState
+#define jtagTAP_ShiftExit	chain_Mock_jtagTAP_ShiftExit
+#define jtag_GetGangCfg		chain_Mock_jtag_GetGangCfg
+#define jtag_ShiftGang		chain_Mock_jtag_ShiftGang
 #define serial_Write		chain_Mock_serial_Write		//get rid of a unnneded function
 
 #include "../source/jtag.h"
@@ -41,6 +45,7 @@ static bool TDO;			///< Fake chain TDO state
 static bool TDI;			///< Fake chain TDI state
 static bool chain_reset;		///< Was the chain reset
 static int usage_error;			///< did a usage error occur?
+static bool chain_gang_stuck;		///< Is the fake third gang target's TDO stuck low
 
 /**
  * @brief Test the fake chain implementation
@@ -248,6 +253,10 @@ void chain_Mock_jtagTAP_SetState(jtagTAP_TAPState target)
 		//flag that reset was called
 		chain_reset = true;
 	}
+	else if(target == JTAGTAP_STATE_IDLE)
+	{
+		//scans finish here, nothing to do
+	}
 	else
 	{
 		usage_error = 1;
@@ -255,6 +264,13 @@ void chain_Mock_jtagTAP_SetState(jtagTAP_TAPState target)
 	TAPState = target;
 }
 
+/**
+ * @brief Fake leaving the shift state, the fake chain doesn't need it
+ */
+void chain_Mock_jtagTAP_ShiftExit()
+{
+}
+
 /**
  * @brief Get the faked TDO
  */
@@ -283,14 +299,39 @@ void chain_Mock_jtag_Set(jtag_Signal sig, bool state)
 	}
 }
 
+/**
+ * @brief Fake the bulk shift using the fake signals
+ *
+ * Behaves as jtag_Shift, sampling TDO before each clock. The exit flag is
+ * ignored as the fake chain doesn't track the TAP state.
+ */
+void chain_Mock_jtag_Shift(const uint8_t *tdi, uint8_t *tdo, unsigned int nbits, bool exit)
+{
+	unsigned int bit;
+	for(bit = 0; bit < nbits; ++bit)
+	{
+		const uint8_t mask = 1 << (bit % 8);
+		if(tdi != NULL)
+		{
+			chain_Mock_jtag_Set(JTAG_SIGNAL_TDI, (tdi[bit / 8] & mask) != 0);
+		}
+		if(tdo != NULL)
+		{
+			tdo[bit / 8] &= ~mask;
+			tdo[bit / 8] |= (chain_Mock_jtag_Get(JTAG_SIGNAL_TDO) ? mask : 0);
+		}
+		chain_Mock_jtag_Clock();
+	}
+}
+
 /**
  * @brief Test the device counting algorithm
  *
  * To determine the number of devices on the chain, the following algorithm
  * is used:
  *	Enter into bypass mode (IR = 0xFF....)
- *	Enter into shift_dr and fill with ones
- * 	Clock a 0 through and count the clocks until it appears
+ *	Enter into shift_dr
+ * 	Send a marker through and count the clocks until it appears
  *	DR can be left in whatever state
  * When the device is in BYPASS mode, the data register has a length of one,
  * so the devices on a chain is just the length of the data register. The DR
@@ -350,6 +391,136 @@ bool chain_TestChainIRLength()
 	return true;
 }
 
+/**
+ * @brief Test chains longer than the old fixed limits are measured
+ *
+ * 100 devices with an IR length of 10 each, which is past the old 20 device
+ * and 640 bit IR limits. The IR is filled with the capture pattern each
+ * device loads, ...01, which the marker mustn't be confused by.
+ */
+bool chain_TestLongChain()
+{
+	char longchain_ir[125];		//1000 bits of IR
+	char longchain_dr[13];		//100 BYPASS registers
+	unsigned int count;
+
+	for(count = 0; count < sizeof(longchain_ir); ++count)
+	{
+		longchain_ir[count] = 0x41 << (count % 2);
+	}
+	memset(longchain_dr, 0x00, sizeof(longchain_dr));
+
+	//fake chain setup
+	chain_ir = longchain_ir;
+	chain_ir_len = 1000;
+	chain_dr = longchain_dr;
+	chain_dr_len = 100;
+	usage_error = 0;
+
+	chain_IRLength = 0;
+	chain_Devices = 0;
+	ASSERT(chain_findIRLength(), "IR length not found");
+	ASSERT(chain_IRLength == chain_ir_len, "Wrong IR length found: %i, should be %i", chain_IRLength, chain_ir_len);
+	for(count = 0; count < sizeof(longchain_ir); ++count)
+	{
+		ASSERT(longchain_ir[count] == (char)0xFF, "Not in BYPASS at byte %i", count);
+	}
+
+	ASSERT(chain_findDevices(), "Devices not found");
+	ASSERT(chain_Devices == chain_dr_len, "Wrong number of devices found: %i, should be %i", chain_Devices, chain_dr_len);
+	ASSERT(usage_error == 0, "Usage Error: %i", usage_error);
+	return true;
+}
+
+/**
+ * @brief Test finding each device's IR length from the capture pattern
+ *
+ * Three devices with IR lengths of 4, 5 and 8, the first out of TDO being
+ * nearest TDO. A captured bit that looks like the start of a device makes
+ * the lengths unknown.
+ */
+bool chain_TestIRLengths()
+{
+	char irlengths_ir[3];
+
+	//1000 10000 10000000, LSB first
+	irlengths_ir[0] = 0x11;
+	irlengths_ir[1] = 0x02;
+	irlengths_ir[2] = 0x00;
+
+	chain_ir = irlengths_ir;
+	chain_ir_len = 17;
+	chain_dr = NULL;
+	chain_dr_len = 0;
+	usage_error = 0;
+
+	chain_Devices = 3;
+	chain_IRLength = 17;
+	ASSERT(chain_findIRLengths(), "IR lengths not found");
+	ASSERT(chain_Model[0].irlength == 4, "Device 1 IR length %i, should be 4", chain_Model[0].irlength);
+	ASSERT(chain_Model[1].irlength == 5, "Device 2 IR length %i, should be 5", chain_Model[1].irlength);
+	ASSERT(chain_Model[2].irlength == 8, "Device 3 IR length %i, should be 8", chain_Model[2].irlength);
+	ASSERT(memcmp(irlengths_ir, "\xFF\xFF\x01", 3) == 0, "Not in BYPASS");
+
+	//1000 10000 10010000, the last device captured a 1 that looks like a start
+	irlengths_ir[0] = 0x11;
+	irlengths_ir[1] = 0x12;
+	irlengths_ir[2] = 0x00;
+	ASSERT(!chain_findIRLengths(), "Ambiguous IR lengths found");
+	ASSERT(chain_Model[2].irlength == 0, "Ambiguous IR length left set");
+	ASSERT(usage_error == 0, "Usage Error: %i", usage_error);
+	return true;
+}
+
+/**
+ * @brief Test IR and DR scans of a selected device
+ *
+ * The other devices should be in BYPASS with the DR padded around them, and
+ * loading the same instruction again shouldn't shift the IR.
+ */
+bool chain_TestSelectScan()
+{
+	char select_ir[3] = { 0x00, 0x00, 0x00 };
+	char select_dr[2] = { 0x4B, 0x03 };	//1 10100101 1, the middle device's DR is 0xA5
+	uint8_t tdi = 0x3C;
+	uint8_t tdo = 0x00;
+
+	chain_ir = select_ir;
+	chain_ir_len = 17;
+	chain_dr = select_dr;
+	chain_dr_len = 10;
+	usage_error = 0;
+
+	chain_Devices = 3;
+	chain_IRLength = 17;
+	chain_Model[0].irlength = 4;
+	chain_Model[1].irlength = 5;
+	chain_Model[2].irlength = 8;
+	chain_Selected = CHAIN_NOT_SELECTED;
+	chain_IRValid = false;
+
+	ASSERT(!chain_ScanIR(0x0A), "IR scanned with nothing selected");
+	ASSERT(!chain_Select(3), "Selected a missing device");
+	ASSERT(chain_Select(1), "Device not selected");
+
+	//1111 01010 11111111, LSB first
+	ASSERT(chain_ScanIR(0x0A), "IR scan failed");
+	ASSERT(memcmp(select_ir, "\xAF\xFE\x01", 3) == 0, "Wrong IR: %02X %02X %02X", select_ir[0], select_ir[1], select_ir[2]);
+
+	memset(select_ir, 0x00, sizeof(select_ir));
+	ASSERT(chain_ScanIR(0x0A), "Cached IR scan failed");
+	ASSERT(memcmp(select_ir, "\x00\x00\x00", 3) == 0, "Cached instruction shifted again");
+	chain_Invalidate();
+	ASSERT(chain_ScanIR(0x0A), "IR scan failed");
+	ASSERT(memcmp(select_ir, "\xAF\xFE\x01", 3) == 0, "Invalidated instruction not shifted");
+
+	ASSERT(chain_ScanDR(&tdi, &tdo, 8), "DR scan failed");
+	ASSERT(tdo == 0xA5, "Wrong DR read: %02X, should be A5", tdo);
+	ASSERT(memcmp(select_dr, "\x79\x02", 2) == 0, "Wrong DR: %02X %02X", select_dr[0], select_dr[1]);
+	ASSERT(usage_error == 0, "Usage Error: %i", usage_error);
+	return true;
+}
+
 /**
  * @brief Test the function for finding an IDCODE from a reset device
  *
@@ -431,6 +602,117 @@ bool chain_TestResetDRIDCodes()
 	return true;
 }
 
+/**
+ * @brief Fake gang configuration, targets 1 and 3 are the fake chain
+ */
+bool chain_Mock_jtag_GetGangCfg(unsigned int target, int *tdi, int *tdo)
+{
+	*tdi = (target * 2) + 2;
+	*tdo = (target * 2) + 3;
+	return (target == 0) || (target == 2);
+}
+
+/**
+ * @brief Fake the gang shift, every target is a copy of the fake chain
+ *
+ * Target 3's TDO is stuck low when chain_gang_stuck is set.
+ */
+void chain_Mock_jtag_ShiftGang(const uint8_t *tdi, uint8_t * const tdo[JTAG_GANG_MAX], unsigned int nbits, bool exit)
+{
+	unsigned int target;
+
+	chain_Mock_jtag_Shift(tdi, tdo[0], nbits, exit);
+	for(target = 1; target < JTAG_GANG_MAX; ++target)
+	{
+		if(tdo[target] != NULL)
+		{
+			if((target == 2) && chain_gang_stuck)
+			{
+				memset(tdo[target], 0x00, (nbits + 7) / 8);
+			}
+			else
+			{
+				memcpy(tdo[target], tdo[0], (nbits + 7) / 8);
+			}
+		}
+	}
+}
+
+/**
+ * @brief Test splitting the DR shifted out after a reset into ID CODEs
+ *
+ * The chain ends at the ones from TDI. A TDO stuck low never ends and one
+ * stuck high has no devices.
+ */
+bool chain_TestGangIDCodes()
+{
+	const uint32_t codes[] = { 0x4BA00477, 0, 0x020B20DD };
+	uint8_t data[CHAIN_GANG_BITS / 8];
+	uint32_t idcodes[CHAIN_GANG_DEVICES];
+	unsigned int bit = 0;
+	unsigned int i;
+	int devices;
+
+	//ID CODE, BYPASS, ID CODE then the ones from TDI
+	memset(data, 0xFF, sizeof(data));
+	for(i = 0; i < 3; ++i)
+	{
+		unsigned int length = (codes[i] == 0) ? 1 : 32;
+		unsigned int n;
+
+		for(n = 0; n < length; ++n, ++bit)
+		{
+			if(((codes[i] >> n) & 0x01) == 0)
+			{
+				data[bit >> 3] &= ~(1 << (bit & 0x07));
+			}
+		}
+	}
+	devices = chain_parseIDCodes(data, CHAIN_GANG_BITS, idcodes, CHAIN_GANG_DEVICES);
+	ASSERT(devices == 3, "Wrong device count: %i", devices);
+	for(i = 0; i < 3; ++i)
+	{
+		ASSERT(idcodes[i] == codes[i], "Device %i ID Code is incorrect: %08X, should be %08X", i, idcodes[i], codes[i]);
+	}
+
+	memset(data, 0x00, sizeof(data));
+	devices = chain_parseIDCodes(data, CHAIN_GANG_BITS, idcodes, CHAIN_GANG_DEVICES);
+	ASSERT(devices == -1, "TDO stuck low gave %i devices", devices);
+
+	memset(data, 0xFF, sizeof(data));
+	devices = chain_parseIDCodes(data, CHAIN_GANG_BITS, idcodes, CHAIN_GANG_DEVICES);
+	ASSERT(devices == 0, "TDO stuck high gave %i devices", devices);
+	return true;
+}
+
+/**
+ * @brief Test the gang targets are read and compared
+ *
+ * Two copies of the same chain match. When one target answers with nothing
+ * the detect fails.
+ */
+bool chain_TestDetectGang()
+{
+	const char idcode[] = { 0x77, 0x04, 0xA0, 0x4B };
+	char dr[4];
+
+	chain_ir_len = 0;
+	chain_ir = NULL;	//IR isn't used.
+	chain_dr_len = 32;
+	chain_dr = dr;
+	usage_error = 0;
+
+	memcpy(dr, idcode, sizeof(dr));
+	chain_gang_stuck = false;
+	ASSERT(chain_DetectGang(), "Matching targets not reported");
+
+	memcpy(dr, idcode, sizeof(dr));
+	chain_gang_stuck = true;
+	ASSERT(!chain_DetectGang(), "Missing target not reported");
+	ASSERT(usage_error == 0, "Usage Error: %i", usage_error);
+	return true;
+}
+
 /**
  * NULL function to get rid of serial_Write linking
  */
@@ -25,5 +25,10 @@ extern bool chain_TestChainIRLength();
 extern bool chain_TestResetDRIDCode();
 extern bool chain_TestDetect();
 extern bool chain_TestResetDRIDCodes();
+extern bool chain_TestLongChain();
+extern bool chain_TestIRLengths();
+extern bool chain_TestSelectScan();
+extern bool chain_TestGangIDCodes();
+extern bool chain_TestDetectGang();
 
 #endif
@@ -0,0 +1,184 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tcomdispatch.h"
+#include <string.h>
+
+#include "../source/comdispatch.c"
+
+static void comdisp_Mock_Handler(const comdisp_Args *args) { }
+
+static const char * const comdisp_Mock_Modes[] = { "reset", NULL, "bypass" };	///< Keywords with a gap
+
+/**
+ * @brief Subcommands of the mock scan command
+ */
+static const comdisp_Command comdisp_Mock_ScanCommands[] =
+{
+	{ .name = "abort", .handler = comdisp_Mock_Handler },
+	{ .name = "status", .handler = comdisp_Mock_Handler, .value = 7 },
+};
+
+/**
+ * @brief Mock command table, sorted
+ */
+static const comdisp_Command comdisp_Mock_Commands[] =
+{
+	{ .name = "chain", .handler = comdisp_Mock_Handler },
+	{ .name = "ir", .handler = comdisp_Mock_Handler, .required = 1, .params = { COMDISP_HEX("value", 0) } },
+	{ .name = "scan", .handler = comdisp_Mock_Handler, .subcommands = comdisp_Mock_ScanCommands, .nsubcommands = COMDISP_ENTRIES(comdisp_Mock_ScanCommands), .required = 1,
+		.params = { COMDISP_DEC("npins", 0), COMDISP_KEYWORD("mode", comdisp_Mock_Modes, 0), COMDISP_DEC("seconds", 5) } },
+	{ .name = "swd", .handler = comdisp_Mock_Handler, .flags = COMDISP_FLAG_MORE, .params = { COMDISP_TEXT("port") } },
+	{ .name = "tck", .handler = comdisp_Mock_Handler },
+};
+
+/**
+ * @brief Test splitting a line into tokens
+ *
+ * Runs of delimiters are skipped and replaced by terminators, and tokens
+ * beyond the limit are counted but not stored.
+ */
+bool comdisp_TestTokenize()
+{
+	char line[] = "  scan\r8 \n bypass  ";
+	char empty[] = " \r\n";
+	char many[] = "a b c d e f";
+	char *tokens[4] = { NULL, NULL, NULL, NULL };
+	unsigned int count;
+
+	count = comdisp_Tokenize(line, tokens, 4);
+	ASSERT(count == 3, "%i tokens found, should be %i", count, 3);
+	ASSERT(strcmp(tokens[0], "scan") == 0, "First token %s", tokens[0]);
+	ASSERT(strcmp(tokens[1], "8") == 0, "Second token %s", tokens[1]);
+	ASSERT(strcmp(tokens[2], "bypass") == 0, "Third token %s", tokens[2]);
+	ASSERT(tokens[3] == NULL, "Fourth token set");
+
+	count = comdisp_Tokenize(empty, tokens, 4);
+	ASSERT(count == 0, "%i tokens found in an empty line", count);
+
+	tokens[3] = NULL;
+	count = comdisp_Tokenize(many, tokens, 3);
+	ASSERT(count == 6, "%i tokens counted, should be %i", count, 6);
+	ASSERT(tokens[3] == NULL, "Token stored past the limit");
+
+	return true;
+}
+
+/**
+ * @brief Test looking up commands
+ *
+ * The first and last entries are found, and words between, before and after
+ * entries or only a prefix of one aren't.
+ */
+bool comdisp_TestFind()
+{
+	unsigned int i;
+
+	for(i = 0; i < COMDISP_ENTRIES(comdisp_Mock_Commands); ++i)
+	{
+		ASSERT(comdisp_Find(comdisp_Mock_Commands, COMDISP_ENTRIES(comdisp_Mock_Commands), comdisp_Mock_Commands[i].name) == &comdisp_Mock_Commands[i], "%s not found", comdisp_Mock_Commands[i].name);
+	}
+	ASSERT(comdisp_Find(comdisp_Mock_Commands, COMDISP_ENTRIES(comdisp_Mock_Commands), "abc") == NULL, "Word before the table found");
+	ASSERT(comdisp_Find(comdisp_Mock_Commands, COMDISP_ENTRIES(comdisp_Mock_Commands), "zzz") == NULL, "Word after the table found");
+	ASSERT(comdisp_Find(comdisp_Mock_Commands, COMDISP_ENTRIES(comdisp_Mock_Commands), "jtag") == NULL, "Word between entries found");
+	ASSERT(comdisp_Find(comdisp_Mock_Commands, COMDISP_ENTRIES(comdisp_Mock_Commands), "sca") == NULL, "Prefix found");
+	ASSERT(comdisp_Find(comdisp_Mock_Commands, 0, "chain") == NULL, "Found in an empty table");
+
+	return true;
+}
+
+/**
+ * @brief Test checking and converting parameters
+ *
+ * Numbers and keywords are converted, left out parameters take their
+ * fallback and missing, invalid or extra parameters are rejected. Signed
+ * and out of range numbers are invalid.
+ */
+bool comdisp_TestParams()
+{
+	const comdisp_Command *scan = &comdisp_Mock_Commands[2];
+	const comdisp_Command *ir = &comdisp_Mock_Commands[1];
+	const comdisp_Command *swd = &comdisp_Mock_Commands[3];
+	char *full[] = { "16", "bypass", "30" };
+	char *partial[] = { "16" };
+	char *gap[] = { "16", "" };
+	char *bad[] = { "16x" };
+	char *negative[] = { "-1" };
+	char *big[] = { "4294967296" };
+	char *huge[] = { "99999999999" };
+	char *largest[] = { "4294967295" };
+	char *empty[] = { "" };
+	char *hex[] = { "3c9" };
+	char *extra[] = { "3c9", "1" };
+	char *batch[] = { "dp", "r", "0" };
+	comdisp_Args args;
+
+	ASSERT(comdisp_Parse(scan, full, 3, &args), "Valid parameters rejected");
+	ASSERT(args.command == scan, "Wrong command");
+	ASSERT(args.count == 3, "%i parameters, should be %i", args.count, 3);
+	ASSERT((args.values[0] == 16) && (args.values[1] == 2) && (args.values[2] == 30), "Values %i %i %i", args.values[0], args.values[1], args.values[2]);
+
+	ASSERT(comdisp_Parse(scan, partial, 1, &args), "Optional parameters required");
+	ASSERT((args.values[1] == 0) && (args.values[2] == 5), "Fallbacks %i %i", args.values[1], args.values[2]);
+
+	ASSERT(!comdisp_Parse(scan, partial, 0, &args), "Required parameter left out");
+	ASSERT(!comdisp_Parse(scan, bad, 1, &args), "Invalid number accepted");
+	ASSERT(!comdisp_Parse(scan, negative, 1, &args), "Negative number accepted");
+	ASSERT(!comdisp_Parse(scan, big, 1, &args), "Number over 32 bits accepted");
+	ASSERT(!comdisp_Parse(scan, huge, 1, &args), "Out of range number accepted");
+	ASSERT(!comdisp_Parse(scan, empty, 1, &args), "Empty number accepted");
+	ASSERT(!comdisp_Parse(ir, negative, 1, &args), "Negative hex accepted");
+	ASSERT(comdisp_Parse(scan, largest, 1, &args), "Largest number rejected");
+	ASSERT(args.values[0] == UINT32_MAX, "Largest number %u", args.values[0]);
+	ASSERT(!comdisp_Parse(scan, gap, 2, &args), "Invalid keyword accepted");
+	ASSERT(!comdisp_Parse(ir, bad, 1, &args), "Invalid hex accepted");
+
+	ASSERT(comdisp_Parse(ir, hex, 1, &args), "Valid hex rejected");
+	ASSERT(args.values[0] == 0x3C9, "Hex value %X, should be %X", args.values[0], 0x3C9);
+	ASSERT(!comdisp_Parse(ir, extra, 2, &args), "Extra parameter accepted");
+
+	ASSERT(comdisp_Parse(swd, batch, 3, &args), "Extra tokens rejected");
+	ASSERT((args.count == 3) && (args.tokens == batch), "Extra tokens not passed on");
+
+	return true;
+}
+
+/**
+ * @brief Test subcommands are picked out of the first parameter
+ *
+ * Anything else is a parameter of the command itself.
+ */
+bool comdisp_TestSubcommands()
+{
+	const comdisp_Command *scan = &comdisp_Mock_Commands[2];
+	char *status[] = { "status" };
+	char *extra[] = { "abort", "1" };
+	char *pins[] = { "8", "status" };
+	comdisp_Args args;
+
+	ASSERT(comdisp_Parse(scan, status, 1, &args), "Subcommand rejected");
+	ASSERT(args.command == &comdisp_Mock_ScanCommands[1], "Subcommand not found");
+	ASSERT((args.count == 0) && (args.command->value == 7), "Subcommand parameters %i", args.count);
+
+	ASSERT(!comdisp_Parse(scan, extra, 2, &args), "Extra subcommand parameter accepted");
+
+	ASSERT(!comdisp_Parse(scan, pins, 2, &args), "Subcommand accepted as a keyword");
+	ASSERT(args.command == scan, "Subcommand found after the first parameter");
+
+	return true;
+}
@@ -19,6 +19,7 @@
 #include "tcomprocessor.h"
 
 #define comexec_Execute		comproc_Mock_comexec_Execute
+#define sched_IsBusy		comproc_Mock_sched_IsBusy
 
 #include "../source/comprocessor.c"
 
@@ -39,11 +40,24 @@ static unsigned int expected_ExecuteLen;
  */
 static int result_Execute;
 
+/**
+ * Set to make the next execute start a job
+ */
+static bool start_Job;
+
+/**
+ * Is the mock job running
+ */
+static bool job_Busy;
+
+bool comproc_Mock_sched_IsBusy() { return job_Busy; }
+
 /**
  * @brief Test that execute is being called with the expected values
  */
 void comproc_Mock_comexec_Execute(char *buffer, unsigned int length)
 {
+	job_Busy = start_Job;
 	if(strncmp(buffer, expected_Execute, length) == 0)
 	{
 		result_Execute = 1;
@@ -228,3 +242,124 @@ bool comproc_TestProcessHugePacket()
 
 	return true;
 }
+
+/**
+ * The number of bytes passed to the mock data handler
+ */
+static unsigned int result_DataLen;
+
+/**
+ * @brief Mock data handler, consumes bytes until a '!' is seen
+ */
+static unsigned int comproc_Mock_DataHandler(const char *buffer, unsigned int len)
+{
+	unsigned int used = 0;
+
+	while(used < len)
+	{
+		if(buffer[used++] == '!')
+		{
+			comproc_SetDataHandler(NULL);
+			break;
+		}
+		++result_DataLen;
+	}
+	return used;
+}
+
+/**
+ * @brief Mock data handler, consumes a byte at a time and starts a job on a '#'
+ */
+static unsigned int comproc_Mock_JobHandler(const char *buffer, unsigned int len)
+{
+	job_Busy = (buffer[0] == '#');
+	++result_DataLen;
+	return 1;
+}
+
+/**
+ * @brief Test data is passed to an installed data handler
+ *
+ * While a data handler is installed it should receive all the incoming bytes
+ * without them reaching the command buffer. Once it removes itself command
+ * processing should resume with the rest of the packet.
+ */
+bool comproc_TestProcessDataHandler()
+{
+	comproc_Init();
+	expected_Execute = "test one\r\n";
+	expected_ExecuteLen = 10;
+	result_Execute = 0;
+	result_DataLen = 0;
+
+	comproc_SetDataHandler(comproc_Mock_DataHandler);
+	comproc_Process("01234", 5);
+	comproc_Process("56789\r\n", 7);
+	ASSERT(result_DataLen == 12, "Handler received %i bytes, should be %i", result_DataLen, 12);
+	ASSERT(comproc_BufferLength == 0, "Data reached the command buffer");
+	ASSERT(result_Execute == 0, "Execute was called and it shouldn't have been");
+
+	comproc_Process("AB!test one\r\n", 13);
+	ASSERT(result_DataLen == 14, "Handler received %i bytes, should be %i", result_DataLen, 14);
+	ASSERT(result_Execute == 1, "execute failed: %i", result_Execute);
+
+	return true;
+}
+
+/**
+ * @brief Test processing stops after a command that starts a job
+ *
+ * The bytes after the command shouldn't be consumed until the job is done,
+ * then they are passed in again.
+ */
+bool comproc_TestProcessHoldsForJob()
+{
+	unsigned int used;
+
+	comproc_Init();
+	expected_Execute = "test one\r\n";
+	expected_ExecuteLen = 10;
+	result_Execute = 0;
+
+	start_Job = true;
+	used = comproc_Process("test one\r\ntest one\r\n", 20);
+	ASSERT(used == 10, "Consumed %i bytes, should be %i", used, 10);
+	ASSERT(result_Execute == 1, "execute failed: %i", result_Execute);
+
+	start_Job = false;
+	result_Execute = 0;
+	used = comproc_Process("test one\r\n", 10);
+	ASSERT(used == 10, "Consumed %i bytes, should be %i", used, 10);
+	ASSERT(result_Execute == 1, "execute failed: %i", result_Execute);
+	ASSERT(!job_Busy, "Mock job still running");
+
+	return true;
+}
+
+/**
+ * @brief Test processing stops when the data handler starts a job
+ *
+ * The handler stays installed and gets the rest of the data once the job
+ * is done.
+ */
+bool comproc_TestProcessDataHoldsForJob()
+{
+	unsigned int used;
+
+	comproc_Init();
+	result_DataLen = 0;
+	job_Busy = false;
+
+	comproc_SetDataHandler(comproc_Mock_JobHandler);
+	used = comproc_Process("01#345", 6);
+	ASSERT(used == 3, "Consumed %i bytes, should be %i", used, 3);
+	ASSERT(result_DataLen == 3, "Handler received %i bytes, should be %i", result_DataLen, 3);
+
+	job_Busy = false;
+	used = comproc_Process("345", 3);
+	ASSERT(used == 3, "Consumed %i bytes, should be %i", used, 3);
+	ASSERT(result_DataLen == 6, "Handler received %i bytes, should be %i", result_DataLen, 6);
+
+	comproc_SetDataHandler(NULL);
+	return true;
+}
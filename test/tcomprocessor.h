@@ -27,5 +27,8 @@ extern bool comproc_TestProcessBSDel();
 extern bool comproc_TestProcessSmallPackets();
 extern bool comproc_TestProcessMultiCommands();
 extern bool comproc_TestProcessHugePacket();
+extern bool comproc_TestProcessDataHandler();
+extern bool comproc_TestProcessHoldsForJob();
+extern bool comproc_TestProcessDataHoldsForJob();
 
 #endif
@@ -29,6 +29,13 @@
 #include "tchain.h"
 #include "tmessage.h"
 #include "tcomprocessor.h"
+#include "tknock.h"
+#include "tpinstore.h"
+#include "tidcode.h"
+#include "tsched.h"
+#include "tswd.h"
+#include "tsvf.h"
+#include "tcomdispatch.h"
 
 #define MESSAGE_WRITE_BUFFER	128
 
@@ -57,6 +64,8 @@ static const test_tFunc test_Functions[] =
 	jtagTAP_TestInitilization,
 	jtagTAP_TestTxFromUnknown,
 	jtagTAP_TestReset,
+	jtagTAP_TestShortestPaths,
+	jtagTAP_TestRunTest,
 
 	//Chain tests
 	chain_TestFakeChain,
@@ -64,11 +73,19 @@ static const test_tFunc test_Functions[] =
 	chain_TestChainIRLength,
 	chain_TestResetDRIDCode,
 	chain_TestResetDRIDCodes,
+	chain_TestLongChain,
+	chain_TestIRLengths,
+	chain_TestSelectScan,
+	chain_TestGangIDCodes,
+	chain_TestDetectGang,
 
 	//Message tests
 	message_TestInitialization,
 	message_TestSetLevel,
 	message_TestMessages,
+	message_TestLog,
+	message_TestLogBinary,
+	message_TestLogDropped,
 
 	//Command processor tests
 	comproc_TestInitialization,
@@ -78,6 +95,51 @@ static const test_tFunc test_Functions[] =
 	comproc_TestProcessSmallPackets,
 	comproc_TestProcessMultiCommands,
 	comproc_TestProcessHugePacket,
+	comproc_TestProcessDataHandler,
+	comproc_TestProcessHoldsForJob,
+	comproc_TestProcessDataHoldsForJob,
+
+	//Knock tests
+	knock_TestDetector,
+	knock_TestFindTDIParallel,
+	knock_TestScanSteps,
+	knock_TestScanResume,
+	knock_TestCheckpointPins,
+	knock_TestCheckpointInvalid,
+	knock_TestScanSWD,
+
+	//Pin store tests
+	pinstore_TestSaveRecall,
+	pinstore_TestCompact,
+
+	//ID CODE table tests
+	idcode_TestIsPlausible,
+	idcode_TestSorted,
+	idcode_TestLookup,
+
+	//Scheduler tests
+	sched_TestTasks,
+	sched_TestJob,
+
+	//SWD tests
+	swd_TestRequest,
+	swd_TestConnect,
+	swd_TestBatch,
+
+	//SVF player tests
+	svf_TestNumbers,
+	svf_TestScan,
+	svf_TestInterleaved,
+	svf_TestStreamSplit,
+	svf_TestMismatch,
+	svf_TestPads,
+	svf_TestRunTest,
+
+	//Command dispatcher tests
+	comdisp_TestTokenize,
+	comdisp_TestFind,
+	comdisp_TestParams,
+	comdisp_TestSubcommands,
 };
 
 #define TESTS (sizeof(test_Functions)/sizeof(test_tFunc))	///< Number of functions in the test
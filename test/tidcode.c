@@ -0,0 +1,90 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tidcode.h"
+#include <stdint.h>
+#include <string.h>
+
+#include "../source/idcode.c"
+
+/**
+ * @brief Test the ID CODE validity check
+ *
+ * The LSB must be set, all ones is rejected and so are the manufacturer
+ * codes 0x00 and 0x7F.
+ */
+bool idcode_TestIsPlausible()
+{
+	ASSERT(idcode_IsPlausible(0x020B20DD), "Valid ID CODE rejected");
+	ASSERT(idcode_IsPlausible(0x4BA00477), "Valid ID CODE rejected");
+	ASSERT(!idcode_IsPlausible(0xFFFFFFFF), "All ones accepted");
+	ASSERT(!idcode_IsPlausible(0x020B20DC), "Even value accepted");
+	ASSERT(!idcode_IsPlausible(0x00000001), "Manufacturer 0x00 accepted");
+	ASSERT(!idcode_IsPlausible(0x000000FF), "Manufacturer 0x7F accepted");
+
+	return true;
+}
+
+/**
+ * @brief Test the tables are in order for the binary search
+ *
+ * Every part also needs its manufacturer listed.
+ */
+bool idcode_TestSorted()
+{
+	unsigned int i;
+
+	for(i = 1; i < IDCODE_ENTRIES(idcode_Manufacturers); ++i)
+	{
+		ASSERT(idcode_Manufacturers[i - 1].key < idcode_Manufacturers[i].key, "Manufacturer %03X out of order", idcode_Manufacturers[i].key);
+	}
+	for(i = 1; i < IDCODE_ENTRIES(idcode_Parts); ++i)
+	{
+		ASSERT(idcode_Parts[i - 1].key < idcode_Parts[i].key, "Part %08X out of order", idcode_Parts[i].key);
+	}
+	for(i = 0; i < IDCODE_ENTRIES(idcode_Parts); ++i)
+	{
+		ASSERT(idcode_Find(idcode_Manufacturers, IDCODE_ENTRIES(idcode_Manufacturers), idcode_Parts[i].key >> 16) != NULL, "Part %08X has no manufacturer", idcode_Parts[i].key);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Test looking up ID CODEs
+ *
+ * The first and last entries of each table are found, the version is
+ * ignored and unlisted values return NULL.
+ */
+bool idcode_TestLookup()
+{
+	ASSERT(strcmp(idcode_Manufacturer(0x4BA00477), "ARM") == 0, "ARM not found");
+	ASSERT(strcmp(idcode_Part(0x4BA00477), "JTAG-DP") == 0, "JTAG-DP not found");
+	ASSERT(strcmp(idcode_Manufacturer(0x16410041), "ST") == 0, "ST not found");
+	ASSERT(strcmp(idcode_Part(0x16410041), "STM32F10x medium density") == 0, "STM32F10x not found");
+	ASSERT(strcmp(idcode_Part(0x06410041), "STM32F10x medium density") == 0, "Version not ignored");
+	ASSERT(strcmp(idcode_Manufacturer(0x00000003), "AMD") == 0, "First manufacturer not found");
+	ASSERT(strcmp(idcode_Manufacturer(0x10E31913), "SiFive") == 0, "Last manufacturer not found");
+	ASSERT(strcmp(idcode_Part(0x0940303F), "ATmega16") == 0, "First part not found");
+	ASSERT(strcmp(idcode_Part(0x10E31913), "FE310-G000") == 0, "Last part not found");
+	ASSERT(idcode_Manufacturer(0x12345679) == NULL, "Unlisted manufacturer found");
+	ASSERT(idcode_Part(0x0641F041) == NULL, "Unlisted part found");
+	ASSERT(idcode_Part(0x06410043) == NULL, "Part found under the wrong manufacturer");
+
+	return true;
+}
@@ -23,7 +23,12 @@
 //jtag.h (included by jtagtap.c) will prototype the functions for us.
 #define jtag_Set		jtagTAP_Mock_jtag_Set
 #define jtag_Clock		jtagTAP_Mock_jtag_Clock
+#define jtag_ClockTMS		jtagTAP_Mock_jtag_ClockTMS
 #define jtag_IsAllocated	jtagTAP_Mock_jtag_IsAllocated
+#define jtagTimer_Pulse		jtagTAP_Mock_jtagTimer_Pulse
+#define jtagTimer_IsPulsing	jtagTAP_Mock_jtagTimer_IsPulsing
+#define jtagTimer_Delay		jtagTAP_Mock_jtagTimer_Delay
+#define jtagTimer_IsDelaying	jtagTAP_Mock_jtagTimer_IsDelaying
 
 //include the file *source*
 #include "../source/jtagtap.c"
@@ -33,6 +38,32 @@ static uint32_t TMSStateTx = 0;		///< A log of the TMS state every time jtag_Clo
 static uint32_t TRSTChanged = 0;	///< Number of times TRST was set
 static bool InvalidSignal = false;	///< Was an invalid signal set
 static bool TMSStateCurrent = false;	///< The current state of TMS
+static unsigned int ClockCount = 0;	///< Number of times jtag_Clock was called
+static bool TRSTPulsing = false;	///< Is the mock TRST pulse still running
+static uint32_t DelayTime = 0;		///< Time passed to the last jtagTimer_Delay
+static unsigned int DelayClocks = 0;	///< ClockCount when the delay was polled
+
+/**
+ * @brief Reference TAP state machine, indexed by [state][TMS]
+ */
+static const jtagTAP_TAPState NextState[JTAGTAP_STATE_MAX][2] = {
+	[JTAGTAP_STATE_RESET] = { JTAGTAP_STATE_IDLE, JTAGTAP_STATE_RESET },
+	[JTAGTAP_STATE_IDLE] = { JTAGTAP_STATE_IDLE, JTAGTAP_STATE_DR_SCAN },
+	[JTAGTAP_STATE_DR_SCAN] = { JTAGTAP_STATE_DR_CAPTURE, JTAGTAP_STATE_IR_SCAN },
+	[JTAGTAP_STATE_DR_CAPTURE] = { JTAGTAP_STATE_DR_SHIFT, JTAGTAP_STATE_DR_EXIT1 },
+	[JTAGTAP_STATE_DR_SHIFT] = { JTAGTAP_STATE_DR_SHIFT, JTAGTAP_STATE_DR_EXIT1 },
+	[JTAGTAP_STATE_DR_EXIT1] = { JTAGTAP_STATE_DR_PAUSE, JTAGTAP_STATE_DR_UPDATE },
+	[JTAGTAP_STATE_DR_PAUSE] = { JTAGTAP_STATE_DR_PAUSE, JTAGTAP_STATE_DR_EXIT2 },
+	[JTAGTAP_STATE_DR_EXIT2] = { JTAGTAP_STATE_DR_SHIFT, JTAGTAP_STATE_DR_UPDATE },
+	[JTAGTAP_STATE_DR_UPDATE] = { JTAGTAP_STATE_IDLE, JTAGTAP_STATE_DR_SCAN },
+	[JTAGTAP_STATE_IR_SCAN] = { JTAGTAP_STATE_IR_CAPTURE, JTAGTAP_STATE_RESET },
+	[JTAGTAP_STATE_IR_CAPTURE] = { JTAGTAP_STATE_IR_SHIFT, JTAGTAP_STATE_IR_EXIT1 },
+	[JTAGTAP_STATE_IR_SHIFT] = { JTAGTAP_STATE_IR_SHIFT, JTAGTAP_STATE_IR_EXIT1 },
+	[JTAGTAP_STATE_IR_EXIT1] = { JTAGTAP_STATE_IR_PAUSE, JTAGTAP_STATE_IR_UPDATE },
+	[JTAGTAP_STATE_IR_PAUSE] = { JTAGTAP_STATE_IR_PAUSE, JTAGTAP_STATE_IR_EXIT2 },
+	[JTAGTAP_STATE_IR_EXIT2] = { JTAGTAP_STATE_IR_SHIFT, JTAGTAP_STATE_IR_UPDATE },
+	[JTAGTAP_STATE_IR_UPDATE] = { JTAGTAP_STATE_IDLE, JTAGTAP_STATE_DR_SCAN },
+};
 
 /**
  * @brief Test that the TAP state is initialized correctly.
@@ -144,6 +175,118 @@ bool jtagTAP_TestReset()
 	return true;
 }
 
+/**
+ * @brief Test every state transition takes the shortest path
+ *
+ * The TMS values clocked out are replayed through a reference state machine
+ * to check the TAP ends up in the requested state, and the number of clocks
+ * is compared against a breadth first search of the same state machine.
+ */
+bool jtagTAP_TestShortestPaths()
+{
+	jtagTAP_TAPState from, to;
+
+	HasTRST = false;
+	InvalidSignal = false;
+
+	for(from = JTAGTAP_STATE_RESET; from < JTAGTAP_STATE_MAX; ++from)
+	{
+		unsigned int distance[JTAGTAP_STATE_MAX];
+		jtagTAP_TAPState queue[JTAGTAP_STATE_MAX];
+		unsigned int head = 0, tail = 0;
+		jtagTAP_TAPState state;
+
+		//find the shortest distance to every state from this one
+		for(state = JTAGTAP_STATE_UNKNOWN; state < JTAGTAP_STATE_MAX; ++state)
+		{
+			distance[state] = ~0u;
+		}
+		distance[from] = 0;
+		queue[tail++] = from;
+		while(head < tail)
+		{
+			unsigned int tms;
+			state = queue[head++];
+			for(tms = 0; tms < 2; ++tms)
+			{
+				jtagTAP_TAPState next = NextState[state][tms];
+				if(distance[next] == ~0u)
+				{
+					distance[next] = distance[state] + 1;
+					queue[tail++] = next;
+				}
+			}
+		}
+
+		for(to = JTAGTAP_STATE_RESET; to < JTAGTAP_STATE_MAX; ++to)
+		{
+			unsigned int clock;
+
+			TMSStateTx = 0;
+			ClockCount = 0;
+			TAPState = from;
+			jtagTAP_SetState(to);
+
+			//replay the TMS values, the earliest is in the higher bits
+			state = from;
+			for(clock = ClockCount; clock > 0; --clock)
+			{
+				state = NextState[state][(TMSStateTx >> (clock - 1)) & 0x01];
+			}
+
+			ASSERT(state == to, "%s -> %s ended in %s", jtagTAP_StateNames[from], jtagTAP_StateNames[to], jtagTAP_StateNames[state]);
+			ASSERT(ClockCount == distance[to], "%s -> %s took %i clocks, should be %i", jtagTAP_StateNames[from], jtagTAP_StateNames[to], ClockCount, distance[to]);
+		}
+	}
+
+	ASSERT(!InvalidSignal, "An invalid signal was specified at some point");
+	return true;
+}
+
+/**
+ * @brief Test waiting in Run/Idle
+ *
+ * The clocks should all be in Run/Idle with TMS low, and the delay should
+ * be started before them and waited for after, so the two overlap. Stepping
+ * should run the clocks a batch at a time.
+ */
+bool jtagTAP_TestRunTest()
+{
+	HasTRST = false;
+	InvalidSignal = false;
+	jtagTAP_Init();
+	jtagTAP_SetState(JTAGTAP_STATE_IDLE);
+
+	TMSStateTx = 0xFFFFFFFF;
+	ClockCount = 0;
+	DelayTime = 0;
+	DelayClocks = 0;
+	jtagTAP_RunTest(5, 100);
+
+	ASSERT(jtagTAP_GetState() == JTAGTAP_STATE_IDLE, "Not left in Run/Idle");
+	ASSERT(ClockCount == 5, "Clocked %i times, should have been %i", ClockCount, 5);
+	ASSERT(TMSStateTx == 0xFFFFFFE0, "TMS wasn't held low: %08X", TMSStateTx);
+	ASSERT(DelayTime == 100, "Delay of %i, should have been %i", DelayTime, 100);
+	ASSERT(DelayClocks == 5, "Delay waited for after %i clocks", DelayClocks);
+
+	//no time, no delay
+	DelayTime = 0;
+	DelayClocks = 0;
+	jtagTAP_RunTest(3, 0);
+	ASSERT(ClockCount == 8, "Clocked %i times, should have been %i", ClockCount, 8);
+	ASSERT((DelayTime == 0) && (DelayClocks == 0), "Delay used without a time");
+
+	//in batches
+	jtagTAP_RunTestStart(10, 0);
+	ASSERT(jtagTAP_RunTestStep(4), "Finished after 4 of 10 clocks");
+	ASSERT(jtagTAP_RunTestStep(4), "Finished after 8 of 10 clocks");
+	ASSERT(!jtagTAP_RunTestStep(4), "Not finished after 10 clocks");
+	ASSERT(ClockCount == 18, "Clocked %i times, should have been %i", ClockCount, 18);
+
+	ASSERT(!InvalidSignal, "An invalid signal was specified at some point");
+	return true;
+}
+
 /**
  * @brief Mock function for setting the state of a signal
  *
@@ -196,4 +339,46 @@ void jtagTAP_Mock_jtag_Clock()
 {
 	TMSStateTx <<= 1;
 	TMSStateTx |= (TMSStateCurrent ? 1 : 0);
+	++ClockCount;
+}
+
+/**
+ * @brief Mock jtag_ClockTMS using the mocked signal functions
+ */
+void jtagTAP_Mock_jtag_ClockTMS(uint16_t tms, unsigned int count)
+{
+	while(count-- > 0)
+	{
+		jtagTAP_Mock_jtag_Set(JTAG_SIGNAL_TMS, (tms & 0x01) != 0);
+		jtagTAP_Mock_jtag_Clock();
+		tms >>= 1;
+	}
 }
+
+/**
+ * @brief Mock reset pulse, TRST is driven low until the pulse is polled
+ */
+bool jtagTAP_Mock_jtagTimer_Pulse(jtag_Signal sig)
+{
+	jtagTAP_Mock_jtag_Set(sig, false);
+	TRSTPulsing = true;
+	return true;
+}
+
+/**
+ * @brief Mock pulse poll, the pulse ends the first time it's polled
+ */
+bool jtagTAP_Mock_jtagTimer_IsPulsing(jtag_Signal sig)
+{
+	bool pulsing = TRSTPulsing;
+
+	if(pulsing)
+	{
+		jtagTAP_Mock_jtag_Set(sig, true);
+		TRSTPulsing = false;
+	}
+	return pulsing;
+}
+
+void jtagTAP_Mock_jtagTimer_Delay(uint32_t us) { DelayTime = us; }
+bool jtagTAP_Mock_jtagTimer_IsDelaying() { DelayClocks = ClockCount; return false; }
@@ -23,5 +23,7 @@
 extern bool jtagTAP_TestInitilization();
 extern bool jtagTAP_TestTxFromUnknown();
 extern bool jtagTAP_TestReset();
+extern bool jtagTAP_TestShortestPaths();
+extern bool jtagTAP_TestRunTest();
 
 #endif
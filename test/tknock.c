@@ -0,0 +1,416 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tknock.h"
+#include <stdint.h>
+
+//defines to stop the inclusion of unwanted header files
+#define LIBOPENCM3_GPIO_H
+#define LIBOPENCM3_BKP_H
+#define LIBOPENCM3_CM3_DWT_H
+
+//Mock out the functions we're interested in.
+#define jtag_Cfg		knock_Mock_jtag_Cfg
+#define jtag_CfgBroadcast	knock_Mock_jtag_CfgBroadcast
+#define jtag_GetFreePins	knock_Mock_jtag_GetFreePins
+#define jtag_Sample		knock_Mock_jtag_Sample
+#define jtag_WritePins		knock_Mock_jtag_WritePins
+#define jtag_Set		knock_Mock_jtag_Set
+#define jtag_Get		knock_Mock_jtag_Get
+#define jtag_Clock		knock_Mock_jtag_Clock
+#define jtag_Shift		knock_Mock_jtag_Shift
+#define jtagTAP_SetState	knock_Mock_jtagTAP_SetState
+#define chain_Detect		knock_Mock_chain_Detect
+#define pinstore_Save		knock_Mock_pinstore_Save
+#define jtag_SetInput		knock_Mock_jtag_SetInput
+#define swd_Reset		knock_Mock_swd_Reset
+#define swd_SendRequest		knock_Mock_swd_SendRequest
+#define swd_Connect		knock_Mock_swd_Connect
+
+static uint32_t DWT_CYCCNT;	///< Cycle counter.
+static uint32_t BKP_DR1, BKP_DR2, BKP_DR3, BKP_DR4, BKP_DR5;	///< Backup registers.
+static uint32_t BKP_DR6, BKP_DR7, BKP_DR8, BKP_DR9, BKP_DR10;	///< Backup registers.
+
+#include "../source/knock.c"
+
+static jtag_PinMask knock_Mock_Broadcast;	///< The TDI pins currently being driven
+static int knock_Mock_TDI;		///< The pin that the mock chain's TDI is on
+static unsigned int knock_Mock_Passes;	///< The number of DR shifts captured
+static int knock_Mock_TCK;		///< The pin TCK is configured to
+static int knock_Mock_TMS;		///< The pin TMS is configured to
+static int knock_Mock_SWCLK = -1;	///< The pin the mock SWD target's SWCLK is on, -1 for none
+static int knock_Mock_SWDIO;		///< The pin the mock SWD target's SWDIO is on, the next pin answers with bad parity
+static unsigned int knock_Mock_SWDBit;	///< Bits sampled since the DPIDR request
+
+bool knock_Mock_jtag_Cfg(jtag_Signal sig, int num)
+{
+	if(sig == JTAG_SIGNAL_TCK)
+	{
+		knock_Mock_TCK = num;
+	}
+	else if(sig == JTAG_SIGNAL_TMS)
+	{
+		knock_Mock_TMS = num;
+	}
+	return true;
+}
+bool knock_Mock_jtag_CfgBroadcast(jtag_Signal sig, jtag_PinMask mask) { knock_Mock_Broadcast = mask; return true; }
+jtag_PinMask knock_Mock_jtag_GetFreePins() { return JTAG_PIN(JTAG_PIN_MAX) - 1; }
+
+/**
+ * @brief Mock sample, the mock SWD target answers a DPIDR read on SWDIO
+ *
+ * The ACK is followed by the DPIDR and its parity. The pin after SWDIO
+ * answers the same but with the parity flipped.
+ */
+jtag_PinMask knock_Mock_jtag_Sample()
+{
+	const uint64_t reply = 0x01 | ((uint64_t)0x2BA01477 << 3);	//ACK OK, DPIDR, even parity
+	unsigned int bit = knock_Mock_SWDBit++;
+	jtag_PinMask sample = 0;
+
+	if((knock_Mock_SWCLK >= 0) && (knock_Mock_TCK == knock_Mock_SWCLK) && (bit < KNOCK_SWD_BITS))
+	{
+		sample |= (jtag_PinMask)((reply >> bit) & 0x01) << knock_Mock_SWDIO;
+		sample |= (jtag_PinMask)(((reply | ((uint64_t)1 << 35)) >> bit) & 0x01) << (knock_Mock_SWDIO + 1);
+	}
+	return sample;
+}
+void knock_Mock_jtag_WritePins(jtag_PinMask set, jtag_PinMask reset) { }
+void knock_Mock_jtag_Set(jtag_Signal sig, bool val) { }
+bool knock_Mock_jtag_Get(jtag_Signal sig) { return false; }
+void knock_Mock_jtag_Clock() { }
+
+/**
+ * @brief Mock DR shift, TDO changes once if TDI is being toggled.
+ */
+void knock_Mock_jtag_Shift(const uint8_t *tdi, uint8_t *tdo, unsigned int nbits, bool exit)
+{
+	unsigned int bit;
+	bool toggled = (knock_Mock_TDI >= 0) && (((knock_Mock_Broadcast >> knock_Mock_TDI) & 0x01) == 1);
+
+	if(tdo != NULL)
+	{
+		++knock_Mock_Passes;
+		for(bit = 0; bit < nbits; ++bit)
+		{
+			bool val = toggled && (bit >= 4);
+			tdo[bit >> 3] = (tdo[bit >> 3] & ~(1 << (bit & 0x07))) | (val << (bit & 0x07));
+		}
+	}
+}
+void knock_Mock_jtagTAP_SetState(jtagTAP_TAPState target) { }
+bool knock_Mock_chain_Detect() { return false; }
+bool knock_Mock_pinstore_Save() { return false; }
+void knock_Mock_jtag_SetInput(jtag_Signal sig, bool input) { }
+void knock_Mock_swd_Reset() { }
+void knock_Mock_swd_SendRequest(uint8_t request) { knock_Mock_SWDBit = 0; }
+bool knock_Mock_swd_Connect(uint32_t *dpidr)
+{
+	*dpidr = 0x2BA01477;
+	return (knock_Mock_SWCLK >= 0) && (knock_Mock_TCK == knock_Mock_SWCLK) && (knock_Mock_TMS == knock_Mock_SWDIO);
+}
+
+/**
+ * @brief Test the streaming ID CODE detector
+ *
+ * Pins are given a mix of ID CODEs and noise. Only the pins with a valid
+ * code should be found, and each as soon as its 32nd bit is sampled.
+ * Pin 1 idles low then sends an ID CODE and ones, pin 3 is stuck high, pin
+ * 4 sends an invalid manufacturer, pin 5 sends a manufacturer that isn't
+ * listed, pin 6 sends a second ID CODE after a first that is invalid and
+ * pin 40, on GPIOC, sends the same ID CODE as pin 1. Pin 8 isn't watched.
+ */
+bool knock_TestDetector()
+{
+	knock_Detector detector;
+	const uint32_t code1 = 0x020B20DD;
+	const uint32_t code4 = 0x000000FF;
+	const uint32_t code5 = 0x12345679;
+	const uint32_t code6[2] = { 0x000000FF, 0x4BA00477 };
+	unsigned int clock;
+
+	knock_DetectorInit(&detector, 0x00FF | JTAG_PIN(40));
+
+	for(clock = 0; clock < 100; ++clock)
+	{
+		jtag_PinMask sample = (1 << 3) | (1 << 8);
+
+		//pins 1 and 40, ID CODE starting at clock 10
+		if((clock >= 10) && (clock < 42))
+		{
+			sample |= ((code1 >> (clock - 10)) & 0x01) << 1;
+			sample |= (jtag_PinMask)((code1 >> (clock - 10)) & 0x01) << 40;
+		}
+		else if(clock >= 42)
+		{
+			sample |= (1 << 1);
+		}
+
+		//pin 4, invalid ID CODE from clock 0
+		if(clock < 32)
+		{
+			sample |= ((code4 >> clock) & 0x01) << 4;
+			sample |= ((code5 >> clock) & 0x01) << 5;
+		}
+
+		//pin 6, two ID CODEs from clock 5
+		if((clock >= 5) && (clock < 69))
+		{
+			unsigned int bit = clock - 5;
+			sample |= ((code6[bit / 32] >> (bit % 32)) & 0x01) << 6;
+		}
+
+		knock_DetectorSample(&detector, sample);
+
+		if(clock == 40)
+		{
+			ASSERT((detector.found & (1 << 1)) == 0, "Pin 1 found early");
+		}
+		if(clock == 41)
+		{
+			ASSERT((detector.found & (1 << 1)) != 0, "Pin 1 not found when the ID CODE completed");
+		}
+		if(clock == 60)
+		{
+			ASSERT((detector.found & (1 << 6)) == 0, "Pin 6 found on an invalid ID CODE");
+		}
+	}
+
+	ASSERT(detector.found == ((1 << 1) | (1 << 5) | (1 << 6) | JTAG_PIN(40)), "Wrong pins found: %llX", (unsigned long long)detector.found);
+	ASSERT(detector.known == ((1 << 1) | (1 << 6) | JTAG_PIN(40)), "Wrong pins known: %llX", (unsigned long long)detector.known);
+	ASSERT(detector.clocks == 100, "Wrong sample count: %i", detector.clocks);
+
+	return true;
+}
+
+/**
+ * @brief Test the parallel TDI search
+ *
+ * The real TDI should be found from any of the candidates in log2(n)
+ * passes plus one to confirm it, and no TDI should be reported if none of
+ * the candidates toggle TDO. The candidates are spread across all three
+ * ports.
+ */
+bool knock_TestFindTDIParallel()
+{
+	const jtag_PinMask candidates = 0x7B3C | JTAG_PIN(21) | JTAG_PIN(33) | JTAG_PIN(47);
+	int pin;
+
+	for(pin = 0; pin < JTAG_PIN_MAX; ++pin)
+	{
+		if(((candidates >> pin) & 0x01) == 1)
+		{
+			knock_Mock_TDI = pin;
+			knock_Mock_Passes = 0;
+			ASSERT(knock_FindTDIParallel(candidates, 0x0000, 32) == pin, "Wrong TDI found");
+			ASSERT(knock_Mock_Passes == 5, "Unexpected number of passes");
+			ASSERT(knock_Mock_Broadcast == 0, "TDI candidates left driven");
+		}
+	}
+
+	knock_Mock_TDI = 0;
+	ASSERT(knock_FindTDIParallel(candidates, 0x0000, 32) == KNOCK_TDI_NONE, "TDI found outside the candidates");
+	knock_Mock_TDI = -1;
+	ASSERT(knock_FindTDIParallel(candidates, 0x0000, 32) == KNOCK_TDI_NONE, "TDI found with no chain");
+
+	return true;
+}
+
+/**
+ * @brief Step a scan to the end and count the steps
+ */
+static unsigned int knock_StepAll()
+{
+	unsigned int steps = 0;
+
+	while(knock_IsRunning())
+	{
+		knock_Step();
+		++steps;
+	}
+	return steps;
+}
+
+/**
+ * @brief Test the scan cursor visits every candidate once
+ *
+ * Reset mode steps each TCK/TMS pair, bypass mode each TCK/TMS/TDI and
+ * broadcast and SWD mode each TCK.
+ */
+bool knock_TestScanSteps()
+{
+	unsigned int steps;
+
+	knock_Mock_TDI = -1;
+
+	knock_Start(KNOCK_MODE_RESET, 5, 0);
+	steps = knock_StepAll();
+	ASSERT(steps == 20, "Reset scan took %i steps", steps);
+	ASSERT(knock_State.candidates == 20, "Reset scan counted %i candidates", knock_State.candidates);
+
+	knock_Start(KNOCK_MODE_BYPASS, 4, 0);
+	steps = knock_StepAll();
+	ASSERT(steps == 24, "Bypass scan took %i steps", steps);
+	ASSERT(knock_State.candidates == 12, "Bypass scan counted %i candidates", knock_State.candidates);
+
+	knock_Start(KNOCK_MODE_BROADCAST, 6, 0);
+	steps = knock_StepAll();
+	ASSERT(steps == 6, "Broadcast scan took %i steps", steps);
+
+	knock_Start(KNOCK_MODE_SWD, 7, 0);
+	steps = knock_StepAll();
+	ASSERT(steps == 7, "SWD scan took %i steps", steps);
+	ASSERT(knock_State.status == KNOCK_STATUS_IDLE, "Scan not finished");
+	ASSERT(!knock_Step(), "Finished scan stepped");
+
+	return true;
+}
+
+/**
+ * @brief Test a scan can be stopped, checkpointed and resumed
+ *
+ * The cursor restored from the backup registers should carry on where the
+ * scan stopped and finish with the same number of steps.
+ */
+bool knock_TestScanResume()
+{
+	unsigned int steps;
+	unsigned int tck, tms, tdi;
+
+	knock_Start(KNOCK_MODE_BYPASS, 5, 0);
+	for(steps = 0; steps < 17; ++steps)
+	{
+		knock_Step();
+	}
+	ASSERT(knock_Abort(), "Running scan not stopped");
+	ASSERT(!knock_Abort(), "Stopped scan stopped again");
+	ASSERT(!knock_Step(), "Stopped scan stepped");
+	ASSERT(BKP_DR1 == KNOCK_CHECKPOINT_MAGIC, "No checkpoint saved");
+
+	//lose the state, as a reset would
+	tck = knock_State.tck;
+	tms = knock_State.tms;
+	tdi = knock_State.tdi;
+	knock_State.tck = 0;
+	knock_State.tms = 0;
+	knock_State.tdi = 0;
+	knock_State.status = KNOCK_STATUS_IDLE;
+
+	ASSERT(knock_LoadCheckpoint(), "Checkpoint not loaded");
+	ASSERT((knock_State.tck == tck) && (knock_State.tms == tms) && (knock_State.tdi == tdi), "Wrong cursor restored");
+	ASSERT(knock_Resume(), "Restored scan not resumed");
+	steps += knock_StepAll();
+	ASSERT(steps == 60, "Resumed scan took %i steps", steps);
+	ASSERT(BKP_DR1 != KNOCK_CHECKPOINT_MAGIC, "Checkpoint left after the scan");
+
+	return true;
+}
+
+/**
+ * @brief Test the checkpoint keeps pins on every port
+ *
+ * The known pins are split across the backup registers. An auto scan that
+ * was part way through its bypass scans goes back to the reset scan of the
+ * pair, as the pins it was trying aren't kept.
+ */
+bool knock_TestCheckpointPins()
+{
+	const jtag_PinMask known = JTAG_PIN(2) | JTAG_PIN(20) | JTAG_PIN(47);
+
+	knock_Start(KNOCK_MODE_AUTO, JTAG_PIN_MAX, 0);
+	knock_State.tck = 30;
+	knock_State.tms = 41;
+	knock_State.tdi = 5;
+	knock_KnownPins = known;
+	knock_SaveCheckpoint();
+
+	knock_KnownPins = 0;
+	knock_PinCount = 0;
+	knock_State.status = KNOCK_STATUS_IDLE;
+	ASSERT(knock_LoadCheckpoint(), "Checkpoint not loaded");
+	ASSERT(knock_PinCount == JTAG_PIN_MAX, "Wrong pin count restored: %i", knock_PinCount);
+	ASSERT(knock_KnownPins == known, "Wrong known pins restored: %llX", (unsigned long long)knock_KnownPins);
+	ASSERT((knock_State.tck == 30) && (knock_State.tms == 41), "Wrong cursor restored");
+	ASSERT(knock_State.tdi == KNOCK_CURSOR_RESET, "Auto scan not moved back to the reset scan");
+
+	knock_State.status = KNOCK_STATUS_IDLE;
+	knock_ClearCheckpoint();
+	return true;
+}
+
+/**
+ * @brief Test a checkpoint with a cursor or budget out of range is refused
+ *
+ * The scan state shouldn't be touched, only a checkpoint that passes every
+ * check is used.
+ */
+bool knock_TestCheckpointInvalid()
+{
+	uint32_t cursor;
+
+	knock_Start(KNOCK_MODE_BYPASS, 8, 10);
+	knock_State.tck = 2;
+	knock_State.tms = 5;
+	knock_State.tdi = 6;
+	knock_SaveCheckpoint();
+	cursor = BKP_DR3;
+
+	knock_State.status = KNOCK_STATUS_IDLE;
+	knock_State.tck = 0;
+	BKP_DR3 = 2 | (8 << 8);
+	ASSERT(!knock_LoadCheckpoint(), "TMS past the pins accepted");
+	ASSERT((knock_State.tck == 0) && (knock_State.status == KNOCK_STATUS_IDLE), "State changed by a refused checkpoint");
+
+	BKP_DR3 = cursor;
+	BKP_DR4 = (BKP_DR4 & 0xFF00) | 8;
+	ASSERT(!knock_LoadCheckpoint(), "TDI past the pins accepted");
+	BKP_DR4 = (BKP_DR4 & 0xFF00) | KNOCK_CURSOR_RESET;
+	ASSERT(knock_LoadCheckpoint(), "Reset TDI cursor refused");
+	ASSERT(knock_State.tdi == KNOCK_CURSOR_RESET, "Wrong TDI cursor restored: %i", knock_State.tdi);
+
+	knock_State.status = KNOCK_STATUS_IDLE;
+	knock_State.tck = 0;
+	BKP_DR10 = KNOCK_BUDGET_MAX + 1;
+	ASSERT(!knock_LoadCheckpoint(), "Budget out of range accepted");
+	ASSERT(knock_State.tck == 0, "State changed by a refused checkpoint");
+
+	knock_ClearCheckpoint();
+	return true;
+}
+
+/**
+ * @brief Test the SWD scan finds SWDIO from one sample of every pin
+ *
+ * The pin that answers with bad parity shouldn't be reported, and the
+ * found pins shouldn't be driven again for the SWCLKs after.
+ */
+bool knock_TestScanSWD()
+{
+	knock_Mock_SWCLK = 21;
+	knock_Mock_SWDIO = 46;
+
+	knock_Start(KNOCK_MODE_SWD, JTAG_PIN_MAX, 0);
+	knock_StepAll();
+	ASSERT(knock_State.chains == 1, "SWD scan found %i ports", knock_State.chains);
+	ASSERT(knock_KnownPins == (JTAG_PIN(21) | JTAG_PIN(46)), "Wrong pins known: %llX", (unsigned long long)knock_KnownPins);
+	ASSERT(knock_Mock_Broadcast == 0, "SWDIO candidates left driven");
+
+	knock_Mock_SWCLK = -1;
+	return true;
+}
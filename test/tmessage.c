@@ -17,11 +17,14 @@
  */
 #include "test.h"
 #include "tmessage.h"
+#include <string.h>
 
 #define serial_Send	message_Mock_serial_Send
 #include "../source/message.c"
 
 static unsigned int callCount_Send;
+static char message_Mock_Sent[256];		///< Data sent, from the start of the test
+static unsigned int message_Mock_SentLength;	///< Bytes in message_Mock_Sent
 
 /**
  * @brief Test that the message module initializes correctly
@@ -87,13 +90,108 @@ bool message_TestMessages()
 	return true;
 }
 
+/**
+ * @brief Test logged messages are formatted by the task
+ *
+ * Nothing is sent until the task runs or another message is written, the
+ * level is checked when the message is logged and the output is in order.
+ */
+bool message_TestLog()
+{
+	message_Init();
+	message_Mock_SentLength = 0;
+
+	message_Log(MESSAGE_LEVEL_GENERAL, KNOCK_TCK_TMS, 3, 14);
+	message_Log(MESSAGE_LEVEL_DEBUG, KNOCK_TCK, 5);
+	ASSERT(message_Mock_SentLength == 0, "Logged message sent straight away");
+
+	ASSERT(!message_Task(), "Messages left after the task");
+	message_Mock_Sent[message_Mock_SentLength] = '\x00';
+	ASSERT(strcmp(message_Mock_Sent, "Trying TCK: 3 TMS: 14\r") == 0, "Sent %s", message_Mock_Sent);
+
+	message_Mock_SentLength = 0;
+	message_Log(MESSAGE_LEVEL_GENERAL, KNOCK_TCK, 7);
+	message_Write(MESSAGE_LEVEL_GENERAL, "OK\r\n");
+	message_Mock_Sent[message_Mock_SentLength] = '\x00';
+	ASSERT(strcmp(message_Mock_Sent, "Trying TCK: 7\rOK\r\n") == 0, "Sent %s", message_Mock_Sent);
+
+	return true;
+}
+
+/**
+ * @brief Test logged messages are sent as binary frames
+ *
+ * The frame is the start byte, the ID and argument count and the arguments
+ * little endian.
+ */
+bool message_TestLogBinary()
+{
+	static const char expected[] = { MESSAGE_FRAME_START, MESSAGE_ID_KNOCK_TCK_TMS_PINS, 0x00, 3,
+		0x21, 0x00, 0x00, 0x00,
+		0x34, 0x12, 0x00, 0x00,
+		0x78, 0x56, 0x34, 0x12 };
+
+	message_Init();
+	message_SetLogFormat(MESSAGE_LOG_BINARY);
+	ASSERT(message_GetLogFormat() == MESSAGE_LOG_BINARY, "Format not set");
+	message_Mock_SentLength = 0;
+
+	message_Log(MESSAGE_LEVEL_GENERAL, KNOCK_TCK_TMS_PINS, 33, 0x1234, 0x12345678);
+	message_Flush();
+	ASSERT(message_Mock_SentLength == sizeof(expected), "Frame of %i bytes, should be %i", message_Mock_SentLength, sizeof(expected));
+	ASSERT(memcmp(message_Mock_Sent, expected, sizeof(expected)) == 0, "Frame incorrect");
+
+	message_SetLogFormat(MESSAGE_LOG_MAX);
+	ASSERT(message_GetLogFormat() == MESSAGE_LOG_BINARY, "Invalid format set");
+
+	return true;
+}
+
+/**
+ * @brief Test messages that don't fit in the ring are counted
+ *
+ * The count is reported after the messages that did fit.
+ */
+bool message_TestLogDropped()
+{
+	unsigned int i;
+
+	message_Init();
+	message_SetLevel(MESSAGE_LEVEL_DEBUG);
+	//each message takes three words, the header and two arguments
+	for(i = 0; i < (MESSAGE_LOG_LENGTH / 3) + 5; ++i)
+	{
+		message_Log(MESSAGE_LEVEL_DEBUG, KNOCK_TCK_TMS, 1, 2);
+	}
+	ASSERT(message_LogDropped == 5, "%i messages dropped, should be %i", message_LogDropped, 5);
+
+	message_Mock_SentLength = 0;
+	while(message_LogHead != message_LogTail)
+	{
+		message_SendNext();
+	}
+	message_Mock_SentLength = 0;
+	message_Flush();
+	message_Mock_Sent[message_Mock_SentLength] = '\x00';
+	ASSERT(strcmp(message_Mock_Sent, "[-] 5 message(s) dropped\r\n") == 0, "Sent %s", message_Mock_Sent);
+	ASSERT(message_LogDropped == 0, "Dropped count not cleared");
+
+	return true;
+}
+
 /**
  * @brief Mock serial_Send
  *
- * Records the number of times it was called
+ * Records the number of times it was called and the data sent, wrapping
+ * when the buffer is full.
  */
 void message_Mock_serial_Send(const char *buffer, unsigned int len)
 {
 	callCount_Send += 1;
+	while(len-- > 0)
+	{
+		message_Mock_Sent[message_Mock_SentLength++ % (sizeof(message_Mock_Sent) - 1)] = *buffer++;
+	}
+	message_Mock_SentLength %= (sizeof(message_Mock_Sent) - 1);
 }
 
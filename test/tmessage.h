@@ -24,5 +24,8 @@
 extern bool message_TestInitialization();
 extern bool message_TestSetLevel();
 extern bool message_TestMessages();
+extern bool message_TestLog();
+extern bool message_TestLogBinary();
+extern bool message_TestLogDropped();
 
 #endif
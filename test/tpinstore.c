@@ -0,0 +1,164 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tpinstore.h"
+#include <stdint.h>
+
+static uint32_t pinstore_Flash[1024 / sizeof(uint32_t)];	///< Fake flash page
+
+//Mock out the functions we're interested in.
+#define PINSTORE_ADDRESS	((uintptr_t)pinstore_Flash)
+#define flash_unlock		pinstore_Mock_flash_unlock
+#define flash_lock		pinstore_Mock_flash_lock
+#define flash_erase_page	pinstore_Mock_flash_erase_page
+#define flash_program_word	pinstore_Mock_flash_program_word
+#define jtag_Cfg		pinstore_Mock_jtag_Cfg
+#define jtag_GetCfg		pinstore_Mock_jtag_GetCfg
+#define jtagTAP_SetState	pinstore_Mock_jtagTAP_SetState
+#define chain_Detect		pinstore_Mock_chain_Detect
+#define chain_GetDevices	pinstore_Mock_chain_GetDevices
+#define chain_GetIDCode		pinstore_Mock_chain_GetIDCode
+
+#include "../source/pinstore.c"
+
+static int pinstore_Pins[PINSTORE_SIGNALS];	///< Fake signal configuration
+static int pinstore_ChainTCK;			///< TCK pin the fake chain is on
+static uint32_t pinstore_IDCode;		///< ID CODE of the fake chain's only device
+static bool pinstore_Locked;			///< Is the fake flash locked
+
+void pinstore_Mock_flash_unlock() { pinstore_Locked = false; }
+void pinstore_Mock_flash_lock() { pinstore_Locked = true; }
+
+void pinstore_Mock_flash_erase_page(uint32_t address)
+{
+	unsigned int i;
+
+	if(!pinstore_Locked && (address == (uint32_t)PINSTORE_ADDRESS))
+	{
+		for(i = 0; i < (sizeof(pinstore_Flash) / sizeof(uint32_t)); ++i)
+		{
+			pinstore_Flash[i] = PINSTORE_BLANK;
+		}
+	}
+}
+
+/**
+ * @brief Mock flash programming, bits can only be cleared
+ */
+void pinstore_Mock_flash_program_word(uint32_t address, uint32_t data)
+{
+	unsigned int index = (address - (uint32_t)PINSTORE_ADDRESS) / sizeof(uint32_t);
+
+	if(!pinstore_Locked && (index < (sizeof(pinstore_Flash) / sizeof(uint32_t))))
+	{
+		pinstore_Flash[index] &= data;
+	}
+}
+
+bool pinstore_Mock_jtag_Cfg(jtag_Signal sig, int num) { pinstore_Pins[sig] = num; return true; }
+int pinstore_Mock_jtag_GetCfg(jtag_Signal sig) { return pinstore_Pins[sig]; }
+void pinstore_Mock_jtagTAP_SetState(jtagTAP_TAPState target) { }
+bool pinstore_Mock_chain_Detect() { return pinstore_Pins[JTAG_SIGNAL_TCK] == pinstore_ChainTCK; }
+unsigned int pinstore_Mock_chain_GetDevices() { return 1; }
+uint32_t pinstore_Mock_chain_GetIDCode(unsigned int device) { return (device == 0) ? pinstore_IDCode : 0; }
+
+/**
+ * @brief Set up a blank page and a pinout to store
+ */
+static void pinstore_Setup(int tck)
+{
+	jtag_Signal sig;
+
+	pinstore_Locked = false;
+	pinstore_Mock_flash_erase_page(PINSTORE_ADDRESS);
+	pinstore_Locked = true;
+
+	for(sig = JTAG_SIGNAL_TCK; sig < PINSTORE_SIGNALS; ++sig)
+	{
+		pinstore_Pins[sig] = tck + sig;
+	}
+	pinstore_IDCode = 0x4BA00477;
+}
+
+/**
+ * @brief Test storing and recalling pinouts
+ *
+ * The same pinout should only be stored once and recall should configure
+ * the pins of the stored chain that responds.
+ */
+bool pinstore_TestSaveRecall()
+{
+	pinstore_Setup(0);
+	ASSERT(pinstore_Used() == 0, "Blank page has records");
+	ASSERT(!pinstore_Recall(), "Recalled from a blank page");
+
+	ASSERT(pinstore_Save(), "Failed to store a pinout");
+	ASSERT(pinstore_Used() == 1, "Pinout not stored");
+	ASSERT(pinstore_Save(), "Failed to store a pinout again");
+	ASSERT(pinstore_Used() == 1, "Same pinout stored twice");
+	ASSERT(pinstore_Locked, "Flash left unlocked");
+
+	pinstore_Pins[JTAG_SIGNAL_TCK] = 8;
+	ASSERT(pinstore_Save(), "Failed to store a second pinout");
+	ASSERT(pinstore_Used() == 2, "Second pinout not stored");
+
+	//the older pinout is the one attached
+	pinstore_ChainTCK = 0;
+	pinstore_Pins[JTAG_SIGNAL_TCK] = JTAG_SIGNAL_NOT_ALLOCATED;
+	ASSERT(pinstore_Recall(), "Stored chain not recalled");
+	ASSERT(pinstore_Pins[JTAG_SIGNAL_TCK] == 0, "Wrong TCK recalled %i", pinstore_Pins[JTAG_SIGNAL_TCK]);
+	ASSERT(pinstore_Pins[JTAG_SIGNAL_TDO] == JTAG_SIGNAL_TDO, "Wrong TDO recalled %i", pinstore_Pins[JTAG_SIGNAL_TDO]);
+
+	//a different device on the same pins isn't the same board
+	pinstore_IDCode = 0x06410041;
+	ASSERT(!pinstore_Recall(), "Recalled a chain with a different ID CODE");
+	ASSERT(pinstore_Pins[JTAG_SIGNAL_TCK] == JTAG_SIGNAL_NOT_ALLOCATED, "Pins left configured");
+
+	//an unconfigured signal can't be stored
+	ASSERT(!pinstore_Save(), "Stored an incomplete pinout");
+
+	return true;
+}
+
+/**
+ * @brief Test the page is compacted when full
+ *
+ * Only the most recent records should be kept, oldest first, with the new
+ * one after them.
+ */
+bool pinstore_TestCompact()
+{
+	unsigned int count;
+
+	pinstore_Setup(0);
+	for(count = 0; count <= PINSTORE_SLOTS; ++count)
+	{
+		pinstore_IDCode = 0x1000 | (count << 1) | 0x01;
+		ASSERT(pinstore_Save(), "Failed to store pinout %i", count);
+	}
+
+	ASSERT(pinstore_Used() == PINSTORE_RECORDS, "Page not compacted, %i used", pinstore_Used());
+	ASSERT(pinstore_Slots[0].idcodes[0] == (0x1000 | ((PINSTORE_SLOTS + 1 - PINSTORE_RECORDS) << 1) | 0x01), "Wrong oldest record kept");
+	ASSERT(pinstore_Slots[PINSTORE_RECORDS - 1].idcodes[0] == pinstore_IDCode, "Newest record not last");
+	for(count = 0; count < PINSTORE_RECORDS; ++count)
+	{
+		ASSERT(pinstore_IsValid(&pinstore_Slots[count]), "Record %i invalid", count);
+	}
+
+	return true;
+}
@@ -0,0 +1,88 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tsched.h"
+
+#include "../source/sched.c"
+
+static unsigned int sched_Mock_Order;		///< Log of the tasks run, one nibble per task
+static unsigned int sched_Mock_JobSteps;	///< Steps left before the mock job finishes
+
+static bool sched_Mock_Task1() { sched_Mock_Order = (sched_Mock_Order << 4) | 1; return false; }
+static bool sched_Mock_Task2() { sched_Mock_Order = (sched_Mock_Order << 4) | 2; return true; }
+static bool sched_Mock_Job() { sched_Mock_Order = (sched_Mock_Order << 4) | 0xF; return --sched_Mock_JobSteps > 0; }
+
+/**
+ * @brief Test the tasks are run
+ *
+ * Every task should run once per pass in the order added, and no more than
+ * @ref SCHED_TASKS_MAX can be added.
+ */
+bool sched_TestTasks()
+{
+	unsigned int i;
+
+	sched_Init();
+	sched_Mock_Order = 0;
+	sched_Run();
+	ASSERT(sched_Mock_Order == 0, "Tasks run without any added");
+
+	ASSERT(sched_Add(sched_Mock_Task1), "Task not added");
+	ASSERT(sched_Add(sched_Mock_Task2), "Task not added");
+	sched_Run();
+	sched_Run();
+	ASSERT(sched_Mock_Order == 0x1212, "Tasks run as %X, should be %X", sched_Mock_Order, 0x1212);
+
+	for(i = 2; i < SCHED_TASKS_MAX; ++i)
+	{
+		ASSERT(sched_Add(sched_Mock_Task1), "Task %i not added", i);
+	}
+	ASSERT(!sched_Add(sched_Mock_Task1), "Too many tasks added");
+
+	return true;
+}
+
+/**
+ * @brief Test a job is stepped after the tasks until it's done
+ *
+ * Only one job can run at a time, and another can start once it's done.
+ */
+bool sched_TestJob()
+{
+	sched_Init();
+	sched_Add(sched_Mock_Task1);
+	ASSERT(!sched_IsBusy(), "Busy without a job");
+
+	sched_Mock_Order = 0;
+	sched_Mock_JobSteps = 2;
+	ASSERT(sched_StartJob(sched_Mock_Job), "Job not started");
+	ASSERT(sched_IsBusy(), "Not busy with a job");
+	ASSERT(!sched_StartJob(sched_Mock_Job), "Second job started");
+
+	sched_Run();
+	ASSERT(sched_IsBusy(), "Job dropped with steps left");
+	sched_Run();
+	ASSERT(!sched_IsBusy(), "Job not dropped when done");
+	sched_Run();
+	ASSERT(sched_Mock_Order == 0x1F1F1, "Run as %X, should be %X", sched_Mock_Order, 0x1F1F1);
+
+	sched_Mock_JobSteps = 1;
+	ASSERT(sched_StartJob(sched_Mock_Job), "Job not started after the last");
+
+	return true;
+}
@@ -0,0 +1,326 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tsvf.h"
+#include <stdint.h>
+#include <string.h>
+
+//Mock out the functions we're interested in.
+#define jtag_Shift		svf_Mock_jtag_Shift
+#define jtag_Set		svf_Mock_jtag_Set
+#define jtag_SetInput		svf_Mock_jtag_SetInput
+#define jtag_SetClockRate	svf_Mock_jtag_SetClockRate
+#define jtagTAP_SetState	svf_Mock_jtagTAP_SetState
+#define jtagTAP_ShiftExit	svf_Mock_jtagTAP_ShiftExit
+#define jtagTAP_RunTestStart	svf_Mock_jtagTAP_RunTestStart
+#define jtagTAP_RunTestStep	svf_Mock_jtagTAP_RunTestStep
+
+#include "../source/svf.c"
+
+#define SVF_MOCK_SHIFTS		(8)	///< Shifts logged
+
+/**
+ * @brief A shift seen by the mock
+ */
+typedef struct svf_sMockShift
+{
+	unsigned int nbits;	///< Bits shifted
+	bool exit;		///< Was TMS raised on the last bit
+	uint64_t tdi;		///< The first 64 bits of TDI
+} svf_MockShift;
+
+static svf_MockShift svf_Mock_Shifts[SVF_MOCK_SHIFTS];	///< Log of the shifts
+static unsigned int svf_Mock_ShiftCount;	///< Shifts seen
+static uint64_t svf_Mock_TDO;			///< Fake TDO, the same for every shift
+static jtagTAP_TAPState svf_Mock_State;		///< The state the TAP was last moved to
+static unsigned int svf_Mock_Rate;		///< The last TCK rate set
+static unsigned int svf_Mock_Clocks;		///< RUNTEST clocks requested
+static uint32_t svf_Mock_Time;			///< RUNTEST time requested
+static unsigned int svf_Mock_Steps;		///< RUNTEST steps left
+
+void svf_Mock_jtag_Shift(const uint8_t *tdi, uint8_t *tdo, unsigned int nbits, bool exit)
+{
+	unsigned int bit;
+
+	if(svf_Mock_ShiftCount < SVF_MOCK_SHIFTS)
+	{
+		svf_MockShift *shift = &svf_Mock_Shifts[svf_Mock_ShiftCount];
+
+		shift->nbits = nbits;
+		shift->exit = exit;
+		shift->tdi = 0;
+		for(bit = 0; (bit < nbits) && (bit < 64); ++bit)
+		{
+			shift->tdi |= (uint64_t)((tdi[bit >> 3] >> (bit & 0x07)) & 0x01) << bit;
+		}
+	}
+	++svf_Mock_ShiftCount;
+
+	if(tdo != NULL)
+	{
+		for(bit = 0; bit < nbits; ++bit)
+		{
+			bool val = (bit < 64) && (((svf_Mock_TDO >> bit) & 0x01) != 0);
+			tdo[bit >> 3] = (tdo[bit >> 3] & ~(1 << (bit & 0x07))) | (val << (bit & 0x07));
+		}
+	}
+}
+void svf_Mock_jtag_Set(jtag_Signal sig, bool val) { }
+void svf_Mock_jtag_SetInput(jtag_Signal sig, bool input) { }
+bool svf_Mock_jtag_SetClockRate(unsigned int rate) { svf_Mock_Rate = rate; return true; }
+void svf_Mock_jtagTAP_SetState(jtagTAP_TAPState target) { svf_Mock_State = target; }
+void svf_Mock_jtagTAP_ShiftExit() { }
+void svf_Mock_jtagTAP_RunTestStart(unsigned int clocks, uint32_t us) { svf_Mock_Clocks = clocks; svf_Mock_Time = us; }
+bool svf_Mock_jtagTAP_RunTestStep(unsigned int batch) { return (svf_Mock_Steps > 0) && (--svf_Mock_Steps > 0); }
+
+/**
+ * @brief Play a whole stream in one go
+ *
+ * @param[in] stream The stream, NUL terminated.
+ * @param[out] offset The offset of the failing statement.
+ * @returns The outcome.
+ */
+static svf_Result svf_Mock_Play(const char *stream, uint32_t *offset)
+{
+	uint32_t statements;
+
+	svf_Mock_ShiftCount = 0;
+	svf_Start();
+	svf_Process(stream, strlen(stream));
+	return svf_Finish(offset, &statements);
+}
+
+/**
+ * @brief Test integers and reals are scaled and rounded up
+ */
+bool svf_TestNumbers()
+{
+	uint32_t value;
+
+	ASSERT(svf_ParseNumber("32", 0, &value) && (value == 32), "32 read as %lu", (unsigned long)value);
+	ASSERT(svf_ParseNumber("1.00E-002", 6, &value) && (value == 10000), "1.00E-002 s read as %lu us", (unsigned long)value);
+	ASSERT(svf_ParseNumber("5E-7", 6, &value) && (value == 1), "5E-7 s not rounded up, %lu us", (unsigned long)value);
+	ASSERT(svf_ParseNumber("1.5e+06", 0, &value) && (value == 1500000), "1.5e+06 read as %lu", (unsigned long)value);
+	ASSERT(svf_ParseNumber("0.0", 6, &value) && (value == 0), "0.0 read as %lu", (unsigned long)value);
+	ASSERT(!svf_ParseNumber("5E+10", 0, &value), "5E+10 fits in 32 bits");
+	ASSERT(!svf_ParseNumber("tdi", 0, &value), "Word read as a number");
+	ASSERT(!svf_ParseNumber("12x", 0, &value), "Trailing junk accepted");
+	ASSERT(!svf_ParseNumber("1E", 0, &value), "Missing exponent accepted");
+
+	return true;
+}
+
+/**
+ * @brief Test SIR and SDR are shifted and TDO checked
+ *
+ * Hex strings are most significant digit first and can be shorter than
+ * the scan, white space and comments are skipped. TDI and MASK carry on
+ * to the next scan of the same length.
+ */
+bool svf_TestScan()
+{
+	static const char stream[] =
+		"! a comment\r\n"
+		"// another comment\r\n"
+		"FREQUENCY 1.00E+06 HZ;\r\n"
+		"ENDDR DRPAUSE;\r\n"
+		"SIR 10 TDI (3C9);\r\n"
+		"SDR 40 TDI (12 3456 789A)\r\n"
+		"\tTDO (4BA00477) MASK (00FFFFFFFF);\r\n"
+		"SDR 40 TDO (534BA00477);\r\n";
+	uint32_t offset;
+
+	svf_Mock_TDO = 0x104BA00477ULL;
+	ASSERT(svf_Mock_Play(stream, &offset) == SVF_RESULT_OK, "Stream failed at %lu", (unsigned long)offset);
+	ASSERT(svf_Mock_Rate == 1000, "TCK set to %i kHz", svf_Mock_Rate);
+	ASSERT(svf_Mock_ShiftCount == 3, "%i shifts", svf_Mock_ShiftCount);
+	ASSERT((svf_Mock_Shifts[0].nbits == 10) && (svf_Mock_Shifts[0].tdi == 0x3C9) && svf_Mock_Shifts[0].exit, "Wrong SIR");
+	ASSERT((svf_Mock_Shifts[1].nbits == 40) && (svf_Mock_Shifts[1].tdi == 0x123456789AULL) && svf_Mock_Shifts[1].exit, "Wrong SDR");
+	ASSERT(svf_Mock_Shifts[2].tdi == 0x123456789AULL, "TDI not kept for the next SDR");
+	ASSERT(svf_Mock_State == JTAGTAP_STATE_DR_PAUSE, "SDR ended in %i", svf_Mock_State);
+
+	return true;
+}
+
+/**
+ * @brief Test SIR and SDR keep their own TDI and MASK
+ *
+ * An SIR between two SDRs of the same length doesn't stop the second
+ * leaving out TDI and MASK, and a MASK left out after a change of length
+ * checks every bit.
+ */
+bool svf_TestInterleaved()
+{
+	static const char stream[] =
+		"SDR 32 TDI (12345678) TDO (4BA00477) MASK (0FFFFFFF);\n"
+		"SIR 8 TDI (FE);\n"
+		"SDR 32 TDO (5BA00477);\n"
+		"SIR 8 TDO (77);\n";
+	uint32_t offset;
+
+	svf_Mock_TDO = 0x4BA00477;
+	ASSERT(svf_Mock_Play(stream, &offset) == SVF_RESULT_OK, "Stream failed at %lu", (unsigned long)offset);
+	ASSERT(svf_Mock_ShiftCount == 4, "%i shifts", svf_Mock_ShiftCount);
+	ASSERT((svf_Mock_Shifts[2].nbits == 32) && (svf_Mock_Shifts[2].tdi == 0x12345678), "SDR TDI not kept over the SIR");
+	ASSERT((svf_Mock_Shifts[3].nbits == 8) && (svf_Mock_Shifts[3].tdi == 0xFE), "SIR TDI not kept over the SDR");
+
+	ASSERT(svf_Mock_Play("SDR 32 TDI (0) TDO (4BA00477) MASK (0);\nSDR 16 TDI (0) TDO (0478);\n", &offset) == SVF_RESULT_MISMATCH,
+			"MASK kept after the length changed");
+	ASSERT(svf_Mock_Play("SIR 8 TDI (FE);\nSDR 8 TDO (77);\n", &offset) == SVF_RESULT_SYNTAX, "SDR used the SIR TDI");
+	ASSERT(svf_Mock_Play("SIR 300 TDI (0);", &offset) == SVF_RESULT_TOO_LONG, "SIR longer than SVF_MAX_IR_BITS played");
+
+	return true;
+}
+
+/**
+ * @brief Test the stream can be split anywhere
+ *
+ * Played a byte at a time, the same shifts should be seen.
+ */
+bool svf_TestStreamSplit()
+{
+	static const char stream[] = "SDR 32 TDI (00000000) TDO (4BA00477) ; SIR 4 TDI(e);\n";
+	uint32_t offset;
+	uint32_t statements;
+	unsigned int i;
+
+	svf_Mock_TDO = 0x4BA00477;
+	svf_Mock_ShiftCount = 0;
+	svf_Start();
+	for(i = 0; i < (sizeof(stream) - 1); ++i)
+	{
+		ASSERT(svf_Process(&stream[i], 1) == 1, "Byte %i not used", i);
+	}
+	ASSERT(svf_Finish(&offset, &statements) == SVF_RESULT_OK, "Split stream failed at %lu", (unsigned long)offset);
+	ASSERT(statements == 2, "%lu statements played", (unsigned long)statements);
+	ASSERT((svf_Mock_ShiftCount == 2) && (svf_Mock_Shifts[1].tdi == 0x0E), "Wrong shifts");
+
+	ASSERT(svf_Mock_Play("SIR 4 TDI (E)", &offset) == SVF_RESULT_INCOMPLETE, "Partial statement not reported");
+
+	return true;
+}
+
+/**
+ * @brief Test failures report the offset of the statement and stop the stream
+ */
+bool svf_TestMismatch()
+{
+	static const char stream[] =
+		"SDR 32 TDI (0) TDO (4BA00477);\n"
+		"SDR 32 TDI (0) TDO (5BA00477) MASK (0FFFFFFF);\n"
+		"SDR 32 TDI (0) TDO (4BA00478);\n"
+		"SIR 4 TDI (E);\n";
+	static const char *const failures[] =
+	{
+		"SDR 8 TDI (123);",
+		"SDR 9000 TDI (0);",
+		"PIO (HLU);",
+		"RUNTEST DRPAUSE 10 TCK;",
+		"SDR 8 TDI (1G);",
+		"SDR 16 TDO (1234);",
+		"BOGUS;",
+		"FREQUENCY 500 HZ;",
+	};
+	static const svf_Result results[] =
+	{
+		SVF_RESULT_SYNTAX,
+		SVF_RESULT_TOO_LONG,
+		SVF_RESULT_UNSUPPORTED,
+		SVF_RESULT_UNSUPPORTED,
+		SVF_RESULT_SYNTAX,
+		SVF_RESULT_SYNTAX,
+		SVF_RESULT_UNSUPPORTED,
+		SVF_RESULT_UNSUPPORTED,
+	};
+	uint32_t offset;
+	unsigned int i;
+
+	svf_Mock_TDO = 0x4BA00477;
+	ASSERT(svf_Mock_Play(stream, &offset) == SVF_RESULT_MISMATCH, "Mismatch not found");
+	ASSERT(offset == 78, "Mismatch at %lu, should be %i", (unsigned long)offset, 78);
+	ASSERT(svf_Mock_ShiftCount == 3, "Stream not stopped at the mismatch");
+
+	for(i = 0; i < (sizeof(results) / sizeof(results[0])); ++i)
+	{
+		svf_Result result = svf_Mock_Play(failures[i], &offset);
+		ASSERT(result == results[i], "%s gave %s", failures[i], svf_ResultNames[result]);
+	}
+
+	return true;
+}
+
+/**
+ * @brief Test the header and trailer are shifted either side of the data
+ *
+ * Only the last shift raises TMS, and a trailer of 0 bits removes it.
+ */
+bool svf_TestPads()
+{
+	static const char stream[] =
+		"HIR 3 TDI (7);\n"
+		"TIR 5 TDI (1F);\n"
+		"SIR 4 TDI (E);\n"
+		"TIR 0;\n"
+		"SIR 4 TDI (E);\n";
+	uint32_t offset;
+
+	ASSERT(svf_Mock_Play(stream, &offset) == SVF_RESULT_OK, "Stream failed at %lu", (unsigned long)offset);
+	ASSERT(svf_Mock_ShiftCount == 5, "%i shifts", svf_Mock_ShiftCount);
+	ASSERT((svf_Mock_Shifts[0].nbits == 3) && (svf_Mock_Shifts[0].tdi == 0x07) && !svf_Mock_Shifts[0].exit, "Wrong header");
+	ASSERT((svf_Mock_Shifts[1].nbits == 4) && !svf_Mock_Shifts[1].exit, "Data exited before the trailer");
+	ASSERT((svf_Mock_Shifts[2].nbits == 5) && (svf_Mock_Shifts[2].tdi == 0x1F) && svf_Mock_Shifts[2].exit, "Wrong trailer");
+	ASSERT((svf_Mock_Shifts[3].nbits == 3) && (svf_Mock_Shifts[4].nbits == 4) && svf_Mock_Shifts[4].exit, "Trailer not removed");
+
+	ASSERT(svf_Mock_Play("HIR 3;", &offset) == SVF_RESULT_SYNTAX, "Header length changed without TDI");
+
+	return true;
+}
+
+/**
+ * @brief Test a RUNTEST holds the stream until it has been stepped
+ */
+bool svf_TestRunTest()
+{
+	static const char stream[] = "RUNTEST IDLE 100 TCK 1.00E-002 SEC ENDSTATE IRPAUSE;SIR 4 TDI(E);";
+	uint32_t offset;
+	uint32_t statements;
+	unsigned int used;
+
+	svf_Mock_ShiftCount = 0;
+	svf_Mock_Steps = 3;
+	svf_Start();
+	used = svf_Process(stream, sizeof(stream) - 1);
+	ASSERT(used == 52, "Used %i bytes, should stop after the RUNTEST", used);
+	ASSERT((svf_Mock_Clocks == 100) && (svf_Mock_Time == 10000), "RUNTEST of %i clocks and %lu us", svf_Mock_Clocks, (unsigned long)svf_Mock_Time);
+	ASSERT(svf_IsWaiting(), "Not waiting for the RUNTEST");
+	ASSERT(svf_Step(), "RUNTEST finished early");
+	ASSERT(!svf_Step(), "RUNTEST not finished");
+	ASSERT(!svf_IsWaiting(), "Still waiting after the RUNTEST");
+	ASSERT(svf_Mock_State == JTAGTAP_STATE_IR_PAUSE, "RUNTEST ended in %i", svf_Mock_State);
+
+	used += svf_Process(&stream[used], sizeof(stream) - 1 - used);
+	ASSERT(used == (sizeof(stream) - 1), "Rest of the stream not used");
+	ASSERT(svf_Finish(&offset, &statements) == SVF_RESULT_OK, "Stream failed at %lu", (unsigned long)offset);
+	ASSERT(statements == 2, "%lu statements played", (unsigned long)statements);
+
+	//a short one runs straight away
+	svf_Mock_Steps = 1;
+	ASSERT((svf_Mock_Play("RUNTEST 10 TCK;", &offset) == SVF_RESULT_OK) && !svf_IsWaiting(), "Short RUNTEST left waiting");
+
+	return true;
+}
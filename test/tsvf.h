@@ -0,0 +1,30 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#if !defined(_TSVF_H_)
+#define _TSVF_H_
+#include <stdbool.h>
+
+extern bool svf_TestNumbers();
+extern bool svf_TestScan();
+extern bool svf_TestInterleaved();
+extern bool svf_TestStreamSplit();
+extern bool svf_TestMismatch();
+extern bool svf_TestPads();
+extern bool svf_TestRunTest();
+
+#endif
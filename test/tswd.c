@@ -0,0 +1,337 @@
+/*
+ *  JtagKnocker - JTAG finder and enumerator for STM32 dev boards
+ *  Copyright (C) 2014 Nathan Dyer
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test.h"
+#include "tswd.h"
+#include <stdint.h>
+
+//Mock out the functions we're interested in.
+#define jtag_ClockTMS		swd_Mock_jtag_ClockTMS
+#define jtag_Get		swd_Mock_jtag_Get
+#define jtag_Clock		swd_Mock_jtag_Clock
+#define jtag_SetInput		swd_Mock_jtag_SetInput
+
+#include "../source/swd.c"
+
+#define SWD_MOCK_DPIDR		(0x2BA01477)	///< DPIDR of the fake target
+
+static bool swd_Mock_Present;		///< Is the fake target connected
+static bool swd_Mock_Switched;		///< Has the fake target seen the JTAG to SWD sequence
+static bool swd_Mock_Reset;		///< Is the fake target's line in reset, only a DPIDR read is answered
+static unsigned int swd_Mock_Ones;	///< SWDIO high clocks in a row
+static uint32_t swd_Mock_Last;		///< The last 32 bits the host sent, the newest in the MSB
+static bool swd_Mock_Input;		///< Is the host's SWDIO an input
+static uint8_t swd_Mock_RequestBits;	///< The request the fake target is answering
+static uint64_t swd_Mock_Response;	///< Bits the fake target drives, from the turnaround on
+static unsigned int swd_Mock_Position;	///< Clocks since the host released SWDIO
+static int swd_Mock_WriteBits;		///< Write data bits still to come, -1 for none
+static uint64_t swd_Mock_WriteData;	///< Write data and parity from the host
+static unsigned int swd_Mock_Waits;	///< Transfers to answer WAIT before accepting
+static bool swd_Mock_FaultAP;		///< Answer FAULT to AP accesses
+static uint32_t swd_Mock_CtrlStat;	///< Fake CTRL/STAT register
+static uint32_t swd_Mock_Select;	///< Fake SELECT register
+static uint32_t swd_Mock_Posted;	///< Data of the last AP read, waiting in RDBUFF
+static unsigned int swd_Mock_Transfers;	///< Requests the fake target has answered OK
+
+/**
+ * @brief Value of a fake AP register, made from the bank and address
+ */
+static uint32_t swd_Mock_APValue(unsigned int addr)
+{
+	return 0xA0000000 | ((swd_Mock_Select & 0xF0) << 4) | addr;
+}
+
+/**
+ * @brief Apply a write to a fake DP register after its data has been sent
+ */
+static void swd_Mock_Write(uint8_t request, uint32_t data)
+{
+	if((request & SWD_REQUEST_AP) == 0)
+	{
+		if(SWD_REQUEST_ADDR(request) == SWD_DP_CTRLSTAT)
+		{
+			swd_Mock_CtrlStat = data;
+		}
+		else if(SWD_REQUEST_ADDR(request) == SWD_DP_SELECT)
+		{
+			swd_Mock_Select = data;
+		}
+		else if(SWD_REQUEST_ADDR(request) == SWD_DP_ABORT)
+		{
+			swd_Mock_FaultAP = false;
+		}
+	}
+}
+
+/**
+ * @brief Work out the fake target's reply to a request
+ *
+ * @param[in] request The request, as sent.
+ * @returns The ACK and any read data and parity, the first bit in bit 1.
+ */
+static uint64_t swd_Mock_Answer(uint8_t request)
+{
+	const bool ap = (request & SWD_REQUEST_AP) != 0;
+	const bool read = (request & SWD_REQUEST_READ) != 0;
+	const unsigned int addr = SWD_REQUEST_ADDR(request);
+	uint32_t data = 0;
+
+	//a bad request, or any but a DPIDR read during reset, goes unanswered
+	if(((request & 0xC1) != 0x81) || (swd_Parity((request >> 1) & 0x0F) != ((request >> 5) & 0x01)) ||
+		(swd_Mock_Reset && !(!ap && read && (addr == SWD_DP_DPIDR))))
+	{
+		return 0x0E;
+	}
+	if(swd_Mock_Waits > 0)
+	{
+		--swd_Mock_Waits;
+		return (uint64_t)SWD_ACK_WAIT << 1;
+	}
+	if(ap && swd_Mock_FaultAP)
+	{
+		return (uint64_t)SWD_ACK_FAULT << 1;
+	}
+
+	++swd_Mock_Transfers;
+	if(!read)
+	{
+		swd_Mock_WriteBits = 33;
+		swd_Mock_WriteData = 0;
+		return (uint64_t)SWD_ACK_OK << 1;
+	}
+
+	if(ap)
+	{
+		//posted, the last read's data comes back
+		data = swd_Mock_Posted;
+		swd_Mock_Posted = swd_Mock_APValue(addr);
+	}
+	else if(addr == SWD_DP_DPIDR)
+	{
+		swd_Mock_Reset = false;
+		data = SWD_MOCK_DPIDR;
+	}
+	else if(addr == SWD_DP_CTRLSTAT)
+	{
+		data = swd_Mock_CtrlStat;
+	}
+	else if(addr == SWD_DP_SELECT)
+	{
+		data = swd_Mock_Select;
+	}
+	else
+	{
+		data = swd_Mock_Posted;
+	}
+	return ((uint64_t)SWD_ACK_OK << 1) | ((uint64_t)data << 4) | ((uint64_t)swd_Parity(data) << 36);
+}
+
+/**
+ * @brief Mock SWDIO writes, fed through the fake target's line decoder
+ */
+void swd_Mock_jtag_ClockTMS(uint16_t tms, unsigned int count)
+{
+	while(count-- > 0)
+	{
+		bool bit = (tms & 0x01) != 0;
+
+		tms >>= 1;
+		if(swd_Mock_Input)
+		{
+			continue;	//host has let go of the line
+		}
+
+		swd_Mock_Last = (swd_Mock_Last >> 1) | ((uint32_t)bit << 31);
+		if(swd_Mock_WriteBits > 0)
+		{
+			swd_Mock_WriteData |= (uint64_t)bit << (33 - swd_Mock_WriteBits);
+			if(--swd_Mock_WriteBits == 0)
+			{
+				uint32_t data = swd_Mock_WriteData & 0xFFFFFFFF;
+				if((swd_Mock_WriteData >> 32) == swd_Parity(data))
+				{
+					swd_Mock_Write(swd_Mock_RequestBits, data);
+				}
+				swd_Mock_WriteBits = -1;
+			}
+			continue;
+		}
+
+		if(bit)
+		{
+			if(++swd_Mock_Ones >= 50)
+			{
+				swd_Mock_Reset = true;
+			}
+		}
+		else
+		{
+			swd_Mock_Ones = 0;
+		}
+		if((swd_Mock_Last >> 16) == SWD_JTAG_TO_SWD)
+		{
+			swd_Mock_Switched = true;
+		}
+	}
+}
+
+bool swd_Mock_jtag_Get(jtag_Signal sig)
+{
+	if(!swd_Mock_Input)
+	{
+		return (swd_Mock_Last >> 31) != 0;
+	}
+	if(!swd_Mock_Present || !swd_Mock_Switched)
+	{
+		return true;	//pulled up
+	}
+	return ((swd_Mock_Response >> swd_Mock_Position) & 0x01) != 0;
+}
+
+void swd_Mock_jtag_Clock()
+{
+	++swd_Mock_Position;
+}
+
+/**
+ * @brief Mock the turnaround, releasing SWDIO starts the fake target's reply
+ */
+void swd_Mock_jtag_SetInput(jtag_Signal sig, bool input)
+{
+	swd_Mock_Input = input;
+	if(input)
+	{
+		swd_Mock_RequestBits = swd_Mock_Last >> 24;
+		swd_Mock_Position = 0;
+		swd_Mock_Response = swd_Mock_Answer(swd_Mock_RequestBits);
+		swd_Mock_Ones = 0;
+	}
+}
+
+/**
+ * @brief Put the fake target back to power up
+ */
+static void swd_Mock_Init(bool present)
+{
+	swd_Mock_Present = present;
+	swd_Mock_Switched = false;
+	swd_Mock_Reset = false;
+	swd_Mock_Ones = 0;
+	swd_Mock_Last = 0;
+	swd_Mock_Input = false;
+	swd_Mock_WriteBits = -1;
+	swd_Mock_Waits = 0;
+	swd_Mock_FaultAP = false;
+	swd_Mock_CtrlStat = 0;
+	swd_Mock_Select = 0;
+	swd_Mock_Posted = 0;
+	swd_Mock_Transfers = 0;
+}
+
+/**
+ * @brief Test request headers and parity
+ *
+ * The headers are checked against ones from the ADIv5 spec.
+ */
+bool swd_TestRequest()
+{
+	ASSERT(swd_Request(false, true, SWD_DP_DPIDR) == 0xA5, "DPIDR read is %02X", swd_Request(false, true, SWD_DP_DPIDR));
+	ASSERT(swd_Request(false, false, SWD_DP_ABORT) == 0x81, "ABORT write is %02X", swd_Request(false, false, SWD_DP_ABORT));
+	ASSERT(swd_Request(false, true, SWD_DP_CTRLSTAT) == 0x8D, "CTRL/STAT read is %02X", swd_Request(false, true, SWD_DP_CTRLSTAT));
+	ASSERT(swd_Request(false, false, SWD_DP_CTRLSTAT) == 0xA9, "CTRL/STAT write is %02X", swd_Request(false, false, SWD_DP_CTRLSTAT));
+	ASSERT(swd_Request(true, true, 0x00) == 0x87, "AP read 0 is %02X", swd_Request(true, true, 0x00));
+	ASSERT(swd_Request(true, true, 0x0C) == 0x9F, "AP read C is %02X", swd_Request(true, true, 0x0C));
+	ASSERT(SWD_REQUEST_ADDR(swd_Request(true, false, 0x08)) == 0x08, "Request address lost");
+
+	ASSERT(!swd_Parity(0), "Parity of 0 set");
+	ASSERT(swd_Parity(0x80000000), "Parity of the MSB not set");
+	ASSERT(!swd_Parity(SWD_MOCK_DPIDR), "Parity of %08X set", SWD_MOCK_DPIDR);
+	ASSERT(swd_Parity(0xFFFFFFFE), "Parity of 31 bits not set");
+
+	return true;
+}
+
+/**
+ * @brief Test connecting switches the target to SWD and reads its DPIDR
+ *
+ * With nothing connected SWDIO floats high and no DPIDR should be found.
+ */
+bool swd_TestConnect()
+{
+	uint32_t dpidr = 0;
+
+	swd_Mock_Init(false);
+	ASSERT(!swd_Connect(&dpidr), "Connected to a missing target");
+	ASSERT(!swd_Mock_Input, "SWDIO left as an input");
+
+	swd_Mock_Init(true);
+	ASSERT(swd_Connect(&dpidr), "Target not connected");
+	ASSERT(swd_Mock_Switched, "No JTAG to SWD sequence sent");
+	ASSERT(!swd_Mock_Reset, "Target left in line reset");
+	ASSERT(dpidr == SWD_MOCK_DPIDR, "DPIDR read as %08X", dpidr);
+	ASSERT(!swd_Mock_Input, "SWDIO left as an input");
+
+	//WAIT is retried
+	swd_Mock_Waits = 3;
+	ASSERT(swd_Connect(&dpidr), "Target not connected after WAIT");
+
+	return true;
+}
+
+/**
+ * @brief Test a batch gets each posted AP read its own data
+ *
+ * A run of AP reads should cost one RDBUFF read, and the batch should stop
+ * at a FAULT.
+ */
+bool swd_TestBatch()
+{
+	uint32_t dpidr;
+	swd_Transfer transfers[] =
+	{
+		{ swd_Request(false, false, SWD_DP_CTRLSTAT), 0, 0x50000000 },
+		{ swd_Request(false, false, SWD_DP_SELECT), 0, 0xF0 },
+		{ swd_Request(true, true, 0x04), 0, 0 },
+		{ swd_Request(true, true, 0x0C), 0, 0 },
+		{ swd_Request(false, true, SWD_DP_CTRLSTAT), 0, 0 },
+		{ swd_Request(true, true, 0x08), 0, 0 },
+	};
+	const unsigned int count = sizeof(transfers) / sizeof(transfers[0]);
+	unsigned int done;
+
+	swd_Mock_Init(true);
+	swd_Connect(&dpidr);
+	swd_Mock_Transfers = 0;
+	swd_Mock_Waits = 2;
+
+	done = swd_Batch(transfers, count);
+	ASSERT(done == count, "Batch stopped after %i transfers", done);
+	ASSERT(swd_Mock_Transfers == count + 2, "Batch took %i transfers", swd_Mock_Transfers);
+	ASSERT(swd_Mock_CtrlStat == 0x50000000, "CTRL/STAT written as %08X", swd_Mock_CtrlStat);
+	ASSERT(transfers[2].data == 0xA0000F04, "First AP read %08X", transfers[2].data);
+	ASSERT(transfers[3].data == 0xA0000F0C, "Second AP read %08X", transfers[3].data);
+	ASSERT(transfers[4].data == 0x50000000, "CTRL/STAT read %08X", transfers[4].data);
+	ASSERT(transfers[5].data == 0xA0000F08, "Last AP read %08X", transfers[5].data);
+
+	//the AP read faults, the DP write before it stands
+	swd_Mock_FaultAP = true;
+	done = swd_Batch(transfers, count);
+	ASSERT(done == 2, "Batch with a FAULT completed %i transfers", done);
+	ASSERT(transfers[2].ack == SWD_ACK_FAULT, "FAULT reported as %i", transfers[2].ack);
+
+	return true;
+}